@@ -37,6 +37,16 @@ using namespace ThunderStorm;
 Actor::Actor(TileMap& rMap, LPCWSTR pszClass): 
 			 Object(rMap.GetEngine()),
 			 m_rMap(rMap),
+			 m_pLayer(NULL),
+			 m_nNameID(INVALID_INDEX),
+			 m_nSpaceNode(INVALID_INDEX),
+			 m_dwQueryStamp(0),
+			 m_nVisibleCameras(0),
+			 m_nUpdateTier(TIER_FULL),
+			 m_fLastUpdate(0.0f),
+			 m_fUpdateElapsed(0.0f),
+			 m_fWakeTime(0.0f),
+			 m_bBoundsDeferred(false),
 			 m_strClass(pszClass),
 			 m_vecPos(-1.0f, -1.0f),	
 			 m_vecPrevPos(-1.0f, -1.0f),
@@ -50,6 +60,57 @@ Actor::Actor(TileMap& rMap, LPCWSTR pszClass):
 Actor::~Actor(void)
 {
 	Empty();
+
+	SetLayer(NULL, false);
+}
+
+TileLayer* Actor::GetLayer(void)
+{
+	return m_pLayer;
+}
+
+const TileLayer* Actor::GetLayerConst(void) const
+{
+	return m_pLayer;
+}
+
+void Actor::SetLayer(TileLayer* pLayer, bool bAdjustCoords)
+{
+	if (pLayer == m_pLayer)
+		return;
+
+	// Remove from spacial database of the old layer
+
+	if (m_pLayer != NULL)
+	{
+		// Apply pending move first, and drop it from map's list
+
+		if (true == m_bBoundsDeferred)
+		{
+			m_bBoundsDeferred = false;
+			CommitSpace(m_rcDeferredBounds);
+
+			std::replace(m_rMap.m_arDirtyActors.begin(),
+				m_rMap.m_arDirtyActors.end(), this, (Actor*)NULL);
+		}
+
+		if (m_pLayer->GetSpace() != NULL)
+			m_pLayer->GetSpace()->Remove(this);
+
+		if (true == bAdjustCoords && pLayer != NULL)
+			m_vecPos = pLayer->WorldToLocal(m_pLayer->LocalToWorld(m_vecPos));
+	}
+
+	// Add to spacial database of the new layer
+
+	m_pLayer = pLayer;
+
+	if (m_pLayer != NULL && m_pLayer->GetSpace() != NULL)
+		m_pLayer->GetSpace()->Add(this);
+
+	// Update cameras in view of
+
+	m_rMap.UpdateCameras(this);
 }
 
 void Actor::SetFlags(DWORD dwFlags)
@@ -59,6 +120,8 @@ void Actor::SetFlags(DWORD dwFlags)
 		// Add to map's update list
 
 		m_rMap.m_arUpdateActors.push_back(this);
+
+		m_fLastUpdate = m_rEngine.GetTime();
 	}
 	else if (IsFlagSet(UPDATE) == true && (~dwFlags & UPDATE))
 	{
@@ -82,14 +145,19 @@ void Actor::SetPosition(const Vector2& vecPosition)
 	m_vecPrevPos = m_vecPos;
 	m_vecPos = vecPosition;
 
-	m_pLayer->GetSpace()->Update(this, rcOldBounds);
+	UpdateSpace(rcOldBounds);
 }
 
 Rect Actor::GetBounds(void) const
 {
+	// Actors without a sprite occupy a single tile
+
+	Vector2 vecSize = (NULL == m_pSprite) ?
+		Vector2(1.0f, 1.0f) : m_pSprite->GetSizeInTiles();
+
 	return Rect(int(floor(m_vecPos.x)), int(floor(m_vecPos.y)),
-		int(ceil(m_vecPos.x + m_pSprite->GetSizeInTiles().x)),
-		int(ceil(m_vecPos.y + m_pSprite->GetSizeInTiles().y)));
+		int(ceil(m_vecPos.x + vecSize.x)),
+		int(ceil(m_vecPos.y + vecSize.y)));
 }
 
 void Actor::SetSprite(Sprite* pSprite)
@@ -145,6 +213,16 @@ void Actor::Update(void)
 	m_materialInstance.Update(m_rEngine.GetTime());
 }
 
+void Actor::Wake(float fDuration)
+{
+	// Update at full rate at least once, regardless of distance to cameras
+
+	float fWakeTime = m_rEngine.GetTime() + fDuration + Engine::TIME_EPSILON;
+
+	if (fWakeTime > m_fWakeTime)
+		m_fWakeTime = fWakeTime;
+}
+
 const VolumeCircle* Actor::GetCollisionBoundsCircle(void) const
 {
 	// Default implementation
@@ -190,9 +268,6 @@ int Actor::Collision(CollisionInfoArray* parOutCollisions) const
 
 	m_pLayer->ValidateRange(rcTiles);
 
-	ActorArray arActors;
-	arActors.reserve(rcTiles.GetArea() * 8);
-
 	int nCollisions = 0;
 	CollisionInfo collision;
 	
@@ -209,16 +284,18 @@ int Actor::Collision(CollisionInfoArray* parOutCollisions) const
 				if (parOutCollisions != NULL)
 					parOutCollisions->push_back(collision);
 			}
-
-			// Add actors overlaying this tile to the
-			// list of actors to collide against
-
-			m_pLayer->GetSpace()->Query(x, y, &arActors);
 		}
 	}
 
-	std::sort(arActors.begin(), arActors.end());
-	std::unique(arActors.begin(), arActors.end());
+	// Get actors overlaying these tiles to collide against,
+	// query reports each actor once
+
+	ActorArray arActors;
+
+	Rect rcActors(rcTiles.left, rcTiles.top,
+		rcTiles.right + 1, rcTiles.bottom + 1);
+
+	m_pLayer->GetSpace()->Query(rcActors, &arActors);
 
 	for(ActorArrayIterator pos = arActors.begin();
 		pos != arActors.end();
@@ -364,7 +441,12 @@ void Actor::Deserialize(Stream& rStream)
 
 	// Update map's spacial grid and camera
 
-	m_pLayer->GetSpace()->Add(this);
+	if (m_pLayer != NULL)
+	{
+		m_pLayer->GetSpace()->Add(this);
+
+		m_rMap.UpdateCameras(this);
+	}
 }
 
 DWORD Actor::GetMemoryFootprint(void) const
@@ -491,6 +573,42 @@ void Actor::OnMouseWheel(int nZDelta)
 }
 
 void Actor::OnBoundsChange(const Rect& rrcOldBounds)
+{
+	UpdateSpace(rrcOldBounds);
+}
+
+void Actor::UpdateSpace(const Rect& rrcOldBounds)
+{
+	if (NULL == m_pLayer)
+		return;
+
+	// Already moved since last commit, keep the original bounds
+
+	if (true == m_bBoundsDeferred)
+		return;
+
+	if (true == m_rMap.m_bUpdateDeferred ||
+	   m_rMap.IsFlagSet(TileMap::DEFER_SPACE_UPDATE) == true)
+	{
+		// Mark dirty, map commits one update per moved actor.
+		// Workers may not touch the shared list, map collects
+		// actors moved in parallel after they are done.
+
+		m_rcDeferredBounds = rrcOldBounds;
+		m_bBoundsDeferred = true;
+
+		if (false == m_rMap.m_bUpdateDeferred)
+			m_rMap.m_arDirtyActors.push_back(this);
+
+		return;
+	}
+
+	CommitSpace(rrcOldBounds);
+}
+
+void Actor::CommitSpace(const Rect& rrcOldBounds)
 {
 	m_pLayer->GetSpace()->Update(this, rrcOldBounds);
+
+	m_rMap.UpdateCameras(this);
 }
\ No newline at end of file
@@ -92,7 +92,28 @@ public:
 		CLIP	= 1 << 2,
 
 		// First value for user flags
-		USER	= 1 << 3
+		USER	= 1 << 3,
+
+		// Update on main thread even if map updates actors in parallel.
+		// Allocated from the top so that user flag values stay unchanged
+		SERIAL_UPDATE = 1 << 30
+	};
+
+	// Update tiers assigned by map on every update
+
+	enum UpdateTiers
+	{
+		// Updated on every frame
+		TIER_FULL,
+
+		// Updated at map's reduced update interval
+		TIER_REDUCED,
+
+		// Not updated until woken or approached by a camera
+		TIER_ASLEEP,
+
+		// Number of update tiers
+		TIER_COUNT
 	};
 
 protected:
@@ -106,6 +127,35 @@ protected:
 	// Map layer attached to (only one allowed)
 	TileLayer* m_pLayer;
 
+	// Name ID in map's actor name table (INVALID_INDEX if not added)
+	int m_nNameID;
+
+	// Node or item in layer's space partition (INVALID_INDEX if none)
+	int m_nSpaceNode;
+
+	// Stamp of the last space partition query that reported this actor
+	DWORD m_dwQueryStamp;
+
+	// Number of active cameras this actor is in view of
+	int m_nVisibleCameras;
+
+	// Update tier assigned on last map update
+	int m_nUpdateTier;
+
+	// Time of last update
+	float m_fLastUpdate;
+
+	// Time elapsed between last update and the one before it
+	float m_fUpdateElapsed;
+
+	// Updated at full rate until first update past this time
+	float m_fWakeTime;
+
+	// Bounds before first move since space partition was last updated,
+	// while map defers space updates or updates actors in parallel
+	Rect m_rcDeferredBounds;
+	bool m_bBoundsDeferred;
+
 	// Class name created from
 	String m_strClass;
 
@@ -173,6 +223,15 @@ public:
 		return m_strClass;
 	}
 
+	//
+	// Name
+	//
+
+	inline int GetNameID(void) const
+	{
+		return m_nNameID;
+	}
+
 	//
 	// Flags
 	//
@@ -202,6 +261,20 @@ public:
 
 	Rect GetBounds(void) const;
 
+	//
+	// Visibility
+	//
+
+	inline bool IsVisible(void) const
+	{
+		return (m_nVisibleCameras > 0);
+	}
+
+	inline int GetVisibleCameraCount(void) const
+	{
+		return m_nVisibleCameras;
+	}
+
 	//
 	// Transform
 	//
@@ -306,6 +379,18 @@ public:
 
 	virtual void Update(void);
 
+	inline int GetUpdateTier(void) const
+	{
+		return m_nUpdateTier;
+	}
+
+	inline float GetUpdateElapsed(void) const
+	{
+		return m_fUpdateElapsed;
+	}
+
+	void Wake(float fDuration = 0.0f);
+
 	//
 	// Collision
 	//
@@ -369,11 +454,22 @@ public:
 	virtual void OnMouseWheel(int nZDelta);
 
 protected:
+	//
+	// Space Partition
+	//
+
+	void UpdateSpace(const Rect& rrcOldBounds);
+	void CommitSpace(const Rect& rrcOldBounds);
+
 	//
 	// Friends
 	//
 
 	friend class TileMap;
+	friend class Camera;
+	friend class SpacePartition;
+	friend class SpacePartitionFlatGrid;
+	friend class SpacePartitionQuadTree;
 };
 
 } // namespace ThunderStorm
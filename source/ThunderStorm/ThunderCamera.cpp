@@ -40,7 +40,11 @@ const D3DCOLOR Camera::WIRECOLOR_ACTOR			= D3DCOLOR_XRGB(190, 0, 0);
 \*----------------------------------------------------------*/
 
 Camera::Camera(TileMap* pMap): m_pMap(pMap),
-							   m_fZoom(1.0f)
+							   m_fZoom(1.0f),
+							   m_nMinZ(INT_MIN),
+							   m_nMaxZ(INT_MAX),
+							   m_dwLayerStamp(0),
+							   m_bActive(false)
 {
 }
 
@@ -60,7 +64,15 @@ const TileMap* Camera::GetMapConst(void) const
 
 void Camera::SetMap(TileMap* pMap)
 {
+	// Actors of the old map are no longer in view
+
+	RemoveVisibleActors(NULL);
+
 	m_pMap = pMap;
+	m_rcVisibleRange = Rect(0, 0, 0, 0);
+
+	m_arLayers.clear();
+	m_dwLayerStamp = 0;
 
 	Cache();
 }
@@ -148,6 +160,63 @@ void Camera::Zoom(float fDelta)
 	Cache();
 }
 
+int Camera::GetMinZ(void) const
+{
+	return m_nMinZ;
+}
+
+int Camera::GetMaxZ(void) const
+{
+	return m_nMaxZ;
+}
+
+void Camera::SetZRange(int nMinZ, int nMaxZ)
+{
+	if (nMinZ > nMaxZ)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 1);
+
+	if (nMinZ == m_nMinZ && nMaxZ == m_nMaxZ)
+		return;
+
+	m_nMinZ = nMinZ;
+	m_nMaxZ = nMaxZ;
+
+	m_dwLayerStamp = 0;
+
+	// Actors on layers that left or entered the range
+
+	UpdateVisibleActors(Rect(0, 0, 0, 0));
+}
+
+bool Camera::IsLayerInRange(const TileLayer* pLayer) const
+{
+	return (pLayer->GetZ() >= m_nMinZ && pLayer->GetZ() <= m_nMaxZ);
+}
+
+const TileLayerArray& Camera::GetLayers(void)
+{
+	if (NULL == m_pMap || m_pMap->GetLayerStamp() == m_dwLayerStamp)
+		return m_arLayers;
+
+	// Layers were added, removed or changed Z, or Z range changed
+
+	m_arLayers.clear();
+
+	for(TileLayerArrayConstIterator pos = m_pMap->m_arLayers.begin();
+		pos != m_pMap->m_arLayers.end();
+		pos++)
+	{
+		if (IsLayerInRange(*pos) == true)
+			m_arLayers.push_back(*pos);
+	}
+
+	std::stable_sort(m_arLayers.begin(), m_arLayers.end(), CompareLayers);
+
+	m_dwLayerStamp = m_pMap->GetLayerStamp();
+
+	return m_arLayers;
+}
+
 Rect& Camera::GetDestRect(void)
 {
 	return m_rcDest;
@@ -209,78 +278,88 @@ bool Camera::AreaVisible(Vector2 vecAreaPosition, Vector2 vecAreaSize)
 	return true;
 }
 
+bool Camera::IsActive(void) const
+{
+	return m_bActive;
+}
+
+const ActorArray& Camera::GetVisibleActors(void) const
+{
+	return m_arVisible;
+}
+
+bool Camera::IsActorVisible(const Actor* pActor) const
+{
+	return std::binary_search(m_arVisible.begin(), m_arVisible.end(),
+		const_cast<Actor*>(pActor));
+}
+
 void Camera::Render(void)
 {
 	if (NULL == m_pMap)
 		throw Error(Error::INVALID_CALL, __FUNCTIONW__);
 
-	// Render layers
+	// Share layers and actors prepared by the map for all active cameras,
+	// or prepare them for this camera alone when rendered on its own
+
+	bool bShared = m_pMap->IsRenderPrepared(this);
+
+	if (false == bShared)
+	{
+		Camera* pCamera = this;
+		m_pMap->PrepareRender(&pCamera, 1);
+	}
+
+	// Actors in view of other cameras only are skipped
+
+	bool bFilter = (m_pMap->m_arRenderCameras.size() > 1);
 
-	Graphics& rGraphics = m_pMap->GetEngine().GetGraphics();
+	// Render layers in Z range, in Z order
 
 	float fTileSize =
 		float(m_pMap->GetEngine().GetOption(Engine::OPTION_TILE_SIZE));
 
 	Rect rcLayerRange;
-	ActorArray arActors;
 
-	for(int n = 0;
-		n < m_pMap->GetLayerCount();
-		n++)
+	const TileLayerArray& rarLayers = GetLayers();
+
+	for(TileLayerArrayConstIterator pos = rarLayers.begin();
+		pos != rarLayers.end();
+		pos++)
 	{
-		TileLayer& rLayer = *m_pMap->GetLayer(n);
+		TileLayer& rLayer = **pos;
 
-		if (rLayer.GetBounds().Intersect(m_rcVisibleRange,
+		const TileMap::RenderLayer* pRenderLayer =
+			m_pMap->GetRenderLayer(&rLayer);
+
+		if (pRenderLayer != NULL && rLayer.GetBounds().Intersect(m_rcVisibleRange,
 			rcLayerRange) == true)
 		{
-			// Render tiles
-
-			Vector2 vecTilePos = rLayer.GetPositionConst() - m_vecPos;
+			// Render tiles from pre-built chunk geometry
 
-			for(int ty = 0; ty < rcLayerRange.bottom; ty++)
-			{
-				for(int tx = 0; tx < rcLayerRange.top; tx++)
-				{
-					Tile* pTile = rLayer.GetTile(tx, ty);
-
-					if (pTile->IsFlagSet(Tile::ANIMATED))
-					{
-						TileAnimated* pTileAnimated =
-							static_cast<TileAnimated*>(pTile);
-
-						rGraphics.RenderQuad(pTileAnimated->GetMaterialInstance(),
-							vecTilePos, pTileAnimated->GetBlendConst());
-					}
-					else
-					{
-						TileStatic* pTileStatic =
-							static_cast<TileStatic*>(pTile);
-
-						rGraphics.RenderQuad(pTileStatic->GetMaterialInstance(),
-							vecTilePos, pTileStatic->GetBlendConst());
-					}
-
-					vecTilePos.x += fTileSize;
-				}
-
-				vecTilePos.x = rLayer.GetPositionConst().x - m_vecPos.x;
-				vecTilePos.y += fTileSize;
-			}
+			rcLayerRange.Offset(-int(floor(rLayer.GetPositionConst().x)),
+				-int(floor(rLayer.GetPositionConst().y)));
 
-			// Render Actors
+			rLayer.Render(rcLayerRange,
+				Vector2(rLayer.GetPositionConst() - m_vecPos) * fTileSize,
+				m_nMaxZ);
 
-			rLayer.GetSpace()->Query(rcLayerRange, &arActors);
+			// Render actors in view attached to this layer
 
-			for(ActorArrayIterator pos = arActors.begin();
-				pos != arActors.end();
-				pos++)
+			for(int n = pRenderLayer->nFirstActor;
+				n < pRenderLayer->nFirstActor + pRenderLayer->nActors;
+				n++)
 			{
-				(*pos)->Render();
-			}
+				Actor* pActor = m_pMap->m_arRenderActors[n];
 
-			arActors.clear();
+				if (false == bFilter || IsActorVisible(pActor) == true)
+					pActor->Render();
+			}
 		}
 	}
+
+	if (false == bShared)
+		m_pMap->m_arRenderCameras.clear();
 }
 
 void Camera::Cache(void)
@@ -288,6 +367,8 @@ void Camera::Cache(void)
 	if (NULL == m_pMap)
 		return;
 
+	Rect rcOldRange = m_rcVisibleRange;
+
 	// Calculate visible range scaled by zoom
 	// using center point as reference
 
@@ -335,4 +416,220 @@ void Camera::Cache(void)
 		D3DXMatrixIdentity(&m_mtxViewScale);
 		D3DXMatrixIdentity(&m_mtxView);
 	}
+
+	// Update actors in view
+
+	if (m_rcVisibleRange != rcOldRange)
+		UpdateVisibleActors(rcOldRange);
+}
+
+void Camera::Activate(bool bActive)
+{
+	if (bActive == m_bActive)
+		return;
+
+	if (true == bActive)
+	{
+		m_bActive = true;
+
+		UpdateVisibleActors(Rect(0, 0, 0, 0));
+	}
+	else
+	{
+		RemoveVisibleActors(NULL);
+
+		m_bActive = false;
+	}
+}
+
+void Camera::UpdateVisibleActors(const Rect& rrcOldRange)
+{
+	if (false == m_bActive || NULL == m_pMap)
+		return;
+
+	// Drop actors that left the visible range
+
+	ActorArrayIterator posKeep = m_arVisible.begin();
+
+	for(ActorArrayIterator pos = m_arVisible.begin();
+		pos != m_arVisible.end();
+		pos++)
+	{
+		if (IsInView(*pos) == true)
+			*posKeep++ = *pos;
+		else
+			m_arExited.push_back(*pos);
+	}
+
+	m_arVisible.erase(posKeep, m_arVisible.end());
+
+	// Actors that entered must overlap the part of visible range
+	// not covered by the old range, so only query that part
+
+	Rect arrcEntered[4];
+
+	int nEntered = m_rcVisibleRange.Subtract(rrcOldRange, arrcEntered);
+
+	for(int n = 0; n < nEntered; n++)
+		m_pMap->GetActorsFromRange(arrcEntered[n], QueryEntering, this);
+
+	// An actor spanning several parts is reported by each
+
+	std::sort(m_arActors.begin(), m_arActors.end());
+
+	m_arActors.erase(std::unique(m_arActors.begin(), m_arActors.end()),
+		m_arActors.end());
+
+	size_t nVisible = m_arVisible.size();
+
+	m_arVisible.insert(m_arVisible.end(), m_arActors.begin(), m_arActors.end());
+
+	std::inplace_merge(m_arVisible.begin(), m_arVisible.begin() + nVisible,
+		m_arVisible.end());
+
+	// Notify once the set is consistent. Handlers may move actors or
+	// cameras and re-enter here, so notify from local copies
+
+	ActorArray arExited;
+	ActorArray arEntered;
+
+	arExited.swap(m_arExited);
+	arEntered.swap(m_arActors);
+
+	for(ActorArrayIterator pos = arExited.begin();
+		pos != arExited.end();
+		pos++)
+	{
+		if (0 == --(*pos)->m_nVisibleCameras)
+			(*pos)->OnExitCamera();
+	}
+
+	for(ActorArrayIterator pos = arEntered.begin();
+		pos != arEntered.end();
+		pos++)
+	{
+		if (1 == ++(*pos)->m_nVisibleCameras)
+			(*pos)->OnEnterCamera();
+	}
+
+	// Keep allocated storage for next update
+
+	arExited.clear();
+	arEntered.clear();
+
+	if (m_arExited.empty() == true)
+		m_arExited.swap(arExited);
+
+	if (m_arActors.empty() == true)
+		m_arActors.swap(arEntered);
+}
+
+void Camera::UpdateVisibleActor(Actor* pActor)
+{
+	if (false == m_bActive)
+		return;
+
+	ActorArrayIterator pos = std::lower_bound(m_arVisible.begin(),
+		m_arVisible.end(), pActor);
+
+	bool bWasVisible = (pos != m_arVisible.end() && *pos == pActor);
+
+	if (IsInView(pActor) == true)
+	{
+		if (true == bWasVisible)
+			return;
+
+		m_arVisible.insert(pos, pActor);
+
+		if (1 == ++pActor->m_nVisibleCameras)
+			pActor->OnEnterCamera();
+	}
+	else if (true == bWasVisible)
+	{
+		m_arVisible.erase(pos);
+
+		if (0 == --pActor->m_nVisibleCameras)
+			pActor->OnExitCamera();
+	}
+}
+
+void Camera::RemoveVisibleActors(const TileLayer* pLayer)
+{
+	// Remove actors attached to specified layer, or all if NULL
+
+	ActorArrayIterator posKeep = m_arVisible.begin();
+
+	for(ActorArrayIterator pos = m_arVisible.begin();
+		pos != m_arVisible.end();
+		pos++)
+	{
+		if (pLayer != NULL && (*pos)->GetLayerConst() != pLayer)
+			*posKeep++ = *pos;
+		else
+			m_arExited.push_back(*pos);
+	}
+
+	m_arVisible.erase(posKeep, m_arVisible.end());
+
+	ActorArray arExited;
+	arExited.swap(m_arExited);
+
+	for(ActorArrayIterator pos = arExited.begin();
+		pos != arExited.end();
+		pos++)
+	{
+		if (0 == --(*pos)->m_nVisibleCameras)
+			(*pos)->OnExitCamera();
+	}
+}
+
+bool Camera::IsInView(const Actor* pActor) const
+{
+	const TileLayer* pLayer = pActor->GetLayerConst();
+
+	if (NULL == pLayer || IsLayerInRange(pLayer) == false)
+		return false;
+
+	// Same test as layer space partition queries, in layer coordinates
+
+	Rect rcRange = m_rcVisibleRange;
+	rcRange.Offset(pLayer->GetPositionConst() * -1);
+
+	return pActor->GetBounds().Intersect(rcRange);
+}
+
+void Camera::GetActorsInView(ActorArray& rarActors)
+{
+	if (NULL == m_pMap)
+		return;
+
+	Rect rcRange = m_rcVisibleRange;
+
+	m_pMap->GetActorsFromRange(rcRange, QueryInView, this);
+
+	rarActors.insert(rarActors.end(), m_arActors.begin(), m_arActors.end());
+
+	m_arActors.clear();
+}
+
+void Camera::QueryEntering(Actor* pActor, void* pContext)
+{
+	Camera* pCamera = reinterpret_cast<Camera*>(pContext);
+
+	if (pCamera->IsInView(pActor) == true &&
+	   pCamera->IsActorVisible(pActor) == false)
+		pCamera->m_arActors.push_back(pActor);
+}
+
+void Camera::QueryInView(Actor* pActor, void* pContext)
+{
+	Camera* pCamera = reinterpret_cast<Camera*>(pContext);
+
+	if (pCamera->IsInView(pActor) == true)
+		pCamera->m_arActors.push_back(pActor);
+}
+
+bool Camera::CompareLayers(const TileLayer* pLeft, const TileLayer* pRight)
+{
+	return (pLeft->GetZ() < pRight->GetZ());
 }
\ No newline at end of file
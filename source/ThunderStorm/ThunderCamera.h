@@ -18,7 +18,9 @@
 | Includes
 \*----------------------------------------------------------*/
 
-#include "ThunderMath.h"	// using Vector2, Rect
+#include "ThunderMath.h"		// using Vector2, Rect
+#include "ThunderActor.h"		// using ActorArray
+#include "ThunderTileLayer.h"	// using TileLayerArray
 
 /*----------------------------------------------------------*\
 | Namespace
@@ -32,6 +34,7 @@ namespace ThunderStorm {
 
 class Camera;				// referencing Camera, declared below
 class TileMap;				// referencing TileMap
+class TileLayer;			// referencing TileLayer
 
 /*----------------------------------------------------------*\
 | Definitions
@@ -73,6 +76,16 @@ protected:
 	// Camera zoom factor
 	float m_fZoom;
 
+	// Range of layer Z shown in camera, inclusive
+	int m_nMinZ;
+	int m_nMaxZ;
+
+	// Layers in Z range, sorted by Z and then by map order
+	TileLayerArray m_arLayers;
+
+	// Map layer stamp layers were collected at, 0 if out of date
+	DWORD m_dwLayerStamp;
+
 	// Dest rectangle
 	Rect m_rcDest;
 
@@ -85,6 +98,16 @@ protected:
 	// Scaling of the view to fit in destination rect
 	D3DXMATRIX m_mtxViewScale;
 
+	// Actors in view, sorted by address (maintained while active)
+	ActorArray m_arVisible;
+
+	// Scratch storage for actors entering or leaving view
+	ActorArray m_arActors;
+	ActorArray m_arExited;
+
+	// Set by the map while the camera is active
+	bool m_bActive;
+
 public:
 	Camera(TileMap* pMap = NULL);
 	virtual ~Camera(void);
@@ -132,6 +155,19 @@ public:
 
 	virtual void Zoom(float fDelta);
 
+	//
+	// Z Range
+	//
+
+	int GetMinZ(void) const;
+	int GetMaxZ(void) const;
+
+	virtual void SetZRange(int nMinZ, int nMaxZ);
+
+	bool IsLayerInRange(const TileLayer* pLayer) const;
+
+	const TileLayerArray& GetLayers(void);
+
 	//
 	// Dest Rectangle
 	//
@@ -152,6 +188,15 @@ public:
 	bool AreaVisible(Rect rcArea);
 	bool AreaVisible(Vector2 vecAreaPosition, Vector2 vecAreaSize);
 
+	//
+	// Visible Actors
+	//
+
+	bool IsActive(void) const;
+
+	const ActorArray& GetVisibleActors(void) const;
+	bool IsActorVisible(const Actor* pActor) const;
+
 	//
 	// Rendering
 	//
@@ -164,6 +209,28 @@ protected:
 	//
 
 	virtual void Cache(void);
+
+	void Activate(bool bActive);
+
+	void UpdateVisibleActors(const Rect& rrcOldRange);
+	void UpdateVisibleActor(Actor* pActor);
+	void RemoveVisibleActors(const TileLayer* pLayer);
+
+	bool IsInView(const Actor* pActor) const;
+
+	// Queries layer spaces directly, for use while not active
+	void GetActorsInView(ActorArray& rarActors);
+
+	static void QueryEntering(Actor* pActor, void* pContext);
+	static void QueryInView(Actor* pActor, void* pContext);
+
+	static bool CompareLayers(const TileLayer* pLeft, const TileLayer* pRight);
+
+	//
+	// Friends
+	//
+
+	friend class TileMap;
 };
 
 } // namespace ThunderStorm
@@ -73,6 +73,7 @@ const LPCWSTR Error::SZ_ERRORS[] =	{
 										L"#QueryPerformanceFrequency failed.",
 										L"#QueryPerformanceCounter failed.",
 										L"#GetFileVersionInfo failed.",
+										L"#CreateThread failed.",
 
 										L"#RegisterClassEx failed.",
 										L"#CreateWindowEx failed.",
@@ -106,6 +106,7 @@ public:
 		WIN_SYS_QUERYPERFORMANCEFREQUENCY,
 		WIN_SYS_QUERYPERFORMANCECOUNTER,
 		WIN_SYS_GETFILEVERSIONINFO,
+		WIN_SYS_CREATETHREAD,
 
 		// Win32 user interface errors
 
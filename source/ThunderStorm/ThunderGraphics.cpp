@@ -1874,6 +1874,135 @@ void Graphics::RenderQuad(const MaterialInstance& rMaterialInst,
 	}
 }
 
+void Graphics::RenderQuads(const MaterialInstance& rMaterialInst,
+						   const VertexTriangle* pVertices,
+						   UINT uQuadCount,
+						   float fZOrder,
+						   const D3DXMATRIX* pmtxTransform)
+{
+	// Validate
+
+	MaterialInstanceShared* pMat =
+		m_rEngine.GetOption(Engine::OPTION_WIREFRAME) ?
+		GetWireframeMaterial() :
+		rMaterialInst.GetSharedMaterial();
+
+	if (pMat == NULL)
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PTR,
+			__FUNCTIONW__, L"pMat");
+
+	// Vertices are pre-built, 4 per quad, submitted in parts that
+	// fit into vertex cache and are covered by quad index buffer
+
+	UINT uMaxQuads = UINT(m_rEngine.GetOptionEx(
+		Engine::OPTION_MAX_BATCH_PRIM)) * 3 / 4;
+
+	while(uQuadCount > 0)
+	{
+		UINT uQuads = min(uQuadCount, uMaxQuads);
+		UINT uSize = sizeof(VertexTriangle) * 4 * uQuads;
+
+		if (IsBatching() == true)
+		{
+			if (m_VC.GetSizeFree() < uSize)
+				FlushBatch();
+
+			// Add item to render queue (transforms reset when flushed)
+
+			Renderable r;
+
+			r.nType = Renderable::TYPE_TRIANGLELIST;
+			r.fZOrder = fZOrder;
+			r.pMaterial = pMat;
+			r.pbVertices = m_VC.GetCurrentPos();
+			r.uVertexCount = uQuads * 4;
+			r.uPrimitiveCount = uQuads * 2;
+			r.nTransform = (pmtxTransform != NULL) ?
+				AddTransform(*pmtxTransform) : 0;
+
+			// Cache vertices
+
+			m_VC.Write(LPBYTE(pVertices), uSize);
+
+			m_arRenderQueue.push_back(r);
+		}
+		else
+		{
+			// Fill vertex buffer
+
+			if (m_TriVB.GetFreeSize() < uSize)
+				return;
+
+			LPBYTE pbData = NULL;
+			m_TriVB.Lock(uSize, (void**)&pbData, D3DLOCK_DISCARD);
+
+			CopyMemory(pbData, pVertices, uSize);
+
+			m_TriVB.Unlock();
+			m_TriVB.Reset();
+
+			// Set vertex declaration
+
+			HRESULT hr = m_pD3DDevice->SetVertexDeclaration(m_pTriVD);
+
+			if (FAILED(hr))
+				throw m_rEngine.GetErrors().Push(
+					Error::D3D_DEVICE_SETVERTEXDECLARATION,
+					__FUNCTIONW__, hr);
+
+			// Set vertex buffer
+
+			hr = m_pD3DDevice->SetStreamSource(0, m_TriVB.GetBuffer(),
+				0, m_TriVB.GetVertexSize());
+
+			if (FAILED(hr))
+				throw m_rEngine.GetErrors().Push(Error::D3D_DEVICE_SETSTREAMSOURCE,
+					__FUNCTIONW__, hr);
+
+			// Set index buffer
+
+			hr = m_pD3DDevice->SetIndices(m_TriIB.GetBuffer());
+
+			if (FAILED(hr))
+				throw m_rEngine.GetErrors().Push(Error::D3D_DEVICE_SETINDICES,
+					__FUNCTIONW__, hr);
+
+			// Set transform
+
+			m_pStateManager->SetTransform(D3DTS_WORLD, (pmtxTransform != NULL) ?
+				pmtxTransform : &m_arTransforms[0]);
+
+			// Set material
+
+			pMat->Apply();
+
+			UINT uPasses = pMat->Begin();
+
+			for(UINT u = 0; u < uPasses; u++)
+			{
+				pMat->BeginPass(u);
+
+				hr = m_pD3DDevice->DrawIndexedPrimitive(D3DPT_TRIANGLELIST,
+					0, 0, uQuads * 4, 0, uQuads * 2);
+
+				if (FAILED(hr))
+					m_rEngine.GetErrors().Push(
+						Error::D3D_DEVICE_DRAWINDEXEDPRIMITIVE,
+						__FUNCTIONW__, hr);
+
+				pMat->EndPass();
+			}
+
+			pMat->End();
+
+			m_uTriangles += uQuads * 2 * uPasses;
+		}
+
+		pVertices += uQuads * 4;
+		uQuadCount -= uQuads;
+	}
+}
+
 void Graphics::RenderLines(const MaterialInstance& rMaterialInst,
 						   const VertexLine* pVertices,
 						   UINT uVertexCount,
@@ -434,6 +434,10 @@ public:
 		const Vector2& rvecSize,
 		D3DCOLOR clrBlend = Color::BLEND_ONE);
 
+	void RenderQuads(const MaterialInstance& rMaterialInst,
+		const VertexTriangle* pVertices, UINT uQuadCount,
+		float fZOrder = 0.0f, const D3DXMATRIX* pmtxTransform = NULL);
+
 	void RenderRectangle(const MaterialInstance& rMaterialInst,
 		const Rect& rrc, D3DCOLOR clrBlend, float fZOrder = 0.0f,
 		const Vector2* pvecPivot = NULL,
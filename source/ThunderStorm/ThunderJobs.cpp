@@ -0,0 +1,252 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderJobs.cpp
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine worker thread pool implementation
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "stdafx.h"				// precompiled header
+#include "ThunderJobs.h"		// defining Job, WorkerPool
+#include "ThunderError.h"		// using Error
+#include <process.h>			// using _beginthreadex
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+using namespace ThunderStorm;
+
+/*----------------------------------------------------------*\
+| Constants
+\*----------------------------------------------------------*/
+
+const int WorkerPool::BATCH_SIZE = 16;
+
+
+/*----------------------------------------------------------*\
+| Job implementation
+\*----------------------------------------------------------*/
+
+Job::~Job(void)
+{
+}
+
+
+/*----------------------------------------------------------*\
+| WorkerPool implementation
+\*----------------------------------------------------------*/
+
+WorkerPool::WorkerPool(void):	m_hStart(NULL),
+								m_hDone(NULL),
+								m_pJob(NULL),
+								m_nItems(0),
+								m_nNextItem(0),
+								m_nBusyWorkers(0),
+								m_pError(NULL),
+								m_bExit(false)
+{
+	InitializeCriticalSection(&m_csError);
+}
+
+WorkerPool::~WorkerPool(void)
+{
+	Destroy();
+
+	DeleteCriticalSection(&m_csError);
+}
+
+void WorkerPool::Create(int nThreads)
+{
+	Destroy();
+
+	if (nThreads < 0)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 1);
+
+	if (0 == nThreads)
+	{
+		SYSTEM_INFO si = {0};
+		GetSystemInfo(&si);
+
+		nThreads = int(si.dwNumberOfProcessors) - 1;
+	}
+
+	if (0 == nThreads)
+		return;
+
+	// Workers wait on start semaphore, last one out signals done
+
+	m_hStart = CreateSemaphore(NULL, 0, nThreads, NULL);
+
+	if (NULL == m_hStart)
+		throw Error(Error::WIN_SYS_CREATETHREAD, __FUNCTIONW__);
+
+	m_hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+	if (NULL == m_hDone)
+	{
+		Destroy();
+		throw Error(Error::WIN_SYS_CREATETHREAD, __FUNCTIONW__);
+	}
+
+	m_bExit = false;
+
+	for(int n = 0; n < nThreads; n++)
+	{
+		HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, ThreadProc,
+			this, 0, NULL);
+
+		if (NULL == hThread)
+		{
+			Destroy();
+			throw Error(Error::WIN_SYS_CREATETHREAD, __FUNCTIONW__);
+		}
+
+		m_arThreads.push_back(hThread);
+	}
+}
+
+void WorkerPool::Destroy(void)
+{
+	if (m_arThreads.empty() == false)
+	{
+		// Wake all workers and wait for them to exit
+
+		m_bExit = true;
+
+		ReleaseSemaphore(m_hStart, LONG(m_arThreads.size()), NULL);
+
+		for(std::vector<HANDLE>::iterator pos = m_arThreads.begin();
+			pos != m_arThreads.end();
+			pos++)
+		{
+			WaitForSingleObject(*pos, INFINITE);
+			CloseHandle(*pos);
+		}
+
+		m_arThreads.clear();
+	}
+
+	if (m_hStart != NULL)
+	{
+		CloseHandle(m_hStart);
+		m_hStart = NULL;
+	}
+
+	if (m_hDone != NULL)
+	{
+		CloseHandle(m_hDone);
+		m_hDone = NULL;
+	}
+}
+
+void WorkerPool::Run(Job& rJob, int nItems)
+{
+	if (nItems <= 0)
+		return;
+
+	m_pJob = &rJob;
+	m_nItems = nItems;
+	m_nNextItem = 0;
+
+	// Not worth waking workers for a single batch
+
+	if (m_arThreads.empty() == false && nItems > BATCH_SIZE)
+	{
+		m_nBusyWorkers = LONG(m_arThreads.size());
+
+		ReleaseSemaphore(m_hStart, LONG(m_arThreads.size()), NULL);
+
+		ExecuteItems();
+
+		WaitForSingleObject(m_hDone, INFINITE);
+	}
+	else
+	{
+		ExecuteItems();
+	}
+
+	m_pJob = NULL;
+
+	// Re-throw first error on calling thread
+
+	if (m_pError != NULL)
+	{
+		Error err(*m_pError);
+
+		delete m_pError;
+		m_pError = NULL;
+
+		throw err;
+	}
+}
+
+void WorkerPool::ExecuteItems(void)
+{
+	for(;;)
+	{
+		int nFirst = int(InterlockedExchangeAdd(&m_nNextItem, BATCH_SIZE));
+
+		if (nFirst >= m_nItems)
+			break;
+
+		int nLast = min(nFirst + BATCH_SIZE, m_nItems);
+
+		for(int n = nFirst; n < nLast; n++)
+		{
+			try
+			{
+				m_pJob->Execute(n);
+			}
+
+			catch(Error& rError)
+			{
+				EnterCriticalSection(&m_csError);
+
+				if (NULL == m_pError)
+					m_pError = new Error(rError);
+
+				LeaveCriticalSection(&m_csError);
+			}
+
+			catch(std::exception e)
+			{
+				EnterCriticalSection(&m_csError);
+
+				if (NULL == m_pError)
+					m_pError = new Error(Error::INTERNAL, __FUNCTIONW__);
+
+				LeaveCriticalSection(&m_csError);
+			}
+		}
+	}
+}
+
+unsigned int __stdcall WorkerPool::ThreadProc(void* pParam)
+{
+	WorkerPool* pPool = reinterpret_cast<WorkerPool*>(pParam);
+
+	for(;;)
+	{
+		WaitForSingleObject(pPool->m_hStart, INFINITE);
+
+		if (true == pPool->m_bExit)
+			break;
+
+		pPool->ExecuteItems();
+
+		if (0 == InterlockedDecrement(&pPool->m_nBusyWorkers))
+			SetEvent(pPool->m_hDone);
+	}
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,128 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderJobs.h
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine worker thread pool for parallel jobs
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+#ifndef THUNDER_JOBS_H
+#define THUNDER_JOBS_H
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+namespace ThunderStorm {
+
+/*----------------------------------------------------------*\
+| Declarations
+\*----------------------------------------------------------*/
+
+class Error;			// referencing Error
+
+/*----------------------------------------------------------*\
+| Job class - work split into independent items
+\*----------------------------------------------------------*/
+
+class Job
+{
+public:
+	virtual ~Job(void);
+
+public:
+	// Called once for every item, on any thread and in any order
+	virtual void Execute(int nItem) = 0;
+};
+
+/*----------------------------------------------------------*\
+| WorkerPool class - runs jobs on worker threads
+\*----------------------------------------------------------*/
+
+class WorkerPool
+{
+public:
+	//
+	// Constants
+	//
+
+	// Number of items a thread takes from a job at a time
+	static const int BATCH_SIZE;
+
+private:
+	//
+	// Members
+	//
+
+	// Worker threads
+	std::vector<HANDLE> m_arThreads;
+
+	// Released once for every worker when a job starts
+	HANDLE m_hStart;
+
+	// Signaled when last worker finished current job
+	HANDLE m_hDone;
+
+	// Guards failure of current job
+	CRITICAL_SECTION m_csError;
+
+	// Job being run, and number of its items
+	Job* m_pJob;
+	int m_nItems;
+
+	// Next item to be taken from current job
+	volatile LONG m_nNextItem;
+
+	// Workers that have not finished current job
+	volatile LONG m_nBusyWorkers;
+
+	// First error thrown by current job, NULL if none
+	Error* m_pError;
+
+	// Set when threads should exit
+	volatile bool m_bExit;
+
+public:
+	WorkerPool(void);
+	~WorkerPool(void);
+
+public:
+	//
+	// Threads
+	//
+
+	// Pass 0 to create one thread less than there are processors
+	void Create(int nThreads = 0);
+	void Destroy(void);
+
+	inline int GetThreadCount(void) const
+	{
+		return int(m_arThreads.size());
+	}
+
+	//
+	// Jobs
+	//
+
+	// Execute all items on workers and calling thread, return when done.
+	// First error thrown by any item is re-thrown on calling thread.
+	void Run(Job& rJob, int nItems);
+
+private:
+	//
+	// Private Functions
+	//
+
+	void ExecuteItems(void);
+
+	static unsigned int __stdcall ThreadProc(void* pParam);
+};
+
+} // namespace ThunderStorm
+
+#endif // THUNDER_JOBS_H
\ No newline at end of file
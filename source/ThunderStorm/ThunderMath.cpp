@@ -129,6 +129,42 @@ void Rect::Offset(POINT pt)
 	bottom += pt.y;
 }
 
+int Rect::Subtract(const Rect& rrcOther, Rect* prcDest) const
+{
+	// Split area not covered by other rect into up to 4 rects:
+	// top and bottom bands at full width, left and right in between
+
+	if (left >= right || top >= bottom)
+		return 0;
+
+	if (rrcOther.left >= right || rrcOther.right <= left ||
+	   rrcOther.top >= bottom || rrcOther.bottom <= top ||
+	   rrcOther.left >= rrcOther.right || rrcOther.top >= rrcOther.bottom)
+	{
+		prcDest[0] = *this;
+		return 1;
+	}
+
+	int nCount = 0;
+
+	if (rrcOther.top > top)
+		prcDest[nCount++].Set(left, top, right, rrcOther.top);
+
+	if (rrcOther.bottom < bottom)
+		prcDest[nCount++].Set(left, rrcOther.bottom, right, bottom);
+
+	int nTop = max(top, rrcOther.top);
+	int nBottom = min(bottom, rrcOther.bottom);
+
+	if (rrcOther.left > left)
+		prcDest[nCount++].Set(left, nTop, rrcOther.left, nBottom);
+
+	if (rrcOther.right < right)
+		prcDest[nCount++].Set(rrcOther.right, nTop, right, nBottom);
+
+	return nCount;
+}
+
 void Rect::Serialize(Stream& rStream) const
 {
 	rStream.Write(this, sizeof(Rect));
@@ -489,6 +489,8 @@ public:
 		return (::IntersectRect(&rcDest, this, &rrcOther) == TRUE);
 	}
 
+	int Subtract(const Rect& rrcOther, Rect* prcDest) const;
+
 	inline bool PtInRect(POINT pt) const
 	{
 		return (::PtInRect(this, pt) == TRUE);
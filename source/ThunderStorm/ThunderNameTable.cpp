@@ -0,0 +1,183 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderNameTable.cpp
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm interned name table implementation
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "stdafx.h"				// precompiled header
+#include "ThunderNameTable.h"	// defining NameTable
+#include "ThunderGlobals.h"		// using INVALID_INDEX
+#include "ThunderError.h"		// using Error
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+using namespace ThunderStorm;
+
+/*----------------------------------------------------------*\
+| Constants
+\*----------------------------------------------------------*/
+
+const int NameTable::MIN_BUCKETS = 64;
+
+
+/*----------------------------------------------------------*\
+| NameTable implementation
+\*----------------------------------------------------------*/
+
+NameTable::NameTable(void)
+{
+}
+
+NameTable::~NameTable(void)
+{
+}
+
+int NameTable::Add(LPCWSTR pszName)
+{
+	if (NULL == pszName || L'\0' == *pszName)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 1);
+
+	DWORD dwHash = Hash(pszName);
+
+	if (m_arBuckets.empty() == false)
+	{
+		int nBucket = FindBucket(pszName, dwHash);
+
+		if (m_arBuckets[nBucket] != INVALID_INDEX)
+			return m_arBuckets[nBucket];
+	}
+
+	// Grow before the index is more than half full
+
+	if ((m_arNames.size() + 1) * 2 > m_arBuckets.size())
+		Rehash(max(MIN_BUCKETS, int(m_arBuckets.size()) * 2));
+
+	int nID = int(m_arNames.size());
+
+	try
+	{
+		m_arNames.push_back(String(pszName));
+		m_arHashes.push_back(dwHash);
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			(m_arNames.size() + 1) * sizeof(String));
+	}
+
+	m_arBuckets[FindBucket(pszName, dwHash)] = nID;
+
+	return nID;
+}
+
+int NameTable::Find(LPCWSTR pszName) const
+{
+	if (NULL == pszName || m_arBuckets.empty() == true)
+		return INVALID_INDEX;
+
+	return m_arBuckets[FindBucket(pszName, Hash(pszName))];
+}
+
+void NameTable::Empty(void)
+{
+	m_arNames.clear();
+	m_arHashes.clear();
+	m_arBuckets.clear();
+}
+
+DWORD NameTable::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(NameTable) +
+		DWORD(m_arNames.capacity() * sizeof(String)) +
+		DWORD(m_arHashes.capacity() * sizeof(DWORD)) +
+		DWORD(m_arBuckets.capacity() * sizeof(int));
+
+	for(StringArrayConstIterator pos = m_arNames.begin();
+		pos != m_arNames.end();
+		pos++)
+	{
+		dwSize += DWORD(pos->GetLengthBytes() + sizeof(WCHAR));
+	}
+
+	return dwSize;
+}
+
+DWORD NameTable::Hash(LPCWSTR pszName)
+{
+	// FNV-1a over characters
+
+	DWORD dwHash = 2166136261u;
+
+	for(LPCWSTR psz = pszName; *psz != L'\0'; psz++)
+	{
+		dwHash ^= DWORD(*psz);
+		dwHash *= 16777619u;
+	}
+
+	return dwHash;
+}
+
+int NameTable::FindBucket(LPCWSTR pszName, DWORD dwHash) const
+{
+	// Linear probing, comparing strings only when hashes match
+
+	int nMask = int(m_arBuckets.size()) - 1;
+	int nBucket = int(dwHash) & nMask;
+
+	for(;;)
+	{
+		int nID = m_arBuckets[nBucket];
+
+		if (INVALID_INDEX == nID)
+			return nBucket;
+
+		if (m_arHashes[nID] == dwHash &&
+		   wcscmp(m_arNames[nID].GetBufferConst(), pszName) == 0)
+			return nBucket;
+
+		nBucket = (nBucket + 1) & nMask;
+	}
+}
+
+void NameTable::Rehash(int nBuckets)
+{
+	try
+	{
+		m_arBuckets.assign(size_t(nBuckets), INVALID_INDEX);
+
+		m_arNames.reserve(size_t(nBuckets / 2));
+		m_arHashes.reserve(size_t(nBuckets / 2));
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			nBuckets * sizeof(int));
+	}
+
+	int nMask = nBuckets - 1;
+
+	for(int nID = 0; nID < int(m_arNames.size()); nID++)
+	{
+		int nBucket = int(m_arHashes[nID]) & nMask;
+
+		while(m_arBuckets[nBucket] != INVALID_INDEX)
+			nBucket = (nBucket + 1) & nMask;
+
+		m_arBuckets[nBucket] = nID;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderNameTable.h
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm interned name table class
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+#ifndef THUNDER_NAME_TABLE_H
+#define THUNDER_NAME_TABLE_H
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "ThunderString.h"		// using String, StringArray
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+namespace ThunderStorm {
+
+/*----------------------------------------------------------*\
+| NameTable class - interns names as small integer IDs
+\*----------------------------------------------------------*/
+
+class NameTable
+{
+public:
+	//
+	// Constants
+	//
+
+	// Bucket count allocated on first add, always a power of two
+	static const int MIN_BUCKETS;
+
+private:
+	//
+	// Members
+	//
+
+	// Interned names and their hashes, indexed by ID
+	StringArray m_arNames;
+	std::vector<DWORD> m_arHashes;
+
+	// Open addressed hash index of IDs, INVALID_INDEX if empty,
+	// kept at most half full
+	std::vector<int> m_arBuckets;
+
+public:
+	NameTable(void);
+	~NameTable(void);
+
+public:
+	//
+	// Names
+	//
+
+	// Returns ID of name, interning it if not yet interned
+	int Add(LPCWSTR pszName);
+
+	// Returns ID of name or INVALID_INDEX if not interned, never allocates
+	int Find(LPCWSTR pszName) const;
+
+	inline const String& GetName(int nID) const
+	{
+		return m_arNames[nID];
+	}
+
+	inline int GetCount(void) const
+	{
+		return int(m_arNames.size());
+	}
+
+	void Empty(void);
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+private:
+	//
+	// Private Functions
+	//
+
+	static DWORD Hash(LPCWSTR pszName);
+
+	// Bucket holding name or the empty bucket it would go to
+	int FindBucket(LPCWSTR pszName, DWORD dwHash) const;
+
+	void Rehash(int nBuckets);
+};
+
+} // namespace ThunderStorm
+
+#endif // THUNDER_NAME_TABLE_H
\ No newline at end of file
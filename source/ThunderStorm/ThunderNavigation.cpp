@@ -0,0 +1,1748 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderNavigation.cpp
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine path finding and flow field implementation
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "stdafx.h"				// precompiled header
+#include "ThunderNavigation.h"	// defining NavigationGraph, Navigation
+#include "ThunderTileMap.h"		// using TileMap, TileLayer, Tile
+#include "ThunderError.h"		// using Error
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+using namespace ThunderStorm;
+
+/*----------------------------------------------------------*\
+| Constants
+\*----------------------------------------------------------*/
+
+const int NavigationGraph::CLUSTER_SIZE = 16;
+const int NavigationGraph::WIDE_ENTRANCE = 6;
+
+const int Navigation::DEFAULT_EXPANSION_BUDGET = 4096;
+
+const BYTE FlowField::DIRECTION_NONE = 0xFF;
+
+// Steps to the four neighbors of a tile
+
+const int N_STEP_X[] = { 1, -1, 0, 0 };
+const int N_STEP_Y[] = { 0, 0, 1, -1 };
+
+
+/*----------------------------------------------------------*\
+| FlowField implementation
+\*----------------------------------------------------------*/
+
+FlowField::FlowField(NavigationGraph& rGraph, const PointArray& rarGoals):
+					 m_rGraph(rGraph),
+					 m_arGoals(rarGoals),
+					 m_nWidth(0),
+					 m_nHeight(0),
+					 m_bInvalid(true),
+					 m_dwVersion(0),
+					 m_nUpdated(0),
+					 m_nRefs(1)
+{
+	SortGoals(m_arGoals);
+}
+
+FlowField::~FlowField(void)
+{
+}
+
+const PointArray& FlowField::GetGoals(void) const
+{
+	return m_arGoals;
+}
+
+void FlowField::SetGoals(const PointArray& rarGoals)
+{
+	PointArray arGoals(rarGoals);
+
+	SortGoals(arGoals);
+
+	if (true == m_bInvalid)
+	{
+		m_arGoals.swap(arGoals);
+		return;
+	}
+
+	// Nearly every tile leads to some goal, so removing goals recomputes
+	// the whole field. Added goals only spread out from where they are.
+
+	if (std::includes(arGoals.begin(), arGoals.end(),
+	   m_arGoals.begin(), m_arGoals.end(), ComparePoints) == false)
+	{
+		m_bInvalid = true;
+	}
+	else
+	{
+		PointArray arAdded;
+
+		std::set_difference(arGoals.begin(), arGoals.end(),
+			m_arGoals.begin(), m_arGoals.end(),
+			std::back_inserter(arAdded), ComparePoints);
+
+		for(PointArrayConstIterator pos = arAdded.begin();
+			pos != arAdded.end();
+			pos++)
+		{
+			if (pos->x >= 0 && pos->y >= 0 &&
+			   pos->x < m_nWidth && pos->y < m_nHeight)
+				m_arChanged.push_back(pos->y * m_nWidth + pos->x);
+		}
+	}
+
+	m_arGoals.swap(arGoals);
+}
+
+bool FlowField::IsSameGoals(const FlowField& rOther) const
+{
+	if (m_arGoals.size() != rOther.m_arGoals.size())
+		return false;
+
+	for(size_t n = 0; n < m_arGoals.size(); n++)
+	{
+		if (m_arGoals[n].x != rOther.m_arGoals[n].x ||
+		   m_arGoals[n].y != rOther.m_arGoals[n].y)
+			return false;
+	}
+
+	return true;
+}
+
+bool FlowField::IsGoal(int tx, int ty) const
+{
+	POINT pt = { tx, ty };
+
+	return std::binary_search(m_arGoals.begin(), m_arGoals.end(),
+		pt, ComparePoints);
+}
+
+void FlowField::Update(void)
+{
+	// Graph rebuild invalidates this field
+
+	m_rGraph.Repair();
+
+	m_nUpdated = 0;
+
+	if (true == m_bInvalid)
+	{
+		Build();
+		return;
+	}
+
+	if (m_arChanged.empty() == true)
+		return;
+
+	m_arTouched.clear();
+
+	Raise();
+	Lower();
+
+	// Directions change where distances changed and next to those
+
+	for(std::vector<int>::const_iterator pos = m_arTouched.begin();
+		pos != m_arTouched.end();
+		pos++)
+	{
+		int tx = *pos % m_nWidth;
+		int ty = *pos / m_nWidth;
+
+		UpdateDirection(*pos);
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = tx + N_STEP_X[nDir];
+			int ny = ty + N_STEP_Y[nDir];
+
+			if (nx >= 0 && ny >= 0 && nx < m_nWidth && ny < m_nHeight)
+				UpdateDirection(ny * m_nWidth + nx);
+		}
+	}
+
+	m_nUpdated = int(m_arTouched.size());
+
+	m_arChanged.clear();
+
+	m_dwVersion++;
+}
+
+Vector2 FlowField::GetDirection(const Vector2& vecPos) const
+{
+	int tx = int(floor(vecPos.x));
+	int ty = int(floor(vecPos.y));
+
+	if (tx < 0 || ty < 0 || tx >= m_nWidth || ty >= m_nHeight)
+		return Vector2(0.0f, 0.0f);
+
+	BYTE bDir = m_arDirection[ty * m_nWidth + tx];
+
+	if (DIRECTION_NONE == bDir)
+		return Vector2(0.0f, 0.0f);
+
+	return Vector2(float(N_STEP_X[bDir]), float(N_STEP_Y[bDir]));
+}
+
+int FlowField::AddRef(void)
+{
+	return ++m_nRefs;
+}
+
+int FlowField::RemoveRef(void)
+{
+	return --m_nRefs;
+}
+
+void FlowField::Invalidate(void)
+{
+	m_bInvalid = true;
+	m_arChanged.clear();
+}
+
+void FlowField::OnTileChange(int tx, int ty)
+{
+	if (false == m_bInvalid)
+		m_arChanged.push_back(ty * m_nWidth + tx);
+}
+
+DWORD FlowField::GetMemoryFootprint(void) const
+{
+	return sizeof(FlowField) +
+		DWORD(m_arGoals.capacity() * sizeof(POINT)) +
+		DWORD(m_arDistance.capacity() * sizeof(int)) +
+		DWORD(m_arDirection.capacity()) +
+		DWORD((m_arChanged.capacity() + m_arTouched.capacity()) * sizeof(int)) +
+		DWORD(m_arOpen.capacity() * sizeof(OpenTile));
+}
+
+void FlowField::Build(void)
+{
+	m_nWidth = m_rGraph.GetWidth();
+	m_nHeight = m_rGraph.GetHeight();
+
+	int nTiles = m_nWidth * m_nHeight;
+
+	try
+	{
+		m_arDistance.assign(size_t(nTiles), INT_MAX);
+		m_arDirection.assign(size_t(nTiles), DIRECTION_NONE);
+		m_arTouched.reserve(size_t(nTiles));
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			nTiles * (sizeof(int) * 2 + sizeof(BYTE)));
+	}
+
+	// Breadth first from all goals at once
+
+	m_arTouched.clear();
+
+	for(PointArrayConstIterator pos = m_arGoals.begin();
+		pos != m_arGoals.end();
+		pos++)
+	{
+		if (pos->x < 0 || pos->y < 0 ||
+		   pos->x >= m_nWidth || pos->y >= m_nHeight ||
+		   m_rGraph.IsBlocked(pos->x, pos->y) == true)
+			continue;
+
+		int nTile = pos->y * m_nWidth + pos->x;
+
+		m_arDistance[nTile] = 0;
+		m_arTouched.push_back(nTile);
+	}
+
+	for(size_t n = 0; n < m_arTouched.size(); n++)
+	{
+		int nTile = m_arTouched[n];
+		int nDistance = m_arDistance[nTile] + 1;
+
+		int tx = nTile % m_nWidth;
+		int ty = nTile / m_nWidth;
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = tx + N_STEP_X[nDir];
+			int ny = ty + N_STEP_Y[nDir];
+
+			if (nx < 0 || ny < 0 || nx >= m_nWidth || ny >= m_nHeight)
+				continue;
+
+			int nNext = ny * m_nWidth + nx;
+
+			if (m_arDistance[nNext] != INT_MAX ||
+			   m_rGraph.IsBlocked(nx, ny) == true)
+				continue;
+
+			m_arDistance[nNext] = nDistance;
+			m_arTouched.push_back(nNext);
+		}
+	}
+
+	for(int nTile = 0; nTile < nTiles; nTile++)
+		UpdateDirection(nTile);
+
+	m_nUpdated = nTiles;
+
+	m_arChanged.clear();
+
+	m_bInvalid = false;
+	m_dwVersion++;
+}
+
+void FlowField::Raise(void)
+{
+	// Tiles that became blocked lose their distance, and so do tiles
+	// that were reached only through them. Visiting in order of old
+	// distance means all tiles that could still lead to a goal are
+	// settled before a tile is checked.
+
+	m_arOpen.clear();
+
+	for(std::vector<int>::const_iterator pos = m_arChanged.begin();
+		pos != m_arChanged.end();
+		pos++)
+	{
+		int nTile = *pos;
+
+		if (INT_MAX == m_arDistance[nTile] ||
+		   m_rGraph.IsBlocked(nTile % m_nWidth, nTile / m_nWidth) == false)
+			continue;
+
+		PushOpen(m_arDistance[nTile], nTile);
+	}
+
+	while(m_arOpen.empty() == false)
+	{
+		OpenTile open = PopOpen();
+
+		if (m_arDistance[open.nTile] != open.nDistance)
+			continue;
+
+		int tx = open.nTile % m_nWidth;
+		int ty = open.nTile / m_nWidth;
+
+		if (m_rGraph.IsBlocked(tx, ty) == false)
+		{
+			if (IsGoal(tx, ty) == true)
+				continue;
+
+			// Still reached from another tile?
+
+			bool bReached = false;
+
+			for(int nDir = 0; nDir < 4 && false == bReached; nDir++)
+			{
+				int nx = tx + N_STEP_X[nDir];
+				int ny = ty + N_STEP_Y[nDir];
+
+				if (nx >= 0 && ny >= 0 && nx < m_nWidth && ny < m_nHeight)
+				{
+					bReached = (m_arDistance[ny * m_nWidth + nx] ==
+						open.nDistance - 1);
+				}
+			}
+
+			if (true == bReached)
+				continue;
+		}
+
+		m_arDistance[open.nTile] = INT_MAX;
+		m_arTouched.push_back(open.nTile);
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = tx + N_STEP_X[nDir];
+			int ny = ty + N_STEP_Y[nDir];
+
+			if (nx < 0 || ny < 0 || nx >= m_nWidth || ny >= m_nHeight)
+				continue;
+
+			int nNext = ny * m_nWidth + nx;
+
+			if (m_arDistance[nNext] == open.nDistance + 1)
+				PushOpen(open.nDistance + 1, nNext);
+		}
+	}
+}
+
+void FlowField::Lower(void)
+{
+	// Tiles that lost their distance, became open or became goals
+	// take distance from neighbors and spread it out
+
+	m_arOpen.clear();
+
+	size_t nRaised = m_arTouched.size();
+
+	for(size_t n = 0; n < nRaised + m_arChanged.size(); n++)
+	{
+		int nTile = (n < nRaised) ? m_arTouched[n] : m_arChanged[n - nRaised];
+
+		int tx = nTile % m_nWidth;
+		int ty = nTile / m_nWidth;
+
+		if (m_rGraph.IsBlocked(tx, ty) == true)
+			continue;
+
+		int nDistance = INT_MAX;
+
+		if (IsGoal(tx, ty) == true)
+		{
+			nDistance = 0;
+		}
+		else
+		{
+			for(int nDir = 0; nDir < 4; nDir++)
+			{
+				int nx = tx + N_STEP_X[nDir];
+				int ny = ty + N_STEP_Y[nDir];
+
+				if (nx < 0 || ny < 0 || nx >= m_nWidth || ny >= m_nHeight)
+					continue;
+
+				int nNext = m_arDistance[ny * m_nWidth + nx];
+
+				if (nNext != INT_MAX && nNext + 1 < nDistance)
+					nDistance = nNext + 1;
+			}
+		}
+
+		if (nDistance < m_arDistance[nTile])
+		{
+			m_arDistance[nTile] = nDistance;
+			m_arTouched.push_back(nTile);
+
+			PushOpen(nDistance, nTile);
+		}
+	}
+
+	while(m_arOpen.empty() == false)
+	{
+		OpenTile open = PopOpen();
+
+		if (m_arDistance[open.nTile] != open.nDistance)
+			continue;
+
+		int tx = open.nTile % m_nWidth;
+		int ty = open.nTile / m_nWidth;
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = tx + N_STEP_X[nDir];
+			int ny = ty + N_STEP_Y[nDir];
+
+			if (nx < 0 || ny < 0 || nx >= m_nWidth || ny >= m_nHeight)
+				continue;
+
+			int nNext = ny * m_nWidth + nx;
+
+			if (m_arDistance[nNext] <= open.nDistance + 1 ||
+			   m_rGraph.IsBlocked(nx, ny) == true)
+				continue;
+
+			m_arDistance[nNext] = open.nDistance + 1;
+			m_arTouched.push_back(nNext);
+
+			PushOpen(open.nDistance + 1, nNext);
+		}
+	}
+}
+
+void FlowField::PushOpen(int nDistance, int nTile)
+{
+	OpenTile open = { nDistance, nTile };
+
+	m_arOpen.push_back(open);
+
+	std::push_heap(m_arOpen.begin(), m_arOpen.end(), CompareOpenTiles);
+}
+
+FlowField::OpenTile FlowField::PopOpen(void)
+{
+	std::pop_heap(m_arOpen.begin(), m_arOpen.end(), CompareOpenTiles);
+
+	OpenTile open = m_arOpen.back();
+
+	m_arOpen.pop_back();
+
+	return open;
+}
+
+void FlowField::UpdateDirection(int nTile)
+{
+	// Step to neighbor closest to goal
+
+	BYTE bDir = DIRECTION_NONE;
+
+	int nBest = m_arDistance[nTile];
+
+	if (nBest != INT_MAX && nBest != 0)
+	{
+		int tx = nTile % m_nWidth;
+		int ty = nTile / m_nWidth;
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = tx + N_STEP_X[nDir];
+			int ny = ty + N_STEP_Y[nDir];
+
+			if (nx < 0 || ny < 0 || nx >= m_nWidth || ny >= m_nHeight)
+				continue;
+
+			int nNext = m_arDistance[ny * m_nWidth + nx];
+
+			if (nNext < nBest)
+			{
+				nBest = nNext;
+				bDir = BYTE(nDir);
+			}
+		}
+	}
+
+	m_arDirection[nTile] = bDir;
+}
+
+void FlowField::SortGoals(PointArray& rarGoals)
+{
+	std::sort(rarGoals.begin(), rarGoals.end(), ComparePoints);
+
+	PointArray::iterator posEnd = rarGoals.begin();
+
+	for(PointArrayIterator pos = rarGoals.begin();
+		pos != rarGoals.end();
+		pos++)
+	{
+		if (posEnd == rarGoals.begin() ||
+		   ComparePoints(*(posEnd - 1), *pos) == true)
+			*posEnd++ = *pos;
+	}
+
+	rarGoals.erase(posEnd, rarGoals.end());
+}
+
+bool FlowField::ComparePoints(const POINT& rptLeft, const POINT& rptRight)
+{
+	if (rptLeft.y != rptRight.y)
+		return rptLeft.y < rptRight.y;
+
+	return rptLeft.x < rptRight.x;
+}
+
+bool FlowField::CompareOpenTiles(const OpenTile& rLeft,
+								 const OpenTile& rRight)
+{
+	// Heap keeps lowest distance on top
+
+	return rLeft.nDistance > rRight.nDistance;
+}
+
+
+/*----------------------------------------------------------*\
+| NavigationGraph implementation
+\*----------------------------------------------------------*/
+
+NavigationGraph::NavigationGraph(TileLayer& rLayer):
+								 m_rLayer(rLayer),
+								 m_nWidth(0),
+								 m_nHeight(0),
+								 m_nClustersWidth(0),
+								 m_nClustersHeight(0),
+								 m_dwTileStamp(0),
+								 m_bInvalid(true),
+								 m_dwVersion(0),
+								 m_nRepairs(0)
+{
+}
+
+NavigationGraph::~NavigationGraph(void)
+{
+	for(FlowFieldArrayIterator pos = m_arFlowFields.begin();
+		pos != m_arFlowFields.end();
+		pos++)
+	{
+		delete *pos;
+	}
+}
+
+void NavigationGraph::Invalidate(void)
+{
+	m_bInvalid = true;
+}
+
+void NavigationGraph::Repair(void)
+{
+	// Templates may have changed collision flags, start over
+
+	if (true == m_bInvalid ||
+	   m_dwTileStamp != m_rLayer.GetMapConst().GetTileStamp())
+	{
+		Build();
+		return;
+	}
+
+	if (m_arDirtyClusters.empty() == true)
+		return;
+
+	// Entrances on all borders of changed clusters are rebuilt,
+	// so paths are recalculated in neighbors sharing those borders
+
+	std::vector<int> arBorders;
+	std::vector<int> arClusters;
+
+	for(std::vector<int>::iterator pos = m_arDirtyClusters.begin();
+		pos != m_arDirtyClusters.end();
+		pos++)
+	{
+		int nCluster = *pos;
+		int cx = nCluster % m_nClustersWidth;
+		int cy = nCluster / m_nClustersWidth;
+
+		arBorders.push_back(nCluster * 2);
+		arBorders.push_back(nCluster * 2 + 1);
+
+		arClusters.push_back(nCluster);
+
+		if (cx > 0)
+		{
+			arBorders.push_back((nCluster - 1) * 2);
+			arClusters.push_back(nCluster - 1);
+		}
+
+		if (cy > 0)
+		{
+			arBorders.push_back((nCluster - m_nClustersWidth) * 2 + 1);
+			arClusters.push_back(nCluster - m_nClustersWidth);
+		}
+
+		if (cx < m_nClustersWidth - 1)
+			arClusters.push_back(nCluster + 1);
+
+		if (cy < m_nClustersHeight - 1)
+			arClusters.push_back(nCluster + m_nClustersWidth);
+
+		m_arDirty[nCluster] = FALSE;
+	}
+
+	m_nRepairs += int(m_arDirtyClusters.size());
+	m_arDirtyClusters.clear();
+
+	std::sort(arBorders.begin(), arBorders.end());
+	arBorders.erase(std::unique(arBorders.begin(), arBorders.end()),
+		arBorders.end());
+
+	std::sort(arClusters.begin(), arClusters.end());
+	arClusters.erase(std::unique(arClusters.begin(), arClusters.end()),
+		arClusters.end());
+
+	for(std::vector<int>::iterator pos = arBorders.begin();
+		pos != arBorders.end();
+		pos++)
+	{
+		RemoveBorder(*pos);
+		BuildBorder(*pos);
+	}
+
+	for(std::vector<int>::iterator pos = arClusters.begin();
+		pos != arClusters.end();
+		pos++)
+	{
+		BuildEdges(*pos);
+	}
+
+	m_dwVersion++;
+}
+
+bool NavigationGraph::IsBlocked(int tx, int ty) const
+{
+	return m_arBlocked[ty * m_nWidth + tx] != FALSE;
+}
+
+int NavigationGraph::GetCluster(int tx, int ty) const
+{
+	return (ty / CLUSTER_SIZE) * m_nClustersWidth + tx / CLUSTER_SIZE;
+}
+
+Rect NavigationGraph::GetClusterRange(int nCluster) const
+{
+	int x = (nCluster % m_nClustersWidth) * CLUSTER_SIZE;
+	int y = (nCluster / m_nClustersWidth) * CLUSTER_SIZE;
+
+	return Rect(x, y, min(x + CLUSTER_SIZE, m_nWidth),
+		min(y + CLUSTER_SIZE, m_nHeight));
+}
+
+int NavigationGraph::SearchCluster(int nCluster, int x, int y)
+{
+	std::fill(m_arSteps.begin(), m_arSteps.end(), INT_MAX);
+
+	if (IsBlocked(x, y) == true)
+		return 0;
+
+	// Breadth first, all steps cost the same
+
+	Rect rcCluster = GetClusterRange(nCluster);
+
+	m_arQueue.clear();
+
+	int nOrigin = GetStepIndex(nCluster, x, y);
+
+	m_arSteps[nOrigin] = 0;
+	m_arQueue.push_back(nOrigin);
+
+	for(size_t n = 0; n < m_arQueue.size(); n++)
+	{
+		int nIndex = m_arQueue[n];
+		int nSteps = m_arSteps[nIndex] + 1;
+
+		int cx = rcCluster.left + nIndex % CLUSTER_SIZE;
+		int cy = rcCluster.top + nIndex / CLUSTER_SIZE;
+
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = cx + N_STEP_X[nDir];
+			int ny = cy + N_STEP_Y[nDir];
+
+			if (nx < rcCluster.left || nx >= rcCluster.right ||
+			   ny < rcCluster.top || ny >= rcCluster.bottom)
+				continue;
+
+			int nNext = GetStepIndex(nCluster, nx, ny);
+
+			if (m_arSteps[nNext] != INT_MAX || IsBlocked(nx, ny) == true)
+				continue;
+
+			m_arSteps[nNext] = nSteps;
+			m_arQueue.push_back(nNext);
+		}
+	}
+
+	return int(m_arQueue.size());
+}
+
+bool NavigationGraph::FindLocalPath(int nCluster,
+									const POINT& rptFrom,
+									const POINT& rptTo,
+									PointArray& rarOutPath,
+									int* pnOutExpanded)
+{
+	// Search from destination, then walk down the steps from origin
+
+	int nExpanded = SearchCluster(nCluster, rptTo.x, rptTo.y);
+
+	if (pnOutExpanded != NULL)
+		*pnOutExpanded += nExpanded;
+
+	int nSteps = GetSteps(nCluster, rptFrom.x, rptFrom.y);
+
+	if (INT_MAX == nSteps)
+		return false;
+
+	Rect rcCluster = GetClusterRange(nCluster);
+
+	POINT pt = rptFrom;
+
+	while(nSteps > 0)
+	{
+		for(int nDir = 0; nDir < 4; nDir++)
+		{
+			int nx = pt.x + N_STEP_X[nDir];
+			int ny = pt.y + N_STEP_Y[nDir];
+
+			if (nx < rcCluster.left || nx >= rcCluster.right ||
+			   ny < rcCluster.top || ny >= rcCluster.bottom)
+				continue;
+
+			if (GetSteps(nCluster, nx, ny) == nSteps - 1)
+			{
+				pt.x = nx;
+				pt.y = ny;
+				break;
+			}
+		}
+
+		rarOutPath.push_back(pt);
+		nSteps--;
+	}
+
+	return true;
+}
+
+FlowField* NavigationGraph::CreateFlowField(const PointArray& rarGoals)
+{
+	FlowField* pField = NULL;
+
+	try
+	{
+		pField = new FlowField(*this, rarGoals);
+
+		// Share with holders of the same goals
+
+		for(FlowFieldArrayIterator pos = m_arFlowFields.begin();
+			pos != m_arFlowFields.end();
+			pos++)
+		{
+			if ((*pos)->IsSameGoals(*pField) == true)
+			{
+				delete pField;
+
+				(*pos)->AddRef();
+
+				return *pos;
+			}
+		}
+
+		m_arFlowFields.push_back(pField);
+	}
+
+	catch(std::bad_alloc e)
+	{
+		delete pField;
+
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(FlowField));
+	}
+
+	pField->Update();
+
+	return pField;
+}
+
+void NavigationGraph::ReleaseFlowField(FlowField* pField)
+{
+	if (NULL == pField)
+		throw Error(Error::INVALID_PTR, __FUNCTIONW__, L"pField");
+
+	if (pField->RemoveRef() > 0)
+		return;
+
+	FlowFieldArrayIterator pos =
+		std::find(m_arFlowFields.begin(), m_arFlowFields.end(), pField);
+
+	if (pos != m_arFlowFields.end())
+		m_arFlowFields.erase(pos);
+
+	delete pField;
+}
+
+void NavigationGraph::UpdateFlowFields(void)
+{
+	for(FlowFieldArrayIterator pos = m_arFlowFields.begin();
+		pos != m_arFlowFields.end();
+		pos++)
+	{
+		(*pos)->Update();
+	}
+}
+
+void NavigationGraph::OnTileChange(int tx, int ty)
+{
+	if (true == m_bInvalid)
+		return;
+
+	// Only changes to collision affect the graph
+
+	BYTE bBlocked = ReadBlocked(tx, ty) ? TRUE : FALSE;
+
+	BYTE& rbCached = m_arBlocked[ty * m_nWidth + tx];
+
+	if (rbCached == bBlocked)
+		return;
+
+	rbCached = bBlocked;
+
+	MarkDirty(GetCluster(tx, ty));
+
+	for(FlowFieldArrayIterator pos = m_arFlowFields.begin();
+		pos != m_arFlowFields.end();
+		pos++)
+	{
+		(*pos)->OnTileChange(tx, ty);
+	}
+}
+
+void NavigationGraph::OnTilesLoad(const Rect& rrcTiles)
+{
+	if (true == m_bInvalid)
+		return;
+
+	for(int ty = rrcTiles.top; ty < rrcTiles.bottom; ty++)
+	{
+		for(int tx = rrcTiles.left; tx < rrcTiles.right; tx++)
+			OnTileChange(tx, ty);
+	}
+}
+
+DWORD NavigationGraph::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(NavigationGraph) +
+		DWORD(m_arBlocked.capacity()) +
+		DWORD(m_arNodes.capacity() * sizeof(Node)) +
+		DWORD(m_arFreeNodes.capacity() * sizeof(int)) +
+		DWORD(m_arClusterNodes.capacity() * sizeof(std::vector<int>)) +
+		DWORD(m_arDirtyClusters.capacity() * sizeof(int)) +
+		DWORD(m_arDirty.capacity()) +
+		DWORD((m_arSteps.capacity() + m_arQueue.capacity()) * sizeof(int));
+
+	for(NodeArray::const_iterator pos = m_arNodes.begin();
+		pos != m_arNodes.end();
+		pos++)
+	{
+		dwSize += DWORD(pos->arEdges.capacity() * sizeof(Edge));
+	}
+
+	for(std::vector< std::vector<int> >::const_iterator pos =
+		m_arClusterNodes.begin();
+		pos != m_arClusterNodes.end();
+		pos++)
+	{
+		dwSize += DWORD(pos->capacity() * sizeof(int));
+	}
+
+	for(FlowFieldArrayConstIterator pos = m_arFlowFields.begin();
+		pos != m_arFlowFields.end();
+		pos++)
+	{
+		dwSize += DWORD(sizeof(FlowField*)) + (*pos)->GetMemoryFootprint();
+	}
+
+	return dwSize;
+}
+
+void NavigationGraph::Build(void)
+{
+	m_nWidth = m_rLayer.GetWidth();
+	m_nHeight = m_rLayer.GetHeight();
+
+	m_nClustersWidth = (m_nWidth + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	m_nClustersHeight = (m_nHeight + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+	int nClusters = m_nClustersWidth * m_nClustersHeight;
+
+	try
+	{
+		m_arBlocked.resize(size_t(m_nWidth * m_nHeight));
+
+		m_arNodes.clear();
+		m_arFreeNodes.clear();
+
+		m_arClusterNodes.clear();
+		m_arClusterNodes.resize(size_t(nClusters));
+
+		m_arDirty.assign(size_t(nClusters), FALSE);
+		m_arDirtyClusters.clear();
+
+		m_arSteps.resize(CLUSTER_SIZE * CLUSTER_SIZE);
+		m_arQueue.reserve(CLUSTER_SIZE * CLUSTER_SIZE);
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			m_nWidth * m_nHeight + nClusters * sizeof(std::vector<int>));
+	}
+
+	// Cache collision flags
+
+	for(int ty = 0; ty < m_nHeight; ty++)
+	{
+		for(int tx = 0; tx < m_nWidth; tx++)
+		{
+			m_arBlocked[ty * m_nWidth + tx] =
+				ReadBlocked(tx, ty) ? TRUE : FALSE;
+		}
+	}
+
+	// Find entrances on east and south border of each cluster,
+	// then connect entrances within clusters
+
+	for(int nCluster = 0; nCluster < nClusters; nCluster++)
+	{
+		BuildBorder(nCluster * 2);
+		BuildBorder(nCluster * 2 + 1);
+	}
+
+	for(int nCluster = 0; nCluster < nClusters; nCluster++)
+		BuildEdges(nCluster);
+
+	m_dwTileStamp = m_rLayer.GetMapConst().GetTileStamp();
+	m_bInvalid = false;
+	m_dwVersion++;
+
+	// Flow fields are recomputed on their next update
+
+	for(FlowFieldArrayIterator pos = m_arFlowFields.begin();
+		pos != m_arFlowFields.end();
+		pos++)
+	{
+		(*pos)->Invalidate();
+	}
+}
+
+bool NavigationGraph::ReadBlocked(int tx, int ty) const
+{
+	// Empty tiles do not collide. Streamed tiles are not paged in,
+	// paths avoid them until streaming loads them and they are read again
+
+	if (m_rLayer.IsTileLoaded(tx, ty) == false)
+		return true;
+
+	const Tile* pTile = m_rLayer.GetTileConst(tx, ty);
+
+	return (pTile != NULL && pTile->IsFlagSet(Tile::CLIP) == true);
+}
+
+void NavigationGraph::BuildBorder(int nBorder)
+{
+	// Even borders are east of cluster, odd ones south
+
+	int nCluster = nBorder / 2;
+	bool bSouth = (nBorder & 1) != 0;
+
+	int cx = nCluster % m_nClustersWidth;
+	int cy = nCluster / m_nClustersWidth;
+
+	if ((false == bSouth && cx + 1 >= m_nClustersWidth) ||
+	   (true == bSouth && cy + 1 >= m_nClustersHeight))
+		return;
+
+	// Tiles along the border on this side of it
+
+	Rect rcCluster = GetClusterRange(nCluster);
+
+	int nFirst = bSouth ? rcCluster.left : rcCluster.top;
+	int nEnd = bSouth ? rcCluster.right : rcCluster.bottom;
+
+	int nAcross = bSouth ? rcCluster.bottom - 1 : rcCluster.right - 1;
+
+	// Walk open segments, where tiles on both sides are open
+
+	int nStart = INVALID_INDEX;
+
+	for(int n = nFirst; n <= nEnd; n++)
+	{
+		bool bOpen = false;
+
+		if (n < nEnd)
+		{
+			bOpen = bSouth ?
+				(IsBlocked(n, nAcross) == false &&
+				 IsBlocked(n, nAcross + 1) == false) :
+				(IsBlocked(nAcross, n) == false &&
+				 IsBlocked(nAcross + 1, n) == false);
+		}
+
+		if (true == bOpen)
+		{
+			if (INVALID_INDEX == nStart)
+				nStart = n;
+
+			continue;
+		}
+
+		if (INVALID_INDEX == nStart)
+			continue;
+
+		// Narrow segments get one entrance in the middle,
+		// wide ones an entrance at each end
+
+		int nLength = n - nStart;
+
+		int nEntrances[2] = { nStart + nLength / 2, INVALID_INDEX };
+
+		if (nLength >= WIDE_ENTRANCE)
+		{
+			nEntrances[0] = nStart;
+			nEntrances[1] = n - 1;
+		}
+
+		for(int e = 0; e < 2 && nEntrances[e] != INVALID_INDEX; e++)
+		{
+			if (true == bSouth)
+			{
+				AddEntrance(nBorder, nEntrances[e], nAcross,
+					nEntrances[e], nAcross + 1);
+			}
+			else
+			{
+				AddEntrance(nBorder, nAcross, nEntrances[e],
+					nAcross + 1, nEntrances[e]);
+			}
+		}
+
+		nStart = INVALID_INDEX;
+	}
+}
+
+void NavigationGraph::RemoveBorder(int nBorder)
+{
+	int nCluster = nBorder / 2;
+
+	int nClusters[2] = { nCluster, INVALID_INDEX };
+
+	if (nBorder & 1)
+	{
+		if (nCluster / m_nClustersWidth + 1 < m_nClustersHeight)
+			nClusters[1] = nCluster + m_nClustersWidth;
+	}
+	else
+	{
+		if (nCluster % m_nClustersWidth + 1 < m_nClustersWidth)
+			nClusters[1] = nCluster + 1;
+	}
+
+	for(int c = 0; c < 2 && nClusters[c] != INVALID_INDEX; c++)
+	{
+		std::vector<int>& rarNodes = m_arClusterNodes[nClusters[c]];
+
+		for(size_t n = 0; n < rarNodes.size();)
+		{
+			if (m_arNodes[rarNodes[n]].nBorder == nBorder)
+				RemoveNode(rarNodes[n]);
+			else
+				n++;
+		}
+	}
+}
+
+void NavigationGraph::BuildEdges(int nCluster)
+{
+	const std::vector<int>& rarNodes = m_arClusterNodes[nCluster];
+
+	for(std::vector<int>::const_iterator pos = rarNodes.begin();
+		pos != rarNodes.end();
+		pos++)
+	{
+		Node& rNode = m_arNodes[*pos];
+
+		rNode.arEdges.clear();
+
+		SearchCluster(nCluster, rNode.x, rNode.y);
+
+		for(std::vector<int>::const_iterator posOther = rarNodes.begin();
+			posOther != rarNodes.end();
+			posOther++)
+		{
+			if (posOther == pos)
+				continue;
+
+			const Node& rOther = m_arNodes[*posOther];
+
+			int nSteps = GetSteps(nCluster, rOther.x, rOther.y);
+
+			if (INT_MAX == nSteps)
+				continue;
+
+			Edge edge = { *posOther, nSteps };
+			rNode.arEdges.push_back(edge);
+		}
+	}
+}
+
+void NavigationGraph::AddEntrance(int nBorder, int x1, int y1, int x2, int y2)
+{
+	int nFirst = AddNode(x1, y1, nBorder);
+	int nSecond = AddNode(x2, y2, nBorder);
+
+	m_arNodes[nFirst].nTwin = nSecond;
+	m_arNodes[nSecond].nTwin = nFirst;
+}
+
+int NavigationGraph::AddNode(int x, int y, int nBorder)
+{
+	int nNode = INVALID_INDEX;
+
+	if (m_arFreeNodes.empty() == false)
+	{
+		nNode = m_arFreeNodes.back();
+		m_arFreeNodes.pop_back();
+	}
+	else
+	{
+		nNode = int(m_arNodes.size());
+		m_arNodes.resize(m_arNodes.size() + 1);
+	}
+
+	Node& rNode = m_arNodes[nNode];
+
+	rNode.x = x;
+	rNode.y = y;
+	rNode.nCluster = GetCluster(x, y);
+	rNode.nBorder = nBorder;
+	rNode.nTwin = INVALID_INDEX;
+
+	m_arClusterNodes[rNode.nCluster].push_back(nNode);
+
+	return nNode;
+}
+
+void NavigationGraph::RemoveNode(int nNode)
+{
+	Node& rNode = m_arNodes[nNode];
+
+	std::vector<int>& rarNodes = m_arClusterNodes[rNode.nCluster];
+
+	rarNodes.erase(std::find(rarNodes.begin(), rarNodes.end(), nNode));
+
+	rNode.nCluster = INVALID_INDEX;
+	rNode.nBorder = INVALID_INDEX;
+	rNode.nTwin = INVALID_INDEX;
+	rNode.arEdges.clear();
+
+	m_arFreeNodes.push_back(nNode);
+}
+
+void NavigationGraph::MarkDirty(int nCluster)
+{
+	if (TRUE == m_arDirty[nCluster])
+		return;
+
+	m_arDirty[nCluster] = TRUE;
+	m_arDirtyClusters.push_back(nCluster);
+}
+
+
+/*----------------------------------------------------------*\
+| Navigation implementation
+\*----------------------------------------------------------*/
+
+Navigation::Navigation(TileMap& rMap):	m_rMap(rMap),
+										m_nNextID(1),
+										m_nExpansionBudget(DEFAULT_EXPANSION_BUDGET),
+										m_nExpansions(0)
+{
+}
+
+Navigation::~Navigation(void)
+{
+	Empty();
+}
+
+int Navigation::RequestPath(TileLayer* pLayer,
+							const POINT& rptStart,
+							const POINT& rptGoal)
+{
+	if (NULL == pLayer)
+		throw Error(Error::INVALID_PTR, __FUNCTIONW__, L"pLayer");
+
+	Request* pRequest = NULL;
+
+	try
+	{
+		pRequest = new Request;
+
+		m_arRequests.push_back(pRequest);
+	}
+
+	catch(std::bad_alloc e)
+	{
+		delete pRequest;
+
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Request));
+	}
+
+	pRequest->nID = m_nNextID++;
+	pRequest->pLayer = pLayer;
+	pRequest->ptStart = rptStart;
+	pRequest->ptGoal = rptGoal;
+	pRequest->nStatus = STATUS_PENDING;
+	pRequest->dwVersion = 0;
+	pRequest->bStarted = false;
+
+	return pRequest->nID;
+}
+
+Navigation::Status Navigation::GetPathStatus(int nRequest) const
+{
+	Request* pRequest = GetRequest(nRequest);
+
+	return (NULL == pRequest) ? STATUS_INVALID : pRequest->nStatus;
+}
+
+const PointArray& Navigation::GetPath(int nRequest) const
+{
+	Request* pRequest = GetRequest(nRequest);
+
+	if (NULL == pRequest)
+		throw Error(Error::INVALID_INDEX, __FUNCTIONW__, L"nRequest");
+
+	return pRequest->arPath;
+}
+
+void Navigation::ReleasePath(int nRequest)
+{
+	for(RequestArrayIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		if ((*pos)->nID == nRequest)
+		{
+			delete *pos;
+			m_arRequests.erase(pos);
+			return;
+		}
+	}
+}
+
+int Navigation::GetPendingCount(void) const
+{
+	int nPending = 0;
+
+	for(RequestArrayConstIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		if (STATUS_PENDING == (*pos)->nStatus)
+			nPending++;
+	}
+
+	return nPending;
+}
+
+bool Navigation::FindPath(TileLayer* pLayer,
+						  const POINT& rptStart,
+						  const POINT& rptGoal,
+						  PointArray& rarOutPath)
+{
+	if (NULL == pLayer)
+		throw Error(Error::INVALID_PTR, __FUNCTIONW__, L"pLayer");
+
+	Request request;
+
+	request.nID = INVALID_INDEX;
+	request.pLayer = pLayer;
+	request.ptStart = rptStart;
+	request.ptGoal = rptGoal;
+	request.nStatus = STATUS_PENDING;
+	request.dwVersion = 0;
+	request.bStarted = false;
+
+	Search(request, INT_MAX);
+
+	rarOutPath.swap(request.arPath);
+
+	return (STATUS_FOUND == request.nStatus);
+}
+
+int Navigation::GetExpansionBudget(void) const
+{
+	return m_nExpansionBudget;
+}
+
+void Navigation::SetExpansionBudget(int nBudget)
+{
+	if (nBudget <= 0)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	m_nExpansionBudget = nBudget;
+}
+
+int Navigation::GetExpansionCount(void) const
+{
+	return m_nExpansions;
+}
+
+void Navigation::Update(void)
+{
+	// Serve pending requests in order made until budget runs out,
+	// unfinished searches continue on next update
+
+	m_nExpansions = 0;
+
+	// Bring flow fields up to date with tile changes, so that actors
+	// can sample them without changing anything on the next update
+
+	for(int nLayer = 0; nLayer < m_rMap.GetLayerCount(); nLayer++)
+	{
+		NavigationGraph* pGraph = m_rMap.GetLayer(nLayer)->m_pNavigation;
+
+		if (pGraph != NULL)
+			pGraph->UpdateFlowFields();
+	}
+
+	for(RequestArrayIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end() && m_nExpansions < m_nExpansionBudget;
+		pos++)
+	{
+		if (STATUS_PENDING == (*pos)->nStatus)
+			m_nExpansions += Search(**pos, m_nExpansionBudget - m_nExpansions);
+	}
+}
+
+void Navigation::OnLayerRemoved(TileLayer* pLayer)
+{
+	for(RequestArrayIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		Request& rRequest = **pos;
+
+		if (rRequest.pLayer != pLayer)
+			continue;
+
+		if (STATUS_PENDING == rRequest.nStatus)
+			rRequest.nStatus = STATUS_NOT_FOUND;
+
+		rRequest.pLayer = NULL;
+
+		rRequest.arOpen.clear();
+		rRequest.arCost.clear();
+		rRequest.arParent.clear();
+		rRequest.arStartEdges.clear();
+		rRequest.arGoalSteps.clear();
+	}
+}
+
+DWORD Navigation::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(Navigation) +
+		DWORD(m_arRequests.capacity() * sizeof(Request*));
+
+	for(RequestArrayConstIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		const Request& rRequest = **pos;
+
+		dwSize += sizeof(Request) +
+			DWORD(rRequest.arOpen.capacity() * sizeof(OpenNode)) +
+			DWORD((rRequest.arCost.capacity() + rRequest.arParent.capacity() +
+				rRequest.arGoalSteps.capacity()) * sizeof(int)) +
+			DWORD(rRequest.arStartEdges.capacity() *
+				sizeof(NavigationGraph::Edge)) +
+			DWORD(rRequest.arPath.capacity() * sizeof(POINT));
+	}
+
+	return dwSize;
+}
+
+void Navigation::Empty(void)
+{
+	for(RequestArrayIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		delete *pos;
+	}
+
+	m_arRequests.clear();
+}
+
+int Navigation::Search(Request& rRequest, int nBudget)
+{
+	NavigationGraph& rGraph = *rRequest.pLayer->GetNavigationGraph();
+
+	rGraph.Repair();
+
+	// Start over if graph changed since search started
+
+	int nExpanded = 0;
+
+	if (false == rRequest.bStarted || rRequest.dwVersion != rGraph.GetVersion())
+	{
+		nExpanded += StartSearch(rRequest, rGraph);
+
+		if (rRequest.nStatus != STATUS_PENDING)
+			return nExpanded;
+	}
+
+	// Search abstract graph, start and goal are placed past the last node
+
+	int nStart = rGraph.GetNodeCount();
+	int nGoal = nStart + 1;
+
+	while(rRequest.arOpen.empty() == false)
+	{
+		if (nExpanded >= nBudget)
+			return nExpanded;
+
+		std::pop_heap(rRequest.arOpen.begin(), rRequest.arOpen.end(),
+			CompareOpenNodes);
+
+		OpenNode open = rRequest.arOpen.back();
+		rRequest.arOpen.pop_back();
+
+		if (open.nCost != rRequest.arCost[open.nNode])
+			continue;
+
+		nExpanded++;
+
+		if (nGoal == open.nNode)
+			return nExpanded + FinishSearch(rRequest, rGraph);
+
+		const NavigationGraph::EdgeArray* parEdges = &rRequest.arStartEdges;
+
+		if (open.nNode != nStart)
+		{
+			const NavigationGraph::Node& rNode = rGraph.GetNode(open.nNode);
+
+			parEdges = &rNode.arEdges;
+
+			// Cross the border
+
+			PushOpen(rRequest, rNode.nTwin, open.nCost + 1,
+				open.nNode, rGraph);
+
+			// Reach goal from entrances of its cluster
+
+			if (rRequest.arGoalSteps[open.nNode] != INT_MAX)
+			{
+				PushOpen(rRequest, nGoal,
+					open.nCost + rRequest.arGoalSteps[open.nNode],
+					open.nNode, rGraph);
+			}
+		}
+
+		for(NavigationGraph::EdgeArrayConstIterator pos = parEdges->begin();
+			pos != parEdges->end();
+			pos++)
+		{
+			PushOpen(rRequest, pos->nNode, open.nCost + pos->nCost,
+				open.nNode, rGraph);
+		}
+	}
+
+	rRequest.nStatus = STATUS_NOT_FOUND;
+
+	return nExpanded;
+}
+
+int Navigation::StartSearch(Request& rRequest, NavigationGraph& rGraph)
+{
+	rRequest.bStarted = true;
+	rRequest.dwVersion = rGraph.GetVersion();
+
+	rRequest.arOpen.clear();
+	rRequest.arStartEdges.clear();
+	rRequest.arPath.clear();
+
+	const POINT& rptStart = rRequest.ptStart;
+	const POINT& rptGoal = rRequest.ptGoal;
+
+	int nWidth = rRequest.pLayer->GetWidth();
+	int nHeight = rRequest.pLayer->GetHeight();
+
+	if (rptStart.x < 0 || rptStart.y < 0 ||
+	   rptStart.x >= nWidth || rptStart.y >= nHeight ||
+	   rptGoal.x < 0 || rptGoal.y < 0 ||
+	   rptGoal.x >= nWidth || rptGoal.y >= nHeight ||
+	   rGraph.IsBlocked(rptStart.x, rptStart.y) == true ||
+	   rGraph.IsBlocked(rptGoal.x, rptGoal.y) == true)
+	{
+		rRequest.nStatus = STATUS_NOT_FOUND;
+		return 0;
+	}
+
+	int nExpanded = 0;
+
+	int nStartCluster = rGraph.GetCluster(rptStart.x, rptStart.y);
+	int nGoalCluster = rGraph.GetCluster(rptGoal.x, rptGoal.y);
+
+	// Try without leaving the cluster first
+
+	if (nStartCluster == nGoalCluster)
+	{
+		rRequest.arPath.push_back(rptStart);
+
+		if (rGraph.FindLocalPath(nStartCluster, rptStart, rptGoal,
+		   rRequest.arPath, &nExpanded) == true)
+		{
+			rRequest.nStatus = STATUS_FOUND;
+			return nExpanded;
+		}
+
+		rRequest.arPath.clear();
+	}
+
+	int nNodes = rGraph.GetNodeCount();
+
+	rRequest.arCost.assign(size_t(nNodes + 2), INT_MAX);
+	rRequest.arParent.assign(size_t(nNodes + 2), INVALID_INDEX);
+	rRequest.arGoalSteps.assign(size_t(nNodes), INT_MAX);
+
+	// Connect start to entrances of its cluster
+
+	nExpanded += rGraph.SearchCluster(nStartCluster, rptStart.x, rptStart.y);
+
+	const std::vector<int>& rarStartNodes =
+		rGraph.GetClusterNodes(nStartCluster);
+
+	for(std::vector<int>::const_iterator pos = rarStartNodes.begin();
+		pos != rarStartNodes.end();
+		pos++)
+	{
+		const NavigationGraph::Node& rNode = rGraph.GetNode(*pos);
+
+		int nSteps = rGraph.GetSteps(nStartCluster, rNode.x, rNode.y);
+
+		if (nSteps != INT_MAX)
+		{
+			NavigationGraph::Edge edge = { *pos, nSteps };
+			rRequest.arStartEdges.push_back(edge);
+		}
+	}
+
+	// Connect entrances of goal cluster to goal
+
+	nExpanded += rGraph.SearchCluster(nGoalCluster, rptGoal.x, rptGoal.y);
+
+	const std::vector<int>& rarGoalNodes =
+		rGraph.GetClusterNodes(nGoalCluster);
+
+	for(std::vector<int>::const_iterator pos = rarGoalNodes.begin();
+		pos != rarGoalNodes.end();
+		pos++)
+	{
+		const NavigationGraph::Node& rNode = rGraph.GetNode(*pos);
+
+		rRequest.arGoalSteps[*pos] =
+			rGraph.GetSteps(nGoalCluster, rNode.x, rNode.y);
+	}
+
+	rRequest.arCost[nNodes] = 0;
+
+	OpenNode open = { abs(rptGoal.x - rptStart.x) +
+		abs(rptGoal.y - rptStart.y), 0, nNodes };
+
+	rRequest.arOpen.push_back(open);
+
+	return nExpanded;
+}
+
+int Navigation::FinishSearch(Request& rRequest, NavigationGraph& rGraph)
+{
+	int nStart = rGraph.GetNodeCount();
+	int nGoal = nStart + 1;
+
+	// Collect entrances passed, from goal back to start
+
+	PointArray arWaypoints;
+
+	arWaypoints.push_back(rRequest.ptGoal);
+
+	for(int nNode = rRequest.arParent[nGoal];
+		nNode != nStart;
+		nNode = rRequest.arParent[nNode])
+	{
+		const NavigationGraph::Node& rNode = rGraph.GetNode(nNode);
+
+		POINT pt = { rNode.x, rNode.y };
+		arWaypoints.push_back(pt);
+	}
+
+	arWaypoints.push_back(rRequest.ptStart);
+
+	// Refine into tiles: cross borders between twins,
+	// search clusters between entrances of the same cluster
+
+	int nExpanded = 0;
+
+	rRequest.arPath.clear();
+	rRequest.arPath.push_back(rRequest.ptStart);
+
+	for(PointArray::reverse_iterator pos = arWaypoints.rbegin() + 1;
+		pos != arWaypoints.rend();
+		pos++)
+	{
+		const POINT& rptFrom = rRequest.arPath.back();
+
+		if (rptFrom.x == pos->x && rptFrom.y == pos->y)
+			continue;
+
+		int nFromCluster = rGraph.GetCluster(rptFrom.x, rptFrom.y);
+
+		if (nFromCluster != rGraph.GetCluster(pos->x, pos->y))
+		{
+			rRequest.arPath.push_back(*pos);
+		}
+		else
+		{
+			POINT ptFrom = rptFrom;
+
+			rGraph.FindLocalPath(nFromCluster, ptFrom, *pos,
+				rRequest.arPath, &nExpanded);
+		}
+	}
+
+	rRequest.nStatus = STATUS_FOUND;
+
+	// Search state is no longer needed
+
+	rRequest.arOpen.clear();
+	rRequest.arCost.clear();
+	rRequest.arParent.clear();
+	rRequest.arStartEdges.clear();
+	rRequest.arGoalSteps.clear();
+
+	return nExpanded;
+}
+
+void Navigation::PushOpen(Request& rRequest,
+						  int nNode,
+						  int nCost,
+						  int nParent,
+						  const NavigationGraph& rGraph)
+{
+	if (nCost >= rRequest.arCost[nNode])
+		return;
+
+	rRequest.arCost[nNode] = nCost;
+	rRequest.arParent[nNode] = nParent;
+
+	// Estimate remaining steps by manhattan distance
+
+	int nEstimate = 0;
+
+	if (nNode < rGraph.GetNodeCount())
+	{
+		const NavigationGraph::Node& rNode = rGraph.GetNode(nNode);
+
+		nEstimate = abs(rRequest.ptGoal.x - rNode.x) +
+			abs(rRequest.ptGoal.y - rNode.y);
+	}
+
+	OpenNode open = { nCost + nEstimate, nCost, nNode };
+
+	rRequest.arOpen.push_back(open);
+
+	std::push_heap(rRequest.arOpen.begin(), rRequest.arOpen.end(),
+		CompareOpenNodes);
+}
+
+Navigation::Request* Navigation::GetRequest(int nRequest) const
+{
+	for(RequestArrayConstIterator pos = m_arRequests.begin();
+		pos != m_arRequests.end();
+		pos++)
+	{
+		if ((*pos)->nID == nRequest)
+			return *pos;
+	}
+
+	return NULL;
+}
+
+bool Navigation::CompareOpenNodes(const OpenNode& rLeft,
+								  const OpenNode& rRight)
+{
+	// Heap keeps lowest score on top
+
+	return rLeft.nScore > rRight.nScore;
+}
\ No newline at end of file
@@ -0,0 +1,619 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderNavigation.h
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine path finding and flow field classes
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+#ifndef THUNDER_NAVIGATION_H
+#define THUNDER_NAVIGATION_H
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "ThunderMath.h"		// using Rect
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+namespace ThunderStorm {
+
+/*----------------------------------------------------------*\
+| Declarations
+\*----------------------------------------------------------*/
+
+class TileMap;				// referencing TileMap
+class TileLayer;			// referencing TileLayer
+class NavigationGraph;		// referencing NavigationGraph, declared below
+
+/*----------------------------------------------------------*\
+| Definitions
+\*----------------------------------------------------------*/
+
+typedef std::vector<POINT> PointArray;
+typedef std::vector<POINT>::iterator PointArrayIterator;
+typedef std::vector<POINT>::const_iterator PointArrayConstIterator;
+
+/*----------------------------------------------------------*\
+| FlowField class - steps to nearest goal from every tile
+\*----------------------------------------------------------*/
+
+class FlowField
+{
+public:
+	//
+	// Constants
+	//
+
+	// Direction of goals and tiles that cannot reach one
+	static const BYTE DIRECTION_NONE;
+
+private:
+	// Tile to propagate distance from
+
+	struct OpenTile
+	{
+		// Distance to goal
+		int nDistance;
+
+		// Tile index in layer
+		int nTile;
+	};
+
+	typedef std::vector<OpenTile> OpenTileArray;
+
+private:
+	//
+	// Members
+	//
+
+	// Graph of the layer, providing collision flags
+	NavigationGraph& m_rGraph;
+
+	// Goal tiles, sorted
+	PointArray m_arGoals;
+
+	// Layer size in tiles
+	int m_nWidth;
+	int m_nHeight;
+
+	// Steps to nearest goal for each tile, INT_MAX if none
+	std::vector<int> m_arDistance;
+
+	// Direction of next step to nearest goal for each tile
+	std::vector<BYTE> m_arDirection;
+
+	// Tiles that changed collision or became goals since last update
+	std::vector<int> m_arChanged;
+
+	// Field has to be computed from scratch
+	bool m_bInvalid;
+
+	// Changes whenever distances change
+	DWORD m_dwVersion;
+
+	// Tiles updated on last update
+	int m_nUpdated;
+
+	// Number of holders sharing this field
+	int m_nRefs;
+
+	// Propagation state
+	OpenTileArray m_arOpen;
+	std::vector<int> m_arTouched;
+
+public:
+	FlowField(NavigationGraph& rGraph, const PointArray& rarGoals);
+	~FlowField(void);
+
+public:
+	//
+	// Goals
+	//
+
+	const PointArray& GetGoals(void) const;
+	void SetGoals(const PointArray& rarGoals);
+
+	bool IsSameGoals(const FlowField& rOther) const;
+	bool IsGoal(int tx, int ty) const;
+
+	//
+	// Update
+	//
+
+	// Applies changes since last update, called by Navigation::Update
+	void Update(void);
+
+	inline DWORD GetVersion(void) const
+	{
+		return m_dwVersion;
+	}
+
+	inline int GetUpdateCount(void) const
+	{
+		return m_nUpdated;
+	}
+
+	//
+	// Sampling, in layer tile coordinates
+	//
+
+	inline int GetDistance(int tx, int ty) const
+	{
+		return m_arDistance[ty * m_nWidth + tx];
+	}
+
+	inline BYTE GetDirection(int tx, int ty) const
+	{
+		return m_arDirection[ty * m_nWidth + tx];
+	}
+
+	// Unit step towards nearest goal, zero if none or outside layer
+	Vector2 GetDirection(const Vector2& vecPos) const;
+
+	//
+	// References
+	//
+
+	int AddRef(void);
+	int RemoveRef(void);
+
+	//
+	// Events
+	//
+
+	void Invalidate(void);
+	void OnTileChange(int tx, int ty);
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+private:
+	//
+	// Private Functions
+	//
+
+	void Build(void);
+
+	void Raise(void);
+	void Lower(void);
+
+	void PushOpen(int nDistance, int nTile);
+	OpenTile PopOpen(void);
+
+	void UpdateDirection(int nTile);
+
+	static void SortGoals(PointArray& rarGoals);
+
+	static bool ComparePoints(const POINT& rptLeft, const POINT& rptRight);
+	static bool CompareOpenTiles(const OpenTile& rLeft,
+		const OpenTile& rRight);
+};
+
+/*----------------------------------------------------------*\
+| NavigationGraph class - clusters and entrances of a layer
+\*----------------------------------------------------------*/
+
+class NavigationGraph
+{
+public:
+	//
+	// Constants
+	//
+
+	// Width and height of a cluster in tiles
+	static const int CLUSTER_SIZE;
+
+	// Open border segments this wide or wider get an entrance at each end
+	static const int WIDE_ENTRANCE;
+
+	// Path within a cluster to another entrance
+
+	struct Edge
+	{
+		// Node reached
+		int nNode;
+
+		// Steps taken
+		int nCost;
+	};
+
+	typedef std::vector<Edge> EdgeArray;
+	typedef std::vector<Edge>::const_iterator EdgeArrayConstIterator;
+
+	// Entrance tile on a cluster border
+
+	struct Node
+	{
+		// Tile position in layer
+		int x;
+		int y;
+
+		// Cluster containing the tile, INVALID_INDEX if node is free
+		int nCluster;
+
+		// Border crossed by this entrance
+		int nBorder;
+
+		// Node on the other side of border
+		int nTwin;
+
+		// Paths to other entrances of the same cluster
+		EdgeArray arEdges;
+	};
+
+	typedef std::vector<Node> NodeArray;
+
+	typedef std::vector<FlowField*> FlowFieldArray;
+	typedef std::vector<FlowField*>::iterator FlowFieldArrayIterator;
+	typedef std::vector<FlowField*>::const_iterator FlowFieldArrayConstIterator;
+
+private:
+	//
+	// Members
+	//
+
+	// Layer abstracted
+	TileLayer& m_rLayer;
+
+	// Layer size in tiles and clusters
+	int m_nWidth;
+	int m_nHeight;
+	int m_nClustersWidth;
+	int m_nClustersHeight;
+
+	// Collision flag of each tile, cached from templates
+	std::vector<BYTE> m_arBlocked;
+
+	// Entrance nodes, free ones are reused
+	NodeArray m_arNodes;
+	std::vector<int> m_arFreeNodes;
+
+	// Nodes in each cluster
+	std::vector< std::vector<int> > m_arClusterNodes;
+
+	// Clusters that need to be repaired, and flag for each
+	std::vector<int> m_arDirtyClusters;
+	std::vector<BYTE> m_arDirty;
+
+	// Map tile template stamp built with
+	DWORD m_dwTileStamp;
+
+	// Graph has to be built from scratch
+	bool m_bInvalid;
+
+	// Changes whenever nodes change, searches in progress restart
+	DWORD m_dwVersion;
+
+	// Clusters repaired since creation
+	int m_nRepairs;
+
+	// Steps from search origin for each tile in a cluster
+	std::vector<int> m_arSteps;
+	std::vector<int> m_arQueue;
+
+	// Flow fields on this layer, shared by goals
+	FlowFieldArray m_arFlowFields;
+
+public:
+	NavigationGraph(TileLayer& rLayer);
+	~NavigationGraph(void);
+
+public:
+	//
+	// Graph
+	//
+
+	void Invalidate(void);
+	void Repair(void);
+
+	inline DWORD GetVersion(void) const
+	{
+		return m_dwVersion;
+	}
+
+	inline int GetRepairCount(void) const
+	{
+		return m_nRepairs;
+	}
+
+	//
+	// Tiles
+	//
+
+	inline int GetWidth(void) const
+	{
+		return m_nWidth;
+	}
+
+	inline int GetHeight(void) const
+	{
+		return m_nHeight;
+	}
+
+	bool IsBlocked(int tx, int ty) const;
+
+	int GetCluster(int tx, int ty) const;
+	Rect GetClusterRange(int nCluster) const;
+
+	//
+	// Nodes
+	//
+
+	inline int GetNodeCount(void) const
+	{
+		return int(m_arNodes.size());
+	}
+
+	inline const Node& GetNode(int nNode) const
+	{
+		return m_arNodes[nNode];
+	}
+
+	inline const std::vector<int>& GetClusterNodes(int nCluster) const
+	{
+		return m_arClusterNodes[nCluster];
+	}
+
+	//
+	// Searches within a cluster, returning number of tiles expanded
+	//
+
+	int SearchCluster(int nCluster, int x, int y);
+
+	inline int GetSteps(int nCluster, int x, int y) const
+	{
+		return m_arSteps[GetStepIndex(nCluster, x, y)];
+	}
+
+	// Appends tiles after rptFrom up to and including rptTo
+	bool FindLocalPath(int nCluster, const POINT& rptFrom,
+		const POINT& rptTo, PointArray& rarOutPath,
+		int* pnOutExpanded = NULL);
+
+	//
+	// Flow Fields
+	//
+
+	// Returns field with the same goals if one exists
+	FlowField* CreateFlowField(const PointArray& rarGoals);
+	void ReleaseFlowField(FlowField* pField);
+
+	void UpdateFlowFields(void);
+
+	inline int GetFlowFieldCount(void) const
+	{
+		return int(m_arFlowFields.size());
+	}
+
+	//
+	// Events
+	//
+
+	void OnTileChange(int tx, int ty);
+
+	// Streamed tiles not loaded yet are read as open until loaded
+	void OnTilesLoad(const Rect& rrcTiles);
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+private:
+	//
+	// Private Functions
+	//
+
+	void Build(void);
+
+	bool ReadBlocked(int tx, int ty) const;
+
+	void BuildBorder(int nBorder);
+	void RemoveBorder(int nBorder);
+	void BuildEdges(int nCluster);
+
+	void AddEntrance(int nBorder, int x1, int y1, int x2, int y2);
+	int AddNode(int x, int y, int nBorder);
+	void RemoveNode(int nNode);
+
+	void MarkDirty(int nCluster);
+
+	inline int GetStepIndex(int nCluster, int x, int y) const
+	{
+		return (y - (nCluster / m_nClustersWidth) * CLUSTER_SIZE) *
+			CLUSTER_SIZE + (x - (nCluster % m_nClustersWidth) * CLUSTER_SIZE);
+	}
+};
+
+/*----------------------------------------------------------*\
+| Navigation class - path requests answered over frames
+\*----------------------------------------------------------*/
+
+class Navigation
+{
+public:
+	//
+	// Constants
+	//
+
+	enum Status
+	{
+		// Unknown or released request
+		STATUS_INVALID,
+
+		// Still searching
+		STATUS_PENDING,
+
+		// Path found
+		STATUS_FOUND,
+
+		// No path between requested tiles
+		STATUS_NOT_FOUND
+	};
+
+	// Default tiles and nodes expanded by all requests on each update
+	static const int DEFAULT_EXPANSION_BUDGET;
+
+private:
+	// Search in abstract graph
+
+	struct OpenNode
+	{
+		// Cost so far plus estimate to goal
+		int nScore;
+
+		// Cost so far, entry is stale if node was reached cheaper since
+		int nCost;
+
+		// Node index, or start and goal past the last graph node
+		int nNode;
+	};
+
+	typedef std::vector<OpenNode> OpenNodeArray;
+
+	// Path request and its search state
+
+	struct Request
+	{
+		// Handle returned to caller
+		int nID;
+
+		// Layer searched, start and goal tiles in layer
+		TileLayer* pLayer;
+		POINT ptStart;
+		POINT ptGoal;
+
+		// Search status
+		Status nStatus;
+
+		// Graph version search was started with, restarted on change
+		DWORD dwVersion;
+		bool bStarted;
+
+		// Abstract search state
+		OpenNodeArray arOpen;
+		std::vector<int> arCost;
+		std::vector<int> arParent;
+
+		// Entrances reachable from start, steps to goal from entrances
+		NavigationGraph::EdgeArray arStartEdges;
+		std::vector<int> arGoalSteps;
+
+		// Tiles from start to goal, including both
+		PointArray arPath;
+	};
+
+	typedef std::vector<Request*> RequestArray;
+	typedef std::vector<Request*>::iterator RequestArrayIterator;
+	typedef std::vector<Request*>::const_iterator RequestArrayConstIterator;
+
+private:
+	//
+	// Members
+	//
+
+	TileMap& m_rMap;
+
+	// Requests in order made, pending ones are served first come first
+	RequestArray m_arRequests;
+
+	// Next request handle
+	int m_nNextID;
+
+	// Tiles and nodes expanded by all requests on each update
+	int m_nExpansionBudget;
+
+	// Tiles and nodes expanded on last update
+	int m_nExpansions;
+
+public:
+	Navigation(TileMap& rMap);
+	~Navigation(void);
+
+public:
+	//
+	// Requests
+	//
+
+	int RequestPath(TileLayer* pLayer, const POINT& rptStart,
+		const POINT& rptGoal);
+
+	Status GetPathStatus(int nRequest) const;
+	const PointArray& GetPath(int nRequest) const;
+
+	void ReleasePath(int nRequest);
+
+	int GetPendingCount(void) const;
+
+	// Search to completion without a budget
+	bool FindPath(TileLayer* pLayer, const POINT& rptStart,
+		const POINT& rptGoal, PointArray& rarOutPath);
+
+	//
+	// Budget
+	//
+
+	int GetExpansionBudget(void) const;
+	void SetExpansionBudget(int nBudget);
+
+	int GetExpansionCount(void) const;
+
+	//
+	// Update
+	//
+
+	void Update(void);
+
+	//
+	// Layers
+	//
+
+	void OnLayerRemoved(TileLayer* pLayer);
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+	//
+	// Deinitialization
+	//
+
+	void Empty(void);
+
+private:
+	//
+	// Private Functions
+	//
+
+	int Search(Request& rRequest, int nBudget);
+
+	int StartSearch(Request& rRequest, NavigationGraph& rGraph);
+	int FinishSearch(Request& rRequest, NavigationGraph& rGraph);
+
+	void PushOpen(Request& rRequest, int nNode, int nCost, int nParent,
+		const NavigationGraph& rGraph);
+
+	Request* GetRequest(int nRequest) const;
+
+	static bool CompareOpenNodes(const OpenNode& rLeft,
+		const OpenNode& rRight);
+};
+
+} // namespace ThunderStorm
+
+#endif // THUNDER_NAVIGATION_H
\ No newline at end of file
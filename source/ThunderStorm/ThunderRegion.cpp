@@ -30,7 +30,9 @@ using namespace ThunderStorm;
 \*----------------------------------------------------------*/
 
 const BYTE RegionSet::RGN_SIGNATURE[]		= "THR";
-const BYTE RegionSet::RGN_FORMAT_VERSION[] = { 2, 1, 0, 0 };
+const BYTE RegionSet::RGN_FORMAT_VERSION[] = { 3, 0, 0, 0 };
+const BYTE RegionSet::RGN_FORMAT_VERSION_UNPACKED[] = { 2, 1, 0, 0 };
+const int Region::WORD_BITS = 64;
 
 
 /*----------------------------------------------------------*\
@@ -248,8 +250,12 @@ void RegionSet::Deserialize(Stream& rStream)
 
 		// Validate format version
 
-		if (strncmp((char*)version, (const char*)RGN_FORMAT_VERSION,
-			sizeof(RGN_FORMAT_VERSION)))
+		bool bPacked = (0 == strncmp((char*)version,
+			(const char*)RGN_FORMAT_VERSION, sizeof(RGN_FORMAT_VERSION)));
+
+		if (false == bPacked && strncmp((char*)version,
+		   (const char*)RGN_FORMAT_VERSION_UNPACKED,
+		   sizeof(RGN_FORMAT_VERSION_UNPACKED)))
 				throw m_rEngine.GetErrors().Push(Error::FILE_VERSION,
 					__FUNCTIONW__, rStream.GetPath());
 
@@ -266,7 +272,7 @@ void RegionSet::Deserialize(Stream& rStream)
 		{	
 			Region* pNewRegion = CreateRegion();
 
-			pNewRegion->Deserialize(rStream);
+			pNewRegion->Deserialize(rStream, bPacked);
 
 			m_arRegions[n] = pNewRegion;
 		}
@@ -308,7 +314,7 @@ void RegionSet::Empty(void)
 
 Region::Region(RegionSet* pRegionSet): m_pRegionSet(pRegionSet),
 									   m_pData(NULL),
-									   m_ppData(NULL)
+									   m_nRowWords(0)
 {
 	m_psSize.cx = 0;
 	m_psSize.cy = 0;
@@ -336,49 +342,50 @@ void Region::SetSize(const SIZE& rpsSize)
 	m_psSize.cx = rpsSize.cx;
 	m_psSize.cy = rpsSize.cy;
 
-	int nSize = rpsSize.cx * rpsSize.cy;
-
-	try
-	{
-		m_pData = new BYTE[nSize];
-	}
-
-	catch(std::bad_alloc)
-	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, nSize);
-	}
+	m_nRowWords = (rpsSize.cx + WORD_BITS - 1) / WORD_BITS;
 
-	ZeroMemory(m_pData, nSize);
+	int nSize = m_nRowWords * rpsSize.cy;
 
 	try
 	{
-		m_ppData = new BYTE*[rpsSize.cy];
+		m_pData = new ULONGLONG[nSize];
 	}
 
 	catch(std::bad_alloc)
 	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, rpsSize.cy);
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			nSize * sizeof(ULONGLONG));
 	}
 
-	for(int n = 0; n < rpsSize.cy; n++)
-	{
-		m_ppData[n] = m_pData + n * rpsSize.cx;
-	}
+	ZeroMemory(m_pData, nSize * sizeof(ULONGLONG));
+}
+
+ULONGLONG* Region::GetData(void)
+{
+	return m_pData;
 }
 
-BYTE* Region::GetData1D(void)
+const ULONGLONG* Region::GetDataConst(void) const
 {
 	return m_pData;
 }
 
-BYTE** Region::GetData2D(void)
+int Region::GetRowWords(void) const
 {
-	return m_ppData;
+	return m_nRowWords;
 }
 
-const BYTE** Region::GetData2DConst(void) const
+void Region::SetPixel(int x, int y, bool bSet)
 {
-	return (const BYTE**)m_ppData;
+	_ASSERT(x >= 0 && y >= 0 && x < m_psSize.cx && y < m_psSize.cy);
+
+	ULONGLONG& rWord = m_pData[y * m_nRowWords + x / WORD_BITS];
+	ULONGLONG qwBit = ULONGLONG(1) << (x % WORD_BITS);
+
+	if (true == bSet)
+		rWord |= qwBit;
+	else
+		rWord &= ~qwBit;
 }
 
 void Region::FromSurface(LPDIRECT3DSURFACE9 pSurf, const RECT& rrcSrcRect)
@@ -424,27 +431,22 @@ void Region::FromSurface(LPDIRECT3DSURFACE9 pSurf, const RECT& rrcSrcRect)
 	
 	SetSize(psSize);
 
-	// Loop through source rect pixels, and set corresponding region cells
+	// Loop through source rect pixels, and set bits of opaque pixels
 
-	int nRectWidth = rrcSrcRect.right - rrcSrcRect.left;
-	int nExtra = lock.Pitch / 4 - nRectWidth;
+	const BYTE* pRow = (const BYTE*)lock.pBits;
 
-	DWORD* pdwCurPixel = (DWORD*)lock.pBits;
-	BYTE* pCurCell = m_pData;
-	
-	for(int y = rrcSrcRect.top;
-		y < rrcSrcRect.bottom;
-		y++, pdwCurPixel += nExtra)
+	for(int y = 0; y < psSize.cy; y++, pRow += lock.Pitch)
 	{
-		for(int x = rrcSrcRect.left;
-			x < rrcSrcRect.right;
-			x++, pdwCurPixel++, pCurCell++)
+		const DWORD* pdwCurPixel = (const DWORD*)pRow;
+		ULONGLONG* pCurWord = m_pData + y * m_nRowWords;
+
+		for(int x = 0; x < psSize.cx; x++, pdwCurPixel++)
 		{
 			if (*pdwCurPixel >> 24)
 			{
 				// Opaque pixel
 
-				*pCurCell = BYTE(1);
+				pCurWord[x / WORD_BITS] |= ULONGLONG(1) << (x % WORD_BITS);
 			}
 		}
 	}
@@ -458,47 +460,51 @@ bool Region::TestPoint(const POINT& rpt) const
 		rpt.x >= m_psSize.cx || rpt.y >= m_psSize.cy)
 		return false;
 
-	if (0 == m_ppData[rpt.y][rpt.x])
-		return false;
+	ULONGLONG qwWord = m_pData[rpt.y * m_nRowWords + rpt.x / WORD_BITS];
 
-	return true;
+	return ((qwWord >> (rpt.x % WORD_BITS)) & 1) != 0;
 }
 
 bool Region::TestRect(const RECT& rrc) const
 {
-	RECT rcTest = { rrc.left, rrc.top, rrc.right, rrc.bottom };
+	// Clip the rectangle to region bounds
 
-	// Clamp the rectangle to region bounds
+	int nLeft = max(0, int(rrc.left));
+	int nTop = max(0, int(rrc.top));
+	int nRight = min(int(m_psSize.cx), int(rrc.right));
+	int nBottom = min(int(m_psSize.cy), int(rrc.bottom));
 
-	if (rcTest.left < 0)
-		rcTest.left = 0;
-	else if (rcTest.left >= m_psSize.cx)
-		rcTest.left = m_psSize.cx - 1;
+	if (nLeft >= nRight || nTop >= nBottom)
+		return false;
 
-	if (rcTest.top < 0)
-		rcTest.top = 0;
-	else if (rcTest.top >= m_psSize.cy)
-		rcTest.top = m_psSize.cy - 1;
+	// Mask off pixels outside of the rectangle in first and last words,
+	// then test whole words of every row
 
-	if (rcTest.right < 0)
-		rcTest.right = 0;
-	else if (rcTest.right >= m_psSize.cx)
-		rcTest.right = m_psSize.cx - 1;
+	int nFirstWord = nLeft / WORD_BITS;
+	int nLastWord = (nRight - 1) / WORD_BITS;
 
-	if (rcTest.bottom < 0)
-		rcTest.bottom = 0;
-	else if (rcTest.bottom >= m_psSize.cy)
-		rcTest.bottom = m_psSize.cy - 1;
+	ULONGLONG qwFirstMask = ~ULONGLONG(0) << (nLeft % WORD_BITS);
+	ULONGLONG qwLastMask = ~ULONGLONG(0) >>
+		(WORD_BITS - 1 - (nRight - 1) % WORD_BITS);
 
-	// For every cell that lies in rrcTest, see if it's non-zero
-	// If yes, we flag collision
+	if (nFirstWord == nLastWord)
+		qwFirstMask = qwLastMask = qwFirstMask & qwLastMask;
 
-	for(int y = rcTest.top; y < (rcTest.bottom + 1); y++)
+	for(int y = nTop; y < nBottom; y++)
 	{
-		for(int x = rcTest.left; x < (rcTest.right + 1); x++)
+		const ULONGLONG* pRow = m_pData + y * m_nRowWords;
+
+		if (pRow[nFirstWord] & qwFirstMask)
+			return true;
+
+		for(int w = nFirstWord + 1; w < nLastWord; w++)
 		{
-			if (m_ppData[y][x] != 0) return true;
+			if (pRow[w] != 0)
+				return true;
 		}
+
+		if (pRow[nLastWord] & qwLastMask)
+			return true;
 	}
 
 	return false;
@@ -506,56 +512,38 @@ bool Region::TestRect(const RECT& rrc) const
 
 bool Region::TestRegion(const Region& rRegion, const POINT& rptOffset) const
 {
-	// Calculate other region's bounding rectangle
-	
-	RECT rcTest = { rptOffset.x, rptOffset.y,
-		rptOffset.x + rRegion.GetSize().cx,
-		rptOffset.y + rRegion.GetSize().cy };
-
-	// Clamp it to this region's bounds
-
-	if (rcTest.left < 0)
-		rcTest.left = 0;
-	else if (rcTest.left >= m_psSize.cx)
-		rcTest.left = m_psSize.cx - 1;
-
-	if (rcTest.top < 0)
-		rcTest.top = 0;
-	else if (rcTest.top >= m_psSize.cy)
-		rcTest.top = m_psSize.cy - 1;
+	// Calculate intersection with other region placed at offset
 
-	if (rcTest.right < 0)
-		rcTest.right = 0;
-	else if (rcTest.right >= m_psSize.cx)
-		rcTest.right = m_psSize.cx - 1;
+	int nLeft = max(0, int(rptOffset.x));
+	int nTop = max(0, int(rptOffset.y));
+	int nRight = min(int(m_psSize.cx), int(rptOffset.x + rRegion.m_psSize.cx));
+	int nBottom = min(int(m_psSize.cy), int(rptOffset.y + rRegion.m_psSize.cy));
 
-	if (rcTest.bottom < 0)
-		rcTest.bottom = 0;
-	else if (rcTest.bottom >= m_psSize.cy)
-		rcTest.bottom = m_psSize.cy - 1;
+	if (nLeft >= nRight || nTop >= nBottom)
+		return false;
 
-	// Make sure the other region's rect is not
-	// out of bounds after clamping
+	// For every row in the intersection, shift other region's row
+	// to line up with words of this row and AND them together.
+	// Padding bits past the end of rows are always zero,
+	// so pixels outside of either region never match.
 
-	if ((rcTest.right - rcTest.left) > rRegion.GetSize().cx ||
-	   (rcTest.bottom - rcTest.top) > rRegion.GetSize().cy) return false;
+	int nFirstWord = nLeft / WORD_BITS;
+	int nLastWord = (nRight - 1) / WORD_BITS;
 
-	// For every cell that lies in rrcTest in this region, see if it's non-zero
-	// Also see if that region's corresponding cell is non-zero
-	// If so, we flag a collision
+	for(int y = nTop; y < nBottom; y++)
+	{
+		const ULONGLONG* pThisRow = m_pData + y * m_nRowWords;
 
-	const BYTE** ppCheckWith = rRegion.GetData2DConst();
+		const ULONGLONG* pThatRow = rRegion.m_pData +
+			(y - rptOffset.y) * rRegion.m_nRowWords;
 
-	for(int nThisY = rcTest.top, nThatY = 0;
-		nThisY < (rcTest.bottom + 1);
-		nThisY++, nThatY++)
-	{
-		for(int nThisX = rcTest.left, nThatX = 0;
-			nThisX < (rcTest.right + 1);
-			nThisX++, nThatX++)
+		for(int w = nFirstWord; w <= nLastWord; w++)
 		{
-			if (m_ppData[nThisY][nThisX] != 0 &&
-				ppCheckWith[nThatY][nThatX] != 0)
+			if (0 == pThisRow[w])
+				continue;
+
+			if (pThisRow[w] & GetRowBits(pThatRow, rRegion.m_nRowWords,
+			   w * WORD_BITS - rptOffset.x))
 				return true;
 		}
 	}
@@ -571,9 +559,10 @@ void Region::Serialize(Stream& rStream) const
 
 		rStream.WriteVar((int*)&m_psSize, 2);
 
-		// Write data
+		// Write packed rows
 
-		rStream.WriteVar(m_pData, UINT(m_psSize.cx * m_psSize.cy));
+		rStream.WriteVar((const BYTE*)m_pData,
+			m_nRowWords * m_psSize.cy * int(sizeof(ULONGLONG)));
 	}
 
 	catch(Error& rError)
@@ -585,7 +574,7 @@ void Region::Serialize(Stream& rStream) const
 	}
 }
 
-void Region::Deserialize(Stream& rStream)
+void Region::Deserialize(Stream& rStream, bool bPacked)
 {
 	try
 	{
@@ -597,9 +586,53 @@ void Region::Deserialize(Stream& rStream)
 
 		SetSize(psSize);
 
-		// Read data
+		if (false == bPacked)
+		{
+			// Pack rows of one byte per pixel as they are read
+
+			std::vector<BYTE> arRow;
+
+			try
+			{
+				arRow.resize(size_t(psSize.cx));
+			}
+
+			catch(std::bad_alloc)
+			{
+				throw Error(Error::MEM_ALLOC, __FUNCTIONW__, psSize.cx);
+			}
+
+			for(int y = 0; y < psSize.cy && psSize.cx > 0; y++)
+			{
+				rStream.ReadVar(&arRow[0], int(psSize.cx));
+
+				ULONGLONG* pRow = m_pData + y * m_nRowWords;
+
+				for(int x = 0; x < psSize.cx; x++)
+				{
+					if (arRow[x] != 0)
+						pRow[x / WORD_BITS] |= ULONGLONG(1) << (x % WORD_BITS);
+				}
+			}
+
+			return;
+		}
+
+		// Read packed rows
 
-		rStream.ReadVar(m_pData, UINT(psSize.cx * psSize.cy));
+		rStream.ReadVar((BYTE*)m_pData,
+			m_nRowWords * psSize.cy * int(sizeof(ULONGLONG)));
+
+		// Clear padding so that it never matches in collision tests
+
+		if (psSize.cx % WORD_BITS)
+		{
+			ULONGLONG qwMask = ~ULONGLONG(0) >>
+				(WORD_BITS - psSize.cx % WORD_BITS);
+
+			for(int y = 0; y < psSize.cy; y++)
+				m_pData[(y + 1) * m_nRowWords - 1] &= qwMask;
+		}
 	}
 
 	catch(Error& rError)
@@ -614,10 +647,9 @@ void Region::Deserialize(Stream& rStream)
 DWORD Region::GetMemoryFootprint(void) const
 {
 	return sizeof(Region) +
-		m_psSize.cx *
-		m_psSize.cy +
+		m_nRowWords *
 		m_psSize.cy *
-		sizeof(BYTE*);
+		sizeof(ULONGLONG);
 }
 
 void Region::Empty(void)
@@ -626,13 +658,12 @@ void Region::Empty(void)
 	{
 		delete[] m_pData;
 		m_pData = NULL;
-
-		delete[] m_ppData;
-		m_ppData = NULL;
 	}
 
 	m_psSize.cx = 0;
 	m_psSize.cy = 0;
+
+	m_nRowWords = 0;
 }
 
 void Region::operator=(const Region& rAssign)
@@ -641,8 +672,29 @@ void Region::operator=(const Region& rAssign)
 
 	m_pData = rAssign.m_pData;
 
-	m_ppData = rAssign.m_ppData;
+	m_nRowWords = rAssign.m_nRowWords;
 
 	m_psSize.cx = rAssign.m_psSize.cx;
 	m_psSize.cy = rAssign.m_psSize.cy;
+}
+
+ULONGLONG Region::GetRowBits(const ULONGLONG* pRow, int nRowWords, int nBit)
+{
+	// Floor division, pixels may start before the row
+
+	int nWord = (nBit >= 0) ? nBit / WORD_BITS :
+		-((-nBit + WORD_BITS - 1) / WORD_BITS);
+
+	int nShift = nBit - nWord * WORD_BITS;
+
+	ULONGLONG qwLow = (nWord >= 0 && nWord < nRowWords) ?
+		pRow[nWord] : 0;
+
+	if (0 == nShift)
+		return qwLow;
+
+	ULONGLONG qwHigh = (nWord + 1 >= 0 && nWord + 1 < nRowWords) ?
+		pRow[nWord + 1] : 0;
+
+	return (qwLow >> nShift) | (qwHigh << (WORD_BITS - nShift));
 }
\ No newline at end of file
@@ -51,6 +51,14 @@ typedef std::vector<Region*>::const_iterator RegionArrayConstIterator;
 
 class Region
 {
+public:
+	//
+	// Constants
+	//
+
+	// Pixels packed into each word of a row
+	static const int WORD_BITS;
+
 private:
 	//
 	// Members
@@ -62,11 +70,12 @@ private:
 	// Pixel size
 	SIZE m_psSize;
 
-	// Data stored as a 1-d array
-	BYTE* m_pData;
+	// One bit per pixel, rows padded to whole words.
+	// Pixel x of a row is bit x % WORD_BITS of word x / WORD_BITS.
+	ULONGLONG* m_pData;
 
-	// Points into m_pData, used to refer to it as a 2-d array
-	BYTE** m_ppData;
+	// Words in each row
+	int m_nRowWords;
 
 public:
 	Region(RegionSet* pRegionSet = NULL);
@@ -90,10 +99,12 @@ public:
 	// Data
 	//
 
-	BYTE* GetData1D(void);
+	ULONGLONG* GetData(void);
+	const ULONGLONG* GetDataConst(void) const;
+
+	int GetRowWords(void) const;
 
-	BYTE** GetData2D(void);
-	const BYTE** GetData2DConst(void) const;
+	void SetPixel(int x, int y, bool bSet);
 
 	//
 	// Creation
@@ -106,6 +117,8 @@ public:
 	//
 
 	bool TestPoint(const POINT& rpt) const;
+
+	// Right and bottom edges of rectangle are exclusive
 	bool TestRect(const RECT& rrc) const;
 	bool TestRegion(const Region& rRegion, const POINT& rptOffset) const;
 
@@ -113,8 +126,9 @@ public:
 	// Serialization
 	//
 
+	// Rows are read one byte per pixel if not packed, pixel is set if non-zero
 	void Serialize(Stream& rStream) const;
-	void Deserialize(Stream& rStream);
+	void Deserialize(Stream& rStream, bool bPacked = true);
 
 	//
 	// Diagnostics
@@ -133,6 +147,14 @@ public:
 	//
 
 	void operator=(const Region& rAssign);
+
+private:
+	//
+	// Private Functions
+	//
+
+	// Get WORD_BITS pixels of a row starting at any pixel, zero outside of row
+	static ULONGLONG GetRowBits(const ULONGLONG* pRow, int nRowWords, int nBit);
 };
 
 /*----------------------------------------------------------*\
@@ -149,6 +171,9 @@ public:
 	static const BYTE RGN_SIGNATURE[];
 	static const BYTE RGN_FORMAT_VERSION[];
 
+	// Version with one byte per pixel, still read but never written
+	static const BYTE RGN_FORMAT_VERSION_UNPACKED[];
+
 private:
 	//
 	// Members
@@ -38,6 +38,9 @@
 // Lightweight string class used throughout the engine
 #include "ThunderString.h"
 
+// Interned names looked up by hash, used for actor names
+#include "ThunderNameTable.h"
+
 // File reader/writer with buffering support
 #include "ThunderStream.h"
 
@@ -53,6 +56,9 @@
 // Error and std::exception classes
 #include "ThunderError.h"
 
+// Worker thread pool for running jobs in parallel
+#include "ThunderJobs.h"
+
 //
 // Core
 //
@@ -69,6 +75,12 @@
 // Tile Map and Actor classes that define game world
 #include "ThunderTileMap.h"
 
+// Path finding service for tile layers
+#include "ThunderNavigation.h"
+
+// Visibility polygons from tile layer occluders
+#include "ThunderVisibility.h"
+
 // Screen classes for in-game user interface
 #include "ThunderScreen.h"
 
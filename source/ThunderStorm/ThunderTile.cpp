@@ -212,13 +212,16 @@ void TileStatic::Deserialize(TileMap& rMap, Stream& rStream)
 | TileAnimated implementation
 \*----------------------------------------------------------*/
 
-TileAnimated::TileAnimated(void): m_nAnimationID(INVALID_INDEX)
+TileAnimated::TileAnimated(void): m_nAnimationID(INVALID_INDEX),
+								  m_fUpdateTime(-1.0f)
 {
 }
 
 TileAnimated::TileAnimated(const TileAnimated& rInit):
 						   Tile(rInit.m_dwFlags, rInit.m_clrBlend),
-						   m_nAnimationID(rInit.m_nAnimationID)
+						   m_nAnimationID(rInit.m_nAnimationID),
+						   m_MaterialInst(rInit.m_MaterialInst),
+						   m_fUpdateTime(rInit.m_fUpdateTime)
 {
 }
 
@@ -239,6 +242,19 @@ MaterialInstance& TileAnimated::GetMaterialInstance(void)
 	return m_MaterialInst;
 }
 
+void TileAnimated::Update(float fTime)
+{
+	// Update once per frame no matter how many tiles use this template.
+	// Material instance catches up on any time elapsed since last update
+
+	if (fTime == m_fUpdateTime)
+		return;
+
+	m_fUpdateTime = fTime;
+
+	m_MaterialInst.Update(fTime);
+}
+
 TileAnimated& TileAnimated::operator=(const TileAnimated& rAssign)
 {
 	m_dwFlags = rAssign.m_dwFlags;
@@ -72,7 +72,12 @@ public:
 		ANIMATED	= 1 << 2,
 
 		// Start value for user flags
-		USER		= 1 << 3
+		USER		= 1 << 3,
+
+		// Covers its whole cell with opaque pixels, hiding tiles of layers
+		// rendered below it. Allocated from the top so that user flag
+		// values stay unchanged
+		OCCLUDER	= 1 << 30
 	};
 
 protected:
@@ -190,6 +195,7 @@ class TileAnimated: public Tile
 protected:
 	int m_nAnimationID;
 	MaterialInstance m_MaterialInst;
+	float m_fUpdateTime;		// Time material instance was last updated to
 
 public:
 	TileAnimated(void);
@@ -203,6 +209,12 @@ public:
 	int GetAnimationID(void) const;
 	MaterialInstance& GetMaterialInstance(void);
 
+	//
+	// Animation
+	//
+
+	void Update(float fTime);
+
 	//
 	// Operators
 	//
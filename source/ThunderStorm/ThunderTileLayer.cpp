@@ -19,6 +19,10 @@
 #include "ThunderEngine.h"		// using Engine, Error
 #include "ThunderTileMap.h"		// using TileMap
 #include "ThunderTileLayer.h"	// defining TileLayer
+#include "ThunderNavigation.h"	// using NavigationGraph
+#include "ThunderVisibility.h"	// using VisibilityMap
+#include "ThunderSprite.h"		// using Sprite
+#include <functional>			// using std::greater
 
 /*----------------------------------------------------------*\
 | Namespace
@@ -26,6 +30,24 @@
 
 using namespace ThunderStorm;
 
+/*----------------------------------------------------------*\
+| Constants
+\*----------------------------------------------------------*/
+
+const int SpacePartitionQuadTree::NODE_MIN_SIZE = 4;
+
+DWORD SpacePartition::s_dwQueryStamp = 0;
+
+const int TileLayer::CHUNK_SHIFT = 5;
+const int TileLayer::CHUNK_SIZE = 1 << TileLayer::CHUNK_SHIFT;
+const WORD TileLayer::TILE_ANIMATED = 0x8000;
+const WORD TileLayer::TILE_EMPTY = 0xFFFF;
+const int TileLayer::MAX_TILE_INDEX = 0x7FFE;
+const float TileLayer::GEOMETRY_LIFETIME = 5.0f;
+
+const int TileLayerIndex::CELL_SIZE = 32;
+const int TileLayerIndex::BUCKETS = 32;
+
 
 /*----------------------------------------------------------*\
 | TileLayer implementation
@@ -35,14 +57,27 @@ TileLayer::TileLayer(TileMap& rMap):
 					 m_rMap(rMap),
 					 m_nWidth(0),
 					 m_nHeight(0),
-					 m_ppTiles(NULL),
-					 m_pppTiles(NULL),
-					 m_pSpace(NULL)
+					 m_nChunksWidth(0),
+					 m_nChunksAllocated(0),
+					 m_pSpace(NULL),
+					 m_nSpaceType(SpacePartition::TYPE_UNIFORMGRID),
+					 m_pNavigation(NULL),
+					 m_pVisibility(NULL),
+					 m_nZ(0),
+					 m_nMapIndex(0),
+					 m_bIndexed(false),
+					 m_dwQueryStamp(0),
+					 m_dwRenderFrame(0),
+					 m_nRenderLayer(0)
 {
 }
 
 TileLayer::~TileLayer(void)
 {
+	m_rMap.GetLayerIndex().Remove(this);
+	m_rMap.UpdateCameras(this, true);
+	m_rMap.GetNavigation().OnLayerRemoved(this);
+
 	Empty();
 }
 
@@ -73,101 +108,107 @@ Vector2 TileLayer::GetSize(void) const
 
 void TileLayer::SetSize(int nWidth, int nHeight)
 {
-	// Allocate 1D tile array
+	if (nWidth < 0 || nHeight < 0)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
 
-	int nTileCount = nWidth * nHeight;
+	// Chunk indices change, so bring back any actors swapped out by streaming
 
-	Tile** ppTiles = NULL;
-	Tile*** pppTiles = NULL;
+	m_rMap.ReleaseStreamChunks(this, true);
 
-	try
-	{
-		ppTiles = new Tile*[nTileCount];
-	}
+	// Edge chunks change, geometry gets rebuilt when rendered
 
-	catch(std::bad_alloc e)
-	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Tile*) * nTileCount);
-	}
+	ReleaseAllGeometry();
+
+	m_rMap.InvalidateOcclusion();
 
-	// Allocate 2D tile array
+	// Clusters change, navigation graph gets rebuilt when searched
+
+	if (m_pNavigation != NULL)
+		m_pNavigation->Invalidate();
+
+	// Occluder edges get rebuilt when visibility is computed
+
+	if (m_pVisibility != NULL)
+		m_pVisibility->Invalidate();
+
+	// Allocate chunk grid, all chunks start out empty
+
+	int nChunksWidth = (nWidth + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+	int nChunksHeight = (nHeight + CHUNK_SIZE - 1) >> CHUNK_SHIFT;
+
+	Chunk chunkEmpty = { NULL, TILE_EMPTY, false, false, 0, 0, 0, 0, 0, NULL };
+
+	ChunkArray arChunks;
 
 	try
 	{
-		pppTiles = new Tile**[nHeight];
+		arChunks.resize(size_t(nChunksWidth * nChunksHeight), chunkEmpty);
 	}
 
 	catch(std::bad_alloc e)
 	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Tile**) * nHeight);
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(Chunk) * nChunksWidth * nChunksHeight);
 	}
 
-	// Point elements of 2D tile array into 1D tile array
+	// Chunks are aligned to layer origin, so previously allocated
+	// chunks keep their place in the grid if still covered
 
-	for(int y = 0, n = 0; y < nHeight; y++, n += nWidth)
+	int nOldChunksHeight = (0 == m_nChunksWidth) ? 0 :
+		int(m_arChunks.size()) / m_nChunksWidth;
+
+	int nMovedChunksWidth = min(m_nChunksWidth, nChunksWidth);
+	int nMovedChunksHeight = min(nOldChunksHeight, nChunksHeight);
+
+	for(int cy = 0; cy < nMovedChunksHeight; cy++)
 	{
-		pppTiles[y] = &ppTiles[n];
+		for(int cx = 0; cx < nMovedChunksWidth; cx++)
+		{
+			std::swap(arChunks[cy * nChunksWidth + cx],
+				m_arChunks[cy * m_nChunksWidth + cx]);
+		}
 	}
 
-	if (m_ppTiles != NULL)
-	{
-		// Copy and release previously allocated tiles
+	// Release chunks no longer covered
 
-		int nCopyHeight = min(m_nHeight, nHeight);
-		int nCopyWidth = min(m_nWidth, nWidth);
-		int nOldWidth = m_nWidth;
+	EmptyChunks();
 
-		size_t nCopySizeBytes = nOldWidth * sizeof(int);
+	m_arChunks.swap(arChunks);
+	m_nChunksWidth = nChunksWidth;
 
-		size_t nFillSizeBytes =
-			(nWidth > nOldWidth ? nWidth - nOldWidth : 0) * sizeof(int);
+	for(ChunkArrayIterator pos = m_arChunks.begin();
+		pos != m_arChunks.end();
+		pos++)
+	{
+		if (pos->pwTiles != NULL)
+			m_nChunksAllocated++;
+	}
 
-		for(int y = 0; y < nCopyHeight; y++)
-		{
-			// Copy valid tiles
+	int nCopyWidth = min(m_nWidth, nWidth);
+	int nCopyHeight = min(m_nHeight, nHeight);
 
-			CopyMemory(ppTiles[y * nWidth],
-				   m_ppTiles[y * nOldWidth],
-				   nCopySizeBytes);
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
 
-			// If growing, fill new elements with NULL
+	// Clear tiles of moved chunks that were cut off or did not exist before
 
-			if (nFillSizeBytes != 0)
-				memset(ppTiles[y * nWidth + nCopyWidth],
-				NULL,
-				nFillSizeBytes);
-		}
+	int nMovedWidth = min(nWidth, nMovedChunksWidth << CHUNK_SHIFT);
+	int nMovedHeight = min(nHeight, nMovedChunksHeight << CHUNK_SHIFT);
 
-		delete[] m_ppTiles;
-		delete[] m_pppTiles;
-	}
-	else
+	for(int y = 0; y < nMovedHeight; y++)
 	{
-		// If no previously allocated tiles, fill with NULL
-
-		memset(ppTiles, NULL, size_t(nTileCount * sizeof(Tile*)));
+		for(int x = (y < nCopyHeight) ? nCopyWidth : 0; x < nMovedWidth; x++)
+		{
+			SetTileValue(x, y, TILE_EMPTY);
+		}
 	}
 
-	// Update pointers
-
-	m_ppTiles = ppTiles;
-	m_pppTiles = pppTiles;
+	m_rMap.GetLayerIndex().Update(this);
 
 	// Update spacial partitions
 
 	if (NULL == m_pSpace)
-	{
-		try
-		{
-			m_pSpace = new SpacePartitionUniformGrid;
-		}
-
-		catch(std::bad_alloc)
-		{
-			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
-				sizeof(SpacePartitionUniformGrid));
-		}
-	}
+		m_pSpace = SpacePartition::Create(m_nSpaceType);
 	
 	m_pSpace->SetSize(nWidth, nHeight, true);
 }
@@ -185,6 +226,44 @@ SpacePartition* TileLayer::GetSpace(void) const
 	return m_pSpace;
 }
 
+SpacePartition::Types TileLayer::GetSpaceType(void) const
+{
+	return m_nSpaceType;
+}
+
+void TileLayer::SetSpaceType(SpacePartition::Types nType)
+{
+	if (nType < 0 || nType >= SpacePartition::TYPE_COUNT)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	m_nSpaceType = nType;
+
+	if (NULL == m_pSpace || m_pSpace->GetType() == nType)
+		return;
+
+	// Move actors from current partition into the new one
+
+	SpacePartition* pSpace = SpacePartition::Create(nType);
+
+	pSpace->SetSize(m_nWidth, m_nHeight, true);
+
+	ActorArray arActors;
+	Rect rcRange(0, 0, m_nWidth, m_nHeight);
+
+	m_pSpace->Query(rcRange, &arActors);
+
+	for(ActorArrayIterator pos = arActors.begin();
+		pos != arActors.end();
+		pos++)
+	{
+		m_pSpace->Remove(*pos);
+		pSpace->Add(*pos);
+	}
+
+	delete m_pSpace;
+	m_pSpace = pSpace;
+}
+
 Tile* TileLayer::SetTile(int tx,
 						 int ty,
 						 DWORD dwFlags,
@@ -214,6 +293,8 @@ Tile* TileLayer::SetTile(int tx,
 
 void TileLayer::SetTile(int tx, int ty, Tile* pTile)
 {
+	WORD wTile = EncodeTile(pTile);
+
 	if (pTile != NULL)
 		pTile->AddRef();
 
@@ -222,45 +303,96 @@ void TileLayer::SetTile(int tx, int ty, Tile* pTile)
 	if (pOldTile != NULL)
 		pOldTile->RemoveRef();
 
-	m_pppTiles[ty][tx] = pTile;
+	SetTileValue(tx, ty, wTile);
 }
 
 Tile* TileLayer::GetTile(int tx, int ty)
 {
-	return m_pppTiles[ty][tx];
+	return DecodeTile(GetTileValue(tx, ty));
 }
 
 const Tile* TileLayer::GetTileConst(int tx, int ty) const
 {
-	return m_pppTiles[ty][tx];
+	return DecodeTile(GetTileValue(tx, ty));
 }
 
 int TileLayer::GetTileIndex(int tx, int ty, bool* pbOutAnimated) const
 {
-	const Tile* pTemplate = GetTileConst(tx, ty);
+	WORD wTile = GetTileValue(tx, ty);
 
-	if (pTemplate != NULL)
-	{
-		if (pbOutAnimated != NULL)
-			*pbOutAnimated = pTemplate->IsFlagSet(Tile::ANIMATED);
+	if (TILE_EMPTY == wTile)
+		return INVALID_INDEX;
 
-		if (pTemplate->IsFlagSet(Tile::ANIMATED) == true)
-			return int(pTemplate - &m_rMap.GetTileTemplateAnimatedConst(0));
-		else
-			return int(pTemplate - &m_rMap.GetTileTemplateStaticConst(0));
-	}
+	if (pbOutAnimated != NULL)
+		*pbOutAnimated = (wTile & TILE_ANIMATED) != 0;
+
+	return int(wTile & ~TILE_ANIMATED);
+}
+
+bool TileLayer::IsTileLoaded(int tx, int ty) const
+{
+	const Chunk& rChunk =
+		m_arChunks[(ty >> CHUNK_SHIFT) * m_nChunksWidth + (tx >> CHUNK_SHIFT)];
 
-	return INVALID_INDEX;
+	return (rChunk.pwTiles != NULL || 0 == rChunk.dwOffset);
 }
 
-Tile** TileLayer::GetTiles(void)
+int TileLayer::GetChunkCount(void) const
 {
-	return m_ppTiles;
+	return int(m_arChunks.size());
 }
 
-Tile*** TileLayer::GetTiles2D(void)
+int TileLayer::GetAllocatedChunkCount(void) const
 {
-	return m_pppTiles;
+	return m_nChunksAllocated;
+}
+
+void TileLayer::Compact(void)
+{
+	// Release chunks whose tiles all share the same value
+
+	for(int n = 0; n < int(m_arChunks.size()); n++)
+	{
+		Chunk& rChunk = m_arChunks[n];
+
+		if (NULL == rChunk.pwTiles)
+			continue;
+
+		// Edge chunks extend past layer size, ignore tiles outside
+
+		int nLeft = (n % m_nChunksWidth) << CHUNK_SHIFT;
+		int nTop = (n / m_nChunksWidth) << CHUNK_SHIFT;
+
+		int nWidth = min(CHUNK_SIZE, m_nWidth - nLeft);
+		int nHeight = min(CHUNK_SIZE, m_nHeight - nTop);
+
+		WORD wFill = rChunk.pwTiles[0];
+		bool bUniform = true;
+
+		for(int y = 0; y < nHeight && true == bUniform; y++)
+		{
+			const WORD* pwRow = rChunk.pwTiles + (y << CHUNK_SHIFT);
+
+			for(int x = 0; x < nWidth; x++)
+			{
+				if (pwRow[x] != wFill)
+				{
+					bUniform = false;
+					break;
+				}
+			}
+		}
+
+		if (true == bUniform)
+		{
+			delete[] rChunk.pwTiles;
+			rChunk.pwTiles = NULL;
+			rChunk.wFill = wFill;
+			rChunk.dwOffset = 0;
+
+			m_nChunksAllocated--;
+		}
+	}
 }
 
 bool TileLayer::IsValidPosition(const Vector2& rvecPos) const
@@ -326,6 +458,107 @@ void TileLayer::ValidateRange(Rect& rrc) const
 		rrc.bottom = m_nHeight;
 }
 
+bool TileLayer::CastSegment(const Vector2& rvecFrom,
+							const Vector2& rvecTo,
+							RayHit* pOutHit,
+							DWORD dwFlags,
+							const Actor* pIgnore) const
+{
+	ActorArray arCell;
+
+	return Traverse(rvecFrom, rvecTo, false, pOutHit, dwFlags, pIgnore,
+		NULL, arCell);
+}
+
+bool TileLayer::CastRay(const Vector2& rvecOrigin,
+						const Vector2& rvecDirection,
+						RayHit* pOutHit,
+						DWORD dwFlags,
+						const Actor* pIgnore) const
+{
+	ActorArray arCell;
+
+	return Traverse(rvecOrigin, rvecDirection, true, pOutHit, dwFlags,
+		pIgnore, NULL, arCell);
+}
+
+int TileLayer::CastSegments(const Ray* pRays,
+							int nCount,
+							RayHit* pOutHits,
+							DWORD dwFlags) const
+{
+	if (NULL == pRays)
+		throw Error(Error::INVALID_PTR, __FUNCTIONW__, L"pRays");
+
+	if (NULL == pOutHits)
+		throw Error(Error::INVALID_PTR, __FUNCTIONW__, L"pOutHits");
+
+	if (nCount <= 0)
+		return 0;
+
+	// Resolve collision flag of every template once for the whole batch,
+	// animated templates follow static ones
+
+	int nStatic = int(m_rMap.m_arTilesStatic.size());
+	int nAnimated = int(m_rMap.m_arTilesAnimated.size());
+
+	std::vector<BYTE> arClip;
+	std::vector< std::pair<int, int> > arOrder;
+
+	try
+	{
+		arClip.resize(size_t(nStatic + nAnimated + 1));
+		arOrder.resize(size_t(nCount));
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			nStatic + nAnimated + nCount * sizeof(std::pair<int, int>));
+	}
+
+	for(int n = 0; n < nStatic; n++)
+	{
+		arClip[n] = BYTE(m_rMap.m_arTilesStatic[n].IsFlagSet(Tile::CLIP));
+	}
+
+	for(int n = 0; n < nAnimated; n++)
+	{
+		arClip[nStatic + n] =
+			BYTE(m_rMap.m_arTilesAnimated[n].IsFlagSet(Tile::CLIP));
+	}
+
+	// Trace rays starting in the same chunk one after another,
+	// so that their tiles are still in cache
+
+	for(int n = 0; n < nCount; n++)
+	{
+		int tx = max(0, min(int(floor(pRays[n].vecFrom.x)), m_nWidth - 1));
+		int ty = max(0, min(int(floor(pRays[n].vecFrom.y)), m_nHeight - 1));
+
+		arOrder[n].first =
+			(ty >> CHUNK_SHIFT) * m_nChunksWidth + (tx >> CHUNK_SHIFT);
+		arOrder[n].second = n;
+	}
+
+	std::sort(arOrder.begin(), arOrder.end());
+
+	ActorArray arCell;
+
+	int nHits = 0;
+
+	for(int n = 0; n < nCount; n++)
+	{
+		int nRay = arOrder[n].second;
+
+		if (Traverse(pRays[nRay].vecFrom, pRays[nRay].vecTo, false,
+		   &pOutHits[nRay], dwFlags, NULL, &arClip[0], arCell) == true)
+			nHits++;
+	}
+
+	return nHits;
+}
+
 Vector2& TileLayer::GetPosition(void)
 {
 	return m_vecPos;
@@ -339,18 +572,30 @@ const Vector2& TileLayer::GetPositionConst(void) const
 void TileLayer::SetPosition(Vector2 vecPosition)
 {
 	m_vecPos = vecPosition;
+
+	m_rMap.GetLayerIndex().Update(this);
+	m_rMap.UpdateCameras(this, false);
+	m_rMap.InvalidateOcclusion();
 }
 
 void TileLayer::SetPosition(float x, float y)
 {
 	m_vecPos.x = x;
 	m_vecPos.y = y;
+
+	m_rMap.GetLayerIndex().Update(this);
+	m_rMap.UpdateCameras(this, false);
+	m_rMap.InvalidateOcclusion();
 }
 
 void TileLayer::Move(float fDeltaX, float fDeltaY)
 {
 	m_vecPos.x += fDeltaX;
 	m_vecPos.y += fDeltaY;
+
+	m_rMap.GetLayerIndex().Update(this);
+	m_rMap.UpdateCameras(this, false);
+	m_rMap.InvalidateOcclusion();
 }
 
 Vector2 TileLayer::LocalToWorld(Vector2 vecLocal)
@@ -363,168 +608,1862 @@ Vector2 TileLayer::WorldToLocal(Vector2 vecWorld)
 	return (vecWorld - m_vecPos);
 }
 
-void TileLayer::Serialize(Stream& rStream) const
+int TileLayer::GetZ(void) const
 {
-	// Write position on map
-
-	m_vecPos.Serialize(rStream);
-
-	// Write size
-
-	rStream.WriteVar(&m_nWidth);
-	rStream.WriteVar(&m_nHeight);
+	return m_nZ;
+}
 
-	// Write tiles
+void TileLayer::Prepare(const Rect& rrcRange)
+{
+	float fTileSize =
+		float(m_rMap.GetEngine().GetOption(Engine::OPTION_TILE_SIZE));
 
-	int nTileCount = m_nWidth * m_nHeight;
+	float fTime = m_rMap.GetEngine().GetTime();
 
-	for(int n = 0; n < nTileCount; n++)
-	{		
-		bool bTileAnimated;
-		int nTileIndex;
+	// Chunks already prepared this frame for another camera are skipped
 
-		if (m_ppTiles[n]->IsFlagSet(Tile::ANIMATED) == true)
-		{
-			bTileAnimated = true;
-			nTileIndex = int(m_ppTiles[n] - &m_rMap.GetTileTemplateAnimated(0));
-		}
-		else
-		{
-			bTileAnimated = false;
-			nTileIndex = int(m_ppTiles[n] - &m_rMap.GetTileTemplateStatic(0));
-		}
+	Rect rcChunks = GetChunkRange(rrcRange);
 
-		rStream.WriteVar(&bTileAnimated);
-		rStream.WriteVar(&nTileIndex);
+	for(int cy = rcChunks.top; cy < rcChunks.bottom; cy++)
+	{
+		for(int cx = rcChunks.left; cx < rcChunks.right; cx++)
+			PrepareChunk(cy * m_nChunksWidth + cx, fTileSize, fTime);
 	}
 }
 
-void TileLayer::Deserialize(Stream& rStream)
+void TileLayer::Render(const Rect& rrcRange,
+					   const Vector2& rvecOffset,
+					   int nMaxZ)
 {
-	Empty();
+	Graphics& rGraphics = m_rMap.GetEngine().GetGraphics();
 
-	// Read position on map
+	float fTileSize =
+		float(m_rMap.GetEngine().GetOption(Engine::OPTION_TILE_SIZE));
 
-	m_vecPos.Deserialize(rStream);
+	float fTime = m_rMap.GetEngine().GetTime();
 
-	// Read size
+	// Geometry is in layer space, move it to where layer is rendered
 
-	rStream.ReadVar(&m_nWidth);
-	rStream.ReadVar(&m_nHeight);
+	D3DXMATRIX mtxOffset;
+	D3DXMatrixTranslation(&mtxOffset, rvecOffset.x, rvecOffset.y, 0.0f);
 
-	// Read tile type/index pairs and convert to pointers
+	// Render chunks in range
 
-	int nTileCount = m_nWidth * m_nHeight;
+	Rect rcChunks = GetChunkRange(rrcRange);
 
-	for(int n = 0; n < nTileCount; n++)
+	for(int cy = rcChunks.top; cy < rcChunks.bottom; cy++)
 	{
-		bool bTileAnimated;
-		rStream.ReadVar(&bTileAnimated);
+		for(int cx = rcChunks.left; cx < rcChunks.right; cx++)
+		{
+			ChunkGeometry* pGeometry =
+				PrepareChunk(cy * m_nChunksWidth + cx, fTileSize, fTime);
 
-		int nTileIndex;		
-		rStream.ReadVar(&nTileIndex);
+			if (NULL == pGeometry)
+				continue;
 
-		if (true == bTileAnimated)
-			m_ppTiles[n] = (Tile*)&m_rMap.GetTileTemplateAnimated(nTileIndex);
-		else
-			m_ppTiles[n] = (Tile*)&m_rMap.GetTileTemplateStatic(nTileIndex);
-	}
-}
+			const ChunkGeometry& rGeometry = *pGeometry;
 
-DWORD TileLayer::GetMemoryFootprint(void) const
-{
-	return sizeof(TileLayer) +
-		sizeof(Tile*) * m_nWidth * m_nHeight +
-		sizeof(Tile**) * m_nHeight +
-		(m_pSpace != NULL ? m_pSpace->GetMemoryFootprint() : 0);
-}
+			// Submit static tiles, one call per material. Quads covered
+			// by occluders in rendered layers are at the end of each group
 
-void TileLayer::Empty(void)
-{
-	// Deallocate 2D tile array
+			for(GeometryGroupArrayConstIterator pos = rGeometry.arGroups.begin();
+				pos != rGeometry.arGroups.end();
+				pos++)
+			{
+				std::vector<int>::const_iterator posFirst =
+					rGeometry.arOccluders.begin() + pos->uFirstQuad;
 
-	delete[] m_pppTiles;
-	m_pppTiles = NULL;
+				UINT uQuadCount = UINT(std::lower_bound(posFirst,
+					posFirst + pos->uQuadCount, nMaxZ, std::greater<int>()) -
+					posFirst);
 
-	// Deallocate 1D tile array
+				if (0 == uQuadCount)
+					continue;
 
-	delete[] m_ppTiles;
-	m_ppTiles = NULL;
+				rGraphics.RenderQuads(
+					m_rMap.m_arTilesStatic[pos->nTemplate].GetMaterialInstance(),
+					&rGeometry.arVertices[pos->uFirstQuad * 4],
+					uQuadCount, 0.0f, &mtxOffset);
+			}
 
-	// Deallocate spacial database
-	
-	delete m_pSpace;
-	m_pSpace = NULL;
-}
+			// Animated tiles change texture coordinates, render them one by one
 
-/*----------------------------------------------------------*\
-| SpacePartitionUniformGrid implementation
-\*----------------------------------------------------------*/
+			for(size_t n = 0; n < rGeometry.arAnimated.size(); n++)
+			{
+				if (rGeometry.arAnimatedOccluders[n] <= nMaxZ)
+					continue;
 
-SpacePartitionUniformGrid::SpacePartitionUniformGrid(void):
-													 m_nWidth(0),
-													 m_nHeight(0),
-													 m_ppsetSpace(NULL)
-{
-}
+				TileAnimated& rTile =
+					m_rMap.m_arTilesAnimated[rGeometry.arAnimated[n] >> 16];
 
-SpacePartitionUniformGrid::~SpacePartitionUniformGrid(void)
-{
-	Empty();
+				int nPos = int(rGeometry.arAnimated[n] & 0xFFFF);
+
+				Vector2 vecTilePos(
+					rvecOffset.x + float((cx << CHUNK_SHIFT) +
+						(nPos & (CHUNK_SIZE - 1))) * fTileSize,
+					rvecOffset.y + float((cy << CHUNK_SHIFT) +
+						(nPos >> CHUNK_SHIFT)) * fTileSize);
+
+				rGraphics.RenderQuad(rTile.GetMaterialInstance(),
+					vecTilePos, rTile.GetBlendConst());
+			}
+		}
+	}
 }
 
-void SpacePartitionUniformGrid::SetSize(int nWidth, int nHeight, bool bInitOnUse)
+void TileLayer::SetZ(int nZ)
 {
-	if (NULL == m_ppsetSpace)
+	if (nZ == m_nZ)
+		return;
+
+	// Index buckets are sorted by Z, so re-add with the new value
+
+	if (true == m_bIndexed)
 	{
-		m_nWidth = nWidth;
-		m_nHeight = nHeight;
+		TileLayerIndex& rIndex = m_rMap.GetLayerIndex();
 
-		if (false == bInitOnUse)
-			Initialize();
+		rIndex.Remove(this);
+
+		m_nZ = nZ;
+
+		rIndex.Add(this);
 	}
 	else
 	{
-		Resize(nWidth, nHeight);
+		m_nZ = nZ;
 	}
-}
 
-bool SpacePartitionUniformGrid::IsValidPosition(const Vector2& rvecPos) const
-{
-	return ((int(rvecPos.x) >= 0 && int(rvecPos.x) < m_nWidth) &&
-			(int(rvecPos.y) >= 0 && int(rvecPos.y) < m_nHeight));
-}
+	// Cameras rebuild their layer lists and actors in view
 
-bool SpacePartitionUniformGrid::IsValidPosition(float x, float y) const
-{
-	return ((int(x) >= 0 && int(x) < m_nWidth) &&
-			(int(y) >= 0 && int(y) < m_nHeight));
+	m_rMap.m_dwLayerStamp++;
+	m_rMap.UpdateCameras(this, false);
+	m_rMap.InvalidateOcclusion();
 }
 
-bool SpacePartitionUniformGrid::IsValidPosition(int x, int y) const
+void TileLayer::Serialize(Stream& rStream, bool bTiles) const
 {
-	return ((x >= 0 && x < m_nWidth) &&
-			(y >= 0 && y < m_nHeight));
-}
+	// Write position on map
 
-bool SpacePartitionUniformGrid::IsValidRange(const Rect& rrc) const
-{
-	if (rrc.left < 0 || rrc.left >= m_nWidth)
-		return false;
+	m_vecPos.Serialize(rStream);
 
-	if (rrc.top < 0 || rrc.top >= m_nHeight)
-		return false;
+	// Write size
 
-	if (rrc.right < 0 || rrc.right > m_nWidth)
-		return false;
+	rStream.WriteVar(&m_nWidth);
+	rStream.WriteVar(&m_nHeight);
 
-	if (rrc.bottom < 0 || rrc.bottom > m_nHeight)
-		return false;
+	// Streamed maps store tiles in the stream directory instead
 
-	return true;
+	if (false == bTiles)
+		return;
+
+	// Write tiles as type/index pairs, row by row
+
+	for(int y = 0; y < m_nHeight; y++)
+	{
+		for(int x = 0; x < m_nWidth; x++)
+		{
+			bool bTileAnimated = false;
+			int nTileIndex = GetTileIndex(x, y, &bTileAnimated);
+
+			rStream.WriteVar(&bTileAnimated);
+			rStream.WriteVar(&nTileIndex);
+		}
+	}
 }
 
-bool SpacePartitionUniformGrid::IsValidRange(const Vector2& rvecPos,
+void TileLayer::Deserialize(Stream& rStream, bool bTiles)
+{
+	Empty();
+
+	// Read position on map
+
+	m_vecPos.Deserialize(rStream);
+
+	// Read size and allocate tiles
+
+	int nWidth = 0, nHeight = 0;
+
+	rStream.ReadVar(&nWidth);
+	rStream.ReadVar(&nHeight);
+
+	SetSize(nWidth, nHeight);
+
+	if (false == bTiles)
+		return;
+
+	// Read tile type/index pairs and convert to tile values
+
+	for(int y = 0; y < m_nHeight; y++)
+	{
+		for(int x = 0; x < m_nWidth; x++)
+		{
+			bool bTileAnimated;
+			rStream.ReadVar(&bTileAnimated);
+
+			int nTileIndex;
+			rStream.ReadVar(&nTileIndex);
+
+			if (INVALID_INDEX == nTileIndex)
+				continue;
+
+			int nTemplateCount = (true == bTileAnimated) ?
+				int(m_rMap.m_arTilesAnimated.size()) :
+				int(m_rMap.m_arTilesStatic.size());
+
+			if (nTileIndex < 0 || nTileIndex >= nTemplateCount ||
+			   nTileIndex > MAX_TILE_INDEX)
+				throw Error(Error::INVALID_INDEX, __FUNCTIONW__, L"nTileIndex");
+
+			SetTileValue(x, y, (true == bTileAnimated) ?
+				WORD(nTileIndex | TILE_ANIMATED) : WORD(nTileIndex));
+		}
+	}
+
+	// Release chunks that turned out uniform
+
+	Compact();
+}
+
+NavigationGraph* TileLayer::GetNavigationGraph(void)
+{
+	if (NULL == m_pNavigation)
+	{
+		try
+		{
+			m_pNavigation = new NavigationGraph(*this);
+		}
+
+		catch(std::bad_alloc e)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+				sizeof(NavigationGraph));
+		}
+	}
+
+	return m_pNavigation;
+}
+
+VisibilityMap* TileLayer::GetVisibilityMap(void)
+{
+	if (NULL == m_pVisibility)
+	{
+		try
+		{
+			m_pVisibility = new VisibilityMap(*this);
+		}
+
+		catch(std::bad_alloc e)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+				sizeof(VisibilityMap));
+		}
+	}
+
+	return m_pVisibility;
+}
+
+DWORD TileLayer::GetMemoryFootprint(void) const
+{
+	DWORD dwGeometry = 0;
+
+	for(std::vector<int>::const_iterator pos = m_arGeometryChunks.begin();
+		pos != m_arGeometryChunks.end();
+		pos++)
+	{
+		const ChunkGeometry* pGeometry = m_arChunks[*pos].pGeometry;
+
+		dwGeometry += DWORD(sizeof(ChunkGeometry) +
+			pGeometry->arVertices.capacity() * sizeof(VertexTriangle) +
+			pGeometry->arGroups.capacity() * sizeof(GeometryGroup) +
+			pGeometry->arOccluders.capacity() * sizeof(int) +
+			pGeometry->arAnimated.capacity() * sizeof(DWORD) +
+			pGeometry->arAnimatedOccluders.capacity() * sizeof(int));
+	}
+
+	return sizeof(TileLayer) +
+		DWORD(m_arChunks.size() * sizeof(Chunk)) +
+		m_nChunksAllocated * CHUNK_SIZE * CHUNK_SIZE * sizeof(WORD) +
+		dwGeometry +
+		(m_pSpace != NULL ? m_pSpace->GetMemoryFootprint() : 0) +
+		(m_pNavigation != NULL ? m_pNavigation->GetMemoryFootprint() : 0) +
+		(m_pVisibility != NULL ? m_pVisibility->GetMemoryFootprint() : 0);
+}
+
+void TileLayer::Empty(void)
+{
+	// Deallocate tile chunks, dropping actors swapped out of them
+
+	m_rMap.ReleaseStreamChunks(this, false);
+
+	EmptyChunks();
+
+	m_nChunksWidth = 0;
+
+	m_rMap.InvalidateOcclusion();
+
+	// Deallocate spacial database
+	
+	delete m_pSpace;
+	m_pSpace = NULL;
+
+	// Deallocate navigation graph
+
+	delete m_pNavigation;
+	m_pNavigation = NULL;
+
+	// Deallocate occluder edges
+
+	delete m_pVisibility;
+	m_pVisibility = NULL;
+
+	m_nWidth = 0;
+	m_nHeight = 0;
+}
+
+WORD TileLayer::EncodeTile(const Tile* pTile) const
+{
+	if (NULL == pTile)
+		return TILE_EMPTY;
+
+	if (pTile->IsFlagSet(Tile::ANIMATED) == true)
+	{
+		int nIndex = int(static_cast<const TileAnimated*>(pTile) -
+			&m_rMap.m_arTilesAnimated[0]);
+
+		if (nIndex < 0 || nIndex > MAX_TILE_INDEX)
+			throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 2);
+
+		return WORD(nIndex | TILE_ANIMATED);
+	}
+	else
+	{
+		int nIndex = int(static_cast<const TileStatic*>(pTile) -
+			&m_rMap.m_arTilesStatic[0]);
+
+		if (nIndex < 0 || nIndex > MAX_TILE_INDEX)
+			throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 2);
+
+		return WORD(nIndex);
+	}
+}
+
+Tile* TileLayer::DecodeTile(WORD wTile) const
+{
+	if (TILE_EMPTY == wTile)
+		return NULL;
+
+	if (wTile & TILE_ANIMATED)
+		return &m_rMap.m_arTilesAnimated[wTile & ~TILE_ANIMATED];
+
+	return &m_rMap.m_arTilesStatic[wTile];
+}
+
+WORD TileLayer::GetTileValue(int tx, int ty) const
+{
+	int nChunk = (ty >> CHUNK_SHIFT) * m_nChunksWidth + (tx >> CHUNK_SHIFT);
+
+	const Chunk& rChunk = m_arChunks[nChunk];
+
+	if (NULL == rChunk.pwTiles)
+	{
+		if (0 == rChunk.dwOffset)
+			return rChunk.wFill;
+
+		// Streamed tiles not loaded yet, load them on first access
+
+		LoadTiles(nChunk);
+	}
+
+	return rChunk.pwTiles[((ty & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) +
+		(tx & (CHUNK_SIZE - 1))];
+}
+
+void TileLayer::SetTileValue(int tx, int ty, WORD wTile)
+{
+	int nChunk = (ty >> CHUNK_SHIFT) * m_nChunksWidth + (tx >> CHUNK_SHIFT);
+
+	Chunk& rChunk = m_arChunks[nChunk];
+
+	if (rChunk.dwOffset != 0)
+	{
+		// Streamed tiles must be loaded before changing, and kept after
+
+		if (NULL == rChunk.pwTiles)
+			LoadTiles(nChunk);
+
+		rChunk.bModified = true;
+	}
+
+	int nPos = ((ty & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) + (tx & (CHUNK_SIZE - 1));
+
+	// Occluders added or removed change what layers below render
+
+	bool bOccluder = (m_rMap.HasOccluders() == true &&
+		(IsOccluderValue(wTile) == true || IsOccluderValue(
+		(NULL == rChunk.pwTiles) ? rChunk.wFill : rChunk.pwTiles[nPos]) == true));
+
+	if (NULL == rChunk.pwTiles)
+	{
+		if (wTile == rChunk.wFill)
+			return;
+
+		// Tiles in this chunk start to differ, allocate it
+
+		try
+		{
+			rChunk.pwTiles = new WORD[CHUNK_SIZE * CHUNK_SIZE];
+		}
+
+		catch(std::bad_alloc e)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+				sizeof(WORD) * CHUNK_SIZE * CHUNK_SIZE);
+		}
+
+		std::fill(rChunk.pwTiles, rChunk.pwTiles + CHUNK_SIZE * CHUNK_SIZE,
+			rChunk.wFill);
+
+		m_nChunksAllocated++;
+	}
+
+	rChunk.pwTiles[nPos] = wTile;
+
+	if (rChunk.pGeometry != NULL)
+		rChunk.pGeometry->bValid = false;
+
+	if (true == bOccluder)
+		InvalidateCovered(tx, ty);
+
+	if (m_pNavigation != NULL)
+		m_pNavigation->OnTileChange(tx, ty);
+
+	if (m_pVisibility != NULL)
+		m_pVisibility->OnTileChange(tx, ty);
+}
+
+bool TileLayer::IsValidTileValue(WORD wTile) const
+{
+	if (TILE_EMPTY == wTile)
+		return true;
+
+	if (wTile & TILE_ANIMATED)
+		return (wTile & ~TILE_ANIMATED) < int(m_rMap.m_arTilesAnimated.size());
+
+	return wTile < int(m_rMap.m_arTilesStatic.size());
+}
+
+bool TileLayer::IsOccluderValue(WORD wTile) const
+{
+	if (TILE_EMPTY == wTile)
+		return false;
+
+	// Blended tiles let layers below show through
+
+	const Tile* pTile = DecodeTile(wTile);
+
+	return (pTile->IsFlagSet(Tile::OCCLUDER) == true &&
+		pTile->GetBlendConst().GetAlpha() == 255);
+}
+
+void TileLayer::LoadTiles(int nChunk) const
+{
+	Chunk& rChunk = m_arChunks[nChunk];
+
+	Stream* pSource = m_rMap.m_pStreamSource;
+
+	if (NULL == pSource || 0 == rChunk.dwOffset)
+		throw Error(Error::INVALID_CALL, __FUNCTIONW__);
+
+	// Read tile values stored in map file into a local buffer,
+	// so that a failed read or invalid values leave the chunk unloaded
+
+	std::vector<WORD> arTiles;
+
+	try
+	{
+		arTiles.resize(CHUNK_SIZE * CHUNK_SIZE);
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(WORD) * CHUNK_SIZE * CHUNK_SIZE);
+	}
+
+	pSource->SetPosition(LONG(rChunk.dwOffset), Stream::MOVE_BEGIN);
+	pSource->ReadVar(&arTiles[0], CHUNK_SIZE * CHUNK_SIZE);
+
+	for(int n = 0; n < CHUNK_SIZE * CHUNK_SIZE; n++)
+	{
+		if (IsValidTileValue(arTiles[n]) == false)
+			throw Error(Error::INVALID_INDEX, __FUNCTIONW__, L"pwTiles");
+	}
+
+	// Commit to chunk
+
+	try
+	{
+		rChunk.pwTiles = new WORD[CHUNK_SIZE * CHUNK_SIZE];
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(WORD) * CHUNK_SIZE * CHUNK_SIZE);
+	}
+
+	std::copy(arTiles.begin(), arTiles.end(), rChunk.pwTiles);
+
+	m_nChunksAllocated++;
+
+	if (rChunk.pGeometry != NULL)
+		rChunk.pGeometry->bValid = false;
+
+	// Collision caches read tiles not loaded as open
+
+	int nLeft = (nChunk % m_nChunksWidth) << CHUNK_SHIFT;
+	int nTop = (nChunk / m_nChunksWidth) << CHUNK_SHIFT;
+
+	Rect rcTiles(nLeft, nTop, min(nLeft + CHUNK_SIZE, m_nWidth),
+		min(nTop + CHUNK_SIZE, m_nHeight));
+
+	if (m_pNavigation != NULL)
+		m_pNavigation->OnTilesLoad(rcTiles);
+
+	if (m_pVisibility != NULL)
+		m_pVisibility->OnTilesLoad(rcTiles);
+
+	// Let map evict it again when cameras move away
+
+	m_rMap.TrackStreamChunk(this, nChunk);
+}
+
+Rect TileLayer::GetChunkRange(const Rect& rrcRange) const
+{
+	int nChunksHeight = (0 == m_nChunksWidth) ? 0 :
+		int(m_arChunks.size()) / m_nChunksWidth;
+
+	return Rect(max(0, rrcRange.left >> CHUNK_SHIFT),
+		max(0, rrcRange.top >> CHUNK_SHIFT),
+		min(m_nChunksWidth, ((rrcRange.right - 1) >> CHUNK_SHIFT) + 1),
+		min(nChunksHeight, ((rrcRange.bottom - 1) >> CHUNK_SHIFT) + 1));
+}
+
+TileLayer::ChunkGeometry* TileLayer::PrepareChunk(int nChunk,
+												  float fTileSize,
+												  float fTime)
+{
+	Chunk& rChunk = m_arChunks[nChunk];
+
+	if (NULL == rChunk.pwTiles)
+	{
+		if (rChunk.dwOffset != 0)
+			LoadTiles(nChunk);
+		else if (TILE_EMPTY == rChunk.wFill)
+			return NULL;
+	}
+
+	// Rebuild if tiles, templates or tile size changed
+
+	if (NULL == rChunk.pGeometry ||
+	   false == rChunk.pGeometry->bValid ||
+	   rChunk.pGeometry->dwTemplateStamp != m_rMap.m_dwTileStamp ||
+	   rChunk.pGeometry->dwOcclusionStamp != m_rMap.m_dwOcclusionStamp ||
+	   rChunk.pGeometry->fTileSize != fTileSize)
+		BuildGeometry(nChunk, fTileSize);
+
+	ChunkGeometry& rGeometry = *rChunk.pGeometry;
+
+	if (rGeometry.dwRenderFrame != m_rMap.m_dwRenderFrame)
+	{
+		rGeometry.dwRenderFrame = m_rMap.m_dwRenderFrame;
+		rGeometry.fLastRender = fTime;
+
+		// Evaluate animations of visible tiles on demand
+
+		for(std::vector<DWORD>::const_iterator pos = rGeometry.arAnimated.begin();
+			pos != rGeometry.arAnimated.end();
+			pos++)
+		{
+			m_rMap.m_arTilesAnimated[*pos >> 16].Update(fTime);
+		}
+	}
+
+	return &rGeometry;
+}
+
+void TileLayer::ReleaseExpiredGeometry(void)
+{
+	// Release geometry of chunks that have not been in view for a while
+
+	float fTime = m_rMap.GetEngine().GetTime();
+
+	for(size_t n = 0; n < m_arGeometryChunks.size();)
+	{
+		Chunk& rChunk = m_arChunks[m_arGeometryChunks[n]];
+
+		if (fTime - rChunk.pGeometry->fLastRender > GEOMETRY_LIFETIME)
+		{
+			delete rChunk.pGeometry;
+			rChunk.pGeometry = NULL;
+
+			m_arGeometryChunks[n] = m_arGeometryChunks.back();
+			m_arGeometryChunks.pop_back();
+		}
+		else
+		{
+			n++;
+		}
+	}
+}
+
+void TileLayer::BuildGeometry(int nChunk, float fTileSize)
+{
+	Chunk& rChunk = m_arChunks[nChunk];
+
+	if (NULL == rChunk.pGeometry)
+	{
+		try
+		{
+			rChunk.pGeometry = new ChunkGeometry;
+		}
+
+		catch(std::bad_alloc e)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(ChunkGeometry));
+		}
+
+		rChunk.pGeometry->dwRenderFrame = 0;
+		rChunk.pGeometry->fLastRender = 0.0f;
+
+		m_arGeometryChunks.push_back(nChunk);
+	}
+
+	ChunkGeometry& rGeometry = *rChunk.pGeometry;
+
+	rGeometry.arVertices.clear();
+	rGeometry.arGroups.clear();
+	rGeometry.arOccluders.clear();
+	rGeometry.arAnimated.clear();
+	rGeometry.arAnimatedOccluders.clear();
+
+	rGeometry.dwTemplateStamp = m_rMap.m_dwTileStamp;
+	rGeometry.dwOcclusionStamp = m_rMap.m_dwOcclusionStamp;
+	rGeometry.fTileSize = fTileSize;
+	rGeometry.bValid = true;
+
+	// Find tiles covered by occluders in layers rendered later
+
+	std::vector<int> arOccluders(CHUNK_SIZE * CHUNK_SIZE);
+
+	BuildOccluders(nChunk, &arOccluders[0]);
+
+	// Collect tiles as template index in upper bits, occluder Z in middle
+	// bits and position in lower, so that sorting groups static tiles by
+	// template with covered tiles at the end of each group. Occluder Z is
+	// flipped to unsigned and inverted to sort in descending order
+
+	int nLeft = (nChunk % m_nChunksWidth) << CHUNK_SHIFT;
+	int nTop = (nChunk / m_nChunksWidth) << CHUNK_SHIFT;
+
+	int nWidth = min(CHUNK_SIZE, m_nWidth - nLeft);
+	int nHeight = min(CHUNK_SIZE, m_nHeight - nTop);
+
+	std::vector<ULONGLONG> arStatic;
+
+	arStatic.reserve(size_t(nWidth * nHeight));
+
+	for(int y = 0; y < nHeight; y++)
+	{
+		for(int x = 0; x < nWidth; x++)
+		{
+			WORD wTile = (NULL == rChunk.pwTiles) ? rChunk.wFill :
+				rChunk.pwTiles[(y << CHUNK_SHIFT) + x];
+
+			if (TILE_EMPTY == wTile)
+				continue;
+
+			DWORD dwPos = DWORD((y << CHUNK_SHIFT) + x);
+
+			int nOccluder = arOccluders[dwPos];
+
+			if (nOccluder != INT_MAX)
+			{
+				// Tiles reaching out of their cell stay visible
+
+				MaterialInstance& rMaterialInst = (wTile & TILE_ANIMATED) ?
+					m_rMap.m_arTilesAnimated[wTile & ~TILE_ANIMATED].GetMaterialInstance() :
+					m_rMap.m_arTilesStatic[wTile].GetMaterialInstance();
+
+				Vector2 vecSize(rMaterialInst.GetTextureCoords().GetSize());
+
+				if (vecSize.x > fTileSize || vecSize.y > fTileSize)
+					nOccluder = INT_MAX;
+			}
+
+			if (wTile & TILE_ANIMATED)
+			{
+				rGeometry.arAnimated.push_back(
+					(DWORD(wTile & ~TILE_ANIMATED) << 16) | dwPos);
+
+				rGeometry.arAnimatedOccluders.push_back(nOccluder);
+			}
+			else
+			{
+				arStatic.push_back((ULONGLONG(wTile) << 48) |
+					(ULONGLONG(~(DWORD(nOccluder) ^ 0x80000000)) << 16) |
+					ULONGLONG(dwPos));
+			}
+		}
+	}
+
+	std::sort(arStatic.begin(), arStatic.end());
+
+	// Build quads, starting a new group when material changes
+
+	rGeometry.arVertices.resize(arStatic.size() * 4);
+	rGeometry.arOccluders.resize(arStatic.size());
+
+	VertexTriangle* pVertex = rGeometry.arVertices.empty() ? NULL :
+		&rGeometry.arVertices[0];
+
+	int nLastTemplate = INVALID_INDEX;
+	const MaterialInstanceShared* pLastMaterial = NULL;
+
+	float u1 = 0.0f, v1 = 0.0f, u2 = 0.0f, v2 = 0.0f;
+	Vector2 vecSize;
+	D3DCOLOR clrBlend = 0;
+
+	for(UINT n = 0; n < UINT(arStatic.size()); n++)
+	{
+		int nTemplate = int(arStatic[n] >> 48);
+
+		rGeometry.arOccluders[n] =
+			int(~DWORD(arStatic[n] >> 16) ^ 0x80000000);
+
+		if (nTemplate != nLastTemplate)
+		{
+			TileStatic& rTemplate = m_rMap.m_arTilesStatic[nTemplate];
+			MaterialInstance& rMaterialInst = rTemplate.GetMaterialInstance();
+
+			rMaterialInst.GetTextureCoords(u1, v1, u2, v2);
+			vecSize = Vector2(rMaterialInst.GetTextureCoords().GetSize());
+			clrBlend = rTemplate.GetBlendConst();
+
+			// Covered quads must stay at the end of each group
+
+			if (rGeometry.arGroups.empty() == true ||
+			   rMaterialInst.GetSharedMaterial() != pLastMaterial ||
+			   rGeometry.arOccluders[n] > rGeometry.arOccluders[n - 1])
+			{
+				GeometryGroup group = { nTemplate, n, 0 };
+				rGeometry.arGroups.push_back(group);
+
+				pLastMaterial = rMaterialInst.GetSharedMaterial();
+			}
+
+			nLastTemplate = nTemplate;
+		}
+
+		rGeometry.arGroups.back().uQuadCount++;
+
+		// Same layout as Graphics::RenderQuad, in layer space
+
+		int nPos = int(arStatic[n] & 0xFFFF);
+
+		float x = float(nLeft + (nPos & (CHUNK_SIZE - 1))) * fTileSize;
+		float y = float(nTop + (nPos >> CHUNK_SHIFT)) * fTileSize;
+
+		pVertex[0].x = x;
+		pVertex[0].y = y;
+		pVertex[0].clrBlend = clrBlend;
+		pVertex[0].u = u1;
+		pVertex[0].v = v1;
+
+		pVertex[1].x = x + vecSize.x;
+		pVertex[1].y = y;
+		pVertex[1].clrBlend = clrBlend;
+		pVertex[1].u = u2;
+		pVertex[1].v = v1;
+
+		pVertex[2].x = x + vecSize.x;
+		pVertex[2].y = y + vecSize.y;
+		pVertex[2].clrBlend = clrBlend;
+		pVertex[2].u = u2;
+		pVertex[2].v = v2;
+
+		pVertex[3].x = x;
+		pVertex[3].y = y + vecSize.y;
+		pVertex[3].clrBlend = clrBlend;
+		pVertex[3].u = u1;
+		pVertex[3].v = v2;
+
+		pVertex += 4;
+	}
+}
+
+void TileLayer::BuildOccluders(int nChunk, int* pnOccluders) const
+{
+	std::fill(pnOccluders, pnOccluders + CHUNK_SIZE * CHUNK_SIZE, INT_MAX);
+
+	if (m_rMap.HasOccluders() == false)
+		return;
+
+	int nLeft = (nChunk % m_nChunksWidth) << CHUNK_SHIFT;
+	int nTop = (nChunk / m_nChunksWidth) << CHUNK_SHIFT;
+
+	int nWidth = min(CHUNK_SIZE, m_nWidth - nLeft);
+	int nHeight = min(CHUNK_SIZE, m_nHeight - nTop);
+
+	// Layers over this chunk with same or higher Z
+
+	Rect rcRange(int(floor(m_vecPos.x)) + nLeft,
+		int(floor(m_vecPos.y)) + nTop,
+		int(ceil(m_vecPos.x)) + nLeft + nWidth,
+		int(ceil(m_vecPos.y)) + nTop + nHeight);
+
+	TileLayerArray arLayers;
+
+	m_rMap.GetLayerIndexConst().Query(rcRange, arLayers, m_nZ);
+
+	for(TileLayerArrayConstIterator pos = arLayers.begin();
+		pos != arLayers.end();
+		pos++)
+	{
+		const TileLayer* pLayer = *pos;
+
+		if (this == pLayer || pLayer->IsRenderedBefore(this) == true)
+			continue;
+
+		// Only layers aligned to the same tile grid cover whole cells
+
+		Vector2 vecOffset = m_vecPos - pLayer->m_vecPos;
+
+		if (floor(vecOffset.x) != vecOffset.x ||
+		   floor(vecOffset.y) != vecOffset.y)
+			continue;
+
+		int nOffsetX = nLeft + int(vecOffset.x);
+		int nOffsetY = nTop + int(vecOffset.y);
+
+		for(int y = 0; y < nHeight; y++)
+		{
+			for(int x = 0; x < nWidth; x++)
+			{
+				int& rnOccluder = pnOccluders[(y << CHUNK_SHIFT) + x];
+
+				if (rnOccluder <= pLayer->m_nZ)
+					continue;
+
+				int tx = nOffsetX + x;
+				int ty = nOffsetY + y;
+
+				if (pLayer->IsValidPosition(tx, ty) == false)
+					continue;
+
+				// Tiles not streamed in yet are not loaded just for this
+
+				const Chunk& rChunk = pLayer->m_arChunks[
+					(ty >> CHUNK_SHIFT) * pLayer->m_nChunksWidth +
+					(tx >> CHUNK_SHIFT)];
+
+				if (NULL == rChunk.pwTiles && rChunk.dwOffset != 0)
+					continue;
+
+				if (pLayer->IsOccluderValue(pLayer->GetTileValue(tx, ty)) == true)
+					rnOccluder = pLayer->m_nZ;
+			}
+		}
+	}
+}
+
+void TileLayer::InvalidateCovered(int tx, int ty)
+{
+	// Rebuild geometry of layers rendered earlier under this tile
+
+	Rect rcRange(int(floor(m_vecPos.x)) + tx,
+		int(floor(m_vecPos.y)) + ty,
+		int(ceil(m_vecPos.x)) + tx + 1,
+		int(ceil(m_vecPos.y)) + ty + 1);
+
+	TileLayerArray arLayers;
+
+	m_rMap.GetLayerIndex().Query(rcRange, arLayers, INT_MIN, m_nZ);
+
+	for(TileLayerArrayIterator pos = arLayers.begin();
+		pos != arLayers.end();
+		pos++)
+	{
+		TileLayer* pLayer = *pos;
+
+		if (this == pLayer || IsRenderedBefore(pLayer) == true)
+			continue;
+
+		Vector2 vecOffset = m_vecPos - pLayer->m_vecPos;
+
+		if (floor(vecOffset.x) != vecOffset.x ||
+		   floor(vecOffset.y) != vecOffset.y)
+			continue;
+
+		int x = tx + int(vecOffset.x);
+		int y = ty + int(vecOffset.y);
+
+		if (pLayer->IsValidPosition(x, y) == false)
+			continue;
+
+		ChunkGeometry* pGeometry = pLayer->m_arChunks[
+			(y >> CHUNK_SHIFT) * pLayer->m_nChunksWidth +
+			(x >> CHUNK_SHIFT)].pGeometry;
+
+		if (pGeometry != NULL)
+			pGeometry->bValid = false;
+	}
+}
+
+bool TileLayer::IsRenderedBefore(const TileLayer* pLayer) const
+{
+	if (m_nZ != pLayer->m_nZ)
+		return (m_nZ < pLayer->m_nZ);
+
+	return (m_nMapIndex < pLayer->m_nMapIndex);
+}
+
+void TileLayer::ReleaseGeometry(int nChunk)
+{
+	Chunk& rChunk = m_arChunks[nChunk];
+
+	if (NULL == rChunk.pGeometry)
+		return;
+
+	delete rChunk.pGeometry;
+	rChunk.pGeometry = NULL;
+
+	std::vector<int>::iterator pos = std::find(m_arGeometryChunks.begin(),
+		m_arGeometryChunks.end(), nChunk);
+
+	if (pos != m_arGeometryChunks.end())
+	{
+		*pos = m_arGeometryChunks.back();
+		m_arGeometryChunks.pop_back();
+	}
+}
+
+void TileLayer::ReleaseAllGeometry(void)
+{
+	for(std::vector<int>::iterator pos = m_arGeometryChunks.begin();
+		pos != m_arGeometryChunks.end();
+		pos++)
+	{
+		delete m_arChunks[*pos].pGeometry;
+		m_arChunks[*pos].pGeometry = NULL;
+	}
+
+	m_arGeometryChunks.clear();
+}
+
+bool TileLayer::Traverse(const Vector2& rvecFrom,
+						 const Vector2& rvecTo,
+						 bool bUnbounded,
+						 RayHit* pOutHit,
+						 DWORD dwFlags,
+						 const Actor* pIgnore,
+						 const BYTE* pbClip,
+						 ActorArray& rarCell) const
+{
+	// Walk tiles crossed by the ray in order (grid DDA)
+
+	Vector2 vecDir = bUnbounded ? rvecTo : Vector2(rvecTo - rvecFrom);
+
+	float fLength = vecDir.Length();
+
+	if (fLength > 0.0f)
+		vecDir = Vector2(vecDir.x / fLength, vecDir.y / fLength);
+
+	if (true == bUnbounded)
+		fLength = FLT_MAX;
+
+	// Clip to layer
+
+	float fEnter = 0.0f;
+	float fExit = fLength;
+
+	const float fOrigin[] = { rvecFrom.x, rvecFrom.y };
+	const float fDir[] = { vecDir.x, vecDir.y };
+	const float fSize[] = { float(m_nWidth), float(m_nHeight) };
+
+	for(int nAxis = 0; nAxis < 2; nAxis++)
+	{
+		if (0.0f == fDir[nAxis])
+		{
+			if (fOrigin[nAxis] < 0.0f || fOrigin[nAxis] >= fSize[nAxis])
+				fExit = -1.0f;
+		}
+		else
+		{
+			float fNear = -fOrigin[nAxis] / fDir[nAxis];
+			float fFar = (fSize[nAxis] - fOrigin[nAxis]) / fDir[nAxis];
+
+			if (fNear > fFar)
+				std::swap(fNear, fFar);
+
+			fEnter = max(fEnter, fNear);
+			fExit = min(fExit, fFar);
+		}
+	}
+
+	float fHit = FLT_MAX;
+	Actor* pHitActor = NULL;
+	POINT ptHitTile = { INVALID_INDEX, INVALID_INDEX };
+
+	if (fEnter <= fExit && m_nWidth > 0 && m_nHeight > 0)
+	{
+		Vector2 vecEnter = rvecFrom + vecDir * fEnter;
+
+		int tx = max(0, min(int(floor(vecEnter.x)), m_nWidth - 1));
+		int ty = max(0, min(int(floor(vecEnter.y)), m_nHeight - 1));
+
+		int nStepX = 0;
+		int nStepY = 0;
+
+		float fNextX = FLT_MAX;
+		float fNextY = FLT_MAX;
+		float fDeltaX = FLT_MAX;
+		float fDeltaY = FLT_MAX;
+
+		if (vecDir.x > 0.0f)
+		{
+			nStepX = 1;
+			fDeltaX = 1.0f / vecDir.x;
+			fNextX = fEnter + (float(tx + 1) - vecEnter.x) * fDeltaX;
+		}
+		else if (vecDir.x < 0.0f)
+		{
+			nStepX = -1;
+			fDeltaX = -1.0f / vecDir.x;
+			fNextX = fEnter + (vecEnter.x - float(tx)) * fDeltaX;
+		}
+
+		if (vecDir.y > 0.0f)
+		{
+			nStepY = 1;
+			fDeltaY = 1.0f / vecDir.y;
+			fNextY = fEnter + (float(ty + 1) - vecEnter.y) * fDeltaY;
+		}
+		else if (vecDir.y < 0.0f)
+		{
+			nStepY = -1;
+			fDeltaY = -1.0f / vecDir.y;
+			fNextY = fEnter + (vecEnter.y - float(ty)) * fDeltaY;
+		}
+
+		bool bTiles = (dwFlags & RAY_TILES) != 0;
+		bool bActors = ((dwFlags & RAY_ACTORS) != 0 && m_pSpace != NULL);
+
+		int nStatic = int(m_rMap.m_arTilesStatic.size());
+
+		// Tiles of the current chunk, looked up again only on crossing chunks
+
+		int nLastChunk = INVALID_INDEX;
+		const WORD* pwTiles = NULL;
+		WORD wFill = TILE_EMPTY;
+
+		float fCell = fEnter;
+
+		for(;;)
+		{
+			float fCellExit = min(min(fNextX, fNextY), fExit);
+
+			if (true == bTiles)
+			{
+				int nChunk = (ty >> CHUNK_SHIFT) * m_nChunksWidth +
+					(tx >> CHUNK_SHIFT);
+
+				if (nChunk != nLastChunk)
+				{
+					const Chunk& rChunk = m_arChunks[nChunk];
+
+					if (NULL == rChunk.pwTiles && rChunk.dwOffset != 0)
+						LoadTiles(nChunk);
+
+					pwTiles = rChunk.pwTiles;
+					wFill = rChunk.wFill;
+
+					nLastChunk = nChunk;
+				}
+
+				WORD wTile = (NULL == pwTiles) ? wFill :
+					pwTiles[((ty & (CHUNK_SIZE - 1)) << CHUNK_SHIFT) +
+					(tx & (CHUNK_SIZE - 1))];
+
+				bool bBlocked = false;
+
+				if (wTile != TILE_EMPTY)
+				{
+					if (pbClip != NULL)
+					{
+						bBlocked = pbClip[(wTile & TILE_ANIMATED) ?
+							nStatic + (wTile & ~TILE_ANIMATED) : wTile] != 0;
+					}
+					else
+					{
+						bBlocked = DecodeTile(wTile)->IsFlagSet(Tile::CLIP);
+					}
+				}
+
+				if (true == bBlocked)
+				{
+					// Actors found in earlier tiles would have ended the walk
+
+					fHit = fCell;
+					ptHitTile.x = tx;
+					ptHitTile.y = ty;
+					break;
+				}
+			}
+
+			if (true == bActors)
+			{
+				rarCell.clear();
+
+				m_pSpace->Query(tx, ty, &rarCell);
+
+				for(ActorArrayConstIterator pos = rarCell.begin();
+					pos != rarCell.end();
+					pos++)
+				{
+					float fDistance = 0.0f;
+
+					if (*pos != pIgnore &&
+					   IntersectActor(*pos, rvecFrom, vecDir, fExit,
+					   fDistance) == true && fDistance < fHit)
+					{
+						fHit = fDistance;
+						pHitActor = *pos;
+					}
+				}
+
+				// Actors can stick out of this tile, but not before it
+
+				if (pHitActor != NULL && fHit <= fCellExit)
+					break;
+			}
+
+			if (fCellExit >= fExit)
+				break;
+
+			if (fNextX < fNextY)
+			{
+				tx += nStepX;
+				fCell = fNextX;
+				fNextX += fDeltaX;
+			}
+			else
+			{
+				ty += nStepY;
+				fCell = fNextY;
+				fNextY += fDeltaY;
+			}
+
+			if (tx < 0 || ty < 0 || tx >= m_nWidth || ty >= m_nHeight)
+				break;
+		}
+
+		if (NULL == pHitActor && INVALID_INDEX == ptHitTile.x &&
+		   true == bUnbounded)
+			fLength = fExit;
+	}
+	else if (true == bUnbounded)
+	{
+		fLength = 0.0f;
+	}
+
+	bool bHit = (pHitActor != NULL || ptHitTile.x != INVALID_INDEX);
+
+	if (pOutHit != NULL)
+	{
+		pOutHit->fDistance = (true == bHit) ? fHit : fLength;
+		pOutHit->vecPos = rvecFrom + vecDir * pOutHit->fDistance;
+		pOutHit->ptTile = ptHitTile;
+		pOutHit->pActor = (ptHitTile.x != INVALID_INDEX) ? NULL : pHitActor;
+	}
+
+	return bHit;
+}
+
+bool TileLayer::IntersectActor(const Actor* pActor,
+							   const Vector2& rvecFrom,
+							   const Vector2& rvecDir,
+							   float fMaxDistance,
+							   float& rfOutDistance)
+{
+	// Same extent the actor has in space partitions
+
+	const Sprite* pSprite = pActor->GetSpriteConst();
+
+	Vector2 vecMin = pActor->GetPosition();
+	Vector2 vecMax = vecMin + ((NULL == pSprite) ?
+		Vector2(1.0f, 1.0f) : pSprite->GetSizeInTiles());
+
+	float fNear = 0.0f;
+	float fFar = fMaxDistance;
+
+	const float fOrigin[] = { rvecFrom.x, rvecFrom.y };
+	const float fDir[] = { rvecDir.x, rvecDir.y };
+	const float fMin[] = { vecMin.x, vecMin.y };
+	const float fMax[] = { vecMax.x, vecMax.y };
+
+	for(int nAxis = 0; nAxis < 2; nAxis++)
+	{
+		if (0.0f == fDir[nAxis])
+		{
+			if (fOrigin[nAxis] < fMin[nAxis] || fOrigin[nAxis] > fMax[nAxis])
+				return false;
+		}
+		else
+		{
+			float fEnter = (fMin[nAxis] - fOrigin[nAxis]) / fDir[nAxis];
+			float fExit = (fMax[nAxis] - fOrigin[nAxis]) / fDir[nAxis];
+
+			if (fEnter > fExit)
+				std::swap(fEnter, fExit);
+
+			fNear = max(fNear, fEnter);
+			fFar = min(fFar, fExit);
+
+			if (fNear > fFar)
+				return false;
+		}
+	}
+
+	rfOutDistance = fNear;
+
+	return true;
+}
+
+void TileLayer::EmptyChunks(void)
+{
+	ReleaseAllGeometry();
+
+	for(ChunkArrayIterator pos = m_arChunks.begin();
+		pos != m_arChunks.end();
+		pos++)
+	{
+		delete[] pos->pwTiles;
+	}
+
+	m_arChunks.clear();
+
+	m_nChunksAllocated = 0;
+}
+
+/*----------------------------------------------------------*\
+| TileLayerIndex implementation
+\*----------------------------------------------------------*/
+
+TileLayerIndex::TileLayerIndex(void): m_dwQueryStamp(0)
+{
+	m_arBuckets.resize(BUCKETS * BUCKETS);
+}
+
+TileLayerIndex::~TileLayerIndex(void)
+{
+}
+
+void TileLayerIndex::Add(TileLayer* pLayer)
+{
+	if (NULL == pLayer)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	if (true == pLayer->m_bIndexed)
+		Unlink(pLayer);
+
+	pLayer->m_rcIndexBounds = pLayer->GetBounds();
+
+	Link(pLayer);
+}
+
+void TileLayerIndex::Remove(TileLayer* pLayer)
+{
+	if (NULL == pLayer || false == pLayer->m_bIndexed)
+		return;
+
+	Unlink(pLayer);
+}
+
+void TileLayerIndex::Update(TileLayer* pLayer)
+{
+	// Layers not added to the map are not indexed
+
+	if (NULL == pLayer || false == pLayer->m_bIndexed)
+		return;
+
+	Rect rcBounds = pLayer->GetBounds();
+
+	if (rcBounds == pLayer->m_rcIndexBounds)
+		return;
+
+	// Only re-link if covering different cells
+
+	if (GetCellRange(rcBounds) == GetCellRange(pLayer->m_rcIndexBounds))
+	{
+		pLayer->m_rcIndexBounds = rcBounds;
+		return;
+	}
+
+	Unlink(pLayer);
+
+	pLayer->m_rcIndexBounds = rcBounds;
+
+	Link(pLayer);
+}
+
+int TileLayerIndex::Query(int x, int y, TileLayerArray& rarLayers,
+						  int nMinZ, int nMaxZ) const
+{
+	// Position falls into a single cell, which has no duplicates
+
+	int cx = int(floor(float(x) / float(CELL_SIZE)));
+	int cy = int(floor(float(y) / float(CELL_SIZE)));
+
+	const TileLayerArray& rarBucket = GetBucketConst(cx, cy);
+
+	int nCount = 0;
+
+	for(TileLayerArrayConstIterator pos = rarBucket.begin();
+		pos != rarBucket.end();
+		pos++)
+	{
+		TileLayer* pLayer = *pos;
+
+		if (pLayer->m_nZ < nMinZ)
+			continue;
+
+		if (pLayer->m_nZ > nMaxZ)
+			break;
+
+		if (pLayer->m_rcIndexBounds.PtInRect(x, y) == true)
+		{
+			rarLayers.push_back(pLayer);
+			nCount++;
+		}
+	}
+
+	return nCount;
+}
+
+int TileLayerIndex::Query(const Rect& rrcRange, TileLayerArray& rarLayers,
+						  int nMinZ, int nMaxZ) const
+{
+	if (rrcRange.GetWidth() <= 0 || rrcRange.GetHeight() <= 0)
+		return 0;
+
+	Rect rcCells = GetCellRange(rrcRange);
+
+	// Layers overlap several cells, skip those already visited
+
+	if (0 == ++m_dwQueryStamp)
+		++m_dwQueryStamp;
+
+	int nCount = 0;
+
+	for(int cy = rcCells.top; cy < rcCells.bottom; cy++)
+	{
+		for(int cx = rcCells.left; cx < rcCells.right; cx++)
+		{
+			const TileLayerArray& rarBucket = GetBucketConst(cx, cy);
+
+			for(TileLayerArrayConstIterator pos = rarBucket.begin();
+				pos != rarBucket.end();
+				pos++)
+			{
+				TileLayer* pLayer = *pos;
+
+				if (pLayer->m_nZ < nMinZ)
+					continue;
+
+				if (pLayer->m_nZ > nMaxZ)
+					break;
+
+				if (pLayer->m_dwQueryStamp == m_dwQueryStamp)
+					continue;
+
+				pLayer->m_dwQueryStamp = m_dwQueryStamp;
+
+				const Rect& rrcBounds = pLayer->m_rcIndexBounds;
+
+				if (rrcBounds.left < rrcRange.right &&
+				   rrcBounds.right > rrcRange.left &&
+				   rrcBounds.top < rrcRange.bottom &&
+				   rrcBounds.bottom > rrcRange.top)
+				{
+					rarLayers.push_back(pLayer);
+					nCount++;
+				}
+			}
+		}
+	}
+
+	return nCount;
+}
+
+DWORD TileLayerIndex::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(TileLayerIndex) +
+		sizeof(TileLayerArray) * DWORD(m_arBuckets.capacity());
+
+	for(std::vector<TileLayerArray>::const_iterator pos = m_arBuckets.begin();
+		pos != m_arBuckets.end();
+		pos++)
+	{
+		dwSize += sizeof(TileLayer*) * DWORD(pos->capacity());
+	}
+
+	return dwSize;
+}
+
+void TileLayerIndex::Empty(void)
+{
+	for(std::vector<TileLayerArray>::iterator pos = m_arBuckets.begin();
+		pos != m_arBuckets.end();
+		pos++)
+	{
+		for(TileLayerArrayIterator posLayer = pos->begin();
+			posLayer != pos->end();
+			posLayer++)
+		{
+			(*posLayer)->m_bIndexed = false;
+		}
+
+		pos->clear();
+	}
+}
+
+Rect TileLayerIndex::GetCellRange(const Rect& rrcBounds) const
+{
+	// Cells covered by bounds, at most all buckets along each axis
+
+	Rect rcCells(int(floor(float(rrcBounds.left) / float(CELL_SIZE))),
+		int(floor(float(rrcBounds.top) / float(CELL_SIZE))),
+		int(floor(float(rrcBounds.right - 1) / float(CELL_SIZE))) + 1,
+		int(floor(float(rrcBounds.bottom - 1) / float(CELL_SIZE))) + 1);
+
+	if (rcCells.right < rcCells.left)
+		rcCells.right = rcCells.left;
+	else if (rcCells.GetWidth() > BUCKETS)
+		rcCells.right = rcCells.left + BUCKETS;
+
+	if (rcCells.bottom < rcCells.top)
+		rcCells.bottom = rcCells.top;
+	else if (rcCells.GetHeight() > BUCKETS)
+		rcCells.bottom = rcCells.top + BUCKETS;
+
+	return rcCells;
+}
+
+TileLayerArray& TileLayerIndex::GetBucket(int cx, int cy)
+{
+	// Masking wraps negative cells too, since BUCKETS is a power of two
+
+	return m_arBuckets[(cy & (BUCKETS - 1)) * BUCKETS + (cx & (BUCKETS - 1))];
+}
+
+const TileLayerArray& TileLayerIndex::GetBucketConst(int cx, int cy) const
+{
+	return m_arBuckets[(cy & (BUCKETS - 1)) * BUCKETS + (cx & (BUCKETS - 1))];
+}
+
+void TileLayerIndex::Link(TileLayer* pLayer)
+{
+	Rect rcCells = GetCellRange(pLayer->m_rcIndexBounds);
+
+	for(int cy = rcCells.top; cy < rcCells.bottom; cy++)
+	{
+		for(int cx = rcCells.left; cx < rcCells.right; cx++)
+		{
+			// Insert after layers with lower or same Z
+
+			TileLayerArray& rarBucket = GetBucket(cx, cy);
+
+			TileLayerArrayIterator pos = rarBucket.begin();
+
+			while(pos != rarBucket.end() && (*pos)->m_nZ <= pLayer->m_nZ)
+				pos++;
+
+			try
+			{
+				rarBucket.insert(pos, pLayer);
+			}
+
+			catch(std::bad_alloc)
+			{
+				throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+					sizeof(TileLayer*) * (rarBucket.size() + 1));
+			}
+		}
+	}
+
+	pLayer->m_bIndexed = true;
+}
+
+void TileLayerIndex::Unlink(TileLayer* pLayer)
+{
+	Rect rcCells = GetCellRange(pLayer->m_rcIndexBounds);
+
+	for(int cy = rcCells.top; cy < rcCells.bottom; cy++)
+	{
+		for(int cx = rcCells.left; cx < rcCells.right; cx++)
+		{
+			TileLayerArray& rarBucket = GetBucket(cx, cy);
+
+			TileLayerArrayIterator pos =
+				std::find(rarBucket.begin(), rarBucket.end(), pLayer);
+
+			if (pos != rarBucket.end())
+				rarBucket.erase(pos);
+		}
+	}
+
+	pLayer->m_bIndexed = false;
+}
+
+/*----------------------------------------------------------*\
+| SpacePartition implementation
+\*----------------------------------------------------------*/
+
+SpacePartition* SpacePartition::Create(Types nType)
+{
+	size_t nSize = 0;
+
+	try
+	{
+		switch(nType)
+		{
+		case TYPE_UNIFORMGRID:
+			nSize = sizeof(SpacePartitionUniformGrid);
+			return new SpacePartitionUniformGrid;
+		case TYPE_FLATGRID:
+			nSize = sizeof(SpacePartitionFlatGrid);
+			return new SpacePartitionFlatGrid;
+		case TYPE_QUADTREE:
+			nSize = sizeof(SpacePartitionQuadTree);
+			return new SpacePartitionQuadTree;
+		}
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, nSize);
+	}
+
+	throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+}
+
+void SpacePartition::QueryAppend(Actor* pActor, void* pContext)
+{
+	if (pContext != NULL)
+		reinterpret_cast<ActorArray*>(pContext)->push_back(pActor);
+}
+
+DWORD SpacePartition::BeginQuery(void)
+{
+	// Zero is reserved for actors never visited
+
+	if (0 == ++s_dwQueryStamp)
+		++s_dwQueryStamp;
+
+	return s_dwQueryStamp;
+}
+
+bool SpacePartition::Visit(Actor* pActor, DWORD dwStamp)
+{
+	if (pActor->m_dwQueryStamp == dwStamp)
+		return false;
+
+	pActor->m_dwQueryStamp = dwStamp;
+
+	return true;
+}
+
+float SpacePartition::GetDistanceSq(const Vector2& rvecPos,
+									float fLeft, float fTop,
+									float fRight, float fBottom)
+{
+	// Zero inside, otherwise to the closest point on the edge
+
+	float dx = max(0.0f, max(fLeft - rvecPos.x, rvecPos.x - fRight));
+	float dy = max(0.0f, max(fTop - rvecPos.y, rvecPos.y - fBottom));
+
+	return dx * dx + dy * dy;
+}
+
+float SpacePartition::GetDistanceSq(const Vector2& rvecPos,
+									const Actor* pActor)
+{
+	// Same bounds as Actor::GetBounds, before rounding out to tiles
+
+	const Sprite* pSprite = pActor->GetSpriteConst();
+
+	Vector2 vecSize = (NULL == pSprite) ?
+		Vector2(1.0f, 1.0f) : pSprite->GetSizeInTiles();
+
+	const Vector2& rvecActor = pActor->GetPosition();
+
+	return GetDistanceSq(rvecPos, rvecActor.x, rvecActor.y,
+		rvecActor.x + vecSize.x, rvecActor.y + vecSize.y);
+}
+
+void SpacePartition::AddNearest(NearestArray& rarNearest, int nCount,
+								Actor* pActor, float fDistanceSq)
+{
+	// Keep nCount closest candidates in a heap with the farthest on top
+
+	Nearest nearest = { fDistanceSq, pActor };
+
+	if (int(rarNearest.size()) < nCount)
+	{
+		rarNearest.push_back(nearest);
+
+		std::push_heap(rarNearest.begin(), rarNearest.end(), CompareNearest);
+	}
+	else if (fDistanceSq < rarNearest.front().fDistanceSq)
+	{
+		std::pop_heap(rarNearest.begin(), rarNearest.end(), CompareNearest);
+
+		rarNearest.back() = nearest;
+
+		std::push_heap(rarNearest.begin(), rarNearest.end(), CompareNearest);
+	}
+}
+
+float SpacePartition::GetNearestBound(const NearestArray& rarNearest,
+									  int nCount, float fMaxDistanceSq)
+{
+	// Anything farther than this can no longer make it into the result
+
+	if (int(rarNearest.size()) < nCount)
+		return fMaxDistanceSq;
+
+	return rarNearest.front().fDistanceSq;
+}
+
+int SpacePartition::EndNearest(NearestArray& rarNearest,
+							   ActorArray* parResult)
+{
+	std::sort_heap(rarNearest.begin(), rarNearest.end(), CompareNearest);
+
+	if (parResult != NULL)
+	{
+		for(NearestArray::const_iterator pos = rarNearest.begin();
+			pos != rarNearest.end();
+			pos++)
+		{
+			parResult->push_back(pos->pActor);
+		}
+	}
+
+	return int(rarNearest.size());
+}
+
+bool SpacePartition::CompareNearest(const Nearest& rLeft,
+									const Nearest& rRight)
+{
+	return (rLeft.fDistanceSq < rRight.fDistanceSq);
+}
+
+void SpacePartition::QueryCell(int tx, int ty,
+							   PQUERYCALLBACK pCallback,
+							   void* pContext) const
+{
+}
+
+int SpacePartition::QueryNearestCells(const Vector2& rvecPos,
+									  int nCount,
+									  ActorArray* parResult,
+									  float fMaxDistance,
+									  int nWidth,
+									  int nHeight) const
+{
+	NearestArray arNearest;
+	arNearest.reserve(size_t(nCount));
+
+	NearestCells cells = { &rvecPos, &arNearest, nCount,
+		fMaxDistance * fMaxDistance, BeginQuery() };
+
+	int cx = int(floor(rvecPos.x));
+	int cy = int(floor(rvecPos.y));
+
+	int nMaxRing = max(max(cx, nWidth - 1 - cx),
+		max(cy, nHeight - 1 - cy));
+
+	// Expand in rings of cells around the point. Cells in ring r are at
+	// least r - 1 tiles away, so stop once that is past the farthest candidate
+
+	for(int r = 0; r <= nMaxRing; r++)
+	{
+		float fRing = float(max(0, r - 1));
+
+		if (fRing * fRing >
+		   GetNearestBound(arNearest, nCount, cells.fMaxDistanceSq))
+			break;
+
+		int nTop = max(0, cy - r);
+		int nBottom = min(nHeight - 1, cy + r);
+		int nLeft = max(0, cx - r);
+		int nRight = min(nWidth - 1, cx + r);
+
+		for(int ty = nTop; ty <= nBottom; ty++)
+		{
+			// Whole rows on top and bottom of the ring, only sides in between
+
+			bool bEdge = (cy - r == ty || cy + r == ty);
+
+			int nStep = bEdge ? 1 : 2 * r;
+
+			for(int tx = bEdge ? nLeft : cx - r; tx <= nRight; tx += nStep)
+			{
+				if (tx >= 0)
+					QueryCell(tx, ty, VisitNearest, &cells);
+			}
+		}
+	}
+
+	return EndNearest(arNearest, parResult);
+}
+
+int SpacePartition::QueryRadiusCells(const Vector2& rvecPos,
+									 float fRadius,
+									 PQUERYCALLBACK pCallback,
+									 void* pContext) const
+{
+	// Validate range covering the circle
+
+	Rect rcRange(int(floor(rvecPos.x - fRadius)),
+		int(floor(rvecPos.y - fRadius)),
+		int(floor(rvecPos.x + fRadius)) + 1,
+		int(floor(rvecPos.y + fRadius)) + 1);
+
+	ValidateRange(rcRange);
+
+	// Report actors within radius, skipping cells outside of the circle
+
+	RadiusCells cells = { &rvecPos, fRadius * fRadius,
+		pCallback, pContext, BeginQuery(), 0 };
+
+	for(int ty = rcRange.top; ty < rcRange.bottom; ty++)
+	{
+		for(int tx = rcRange.left; tx < rcRange.right; tx++)
+		{
+			if (GetDistanceSq(rvecPos, float(tx), float(ty),
+			   float(tx + 1), float(ty + 1)) <= cells.fRadiusSq)
+				QueryCell(tx, ty, VisitRadius, &cells);
+		}
+	}
+
+	return cells.nCount;
+}
+
+void SpacePartition::VisitNearest(Actor* pActor, void* pContext)
+{
+	NearestCells* pCells = reinterpret_cast<NearestCells*>(pContext);
+
+	if (Visit(pActor, pCells->dwStamp) == false)
+		return;
+
+	float fDistanceSq = GetDistanceSq(*pCells->pvecPos, pActor);
+
+	if (fDistanceSq <= GetNearestBound(*pCells->parNearest, pCells->nCount,
+	   pCells->fMaxDistanceSq))
+		AddNearest(*pCells->parNearest, pCells->nCount, pActor, fDistanceSq);
+}
+
+void SpacePartition::VisitRadius(Actor* pActor, void* pContext)
+{
+	RadiusCells* pCells = reinterpret_cast<RadiusCells*>(pContext);
+
+	if (Visit(pActor, pCells->dwStamp) == false)
+		return;
+
+	if (GetDistanceSq(*pCells->pvecPos, pActor) > pCells->fRadiusSq)
+		return;
+
+	pCells->pCallback(pActor, pCells->pContext);
+
+	pCells->nCount++;
+}
+
+/*----------------------------------------------------------*\
+| SpacePartitionUniformGrid implementation
+\*----------------------------------------------------------*/
+
+SpacePartitionUniformGrid::SpacePartitionUniformGrid(void):
+													 m_nWidth(0),
+													 m_nHeight(0),
+													 m_ppsetSpace(NULL)
+{
+}
+
+SpacePartitionUniformGrid::~SpacePartitionUniformGrid(void)
+{
+	Empty();
+}
+
+SpacePartition::Types SpacePartitionUniformGrid::GetType(void) const
+{
+	return TYPE_UNIFORMGRID;
+}
+
+void SpacePartitionUniformGrid::SetSize(int nWidth, int nHeight, bool bInitOnUse)
+{
+	if (NULL == m_ppsetSpace)
+	{
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+
+		if (false == bInitOnUse)
+			Initialize();
+	}
+	else
+	{
+		Resize(nWidth, nHeight);
+	}
+}
+
+bool SpacePartitionUniformGrid::IsValidPosition(const Vector2& rvecPos) const
+{
+	return ((int(rvecPos.x) >= 0 && int(rvecPos.x) < m_nWidth) &&
+			(int(rvecPos.y) >= 0 && int(rvecPos.y) < m_nHeight));
+}
+
+bool SpacePartitionUniformGrid::IsValidPosition(float x, float y) const
+{
+	return ((int(x) >= 0 && int(x) < m_nWidth) &&
+			(int(y) >= 0 && int(y) < m_nHeight));
+}
+
+bool SpacePartitionUniformGrid::IsValidPosition(int x, int y) const
+{
+	return ((x >= 0 && x < m_nWidth) &&
+			(y >= 0 && y < m_nHeight));
+}
+
+bool SpacePartitionUniformGrid::IsValidRange(const Rect& rrc) const
+{
+	if (rrc.left < 0 || rrc.left >= m_nWidth)
+		return false;
+
+	if (rrc.top < 0 || rrc.top >= m_nHeight)
+		return false;
+
+	if (rrc.right < 0 || rrc.right > m_nWidth)
+		return false;
+
+	if (rrc.bottom < 0 || rrc.bottom > m_nHeight)
+		return false;
+
+	return true;
+}
+
+bool SpacePartitionUniformGrid::IsValidRange(const Vector2& rvecPos,
 											 const Vector2& rvecSize) const
 {
 	return IsValidRange(Rect(int(floor(rvecPos.x)),
@@ -533,7 +2472,989 @@ bool SpacePartitionUniformGrid::IsValidRange(const Vector2& rvecPos,
 							 int(ceil(rvecPos.y + rvecSize.y))));
 }
 
-void SpacePartitionUniformGrid::ValidateRange(Rect& rrc) const
+void SpacePartitionUniformGrid::ValidateRange(Rect& rrc) const
+{
+	if (rrc.left < 0)
+		rrc.left = 0;
+	else if (rrc.left >= m_nWidth)
+		rrc.left = m_nWidth - 1;
+
+	if (rrc.top < 0)
+		rrc.top = 0;
+	else if (rrc.top >= m_nHeight)
+		rrc.top = m_nHeight - 1;
+
+	if (rrc.right < 0)
+		rrc.right = 0;
+	else if (rrc.right > m_nWidth)
+		rrc.right = m_nWidth;
+
+	if (rrc.bottom < 0)
+		rrc.bottom = 0;
+	else if (rrc.bottom > m_nHeight)
+		rrc.bottom = m_nHeight;
+}
+
+void SpacePartitionUniformGrid::Add(Actor* pActor)
+{
+	if (NULL == pActor)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	if (NULL == m_ppsetSpace)
+		Initialize();
+
+	Rect rcBounds = pActor->GetBounds();
+	ValidateRange(rcBounds);
+
+	for(int ty = rcBounds.top; ty < rcBounds.bottom; ty++)
+	{
+		for(int tx = rcBounds.left; tx < rcBounds.right; tx++)
+		{
+			m_ppsetSpace[ty][tx].insert(pActor);
+		}
+	}
+}
+
+void SpacePartitionUniformGrid::Remove(Actor* pActor)
+{
+	if (NULL == pActor)
+		return;
+
+	if (NULL == m_ppsetSpace)
+		return;
+
+	Rect rcBounds = pActor->GetBounds();
+	ValidateRange(rcBounds);
+
+	for(int ty = rcBounds.top; ty < rcBounds.bottom; ty++)
+	{
+		for(int tx = rcBounds.left; tx < rcBounds.right; tx++)
+		{
+			m_ppsetSpace[ty][tx].erase(pActor);
+		}
+	}
+}
+
+void SpacePartitionUniformGrid::Update(Actor* pActor,
+									   const Rect& rrcOldBounds)
+{
+	if (NULL == pActor)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	if (NULL == m_ppsetSpace)
+	{
+		Add(pActor);
+	}
+	else
+	{
+		// Calculate ranges
+
+		Rect rcOldRange = rrcOldBounds;
+		Rect rcNewRange = pActor->GetBounds();
+
+		ValidateRange(rcOldRange);
+		ValidateRange(rcNewRange);
+
+		// Skip if still covering the same cells
+
+		if (rcOldRange == rcNewRange)
+			return;
+
+		// Add to cells entering the range
+
+		Rect arcDelta[4];
+
+		int nDeltaCount = rcNewRange.Subtract(rcOldRange, arcDelta);
+
+		for(int n = 0; n < nDeltaCount; n++)
+		{
+			const Rect& rrc = arcDelta[n];
+
+			for(int ty = rrc.top; ty < rrc.bottom; ty++)
+			{
+				for(int tx = rrc.left; tx < rrc.right; tx++)
+				{
+					m_ppsetSpace[ty][tx].insert(pActor);
+				}
+			}
+		}
+
+		// Remove from cells leaving the range
+
+		nDeltaCount = rcOldRange.Subtract(rcNewRange, arcDelta);
+
+		for(int n = 0; n < nDeltaCount; n++)
+		{
+			const Rect& rrc = arcDelta[n];
+
+			for(int ty = rrc.top; ty < rrc.bottom; ty++)
+			{
+				for(int tx = rrc.left; tx < rrc.right; tx++)
+				{
+					m_ppsetSpace[ty][tx].erase(pActor);
+				}
+			}
+		}
+	}
+}
+
+int SpacePartitionUniformGrid::Query(int tx, int ty, ActorArray* parResult)
+{
+	if (NULL == m_ppsetSpace)
+		return 0;
+
+	if (IsValidPosition(tx, ty) == false)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	ActorSet& rCell = m_ppsetSpace[ty][tx];
+
+	if (parResult != NULL)
+		std::copy(rCell.begin(), rCell.end(),
+			std::inserter(*parResult, parResult->end()));
+
+	return int(rCell.size());
+}
+
+int SpacePartitionUniformGrid::Query(float tx, float ty, ActorArray* parResult)
+{
+	return Query(int(tx), int(ty), parResult);
+}
+
+int SpacePartitionUniformGrid::Query(Rect& rrcRange, ActorArray* parResult) const
+{
+	return Query(rrcRange, QueryAppend, parResult);
+}
+
+int SpacePartitionUniformGrid::Query(Rect& rrcRange,
+									 PQUERYCALLBACK pCallback,
+									 void* pContext) const
+{
+	if (NULL == m_ppsetSpace)
+		return 0;
+
+	// Validate range
+
+	ValidateRange(rrcRange);
+
+	// Report actors from cells in range, skipping those already visited
+
+	DWORD dwStamp = BeginQuery();
+
+	int nCount = 0;
+
+	for(int ty = rrcRange.top; ty < rrcRange.bottom; ty++)
+	{
+		for(int tx = rrcRange.left; tx < rrcRange.right; tx++)
+		{
+			const ActorSet& rsetCell = m_ppsetSpace[ty][tx];
+
+			for(ActorSetConstIterator pos = rsetCell.begin();
+				pos != rsetCell.end();
+				pos++)
+			{
+				if (Visit(*pos, dwStamp) == false)
+					continue;
+
+				pCallback(*pos, pContext);
+
+				nCount++;
+			}
+		}
+	}
+
+	return nCount;
+}
+
+int SpacePartitionUniformGrid::QueryNearest(const Vector2& rvecPos,
+											int nCount,
+											ActorArray* parResult,
+											float fMaxDistance) const
+{
+	if (NULL == m_ppsetSpace || nCount <= 0)
+		return 0;
+
+	return QueryNearestCells(rvecPos, nCount, parResult, fMaxDistance,
+		m_nWidth, m_nHeight);
+}
+
+int SpacePartitionUniformGrid::QueryRadius(const Vector2& rvecPos,
+										   float fRadius,
+										   ActorArray* parResult) const
+{
+	return QueryRadius(rvecPos, fRadius, QueryAppend, parResult);
+}
+
+int SpacePartitionUniformGrid::QueryRadius(const Vector2& rvecPos,
+										   float fRadius,
+										   PQUERYCALLBACK pCallback,
+										   void* pContext) const
+{
+	if (NULL == m_ppsetSpace || fRadius < 0.0f)
+		return 0;
+
+	return QueryRadiusCells(rvecPos, fRadius, pCallback, pContext);
+}
+
+void SpacePartitionUniformGrid::QueryCell(int tx, int ty,
+										  PQUERYCALLBACK pCallback,
+										  void* pContext) const
+{
+	const ActorSet& rsetCell = m_ppsetSpace[ty][tx];
+
+	for(ActorSetConstIterator pos = rsetCell.begin();
+		pos != rsetCell.end();
+		pos++)
+	{
+		pCallback(*pos, pContext);
+	}
+}
+
+void SpacePartitionUniformGrid::Initialize(void)
+{
+	if (m_ppsetSpace != NULL)
+		return;
+
+	try
+	{
+		m_ppsetSpace = new ActorSet*[m_nHeight];
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(ActorSet*) * m_nHeight);
+	}
+
+	try
+	{
+		for(int n = 0; n < m_nHeight; n++)
+		{
+			m_ppsetSpace[n] = new ActorSet[m_nWidth];
+		}
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(ActorSet) * m_nWidth);
+	}
+}
+
+void SpacePartitionUniformGrid::Resize(int nWidth, int nHeight)
+{
+	if (nHeight > m_nHeight)
+	{
+		// Reallocate
+
+		ActorSet** ppsetSpace = NULL;
+
+		try
+		{
+			ppsetSpace = new ActorSet*[nHeight];
+		}
+
+		catch(std::bad_alloc)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+				sizeof(ActorSet*) * nHeight);
+		}
+
+		// Re-fill
+
+		for(int ty = 0; ty < m_nHeight; ty++)
+		{
+			ppsetSpace[ty] = m_ppsetSpace[ty];
+		}	
+
+		// Add new entries
+
+		for(int ty = m_nHeight; ty < nHeight; ty++)
+		{
+			ppsetSpace[ty] = new ActorSet[nWidth];
+		}
+
+		// Replace
+
+		delete[] m_ppsetSpace;
+		m_ppsetSpace = ppsetSpace;
+	}
+	else if (nHeight < m_nHeight)
+	{
+		// Delete a few rows from the end
+
+		for(int y = nHeight; y < m_nHeight; y++)
+		{
+			delete[] m_ppsetSpace[y];
+		}
+
+		// Reallocate
+
+		ActorSet** ppsetSpace = NULL;
+
+		try
+		{
+			ppsetSpace = new ActorSet*[nHeight];
+		}
+
+		catch(std::bad_alloc)
+		{
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+				sizeof(ActorSet*) * nHeight);
+		}
+
+		// Re-fill
+
+		for(int y = 0; y < nHeight; y++)
+		{
+			ppsetSpace[y] = m_ppsetSpace[y];
+		}
+
+		// Replace
+
+		delete[] m_ppsetSpace;
+		m_ppsetSpace = ppsetSpace;
+	}
+
+	// Rows added above are already allocated with new width
+
+	int nOldRows = min(m_nHeight, nHeight);
+
+	try
+	{
+		if (nWidth > m_nWidth)
+		{
+			// Reallocate rows to contain more elements
+			
+			for(int ty = 0; ty < nOldRows; ty++)
+			{
+				ActorSet* pOldSets = m_ppsetSpace[ty];
+
+				m_ppsetSpace[ty] = new ActorSet[nWidth];
+
+				for(int tx = 0; tx < m_nWidth; tx++)
+				{
+					std::copy(pOldSets[tx].begin(), pOldSets[tx].end(),
+						std::inserter(m_ppsetSpace[ty][tx],
+						m_ppsetSpace[ty][tx].end()));
+				}
+
+				delete[] pOldSets;
+			}
+		}
+		else if (nWidth < m_nWidth)
+		{
+			// Reallocate rows to contain less elements
+
+			for(int ty = 0; ty < nOldRows; ty++)
+			{
+				ActorSet* pOldSets = m_ppsetSpace[ty];
+
+				m_ppsetSpace[ty] = new ActorSet[nWidth];
+
+				for(int tx = 0; tx < nWidth; tx++)
+				{
+					std::copy(pOldSets[tx].begin(),
+						pOldSets[tx].end(),
+						std::inserter(m_ppsetSpace[ty][tx],
+							m_ppsetSpace[ty][tx].end()));
+				}
+
+				delete[] pOldSets;
+			}
+		}
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(ActorSet) * nWidth);
+	}
+
+	m_nWidth = nWidth;
+	m_nHeight = nHeight;
+}
+
+DWORD SpacePartitionUniformGrid::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(SpacePartitionUniformGrid) +
+		sizeof(ActorSet) * m_nWidth * m_nHeight +
+		sizeof(ActorSet*) * m_nHeight;
+
+	// Add tree nodes allocated by cell sets (three links, color and key)
+
+	if (m_ppsetSpace != NULL)
+	{
+		for(int ty = 0; ty < m_nHeight; ty++)
+		{
+			for(int tx = 0; tx < m_nWidth; tx++)
+			{
+				dwSize += DWORD(m_ppsetSpace[ty][tx].size()) *
+					(sizeof(void*) * 4 + sizeof(DWORD));
+			}
+		}
+	}
+
+	return dwSize;
+}
+
+void SpacePartitionUniformGrid::Empty(void)
+{
+	if (m_ppsetSpace != NULL)
+	{
+		for(int n = 0; n < m_nHeight; n++)
+		{
+			delete[] m_ppsetSpace[n];
+		}
+
+		delete[] m_ppsetSpace;
+
+		m_ppsetSpace = NULL;
+	}
+
+	m_nWidth = 0;
+	m_nHeight = 0;
+}
+
+/*----------------------------------------------------------*\
+| SpacePartitionFlatGrid implementation
+\*----------------------------------------------------------*/
+
+SpacePartitionFlatGrid::SpacePartitionFlatGrid(void):
+											   m_nWidth(0),
+											   m_nHeight(0),
+											   m_pnCells(NULL),
+											   m_nFreeNode(INVALID_INDEX)
+{
+}
+
+SpacePartitionFlatGrid::~SpacePartitionFlatGrid(void)
+{
+	Empty();
+}
+
+SpacePartition::Types SpacePartitionFlatGrid::GetType(void) const
+{
+	return TYPE_FLATGRID;
+}
+
+void SpacePartitionFlatGrid::SetSize(int nWidth, int nHeight, bool bInitOnUse)
+{
+	if (NULL == m_pnCells)
+	{
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+
+		if (false == bInitOnUse)
+			Initialize();
+	}
+	else
+	{
+		// Cell indices depend on width, so collect actors and re-link them
+
+		ActorArray arActors;
+
+		for(int n = 0; n < int(m_arNodes.size()); n++)
+		{
+			Actor* pActor = m_arNodes[n].pActor;
+
+			if (pActor != NULL && pActor->m_nSpaceNode == n)
+			{
+				pActor->m_nSpaceNode = INVALID_INDEX;
+				arActors.push_back(pActor);
+			}
+		}
+
+		Empty();
+
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+
+		Initialize();
+
+		for(ActorArrayIterator pos = arActors.begin();
+			pos != arActors.end();
+			pos++)
+		{
+			Add(*pos);
+		}
+	}
+}
+
+bool SpacePartitionFlatGrid::IsValidPosition(const Vector2& rvecPos) const
+{
+	return ((int(rvecPos.x) >= 0 && int(rvecPos.x) < m_nWidth) &&
+			(int(rvecPos.y) >= 0 && int(rvecPos.y) < m_nHeight));
+}
+
+bool SpacePartitionFlatGrid::IsValidPosition(float x, float y) const
+{
+	return ((int(x) >= 0 && int(x) < m_nWidth) &&
+			(int(y) >= 0 && int(y) < m_nHeight));
+}
+
+bool SpacePartitionFlatGrid::IsValidPosition(int x, int y) const
+{
+	return ((x >= 0 && x < m_nWidth) &&
+			(y >= 0 && y < m_nHeight));
+}
+
+bool SpacePartitionFlatGrid::IsValidRange(const Rect& rrc) const
+{
+	if (rrc.left < 0 || rrc.left >= m_nWidth)
+		return false;
+
+	if (rrc.top < 0 || rrc.top >= m_nHeight)
+		return false;
+
+	if (rrc.right < 0 || rrc.right > m_nWidth)
+		return false;
+
+	if (rrc.bottom < 0 || rrc.bottom > m_nHeight)
+		return false;
+
+	return true;
+}
+
+bool SpacePartitionFlatGrid::IsValidRange(const Vector2& rvecPos,
+										  const Vector2& rvecSize) const
+{
+	return IsValidRange(Rect(int(floor(rvecPos.x)),
+							 int(floor(rvecPos.y)),
+							 int(ceil(rvecPos.x + rvecSize.x)),
+							 int(ceil(rvecPos.y + rvecSize.y))));
+}
+
+void SpacePartitionFlatGrid::ValidateRange(Rect& rrc) const
+{
+	if (rrc.left < 0)
+		rrc.left = 0;
+	else if (rrc.left >= m_nWidth)
+		rrc.left = m_nWidth - 1;
+
+	if (rrc.top < 0)
+		rrc.top = 0;
+	else if (rrc.top >= m_nHeight)
+		rrc.top = m_nHeight - 1;
+
+	if (rrc.right < 0)
+		rrc.right = 0;
+	else if (rrc.right > m_nWidth)
+		rrc.right = m_nWidth;
+
+	if (rrc.bottom < 0)
+		rrc.bottom = 0;
+	else if (rrc.bottom > m_nHeight)
+		rrc.bottom = m_nHeight;
+}
+
+void SpacePartitionFlatGrid::Add(Actor* pActor)
+{
+	if (NULL == pActor)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	if (NULL == m_pnCells)
+		Initialize();
+
+	if (IsLinked(pActor) == true)
+		Unlink(pActor);
+
+	Rect rcBounds = pActor->GetBounds();
+	ValidateRange(rcBounds);
+
+	Link(pActor, rcBounds);
+}
+
+void SpacePartitionFlatGrid::Remove(Actor* pActor)
+{
+	if (NULL == pActor)
+		return;
+
+	if (NULL == m_pnCells)
+		return;
+
+	// Nodes are chained per actor, so bounds are not needed
+
+	if (IsLinked(pActor) == true)
+		Unlink(pActor);
+}
+
+void SpacePartitionFlatGrid::Update(Actor* pActor,
+									const Rect& rrcOldBounds)
+{
+	if (NULL == pActor)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	// Skip if still covering the same cells
+
+	if (IsLinked(pActor) == true && pActor->GetBounds() == rrcOldBounds)
+		return;
+
+	Add(pActor);
+}
+
+int SpacePartitionFlatGrid::Query(int tx, int ty, ActorArray* parResult)
+{
+	if (NULL == m_pnCells)
+		return 0;
+
+	if (IsValidPosition(tx, ty) == false)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	int nCount = 0;
+
+	for(int nNode = m_pnCells[ty * m_nWidth + tx];
+		nNode != INVALID_INDEX;
+		nNode = m_arNodes[nNode].nNext)
+	{
+		if (parResult != NULL)
+			parResult->push_back(m_arNodes[nNode].pActor);
+
+		nCount++;
+	}
+
+	return nCount;
+}
+
+int SpacePartitionFlatGrid::Query(float tx, float ty, ActorArray* parResult)
+{
+	return Query(int(tx), int(ty), parResult);
+}
+
+int SpacePartitionFlatGrid::Query(Rect& rrcRange, ActorArray* parResult) const
+{
+	return Query(rrcRange, QueryAppend, parResult);
+}
+
+int SpacePartitionFlatGrid::Query(Rect& rrcRange,
+								  PQUERYCALLBACK pCallback,
+								  void* pContext) const
+{
+	if (NULL == m_pnCells)
+		return 0;
+
+	// Validate range
+
+	ValidateRange(rrcRange);
+
+	// Report actors from cells in range, walking rows of contiguous cells
+	// and skipping actors already visited
+
+	DWORD dwStamp = BeginQuery();
+
+	int nCount = 0;
+
+	for(int ty = rrcRange.top; ty < rrcRange.bottom; ty++)
+	{
+		const int* pnRow = m_pnCells + ty * m_nWidth;
+
+		for(int tx = rrcRange.left; tx < rrcRange.right; tx++)
+		{
+			for(int nNode = pnRow[tx];
+				nNode != INVALID_INDEX;
+				nNode = m_arNodes[nNode].nNext)
+			{
+				Actor* pActor = m_arNodes[nNode].pActor;
+
+				if (Visit(pActor, dwStamp) == false)
+					continue;
+
+				pCallback(pActor, pContext);
+
+				nCount++;
+			}
+		}
+	}
+
+	return nCount;
+}
+
+int SpacePartitionFlatGrid::QueryNearest(const Vector2& rvecPos,
+										 int nCount,
+										 ActorArray* parResult,
+										 float fMaxDistance) const
+{
+	if (NULL == m_pnCells || nCount <= 0)
+		return 0;
+
+	return QueryNearestCells(rvecPos, nCount, parResult, fMaxDistance,
+		m_nWidth, m_nHeight);
+}
+
+int SpacePartitionFlatGrid::QueryRadius(const Vector2& rvecPos,
+										float fRadius,
+										ActorArray* parResult) const
+{
+	return QueryRadius(rvecPos, fRadius, QueryAppend, parResult);
+}
+
+int SpacePartitionFlatGrid::QueryRadius(const Vector2& rvecPos,
+										float fRadius,
+										PQUERYCALLBACK pCallback,
+										void* pContext) const
+{
+	if (NULL == m_pnCells || fRadius < 0.0f)
+		return 0;
+
+	return QueryRadiusCells(rvecPos, fRadius, pCallback, pContext);
+}
+
+DWORD SpacePartitionFlatGrid::GetMemoryFootprint(void) const
+{
+	return sizeof(SpacePartitionFlatGrid) +
+		   (m_pnCells != NULL ? sizeof(int) * m_nWidth * m_nHeight : 0) +
+		   sizeof(Node) * DWORD(m_arNodes.capacity());
+}
+
+void SpacePartitionFlatGrid::Empty(void)
+{
+	delete[] m_pnCells;
+	m_pnCells = NULL;
+
+	m_arNodes.clear();
+	m_nFreeNode = INVALID_INDEX;
+}
+
+void SpacePartitionFlatGrid::QueryCell(int tx, int ty,
+									   PQUERYCALLBACK pCallback,
+									   void* pContext) const
+{
+	for(int nNode = m_pnCells[ty * m_nWidth + tx];
+		nNode != INVALID_INDEX;
+		nNode = m_arNodes[nNode].nNext)
+	{
+		pCallback(m_arNodes[nNode].pActor, pContext);
+	}
+}
+
+void SpacePartitionFlatGrid::Initialize(void)
+{
+	if (m_pnCells != NULL)
+		return;
+
+	int nCellCount = m_nWidth * m_nHeight;
+
+	try
+	{
+		m_pnCells = new int[nCellCount];
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			sizeof(int) * nCellCount);
+	}
+
+	std::fill(m_pnCells, m_pnCells + nCellCount, INVALID_INDEX);
+}
+
+bool SpacePartitionFlatGrid::IsLinked(const Actor* pActor) const
+{
+	// Actor node index may be stale if it was linked to another partition
+
+	int nNode = pActor->m_nSpaceNode;
+
+	return (nNode >= 0 && nNode < int(m_arNodes.size()) &&
+		m_arNodes[nNode].pActor == pActor);
+}
+
+void SpacePartitionFlatGrid::Link(Actor* pActor, const Rect& rrcRange)
+{
+	// Link in reverse so that the actor's first node is its top left cell
+
+	int nOwned = INVALID_INDEX;
+
+	for(int ty = rrcRange.bottom - 1; ty >= rrcRange.top; ty--)
+	{
+		for(int tx = rrcRange.right - 1; tx >= rrcRange.left; tx--)
+		{
+			// Take a node from the free list or grow the pool
+
+			int nNode = m_nFreeNode;
+
+			if (INVALID_INDEX == nNode)
+			{
+				try
+				{
+					m_arNodes.push_back(Node());
+				}
+
+				catch(std::bad_alloc)
+				{
+					throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Node));
+				}
+
+				nNode = int(m_arNodes.size()) - 1;
+			}
+			else
+			{
+				m_nFreeNode = m_arNodes[nNode].nNext;
+			}
+
+			// Insert at the head of cell list
+
+			int nCell = ty * m_nWidth + tx;
+
+			Node& rNode = m_arNodes[nNode];
+
+			rNode.pActor = pActor;
+			rNode.nCell = nCell;
+			rNode.nPrev = INVALID_INDEX;
+			rNode.nNext = m_pnCells[nCell];
+			rNode.nNextOwned = nOwned;
+
+			if (rNode.nNext != INVALID_INDEX)
+				m_arNodes[rNode.nNext].nPrev = nNode;
+
+			m_pnCells[nCell] = nNode;
+
+			nOwned = nNode;
+		}
+	}
+
+	pActor->m_nSpaceNode = nOwned;
+}
+
+void SpacePartitionFlatGrid::Unlink(Actor* pActor)
+{
+	int nNode = pActor->m_nSpaceNode;
+
+	while(nNode != INVALID_INDEX)
+	{
+		Node& rNode = m_arNodes[nNode];
+
+		// Remove from cell list
+
+		if (rNode.nPrev != INVALID_INDEX)
+			m_arNodes[rNode.nPrev].nNext = rNode.nNext;
+		else
+			m_pnCells[rNode.nCell] = rNode.nNext;
+
+		if (rNode.nNext != INVALID_INDEX)
+			m_arNodes[rNode.nNext].nPrev = rNode.nPrev;
+
+		// Return to free list
+
+		int nNextOwned = rNode.nNextOwned;
+
+		rNode.pActor = NULL;
+		rNode.nNext = m_nFreeNode;
+		m_nFreeNode = nNode;
+
+		nNode = nNextOwned;
+	}
+
+	pActor->m_nSpaceNode = INVALID_INDEX;
+}
+/*----------------------------------------------------------*\
+| SpacePartitionQuadTree implementation
+\*----------------------------------------------------------*/
+
+SpacePartitionQuadTree::SpacePartitionQuadTree(void):
+											   m_nWidth(0),
+											   m_nHeight(0),
+											   m_nSize(0),
+											   m_nFreeNode(INVALID_INDEX),
+											   m_nFreeItem(INVALID_INDEX)
+{
+}
+
+SpacePartitionQuadTree::~SpacePartitionQuadTree(void)
+{
+	Empty();
+}
+
+SpacePartition::Types SpacePartitionQuadTree::GetType(void) const
+{
+	return TYPE_QUADTREE;
+}
+
+void SpacePartitionQuadTree::SetSize(int nWidth, int nHeight, bool bInitOnUse)
+{
+	if (m_arNodes.empty() == true)
+	{
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+
+		if (false == bInitOnUse)
+			Initialize();
+	}
+	else
+	{
+		// Node placement depends on root size, so collect actors and re-link them
+
+		ActorArray arActors;
+
+		for(ItemArrayIterator pos = m_arItems.begin();
+			pos != m_arItems.end();
+			pos++)
+		{
+			if (pos->pActor != NULL)
+			{
+				pos->pActor->m_nSpaceNode = INVALID_INDEX;
+				arActors.push_back(pos->pActor);
+			}
+		}
+
+		Empty();
+
+		m_nWidth = nWidth;
+		m_nHeight = nHeight;
+
+		Initialize();
+
+		for(ActorArrayIterator pos = arActors.begin();
+			pos != arActors.end();
+			pos++)
+		{
+			Add(*pos);
+		}
+	}
+}
+
+bool SpacePartitionQuadTree::IsValidPosition(const Vector2& rvecPos) const
+{
+	return ((int(rvecPos.x) >= 0 && int(rvecPos.x) < m_nWidth) &&
+			(int(rvecPos.y) >= 0 && int(rvecPos.y) < m_nHeight));
+}
+
+bool SpacePartitionQuadTree::IsValidPosition(float x, float y) const
+{
+	return ((int(x) >= 0 && int(x) < m_nWidth) &&
+			(int(y) >= 0 && int(y) < m_nHeight));
+}
+
+bool SpacePartitionQuadTree::IsValidPosition(int x, int y) const
+{
+	return ((x >= 0 && x < m_nWidth) &&
+			(y >= 0 && y < m_nHeight));
+}
+
+bool SpacePartitionQuadTree::IsValidRange(const Rect& rrc) const
+{
+	if (rrc.left < 0 || rrc.left >= m_nWidth)
+		return false;
+
+	if (rrc.top < 0 || rrc.top >= m_nHeight)
+		return false;
+
+	if (rrc.right < 0 || rrc.right > m_nWidth)
+		return false;
+
+	if (rrc.bottom < 0 || rrc.bottom > m_nHeight)
+		return false;
+
+	return true;
+}
+
+bool SpacePartitionQuadTree::IsValidRange(const Vector2& rvecPos,
+										  const Vector2& rvecSize) const
+{
+	return IsValidRange(Rect(int(floor(rvecPos.x)),
+							 int(floor(rvecPos.y)),
+							 int(ceil(rvecPos.x + rvecSize.x)),
+							 int(ceil(rvecPos.y + rvecSize.y))));
+}
+
+void SpacePartitionQuadTree::ValidateRange(Rect& rrc) const
 {
 	if (rrc.left < 0)
 		rrc.left = 0;
@@ -556,349 +3477,567 @@ void SpacePartitionUniformGrid::ValidateRange(Rect& rrc) const
 		rrc.bottom = m_nHeight;
 }
 
-void SpacePartitionUniformGrid::Add(Actor* pActor)
+void SpacePartitionQuadTree::Add(Actor* pActor)
 {
 	if (NULL == pActor)
 		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
 
-	if (NULL == m_ppsetSpace)
+	if (m_arNodes.empty() == true)
 		Initialize();
 
+	if (IsLinked(pActor) == true)
+		Unlink(pActor);
+
 	Rect rcBounds = pActor->GetBounds();
 	ValidateRange(rcBounds);
 
-	for(int ty = rcBounds.top; ty < rcBounds.bottom; ty++)
-	{
-		for(int tx = rcBounds.left; tx < rcBounds.right; tx++)
-		{
-			m_ppsetSpace[ty][tx].insert(pActor);
-		}
-	}
+	Link(pActor, rcBounds);
 }
 
-void SpacePartitionUniformGrid::Remove(Actor* pActor)
+void SpacePartitionQuadTree::Remove(Actor* pActor)
 {
 	if (NULL == pActor)
 		return;
 
-	if (NULL == m_ppsetSpace)
+	if (m_arNodes.empty() == true)
+		return;
+
+	// Items are referenced from actors, so bounds are not needed
+
+	if (IsLinked(pActor) == true)
+		Unlink(pActor);
+}
+
+void SpacePartitionQuadTree::Update(Actor* pActor,
+									const Rect& rrcOldBounds)
+{
+	if (NULL == pActor)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+
+	UNREFERENCED_PARAMETER(rrcOldBounds);
+
+	if (IsLinked(pActor) == false)
+	{
+		Add(pActor);
 		return;
+	}
 
 	Rect rcBounds = pActor->GetBounds();
 	ValidateRange(rcBounds);
 
-	for(int ty = rcBounds.top; ty < rcBounds.bottom; ty++)
+	Item& rItem = m_arItems[pActor->m_nSpaceNode];
+
+	if (rcBounds == rItem.rcBounds)
+		return;
+
+	// If actor still belongs in the same node, only update its bounds
+
+	if (Locate(rcBounds, false) == rItem.nNode)
 	{
-		for(int tx = rcBounds.left; tx < rcBounds.right; tx++)
-		{
-			m_ppsetSpace[ty][tx].erase(pActor);
-		}
+		rItem.rcBounds = rcBounds;
+		return;
 	}
+
+	Unlink(pActor);
+	Link(pActor, rcBounds);
 }
 
-void SpacePartitionUniformGrid::Update(Actor* pActor,
-									   const Rect& rrcOldBounds)
+int SpacePartitionQuadTree::Query(int tx, int ty, ActorArray* parResult)
 {
-	if (NULL == pActor)
+	if (m_arNodes.empty() == true)
+		return 0;
+
+	if (IsValidPosition(tx, ty) == false)
 		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
 
-	if (NULL == m_ppsetSpace)
-	{
-		Add(pActor);
-	}
-	else
+	return QueryNode(0, 0, 0, m_nSize,
+		Rect(tx, ty, tx + 1, ty + 1), QueryAppend, parResult);
+}
+
+int SpacePartitionQuadTree::Query(float tx, float ty, ActorArray* parResult)
+{
+	return Query(int(tx), int(ty), parResult);
+}
+
+int SpacePartitionQuadTree::Query(Rect& rrcRange, ActorArray* parResult) const
+{
+	return Query(rrcRange, QueryAppend, parResult);
+}
+
+int SpacePartitionQuadTree::Query(Rect& rrcRange,
+								  PQUERYCALLBACK pCallback,
+								  void* pContext) const
+{
+	if (m_arNodes.empty() == true)
+		return 0;
+
+	// Validate range
+
+	ValidateRange(rrcRange);
+
+	if (rrcRange.GetArea() <= 0)
+		return 0;
+
+	// Every actor is stored once, so no duplicates to skip
+
+	return QueryNode(0, 0, 0, m_nSize, rrcRange, pCallback, pContext);
+}
+
+int SpacePartitionQuadTree::QueryNearest(const Vector2& rvecPos,
+										 int nCount,
+										 ActorArray* parResult,
+										 float fMaxDistance) const
+{
+	if (m_arNodes.empty() == true || nCount <= 0)
+		return 0;
+
+	NearestArray arNearest;
+	arNearest.reserve(size_t(nCount));
+
+	float fMaxDistanceSq = fMaxDistance * fMaxDistance;
+
+	// Search nodes closest first by distance to their loose bounds,
+	// until the closest node left is past the farthest candidate
+
+	NodeDistanceArray arOpen;
+
+	NodeDistance root = { 0.0f, 0, 0, 0, m_nSize };
+	arOpen.push_back(root);
+
+	while(arOpen.empty() == false)
 	{
-		// Calculate ranges
+		std::pop_heap(arOpen.begin(), arOpen.end(), CompareNodeDistance);
 
-		Rect rcOldRange = rrcOldBounds;
-		Rect rcNewRange = pActor->GetBounds();
+		NodeDistance open = arOpen.back();
+		arOpen.pop_back();
 
-		ValidateRange(rcOldRange);
-		ValidateRange(rcNewRange);
+		if (open.fDistanceSq >
+		   GetNearestBound(arNearest, nCount, fMaxDistanceSq))
+			break;
 
-		// Add to new range
+		const Node& rNode = m_arNodes[open.nNode];
 
-		for(int ty = rcNewRange.top; ty < rcNewRange.bottom; ty++)
+		// Check actors stored in this node
+
+		for(int nItem = rNode.nFirstItem;
+			nItem != INVALID_INDEX;
+			nItem = m_arItems[nItem].nNext)
 		{
-			for(int tx = rcNewRange.left; tx < rcNewRange.right; tx++)
-			{
-				m_ppsetSpace[ty][tx].insert(pActor);
-			}
-		}
+			const Item& rItem = m_arItems[nItem];
 
-		// Remove from old range
+			// Actors outside of the layer have empty bounds and never match
 
-		Rect rcIntersect;
-		
-		if (rcOldRange.Intersect(rcNewRange, rcIntersect) == true)
-		{
-			// Remove only from non-intersected cells
+			if (rItem.rcBounds.GetArea() <= 0)
+				continue;
 
-			for(int ty = rcOldRange.top; ty < rcOldRange.bottom; ty++)
-			{
-				for(int tx = rcOldRange.left; tx < rcOldRange.right; tx++)
-				{
-					if (rcIntersect.PtInRect(tx, ty) == false)
-						m_ppsetSpace[ty][tx].erase(pActor);
-				}
-			}
+			float fDistanceSq = GetDistanceSq(rvecPos, rItem.pActor);
+
+			if (fDistanceSq <=
+			   GetNearestBound(arNearest, nCount, fMaxDistanceSq))
+				AddNearest(arNearest, nCount, rItem.pActor, fDistanceSq);
 		}
-		else
+
+		// Queue children that are not empty and may still be close enough
+
+		int nHalf = open.nSize / 2;
+		int nQuarter = nHalf / 2;
+
+		for(int q = 0; q < 4; q++)
 		{
-			for(int ty = rcOldRange.top; ty < rcOldRange.bottom; ty++)
-			{
-				for(int tx = rcOldRange.left; tx < rcOldRange.right; tx++)
-				{
-					m_ppsetSpace[ty][tx].erase(pActor);
-				}
-			}
-		}
-	}
-}
+			int nChild = rNode.arChildren[q];
 
-int SpacePartitionUniformGrid::Query(int tx, int ty, ActorArray* parResult)
-{
-	if (NULL == m_ppsetSpace)
-		return 0;
+			if (INVALID_INDEX == nChild || 0 == m_arNodes[nChild].nCount)
+				continue;
 
-	if (IsValidPosition(tx, ty) == false)
-		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 0);
+			int x = (q & 1) ? open.x + nHalf : open.x;
+			int y = (q & 2) ? open.y + nHalf : open.y;
 
-	ActorSet& rCell = m_ppsetSpace[ty][tx];
+			NodeDistance child = { GetDistanceSq(rvecPos,
+				float(x - nQuarter), float(y - nQuarter),
+				float(x + nHalf + nQuarter), float(y + nHalf + nQuarter)),
+				nChild, x, y, nHalf };
 
-	if (parResult != NULL)
-		std::copy(rCell.begin(), rCell.end(),
-			std::inserter(*parResult, parResult->end()));
+			if (child.fDistanceSq >
+			   GetNearestBound(arNearest, nCount, fMaxDistanceSq))
+				continue;
 
-	return int(rCell.size());
+			arOpen.push_back(child);
+
+			std::push_heap(arOpen.begin(), arOpen.end(), CompareNodeDistance);
+		}
+	}
+
+	return EndNearest(arNearest, parResult);
 }
 
-int SpacePartitionUniformGrid::Query(float tx, float ty, ActorArray* parResult)
+int SpacePartitionQuadTree::QueryRadius(const Vector2& rvecPos,
+										float fRadius,
+										ActorArray* parResult) const
 {
-	return Query(int(tx), int(ty), parResult);
+	return QueryRadius(rvecPos, fRadius, QueryAppend, parResult);
 }
 
-int SpacePartitionUniformGrid::Query(Rect& rrcRange, ActorArray* parResult) const
+int SpacePartitionQuadTree::QueryRadius(const Vector2& rvecPos,
+										float fRadius,
+										PQUERYCALLBACK pCallback,
+										void* pContext) const
 {
-	if (NULL == m_ppsetSpace)
+	if (m_arNodes.empty() == true || fRadius < 0.0f)
 		return 0;
 
-	// Validate range
+	// Every actor is stored once, so no duplicates to skip
 
-	ValidateRange(rrcRange);
+	return QueryNodeRadius(0, 0, 0, m_nSize, rvecPos, fRadius * fRadius,
+		pCallback, pContext);
+}
 
-	// Query actors from cells in range	
+DWORD SpacePartitionQuadTree::GetMemoryFootprint(void) const
+{
+	return sizeof(SpacePartitionQuadTree) +
+		   sizeof(Node) * DWORD(m_arNodes.capacity()) +
+		   sizeof(Item) * DWORD(m_arItems.capacity());
+}
 
-	ActorArray arActors;
+void SpacePartitionQuadTree::Empty(void)
+{
+	m_arNodes.clear();
+	m_nFreeNode = INVALID_INDEX;
 
-	for(int ty = rrcRange.top; ty < rrcRange.bottom; ty++)
-	{
-		for(int tx = rrcRange.left; tx < rrcRange.right; tx++)
-		{
-			std::copy(m_ppsetSpace[ty][tx].begin(),
-					  m_ppsetSpace[ty][tx].end(),
-					  std::inserter(arActors, arActors.end()));
-		}
-	}
+	m_arItems.clear();
+	m_nFreeItem = INVALID_INDEX;
 
-	std::sort(arActors.begin(), arActors.end());
+	m_nSize = 0;
+}
 
-	ActorArrayIterator posUniqueEnd =
-		std::unique(arActors.begin(), arActors.end());
+void SpacePartitionQuadTree::Initialize(void)
+{
+	if (m_arNodes.empty() == false)
+		return;
 
-	// Return actors and the count of actors
+	// Root covers the layer with the smallest power of two
 
-	int nUniqueCount =
-		(arActors.end() == posUniqueEnd) ? 0 : int(posUniqueEnd - arActors.begin());
+	m_nSize = 1;
 
-	if (parResult != NULL)
-		std::copy(arActors.begin(), posUniqueEnd,
-		std::inserter(*parResult, parResult->end()));
+	while(m_nSize < m_nWidth || m_nSize < m_nHeight)
+		m_nSize <<= 1;
 
-	return nUniqueCount;
+	AllocNode(INVALID_INDEX);
 }
 
-void SpacePartitionUniformGrid::Initialize(void)
+int SpacePartitionQuadTree::Locate(const Rect& rrcBounds, bool bCreate)
 {
-	if (m_ppsetSpace != NULL)
-		return;
+	// Descend by bounds center while bounds fit into child's side.
+	// Loose node bounds extend by half a side in every direction,
+	// so anything centered in a node with extent up to its side fits.
 
-	try
-	{
-		m_ppsetSpace = new ActorSet*[m_nHeight];
-	}
+	int nExtent = max(rrcBounds.GetWidth(), rrcBounds.GetHeight());
 
-	catch(std::bad_alloc)
-	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
-			sizeof(ActorSet*) * m_nHeight);
-	}
+	int cx = rrcBounds.left + rrcBounds.GetWidth() / 2;
+	int cy = rrcBounds.top + rrcBounds.GetHeight() / 2;
 
-	try
+	int nNode = 0;
+	int x = 0, y = 0;
+
+	for(int nSize = m_nSize; nSize > NODE_MIN_SIZE; nSize /= 2)
 	{
-		for(int n = 0; n < m_nHeight; n++)
+		int nHalf = nSize / 2;
+
+		if (nExtent > nHalf)
+			break;
+
+		int nQuadrant = (cx >= x + nHalf ? 1 : 0) | (cy >= y + nHalf ? 2 : 0);
+
+		int nChild = m_arNodes[nNode].arChildren[nQuadrant];
+
+		if (INVALID_INDEX == nChild)
 		{
-			m_ppsetSpace[n] = new ActorSet[m_nWidth];
+			if (false == bCreate)
+				return INVALID_INDEX;
+
+			nChild = AllocNode(nNode);
+
+			m_arNodes[nNode].arChildren[nQuadrant] = nChild;
 		}
-	}
 
-	catch(std::bad_alloc)
-	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
-			sizeof(ActorSet) * m_nWidth);
+		if (nQuadrant & 1)
+			x += nHalf;
+
+		if (nQuadrant & 2)
+			y += nHalf;
+
+		nNode = nChild;
 	}
+
+	return nNode;
 }
 
-void SpacePartitionUniformGrid::Resize(int nWidth, int nHeight)
+int SpacePartitionQuadTree::AllocNode(int nParent)
 {
-	if (nHeight > m_nHeight)
-	{
-		// Reallocate
+	// Take a node from the free list or grow the pool
 
-		ActorSet** ppsetSpace = NULL;
+	int nNode = m_nFreeNode;
 
+	if (INVALID_INDEX == nNode)
+	{
 		try
 		{
-			ppsetSpace = new ActorSet*[nHeight];
+			m_arNodes.push_back(Node());
 		}
 
 		catch(std::bad_alloc)
 		{
-			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
-				sizeof(ActorSet*) * nHeight);
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Node));
 		}
 
-		// Re-fill
+		nNode = int(m_arNodes.size()) - 1;
+	}
+	else
+	{
+		m_nFreeNode = m_arNodes[nNode].nParent;
+	}
 
-		for(int ty = 0; ty < m_nHeight; ty++)
-		{
-			ppsetSpace[ty] = m_ppsetSpace[ty];
-		}	
+	Node& rNode = m_arNodes[nNode];
 
-		// Add new entries
+	rNode.nParent = nParent;
+	rNode.nFirstItem = INVALID_INDEX;
+	rNode.nCount = 0;
 
-		for(int ty = m_nHeight; ty < nHeight; ty++)
-		{
-			ppsetSpace[ty] = new ActorSet[nWidth];
-		}
+	std::fill(rNode.arChildren, rNode.arChildren + 4, INVALID_INDEX);
 
-		// Replace
+	return nNode;
+}
 
-		delete[] m_ppsetSpace;
-		m_ppsetSpace = ppsetSpace;
-	}
-	else if (nHeight < m_nHeight)
-	{
-		// Delete a few rows from the end
+bool SpacePartitionQuadTree::IsLinked(const Actor* pActor) const
+{
+	// Actor item index may be stale if it was linked to another partition
 
-		for(int y = m_nHeight - nHeight + 1; y < m_nHeight; y++)
-		{
-			delete m_ppsetSpace[y];
-		}
+	int nItem = pActor->m_nSpaceNode;
 
-		// Reallocate
+	return (nItem >= 0 && nItem < int(m_arItems.size()) &&
+		m_arItems[nItem].pActor == pActor);
+}
 
-		ActorSet** ppsetSpace = NULL;
+void SpacePartitionQuadTree::Link(Actor* pActor, const Rect& rrcBounds)
+{
+	int nNode = Locate(rrcBounds, true);
 
+	// Take an item from the free list or grow the pool
+
+	int nItem = m_nFreeItem;
+
+	if (INVALID_INDEX == nItem)
+	{
 		try
 		{
-			ppsetSpace = new ActorSet*[nHeight];
+			m_arItems.push_back(Item());
 		}
 
 		catch(std::bad_alloc)
 		{
-			throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
-				sizeof(ActorSet*) * nHeight);
+			throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(Item));
 		}
 
-		// Re-fill
+		nItem = int(m_arItems.size()) - 1;
+	}
+	else
+	{
+		m_nFreeItem = m_arItems[nItem].nNext;
+	}
 
-		for(int y = 0; y < nHeight; y++)
-		{
-			ppsetSpace[y] = m_ppsetSpace[y];
-		}
+	// Insert at the head of node list
 
-		// Replace
+	Item& rItem = m_arItems[nItem];
 
-		delete[] m_ppsetSpace;
-		m_ppsetSpace = ppsetSpace;
-	}
+	rItem.pActor = pActor;
+	rItem.rcBounds = rrcBounds;
+	rItem.nNode = nNode;
+	rItem.nPrev = INVALID_INDEX;
+	rItem.nNext = m_arNodes[nNode].nFirstItem;
 
-	try
+	if (rItem.nNext != INVALID_INDEX)
+		m_arItems[rItem.nNext].nPrev = nItem;
+
+	m_arNodes[nNode].nFirstItem = nItem;
+
+	// Update counts up to the root
+
+	for(int n = nNode; n != INVALID_INDEX; n = m_arNodes[n].nParent)
+		m_arNodes[n].nCount++;
+
+	pActor->m_nSpaceNode = nItem;
+}
+
+void SpacePartitionQuadTree::Unlink(Actor* pActor)
+{
+	int nItem = pActor->m_nSpaceNode;
+
+	Item& rItem = m_arItems[nItem];
+
+	int nNode = rItem.nNode;
+
+	// Remove from node list
+
+	if (rItem.nPrev != INVALID_INDEX)
+		m_arItems[rItem.nPrev].nNext = rItem.nNext;
+	else
+		m_arNodes[nNode].nFirstItem = rItem.nNext;
+
+	if (rItem.nNext != INVALID_INDEX)
+		m_arItems[rItem.nNext].nPrev = rItem.nPrev;
+
+	// Return to free list
+
+	rItem.pActor = NULL;
+	rItem.nNext = m_nFreeItem;
+	m_nFreeItem = nItem;
+
+	// Update counts up to the root, releasing nodes left empty
+
+	while(nNode != INVALID_INDEX)
 	{
-		if (nWidth > m_nWidth)
-		{
-			// Reallocate rows to contain more elements
-			
-			for(int ty = 0; ty < m_nHeight; ty++)
-			{
-				ActorSet* pOldSets = m_ppsetSpace[ty];
+		Node& rNode = m_arNodes[nNode];
 
-				m_ppsetSpace[ty] = new ActorSet[nWidth];
+		int nParent = rNode.nParent;
 
-				for(int tx = 0; tx < m_nWidth; tx++)
-				{
-					std::copy(pOldSets[tx].begin(), pOldSets[tx].end(),
-						std::inserter(m_ppsetSpace[ty][tx],
-						m_ppsetSpace[ty][tx].end()));
-				}
+		if (0 == --rNode.nCount && nParent != INVALID_INDEX)
+		{
+			int* pnChildren = m_arNodes[nParent].arChildren;
 
-				delete[] pOldSets;
+			for(int q = 0; q < 4; q++)
+			{
+				if (pnChildren[q] == nNode)
+					pnChildren[q] = INVALID_INDEX;
 			}
+
+			rNode.nParent = m_nFreeNode;
+			m_nFreeNode = nNode;
 		}
-		else if (nWidth < m_nWidth)
-		{
-			// Reallocate rows to contain less elements
 
-			for(int ty = 0; ty < m_nHeight; ty++)
-			{
-				ActorSet* pOldSets = m_ppsetSpace[ty];
+		nNode = nParent;
+	}
 
-				m_ppsetSpace[ty] = new ActorSet[nWidth];
+	pActor->m_nSpaceNode = INVALID_INDEX;
+}
 
-				for(int tx = 0; tx < nWidth; tx++)
-				{
-					std::copy(pOldSets[tx].begin(),
-						pOldSets[tx].end(),
-						std::inserter(m_ppsetSpace[ty][tx],
-							m_ppsetSpace[ty][tx].end()));
-				}
+int SpacePartitionQuadTree::QueryNode(int nNode, int x, int y, int nSize,
+									  const Rect& rrcRange,
+									  PQUERYCALLBACK pCallback,
+									  void* pContext) const
+{
+	const Node& rNode = m_arNodes[nNode];
 
-				delete[] pOldSets;
-			}
+	if (0 == rNode.nCount)
+		return 0;
+
+	// Skip if range is outside of loose node bounds
+
+	int nHalf = nSize / 2;
+
+	if (rrcRange.left >= x + nSize + nHalf || rrcRange.right <= x - nHalf ||
+	   rrcRange.top >= y + nSize + nHalf || rrcRange.bottom <= y - nHalf)
+		return 0;
+
+	// Query actors stored in this node
+
+	int nCount = 0;
+
+	for(int nItem = rNode.nFirstItem;
+		nItem != INVALID_INDEX;
+		nItem = m_arItems[nItem].nNext)
+	{
+		const Item& rItem = m_arItems[nItem];
+
+		// Actors outside of the layer have empty bounds and never match
+
+		if (rItem.rcBounds.GetArea() > 0 &&
+		   rItem.rcBounds.left < rrcRange.right &&
+		   rItem.rcBounds.right > rrcRange.left &&
+		   rItem.rcBounds.top < rrcRange.bottom &&
+		   rItem.rcBounds.bottom > rrcRange.top)
+		{
+			pCallback(rItem.pActor, pContext);
+
+			nCount++;
 		}
 	}
 
-	catch(std::bad_alloc)
+	// Query children
+
+	for(int q = 0; q < 4; q++)
 	{
-		throw Error(Error::MEM_ALLOC, __FUNCTIONW__, sizeof(ActorSet) * nWidth);
+		if (rNode.arChildren[q] != INVALID_INDEX)
+		{
+			nCount += QueryNode(rNode.arChildren[q],
+				(q & 1) ? x + nHalf : x,
+				(q & 2) ? y + nHalf : y,
+				nHalf, rrcRange, pCallback, pContext);
+		}
 	}
 
-	m_nWidth = nWidth;
-	m_nHeight = nHeight;
+	return nCount;
 }
 
-DWORD SpacePartitionUniformGrid::GetMemoryFootprint(void) const
+int SpacePartitionQuadTree::QueryNodeRadius(int nNode, int x, int y,
+											int nSize,
+											const Vector2& rvecPos,
+											float fRadiusSq,
+											PQUERYCALLBACK pCallback,
+											void* pContext) const
 {
-	return sizeof(SpacePartitionUniformGrid) +
-		   sizeof(ActorSet) * m_nWidth * m_nHeight +
-		   sizeof(ActorSet*) * m_nHeight;
-}
+	const Node& rNode = m_arNodes[nNode];
 
-void SpacePartitionUniformGrid::Empty(void)
-{
-	if (m_ppsetSpace != NULL)
+	if (0 == rNode.nCount)
+		return 0;
+
+	// Skip if circle is outside of loose node bounds.
+	// Root holds anything that did not fit, so it is never skipped.
+
+	int nHalf = nSize / 2;
+
+	if (nNode != 0 && GetDistanceSq(rvecPos,
+	   float(x - nHalf), float(y - nHalf),
+	   float(x + nSize + nHalf), float(y + nSize + nHalf)) > fRadiusSq)
+		return 0;
+
+	// Query actors stored in this node
+
+	int nCount = 0;
+
+	for(int nItem = rNode.nFirstItem;
+		nItem != INVALID_INDEX;
+		nItem = m_arItems[nItem].nNext)
 	{
-		for(int n = 0; n < m_nHeight; n++)
+		const Item& rItem = m_arItems[nItem];
+
+		if (rItem.rcBounds.GetArea() > 0 &&
+		   GetDistanceSq(rvecPos, rItem.pActor) <= fRadiusSq)
 		{
-			delete m_ppsetSpace[n];
+			pCallback(rItem.pActor, pContext);
+
+			nCount++;
 		}
+	}
 
-		delete[] m_ppsetSpace;
+	// Query children
 
-		m_ppsetSpace = NULL;
+	for(int q = 0; q < 4; q++)
+	{
+		if (rNode.arChildren[q] != INVALID_INDEX)
+		{
+			nCount += QueryNodeRadius(rNode.arChildren[q],
+				(q & 1) ? x + nHalf : x,
+				(q & 2) ? y + nHalf : y,
+				nHalf, rvecPos, fRadiusSq, pCallback, pContext);
+		}
 	}
 
-	m_nWidth = 0;
-	m_nHeight = 0;
+	return nCount;
+}
+
+bool SpacePartitionQuadTree::CompareNodeDistance(const NodeDistance& rLeft,
+												 const NodeDistance& rRight)
+{
+	// Closest node on top of the heap
+
+	return (rLeft.fDistanceSq > rRight.fDistanceSq);
 }
\ No newline at end of file
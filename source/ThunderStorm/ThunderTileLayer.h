@@ -21,6 +21,7 @@
 #include "ThunderMath.h"		// using Vector2
 #include "ThunderTile.h"		// using TileMap, Tile
 #include "ThunderActor.h"		// using Actor, ActorArray
+#include "ThunderVertex.h"		// using VertexTriangle
 
 /*----------------------------------------------------------*\
 | Namespace
@@ -35,6 +36,8 @@ namespace ThunderStorm {
 class TileLayer;				// referencing TileLayer, declared below
 class Actor;					// referencing Actor
 class SpacePartition;			// referencing SpacePartition, declared below
+class NavigationGraph;			// referencing NavigationGraph
+class VisibilityMap;			// referencing VisibilityMap
 
 /*----------------------------------------------------------*\
 | Definitions
@@ -44,6 +47,215 @@ typedef std::vector<TileLayer*> TileLayerArray;
 typedef std::vector<TileLayer*>::iterator TileLayerArrayIterator;
 typedef std::vector<TileLayer*>::const_iterator TileLayerArrayConstIterator;
 
+// Segment for batched ray queries, in layer tiles
+
+struct Ray
+{
+	Vector2 vecFrom;
+	Vector2 vecTo;
+};
+
+// First thing a ray query ran into
+
+struct RayHit
+{
+	// Distance from ray origin in tiles
+	float fDistance;
+
+	// Point hit in layer tiles, segment end if nothing was hit
+	Vector2 vecPos;
+
+	// Blocking tile hit, INVALID_INDEX coordinates if none
+	POINT ptTile;
+
+	// Actor hit, NULL if none
+	Actor* pActor;
+};
+
+// Called once for every actor found by a space partition query.
+// Must not start another query, since that would reset duplicate tracking.
+typedef void (*PQUERYCALLBACK) (Actor* pActor, void* pContext);
+
+
+/*----------------------------------------------------------*\
+| SpacePartition interface class
+\*----------------------------------------------------------*/
+
+class SpacePartition
+{
+public:
+	//
+	// Constants
+	//
+
+	// Partition implementations
+
+	enum Types
+	{
+		// Grid with a tree of actors in every cell
+		TYPE_UNIFORMGRID,
+
+		// Grid with pooled index lists in contiguous cells
+		TYPE_FLATGRID,
+
+		// Loose quadtree, memory proportional to actor count
+		TYPE_QUADTREE,
+
+		// Number of partition implementations
+		TYPE_COUNT
+	};
+
+public:
+	virtual ~SpacePartition(void)
+	{
+	};
+
+public:
+	//
+	// Creation
+	//
+
+	static SpacePartition* Create(Types nType);
+
+	virtual Types GetType(void) const = 0;
+
+	//
+	// Size
+	//
+
+	virtual void SetSize(int nWidth, int nHeight, bool bInitOnUse) = 0;
+
+	virtual bool IsValidPosition(const Vector2& rvecPos) const = 0;
+	virtual bool IsValidPosition(float tx, float ty) const = 0;
+	virtual bool IsValidPosition(int tx, int ty) const = 0;
+
+	virtual bool IsValidRange(const Rect& rrc) const = 0;
+	virtual bool IsValidRange(const Vector2& rvecPos, const Vector2& rvecSize) const = 0;
+	virtual void ValidateRange(Rect& rrc) const = 0;
+
+	//
+	// Update
+	//
+
+	virtual void Add(Actor* pActor) = 0;
+	virtual void Remove(Actor* pActor) = 0;
+	virtual void Update(Actor* pActor, const Rect& rrcOldBounds) = 0;
+
+	//
+	// Query
+	//
+
+	virtual int Query(int tx, int ty, ActorArray* parResult) = 0;
+	virtual int Query(float tx, float ty, ActorArray* parResult) = 0;
+	virtual int Query(Rect& rrcRange, ActorArray* parResult) const = 0;
+	virtual int Query(Rect& rrcRange, PQUERYCALLBACK pCallback, void* pContext) const = 0;
+
+	// Up to nCount actors closest to a point, measured to their bounds,
+	// appended nearest first. Returns number of actors found
+	virtual int QueryNearest(const Vector2& rvecPos, int nCount,
+		ActorArray* parResult, float fMaxDistance = FLT_MAX) const = 0;
+
+	// All actors with bounds within radius of a point, in no particular order
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		ActorArray* parResult) const = 0;
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		PQUERYCALLBACK pCallback, void* pContext) const = 0;
+
+	static void QueryAppend(Actor* pActor, void* pContext);
+
+	//
+	// Diagnostics
+	//
+
+	virtual DWORD GetMemoryFootprint(void) const = 0;
+
+	//
+	// Deinitialization
+	//
+
+	virtual void Empty(void) = 0;
+
+protected:
+	// Candidate of nearest actor queries
+
+	struct Nearest
+	{
+		// Squared distance from query point to actor bounds
+		float fDistanceSq;
+
+		Actor* pActor;
+	};
+
+	typedef std::vector<Nearest> NearestArray;
+
+	// State of nearest and radius queries walking grid cells
+
+	struct NearestCells
+	{
+		const Vector2* pvecPos;
+		NearestArray* parNearest;
+		int nCount;
+		float fMaxDistanceSq;
+		DWORD dwStamp;
+	};
+
+	struct RadiusCells
+	{
+		const Vector2* pvecPos;
+		float fRadiusSq;
+		PQUERYCALLBACK pCallback;
+		void* pContext;
+		DWORD dwStamp;
+		int nCount;
+	};
+
+protected:
+	//
+	// Query Stamps
+	//
+
+	static DWORD BeginQuery(void);
+	static bool Visit(Actor* pActor, DWORD dwStamp);
+
+	//
+	// Distance Queries
+	//
+
+	static float GetDistanceSq(const Vector2& rvecPos,
+		float fLeft, float fTop, float fRight, float fBottom);
+	static float GetDistanceSq(const Vector2& rvecPos, const Actor* pActor);
+
+	static void AddNearest(NearestArray& rarNearest, int nCount,
+		Actor* pActor, float fDistanceSq);
+	static float GetNearestBound(const NearestArray& rarNearest, int nCount,
+		float fMaxDistanceSq);
+	static int EndNearest(NearestArray& rarNearest, ActorArray* parResult);
+
+	static bool CompareNearest(const Nearest& rLeft, const Nearest& rRight);
+
+	//
+	// Grid Queries
+	//
+
+	// Reports every actor linked to a cell, including those reported by
+	// other cells. Only grids have cells, other partitions report none
+	virtual void QueryCell(int tx, int ty,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	// Nearest and radius queries shared by grids, which only look up cells
+	int QueryNearestCells(const Vector2& rvecPos, int nCount,
+		ActorArray* parResult, float fMaxDistance,
+		int nWidth, int nHeight) const;
+	int QueryRadiusCells(const Vector2& rvecPos, float fRadius,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	static void VisitNearest(Actor* pActor, void* pContext);
+	static void VisitRadius(Actor* pActor, void* pContext);
+
+private:
+	// Stamp of the most recent query, compared to Actor::m_dwQueryStamp
+	static DWORD s_dwQueryStamp;
+};
 
 /*----------------------------------------------------------*\
 | TileLayer class
@@ -51,6 +263,128 @@ typedef std::vector<TileLayer*>::const_iterator TileLayerArrayConstIterator;
 
 class TileLayer
 {
+public:
+	//
+	// Constants
+	//
+
+	// Side of a tile chunk in tiles, as power of two
+	static const int CHUNK_SHIFT;
+	static const int CHUNK_SIZE;
+
+	// Tile value bit set if template is animated, index in lower bits
+	static const WORD TILE_ANIMATED;
+
+	// Tile value of tiles without template
+	static const WORD TILE_EMPTY;
+
+	// Largest template index that can be stored in a tile value
+	static const int MAX_TILE_INDEX;
+
+	// Seconds chunk geometry is kept after it was last rendered
+	static const float GEOMETRY_LIFETIME;
+
+	// What ray queries stop at
+
+	enum RayFlags
+	{
+		// Tiles with CLIP flag
+		RAY_TILES = 1 << 0,
+
+		// Actors, walking space partition cells along the ray
+		RAY_ACTORS = 1 << 1
+	};
+
+private:
+	// Quads of static tiles sharing material in chunk geometry
+
+	struct GeometryGroup
+	{
+		// Static tile template providing material
+		int nTemplate;
+
+		// First quad in vertex array
+		UINT uFirstQuad;
+
+		// Number of quads
+		UINT uQuadCount;
+	};
+
+	typedef std::vector<GeometryGroup> GeometryGroupArray;
+	typedef std::vector<GeometryGroup>::const_iterator GeometryGroupArrayConstIterator;
+
+	// Tile quads of a chunk, built when first rendered and after tiles change
+
+	struct ChunkGeometry
+	{
+		// Quads of static tiles in layer space, grouped by material
+		std::vector<VertexTriangle> arVertices;
+
+		// Material groups in vertex array
+		GeometryGroupArray arGroups;
+
+		// Lowest Z of layers rendered later with an occluder over each quad,
+		// INT_MAX if not covered. Descending within each material group
+		std::vector<int> arOccluders;
+
+		// Animated tiles, template index in high word and position in low word
+		std::vector<DWORD> arAnimated;
+
+		// Lowest occluder Z over each animated tile
+		std::vector<int> arAnimatedOccluders;
+
+		// Map template stamp, occlusion stamp and tile size built with
+		DWORD dwTemplateStamp;
+		DWORD dwOcclusionStamp;
+		float fTileSize;
+
+		// Tiles did not change since built
+		bool bValid;
+
+		// Map render frame and time last prepared for rendering
+		DWORD dwRenderFrame;
+		float fLastRender;
+	};
+
+	// Square block of tiles, allocated only if tiles differ
+
+	struct Chunk
+	{
+		// Tile values (template index and animated bit), NULL if uniform or not loaded
+		WORD* pwTiles;
+
+		// Value of all tiles in uniform chunk
+		WORD wFill;
+
+		// Tracked by map streaming, tiles loaded and actors swapped in
+		bool bResident;
+
+		// Tiles changed since loaded from map file, never released
+		bool bModified;
+
+		// Offset of tile values in map file if streamed, 0 if uniform or not streamed
+		DWORD dwOffset;
+
+		// Offset tile values were last saved at, 0 if not stored. Becomes
+		// dwOffset once the saved file replaces the streamed map file
+		DWORD dwSavedOffset;
+
+		// Offset of last actor record in map's swap file
+		DWORD dwActorsOffset;
+
+		// Bytes taken by actor records of this chunk in swap file
+		DWORD dwActorsSize;
+
+		// Number of actors swapped out of this chunk
+		int nActors;
+
+		// Pre-built geometry, NULL if not rendered lately
+		ChunkGeometry* pGeometry;
+	};
+
+	typedef std::vector<Chunk> ChunkArray;
+	typedef std::vector<Chunk>::iterator ChunkArrayIterator;
+
 private:
 	// Maintain reference to parent map
 	TileMap& m_rMap;
@@ -61,18 +395,56 @@ private:
 	// Height in tiles
 	int m_nHeight;
 
-	// 1D tile array, each element points to map's tile template
-	Tile** m_ppTiles;
+	// Chunks covering the layer, row by row.
+	// Streamed tiles are loaded on first access, including from const
+	// accessors such as GetTileConst and ray casts. Loading reads tile values
+	// from map file without changing them, so chunk storage is mutable.
+	mutable ChunkArray m_arChunks;
 
-	// 2D tile array that refers into the 1D array for easier addressing
-	Tile*** m_pppTiles;
+	// Width in chunks
+	int m_nChunksWidth;
+
+	// Number of chunks with allocated tile values
+	mutable int m_nChunksAllocated;
+
+	// Chunks with geometry built
+	std::vector<int> m_arGeometryChunks;
 
 	// Spacial partition database
 	SpacePartition* m_pSpace;
 
+	// Spacial partition implementation to create
+	SpacePartition::Types m_nSpaceType;
+
+	// Path finding abstraction, created on first use
+	NavigationGraph* m_pNavigation;
+
+	// Occluder edges for visibility, created on first use
+	VisibilityMap* m_pVisibility;
+
 	// Position on the map
 	Vector2 m_vecPos;
 
+	// Logical Z order, layers on the same floor share Z
+	int m_nZ;
+
+	// Position in map's layer array, breaks ties in Z order
+	int m_nMapIndex;
+
+	// Is this layer in map's layer index?
+	bool m_bIndexed;
+
+	// Bounds this layer was last indexed with
+	Rect m_rcIndexBounds;
+
+	// Stamp of the last layer index query that reported this layer
+	DWORD m_dwQueryStamp;
+
+	// Map render frame this layer was last prepared in,
+	// and its position in map's render layers during that frame
+	DWORD m_dwRenderFrame;
+	int m_nRenderLayer;
+
 public:
 	TileLayer(TileMap& m_rMap);
 	~TileLayer(void);
@@ -99,6 +471,9 @@ public:
 
 	SpacePartition* GetSpace(void) const;
 
+	SpacePartition::Types GetSpaceType(void) const;
+	void SetSpaceType(SpacePartition::Types nType);
+
 	//
 	// Tiles
 	//	
@@ -128,8 +503,13 @@ public:
 
 	int GetTileIndex(int tx, int ty, bool* pbOutAnimated = NULL) const;
 
-	Tile** GetTiles(void);
-	Tile*** GetTiles2D(void);
+	// False if tiles are streamed and not loaded yet
+	bool IsTileLoaded(int tx, int ty) const;
+
+	int GetChunkCount(void) const;
+	int GetAllocatedChunkCount(void) const;
+
+	void Compact(void);
 
 	bool IsValidPosition(const Vector2& rvecPos) const;
 	bool IsValidPosition(float x, float y) const;
@@ -139,6 +519,23 @@ public:
 	bool IsValidRange(const Vector2& rvecPos, const Vector2& rvecSize) const;
 	void ValidateRange(Rect& rrc) const;
 
+	//
+	// Ray Queries
+	//
+
+	bool CastSegment(const Vector2& rvecFrom, const Vector2& rvecTo,
+		RayHit* pOutHit = NULL, DWORD dwFlags = RAY_TILES,
+		const Actor* pIgnore = NULL) const;
+
+	// Ray continues until it leaves the layer
+	bool CastRay(const Vector2& rvecOrigin, const Vector2& rvecDirection,
+		RayHit* pOutHit = NULL, DWORD dwFlags = RAY_TILES,
+		const Actor* pIgnore = NULL) const;
+
+	// Returns number of segments that hit something
+	int CastSegments(const Ray* pRays, int nCount, RayHit* pOutHits,
+		DWORD dwFlags = RAY_TILES) const;
+
 	//
 	// Position
 	//
@@ -154,12 +551,39 @@ public:
 	Vector2 LocalToWorld(Vector2 vecLocal);
 	Vector2 WorldToLocal(Vector2 vecWorld);
 
+	int GetZ(void) const;
+	void SetZ(int nZ);
+
+	//
+	// Rendering
+	//
+
+	// Loads chunks in range, builds their geometry and evaluates their
+	// tile animations, at most once per map render frame
+	void Prepare(const Rect& rrcRange);
+
+	// Skips tiles covered by occluders in layers with Z up to nMaxZ
+	void Render(const Rect& rrcRange, const Vector2& rvecOffset,
+		int nMaxZ = INT_MAX);
+
 	//
 	// Serialization
 	//
 
-	void Serialize(Stream& rStream) const;
-	void Deserialize(Stream& rStream);
+	void Serialize(Stream& rStream, bool bTiles = true) const;
+	void Deserialize(Stream& rStream, bool bTiles = true);
+
+	//
+	// Navigation
+	//
+
+	NavigationGraph* GetNavigationGraph(void);
+
+	//
+	// Visibility
+	//
+
+	VisibilityMap* GetVisibilityMap(void);
 
 	//
 	// Diagnostics
@@ -172,61 +596,126 @@ public:
 	//
 
 	void Empty(void);
+
+private:
+	//
+	// Private Functions
+	//
+
+	WORD EncodeTile(const Tile* pTile) const;
+	Tile* DecodeTile(WORD wTile) const;
+
+	WORD GetTileValue(int tx, int ty) const;
+	void SetTileValue(int tx, int ty, WORD wTile);
+
+	bool IsValidTileValue(WORD wTile) const;
+	bool IsOccluderValue(WORD wTile) const;
+
+	void LoadTiles(int nChunk) const;
+
+	bool Traverse(const Vector2& rvecFrom, const Vector2& rvecTo,
+		bool bUnbounded, RayHit* pOutHit, DWORD dwFlags,
+		const Actor* pIgnore, const BYTE* pbClip,
+		ActorArray& rarCell) const;
+
+	static bool IntersectActor(const Actor* pActor, const Vector2& rvecFrom,
+		const Vector2& rvecDir, float fMaxDistance, float& rfOutDistance);
+
+	Rect GetChunkRange(const Rect& rrcRange) const;
+
+	ChunkGeometry* PrepareChunk(int nChunk, float fTileSize, float fTime);
+
+	void BuildGeometry(int nChunk, float fTileSize);
+	void BuildOccluders(int nChunk, int* pnOccluders) const;
+	void InvalidateCovered(int tx, int ty);
+
+	// Cameras render layers by Z, then in map order
+	bool IsRenderedBefore(const TileLayer* pLayer) const;
+	void ReleaseGeometry(int nChunk);
+	void ReleaseExpiredGeometry(void);
+	void ReleaseAllGeometry(void);
+
+	void EmptyChunks(void);
+
+	//
+	// Friends
+	//
+
+	friend class TileLayerIndex;
+	friend class TileMap;
+	friend class Navigation;
 };
 
 /*----------------------------------------------------------*\
-| SpacePartition interface class
+| TileLayerIndex class
 \*----------------------------------------------------------*/
 
-class SpacePartition
+class TileLayerIndex
 {
-public:
-	virtual ~SpacePartition(void)
-	{
-	};
-
 public:
 	//
-	// Size
+	// Constants
 	//
 
-	virtual void SetSize(int nWidth, int nHeight, bool bInitOnUse) = 0;
+	// Side of an index cell in tiles
+	static const int CELL_SIZE;
 
-	virtual bool IsValidPosition(const Vector2& rvecPos) const = 0;
-	virtual bool IsValidPosition(float tx, float ty) const = 0;
-	virtual bool IsValidPosition(int tx, int ty) const = 0;
+	// Buckets along each axis, cells beyond wrap around (power of two)
+	static const int BUCKETS;
 
-	virtual bool IsValidRange(const Rect& rrc) const = 0;
-	virtual bool IsValidRange(const Vector2& rvecPos, const Vector2& rvecSize) const = 0;
-	virtual void ValidateRange(Rect& rrc) const = 0;
+private:
+	// Layers overlapping cells of each bucket, sorted by Z
+	std::vector<TileLayerArray> m_arBuckets;
+
+	// Stamp of the most recent query, compared to TileLayer::m_dwQueryStamp
+	mutable DWORD m_dwQueryStamp;
 
+public:
+	TileLayerIndex(void);
+	~TileLayerIndex(void);
+
+public:
 	//
 	// Update
 	//
 
-	virtual void Add(Actor* pActor) = 0;
-	virtual void Remove(Actor* pActor) = 0;
-	virtual void Update(Actor* pActor, const Rect& rrcOldBounds) = 0;
+	void Add(TileLayer* pLayer);
+	void Remove(TileLayer* pLayer);
+	void Update(TileLayer* pLayer);
 
 	//
 	// Query
 	//
 
-	virtual int Query(int tx, int ty, ActorArray* parResult) = 0;
-	virtual int Query(float tx, float ty, ActorArray* parResult) = 0;
-	virtual int Query(Rect& rrcRange, ActorArray* parResult) const = 0;
+	int Query(int x, int y, TileLayerArray& rarLayers,
+		int nMinZ = INT_MIN, int nMaxZ = INT_MAX) const;
+
+	int Query(const Rect& rrcRange, TileLayerArray& rarLayers,
+		int nMinZ = INT_MIN, int nMaxZ = INT_MAX) const;
 
 	//
 	// Diagnostics
 	//
 
-	virtual DWORD GetMemoryFootprint(void) const = 0;
+	DWORD GetMemoryFootprint(void) const;
 
 	//
 	// Deinitialization
 	//
 
-	virtual void Empty(void) = 0;
+	void Empty(void);
+
+protected:
+	//
+	// Private Functions
+	//
+
+	Rect GetCellRange(const Rect& rrcBounds) const;
+	TileLayerArray& GetBucket(int cx, int cy);
+	const TileLayerArray& GetBucketConst(int cx, int cy) const;
+
+	void Link(TileLayer* pLayer);
+	void Unlink(TileLayer* pLayer);
 };
 
 /*----------------------------------------------------------*\
@@ -246,6 +735,12 @@ public:
 	virtual ~SpacePartitionUniformGrid(void);
 
 public:
+	//
+	// Creation
+	//
+
+	virtual Types GetType(void) const;
+
 	//
 	// Size
 	//
@@ -275,6 +770,15 @@ public:
 	virtual int Query(int tx, int ty, ActorArray* parResult);
 	virtual int Query(float tx, float ty, ActorArray* parResult);
 	virtual int Query(Rect& rrcRange, ActorArray* parResult) const;
+	virtual int Query(Rect& rrcRange, PQUERYCALLBACK pCallback, void* pContext) const;
+
+	virtual int QueryNearest(const Vector2& rvecPos, int nCount,
+		ActorArray* parResult, float fMaxDistance = FLT_MAX) const;
+
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		ActorArray* parResult) const;
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		PQUERYCALLBACK pCallback, void* pContext) const;
 
 	//
 	// Diagnostics
@@ -293,10 +797,309 @@ protected:
 	// Private Functions
 	//
 
+	virtual void QueryCell(int tx, int ty,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
 	void Initialize(void);
 	void Resize(int nWidth, int nHeight);
 };
 
+/*----------------------------------------------------------*\
+| SpacePartitionFlatGrid class
+\*----------------------------------------------------------*/
+
+class SpacePartitionFlatGrid: public SpacePartition
+{
+private:
+	// Cell list entry, one for every cell an actor covers
+
+	struct Node
+	{
+		// Actor covering the cell
+		Actor* pActor;
+
+		// Cell index (ty * width + tx)
+		int nCell;
+
+		// Previous node in the same cell
+		int nPrev;
+
+		// Next node in the same cell or in the free list
+		int nNext;
+
+		// Next node owned by the same actor
+		int nNextOwned;
+	};
+
+	typedef std::vector<Node> NodeArray;
+
+private:
+	int m_nWidth;
+	int m_nHeight;
+
+	// First node of each cell list, INVALID_INDEX if empty
+	int* m_pnCells;
+
+	// Nodes of all cells, allocated from one pool
+	NodeArray m_arNodes;
+
+	// First unused node in the pool
+	int m_nFreeNode;
+
+public:
+	SpacePartitionFlatGrid(void);
+	virtual ~SpacePartitionFlatGrid(void);
+
+public:
+	//
+	// Creation
+	//
+
+	virtual Types GetType(void) const;
+
+	//
+	// Size
+	//
+
+	virtual void SetSize(int nWidth, int nHeight, bool bInitOnUse);
+
+	virtual bool IsValidPosition(const Vector2& rvecPos) const;
+	virtual bool IsValidPosition(float x, float y) const;
+	virtual bool IsValidPosition(int x, int y) const;
+
+	virtual bool IsValidRange(const Rect& rrc) const;
+	virtual bool IsValidRange(const Vector2& rvecPos, const Vector2& rvecSize) const;
+	virtual void ValidateRange(Rect& rrc) const;
+
+	//
+	// Update
+	//
+
+	virtual void Add(Actor* pActor);
+	virtual void Remove(Actor* pActor);
+	virtual void Update(Actor* pActor, const Rect& rrcOldBounds);
+
+	//
+	// Query
+	//
+
+	virtual int Query(int tx, int ty, ActorArray* parResult);
+	virtual int Query(float tx, float ty, ActorArray* parResult);
+	virtual int Query(Rect& rrcRange, ActorArray* parResult) const;
+	virtual int Query(Rect& rrcRange, PQUERYCALLBACK pCallback, void* pContext) const;
+
+	virtual int QueryNearest(const Vector2& rvecPos, int nCount,
+		ActorArray* parResult, float fMaxDistance = FLT_MAX) const;
+
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		ActorArray* parResult) const;
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	//
+	// Diagnostics
+	//
+
+	virtual DWORD GetMemoryFootprint(void) const;
+
+	//
+	// Deinitialization
+	//
+
+	virtual void Empty(void);
+
+protected:
+	//
+	// Private Functions
+	//
+
+	virtual void QueryCell(int tx, int ty,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	void Initialize(void);
+
+	bool IsLinked(const Actor* pActor) const;
+	void Link(Actor* pActor, const Rect& rrcRange);
+	void Unlink(Actor* pActor);
+};
+
+/*----------------------------------------------------------*\
+| SpacePartitionQuadTree class
+\*----------------------------------------------------------*/
+
+class SpacePartitionQuadTree: public SpacePartition
+{
+public:
+	//
+	// Constants
+	//
+
+	// Smallest node side in tiles
+	static const int NODE_MIN_SIZE;
+
+private:
+	// Tree node, created only on paths leading to actors
+
+	struct Node
+	{
+		// Parent node or next node in the free list
+		int nParent;
+
+		// Child nodes by quadrant (top left, top right, bottom left, bottom right)
+		int arChildren[4];
+
+		// First item stored in this node
+		int nFirstItem;
+
+		// Number of items in this node and all of its children
+		int nCount;
+	};
+
+	// Actor stored in a node
+
+	struct Item
+	{
+		// Actor, NULL if in the free list
+		Actor* pActor;
+
+		// Actor bounds in tiles at time of insertion
+		Rect rcBounds;
+
+		// Node storing this item
+		int nNode;
+
+		// Previous item in the same node
+		int nPrev;
+
+		// Next item in the same node or in the free list
+		int nNext;
+	};
+
+	typedef std::vector<Node> NodeArray;
+	typedef std::vector<Item> ItemArray;
+	typedef std::vector<Item>::iterator ItemArrayIterator;
+
+	// Node waiting to be searched by nearest actor queries
+
+	struct NodeDistance
+	{
+		// Squared distance from query point to loose node bounds
+		float fDistanceSq;
+
+		// Node and its bounds
+		int nNode;
+		int x;
+		int y;
+		int nSize;
+	};
+
+	typedef std::vector<NodeDistance> NodeDistanceArray;
+
+private:
+	int m_nWidth;
+	int m_nHeight;
+
+	// Root node side in tiles, power of two covering width and height
+	int m_nSize;
+
+	// Nodes of the tree, root is always the first node
+	NodeArray m_arNodes;
+
+	// First unused node in the pool
+	int m_nFreeNode;
+
+	// Items for all actors, allocated from one pool
+	ItemArray m_arItems;
+
+	// First unused item in the pool
+	int m_nFreeItem;
+
+public:
+	SpacePartitionQuadTree(void);
+	virtual ~SpacePartitionQuadTree(void);
+
+public:
+	//
+	// Creation
+	//
+
+	virtual Types GetType(void) const;
+
+	//
+	// Size
+	//
+
+	virtual void SetSize(int nWidth, int nHeight, bool bInitOnUse);
+
+	virtual bool IsValidPosition(const Vector2& rvecPos) const;
+	virtual bool IsValidPosition(float x, float y) const;
+	virtual bool IsValidPosition(int x, int y) const;
+
+	virtual bool IsValidRange(const Rect& rrc) const;
+	virtual bool IsValidRange(const Vector2& rvecPos, const Vector2& rvecSize) const;
+	virtual void ValidateRange(Rect& rrc) const;
+
+	//
+	// Update
+	//
+
+	virtual void Add(Actor* pActor);
+	virtual void Remove(Actor* pActor);
+	virtual void Update(Actor* pActor, const Rect& rrcOldBounds);
+
+	//
+	// Query
+	//
+
+	virtual int Query(int tx, int ty, ActorArray* parResult);
+	virtual int Query(float tx, float ty, ActorArray* parResult);
+	virtual int Query(Rect& rrcRange, ActorArray* parResult) const;
+	virtual int Query(Rect& rrcRange, PQUERYCALLBACK pCallback, void* pContext) const;
+
+	virtual int QueryNearest(const Vector2& rvecPos, int nCount,
+		ActorArray* parResult, float fMaxDistance = FLT_MAX) const;
+
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		ActorArray* parResult) const;
+	virtual int QueryRadius(const Vector2& rvecPos, float fRadius,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	//
+	// Diagnostics
+	//
+
+	virtual DWORD GetMemoryFootprint(void) const;
+
+	//
+	// Deinitialization
+	//
+
+	virtual void Empty(void);
+
+protected:
+	//
+	// Private Functions
+	//
+
+	void Initialize(void);
+
+	int Locate(const Rect& rrcBounds, bool bCreate);
+	int AllocNode(int nParent);
+
+	bool IsLinked(const Actor* pActor) const;
+	void Link(Actor* pActor, const Rect& rrcBounds);
+	void Unlink(Actor* pActor);
+
+	int QueryNode(int nNode, int x, int y, int nSize, const Rect& rrcRange,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+	int QueryNodeRadius(int nNode, int x, int y, int nSize,
+		const Vector2& rvecPos, float fRadiusSq,
+		PQUERYCALLBACK pCallback, void* pContext) const;
+
+	static bool CompareNodeDistance(const NodeDistance& rLeft,
+		const NodeDistance& rRight);
+};
+
 } // namespace ThunderStorm
 
 #endif // THUNDER_TILE_LAYER_H
\ No newline at end of file
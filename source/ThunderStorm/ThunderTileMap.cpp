@@ -23,6 +23,7 @@
 #include "ThunderClient.h"		// using Client
 #include "ThunderRegion.h"		// using Region
 #include <algorithm>			// using std::sort, std::lower_bound, std::unique
+#include <utility>				// using std::pair
 
 /*----------------------------------------------------------*\
 | Namespace
@@ -35,7 +36,8 @@ using namespace ThunderStorm;
 \*----------------------------------------------------------*/
 
 const BYTE TileMap::SIGNATURE[4]		= "THM";
-const BYTE TileMap::FORMAT_VERSION[4]	= {2, 2, 0, 0};
+const BYTE TileMap::FORMAT_VERSION[4]	= {2, 3, 0, 0};
+const BYTE TileMap::FORMAT_VERSION_NOSTREAM[4]	= {2, 2, 0, 0};
 
 const int TileMap::RESERVE_LAYERS				= 4;
 const int TileMap::RESERVE_MATERIALS			= 16;
@@ -45,6 +47,14 @@ const int TileMap::RESERVE_MUSIC				= 4;
 const int TileMap::RESERVE_CAMERAS				= 4;
 const int TileMap::RESERVE_ACTIVECAMERAS		= 2;
 
+const float TileMap::DEFAULT_UPDATE_FULL_DISTANCE		= 32.0f;
+const float TileMap::DEFAULT_UPDATE_REDUCED_DISTANCE	= 96.0f;
+const float TileMap::DEFAULT_UPDATE_REDUCED_INTERVAL	= 0.25f;
+
+const int TileMap::DEFAULT_STREAM_LOAD_DISTANCE		= 32;
+const int TileMap::DEFAULT_STREAM_EVICT_DISTANCE	= 64;
+const int TileMap::DEFAULT_STREAM_LOAD_BUDGET		= 4;
+
 
 /*----------------------------------------------------------*\
 | TileMap implementation
@@ -55,8 +65,46 @@ TileMap::TileMap(Engine& rEngine, LPCWSTR pszClass):
 
 				 m_strClass(pszClass),
 
+				 m_nActors(0),
+
 				 m_pPlayer(NULL),
 
+				 m_fUpdateFullDistance(DEFAULT_UPDATE_FULL_DISTANCE),
+				 m_fUpdateReducedDistance(DEFAULT_UPDATE_REDUCED_DISTANCE),
+				 m_fUpdateReducedInterval(DEFAULT_UPDATE_REDUCED_INTERVAL),
+
+				 m_dwTileStamp(0),
+				 m_dwOccluderStamp(0),
+				 m_bOccluders(false),
+				 m_dwLayerStamp(1),
+				 m_dwOcclusionStamp(0),
+
+				 m_pStreamSource(NULL),
+				 m_pStreamSwap(NULL),
+				 m_dwStreamSwapEnd(0),
+				 m_dwStreamSwapLive(0),
+				 m_nStreamLoadDistance(DEFAULT_STREAM_LOAD_DISTANCE),
+				 m_nStreamEvictDistance(DEFAULT_STREAM_EVICT_DISTANCE),
+				 m_nStreamLoadBudget(DEFAULT_STREAM_LOAD_BUDGET),
+				 m_nStreamLoads(0),
+				 m_nStreamEvictions(0),
+				 m_nStreamSwappedActors(0),
+				 m_bStreamSwapPending(false),
+
+				 m_nUpdateThreads(0),
+				 m_bUpdateWorkers(false),
+				 m_bUpdateDeferred(false),
+
+				 m_nSpaceUpdates(0),
+
+				 #pragma warning(disable : 4355)
+
+				 m_Navigation(*this),
+
+				 #pragma warning(default : 4355)
+
+				 m_dwRenderFrame(1),
+
 				 m_nBackMaterialID(INVALID_INDEX),
 
 				 m_nBackAnimationID(INVALID_INDEX),
@@ -81,6 +129,8 @@ TileMap::TileMap(Engine& rEngine, LPCWSTR pszClass):
 	m_arCameras.reserve(RESERVE_CAMERAS);
 	m_arActiveCameras.reserve(RESERVE_ACTIVECAMERAS);
 
+	ZeroMemory(m_nUpdateTierCounts, sizeof(m_nUpdateTierCounts));
+
 	// Add default layer
 
 	InsertLayer(CreateLayer());
@@ -114,16 +164,20 @@ const String& TileMap::GetClass(void) const
 
 TileStatic& TileMap::GetTileTemplateStatic(int nIndex)
 {
-	if (nIndex >= 0 && nIndex < int(m_arTilesStatic.size()))
+	if (nIndex < 0 || nIndex >= int(m_arTilesStatic.size()))
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
+	// Caller may modify template, baked layer geometry is out of date
+
+	m_dwTileStamp++;
+
 	return m_arTilesStatic[nIndex];
 }
 
 const TileStatic& TileMap::GetTileTemplateStaticConst(int nIndex) const
 {
-	if (nIndex >= 0 && nIndex < int(m_arTilesStatic.size()))
+	if (nIndex < 0 || nIndex >= int(m_arTilesStatic.size()))
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
@@ -135,18 +189,27 @@ int TileMap::GetTileTemplateStaticCount(void) const
 	return int(m_arTilesStatic.size());
 }
 
+DWORD TileMap::GetTileStamp(void) const
+{
+	return m_dwTileStamp;
+}
+
 TileAnimated& TileMap::GetTileTemplateAnimated(int nIndex)
 {
-	if (nIndex >= 0 && nIndex < int(m_arTilesAnimated.size()))
+	if (nIndex < 0 || nIndex >= int(m_arTilesAnimated.size()))
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
+	// Caller may change flags, baked layer occlusion is out of date
+
+	m_dwTileStamp++;
+
 	return m_arTilesAnimated[nIndex];
 }
 
 const TileAnimated& TileMap::GetTileTemplateAnimatedConst(int nIndex) const
 {
-	if (nIndex >= 0 && nIndex < int(m_arTilesAnimated.size()))
+	if (nIndex < 0 || nIndex >= int(m_arTilesAnimated.size()))
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
@@ -188,6 +251,8 @@ TileStatic* TileMap::SetTileTemplateStatic(int nIndex,
 TileStatic* TileMap::SetTileTemplateStatic(int nIndex,
 										   const TileStatic& rTemplate)
 {
+	m_dwTileStamp++;
+
 	// Add or replace
 
 	if (INVALID_INDEX == nIndex || m_arTilesStatic[nIndex].GetRefCount() > 1)
@@ -276,6 +341,8 @@ TileAnimated* TileMap::SetTileTemplateAnimated(int nIndex,
 TileAnimated* TileMap::SetTileTemplateAnimated(int nIndex,
 											   const TileAnimated& rTemplate)
 {
+	m_dwTileStamp++;
+
 	// Add or replace
 
 	if (INVALID_INDEX == nIndex || m_arTilesAnimated[nIndex].GetRefCount() > 1)
@@ -329,10 +396,225 @@ TileAnimated* TileMap::SetTileTemplateAnimated(int nIndex,
 	return &m_arTilesAnimated[nIndex];
 }
 
-void TileMap::Optimize(void)
+DWORD TileMap::Optimize(void)
 {
-	// TODO
-	// Consolidate duplicates and collapse empty spots
+	// Remember template counts and memory used before
+
+	int nStaticBefore = int(m_arTilesStatic.size());
+	int nAnimatedBefore = int(m_arTilesAnimated.size());
+
+	DWORD dwSizeBefore =
+		DWORD(m_arTilesStatic.capacity() * sizeof(TileStatic) +
+		m_arTilesAnimated.capacity() * sizeof(TileAnimated));
+
+	// Count references to each template from tiles in all layers.
+	// Streamed chunks are read in and kept, since they will be remapped
+
+	std::vector<int> arStaticRefs(m_arTilesStatic.size(), 0);
+	std::vector<int> arAnimatedRefs(m_arTilesAnimated.size(), 0);
+
+	for(TileLayerArrayIterator pos = m_arLayers.begin();
+		pos != m_arLayers.end();
+		pos++)
+	{
+		TileLayer* pLayer = *pos;
+
+		for(int nChunk = 0; nChunk < int(pLayer->m_arChunks.size()); nChunk++)
+		{
+			TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+			if (rChunk.dwOffset != 0)
+			{
+				if (NULL == rChunk.pwTiles)
+					pLayer->LoadTiles(nChunk);
+
+				rChunk.bModified = true;
+			}
+
+			// Only count tiles within layer bounds
+
+			int nLeft = (nChunk % pLayer->m_nChunksWidth) *
+				TileLayer::CHUNK_SIZE;
+
+			int nTop = (nChunk / pLayer->m_nChunksWidth) *
+				TileLayer::CHUNK_SIZE;
+
+			int nWidth = min(TileLayer::CHUNK_SIZE, pLayer->m_nWidth - nLeft);
+			int nHeight = min(TileLayer::CHUNK_SIZE, pLayer->m_nHeight - nTop);
+
+			for(int y = 0; y < nHeight; y++)
+			{
+				for(int x = 0; x < nWidth; x++)
+				{
+					WORD wTile = (NULL == rChunk.pwTiles) ? rChunk.wFill :
+						rChunk.pwTiles[(y << TileLayer::CHUNK_SHIFT) + x];
+
+					if (TileLayer::TILE_EMPTY == wTile)
+						continue;
+
+					if (wTile & TileLayer::TILE_ANIMATED)
+						arAnimatedRefs[wTile & ~TileLayer::TILE_ANIMATED]++;
+					else
+						arStaticRefs[wTile]++;
+				}
+			}
+		}
+	}
+
+	// Order referenced static templates by material so that
+	// neighboring tiles batch together, keeping original order within material
+
+	std::vector<std::pair<int, int> > arOrder;
+	arOrder.reserve(m_arTilesStatic.size());
+
+	for(int n = 0; n < nStaticBefore; n++)
+	{
+		if (arStaticRefs[n] > 0)
+			arOrder.push_back(std::make_pair(
+				m_arTilesStatic[n].GetMaterialID(), n));
+	}
+
+	std::sort(arOrder.begin(), arOrder.end());
+
+	// Copy static templates, merging duplicates within each material
+
+	std::vector<WORD> arStaticRemap(m_arTilesStatic.size(),
+		TileLayer::TILE_EMPTY);
+
+	TileStaticArray arTilesStatic;
+	arTilesStatic.reserve(arOrder.size());
+
+	int nGroupStart = 0;
+
+	for(std::vector<std::pair<int, int> >::iterator pos = arOrder.begin();
+		pos != arOrder.end();
+		pos++)
+	{
+		const TileStatic& rTile = m_arTilesStatic[pos->second];
+
+		if (pos != arOrder.begin() && (pos - 1)->first != pos->first)
+			nGroupStart = int(arTilesStatic.size());
+
+		int nNewIndex = nGroupStart;
+
+		for(; nNewIndex < int(arTilesStatic.size()); nNewIndex++)
+		{
+			if (arTilesStatic[nNewIndex] == rTile &&
+			   D3DCOLOR(arTilesStatic[nNewIndex].m_clrBlend) ==
+			   D3DCOLOR(rTile.m_clrBlend))
+				break;
+		}
+
+		if (int(arTilesStatic.size()) == nNewIndex)
+			arTilesStatic.push_back(TileStatic(rTile));
+
+		arTilesStatic[nNewIndex].m_nRefs += arStaticRefs[pos->second];
+		arStaticRemap[pos->second] = WORD(nNewIndex);
+	}
+
+	// Same for animated templates, ordered by animation
+
+	arOrder.clear();
+	arOrder.reserve(m_arTilesAnimated.size());
+
+	for(int n = 0; n < nAnimatedBefore; n++)
+	{
+		if (arAnimatedRefs[n] > 0)
+			arOrder.push_back(std::make_pair(
+				m_arTilesAnimated[n].GetAnimationID(), n));
+	}
+
+	std::sort(arOrder.begin(), arOrder.end());
+
+	std::vector<WORD> arAnimatedRemap(m_arTilesAnimated.size(),
+		TileLayer::TILE_EMPTY);
+
+	TileAnimatedArray arTilesAnimated;
+	arTilesAnimated.reserve(arOrder.size());
+
+	nGroupStart = 0;
+
+	for(std::vector<std::pair<int, int> >::iterator pos = arOrder.begin();
+		pos != arOrder.end();
+		pos++)
+	{
+		const TileAnimated& rTile = m_arTilesAnimated[pos->second];
+
+		if (pos != arOrder.begin() && (pos - 1)->first != pos->first)
+			nGroupStart = int(arTilesAnimated.size());
+
+		int nNewIndex = nGroupStart;
+
+		for(; nNewIndex < int(arTilesAnimated.size()); nNewIndex++)
+		{
+			if (arTilesAnimated[nNewIndex] == rTile)
+				break;
+		}
+
+		if (int(arTilesAnimated.size()) == nNewIndex)
+			arTilesAnimated.push_back(TileAnimated(rTile));
+
+		arTilesAnimated[nNewIndex].m_nRefs += arAnimatedRefs[pos->second];
+		arAnimatedRemap[pos->second] = WORD(TileLayer::TILE_ANIMATED | nNewIndex);
+	}
+
+	// Remap tile values in all layers. Values outside of layer bounds
+	// that referenced dropped templates become empty
+
+	for(TileLayerArrayIterator pos = m_arLayers.begin();
+		pos != m_arLayers.end();
+		pos++)
+	{
+		TileLayer* pLayer = *pos;
+
+		for(TileLayer::ChunkArrayIterator posChunk = pLayer->m_arChunks.begin();
+			posChunk != pLayer->m_arChunks.end();
+			posChunk++)
+		{
+			WORD* pwTiles = posChunk->pwTiles;
+			int nCount = TileLayer::CHUNK_SIZE * TileLayer::CHUNK_SIZE;
+
+			if (NULL == pwTiles)
+			{
+				pwTiles = &posChunk->wFill;
+				nCount = 1;
+			}
+
+			for(int n = 0; n < nCount; n++)
+			{
+				if (TileLayer::TILE_EMPTY == pwTiles[n])
+					continue;
+
+				if (pwTiles[n] & TileLayer::TILE_ANIMATED)
+				{
+					pwTiles[n] = arAnimatedRemap[
+						pwTiles[n] & ~TileLayer::TILE_ANIMATED];
+				}
+				else
+				{
+					pwTiles[n] = arStaticRemap[pwTiles[n]];
+				}
+			}
+		}
+	}
+
+	// Replace templates, invalidating any template pointers held by callers.
+	// Baked layer geometry, navigation and visibility are rebuilt
+	// when they see the new tile stamp
+
+	m_arTilesStatic.swap(arTilesStatic);
+	m_arTilesAnimated.swap(arTilesAnimated);
+
+	m_dwTileStamp++;
+
+	DWORD dwSizeAfter =
+		DWORD(m_arTilesStatic.capacity() * sizeof(TileStatic) +
+		m_arTilesAnimated.capacity() * sizeof(TileAnimated));
+
+	DWORD dwSaved = (dwSizeBefore > dwSizeAfter) ?
+		dwSizeBefore - dwSizeAfter : 0;
+
+	return dwSaved;
 }
 
 void TileMap::RemoveAllTileTemplates(void)
@@ -340,6 +622,8 @@ void TileMap::RemoveAllTileTemplates(void)
 	m_arTilesStatic.clear();
 
 	m_arTilesAnimated.clear();
+
+	m_dwTileStamp++;
 }
 
 TileLayer* TileMap::CreateLayer(void)
@@ -357,11 +641,27 @@ int TileMap::InsertLayer(TileLayer* pLayer, int nIndex)
 
 		m_arLayers.insert(m_arLayers.begin() + nIndex, pLayer);
 
+		IndexLayers(nIndex);
+
+		m_LayerIndex.Add(pLayer);
+
+		m_dwLayerStamp++;
+
+		InvalidateOcclusion();
+
 		return nIndex;
 	}
 
+	pLayer->m_nMapIndex = int(m_arLayers.size());
+
 	m_arLayers.push_back(pLayer);
 
+	m_LayerIndex.Add(pLayer);
+
+	m_dwLayerStamp++;
+
+	InvalidateOcclusion();
+
 	return int(m_arLayers.size());
 }
 
@@ -371,13 +671,23 @@ void TileMap::RemoveLayer(int nIndex)
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
+	m_LayerIndex.Remove(m_arLayers[nIndex]);
+
 	delete m_arLayers[nIndex];
 
 	m_arLayers.erase(m_arLayers.begin() + nIndex);
+
+	IndexLayers(nIndex);
+
+	m_dwLayerStamp++;
+
+	InvalidateOcclusion();
 }
 
 void TileMap::RemoveAllLayers(void)
 {
+	m_LayerIndex.Empty();
+
 	for(TileLayerArrayIterator pos = m_arLayers.begin();
 		pos != m_arLayers.end();
 		pos++)
@@ -386,6 +696,14 @@ void TileMap::RemoveAllLayers(void)
 	}
 
 	m_arLayers.clear();
+
+	m_dwLayerStamp++;
+}
+
+void TileMap::IndexLayers(int nFirst)
+{
+	for(int n = nFirst; n < int(m_arLayers.size()); n++)
+		m_arLayers[n]->m_nMapIndex = n;
 }
 
 int TileMap::GetLayerCount(void) const
@@ -411,6 +729,21 @@ const TileLayer* TileMap::GetLayerConst(int nIndex) const
 	return m_arLayers[nIndex];
 }
 
+TileLayerIndex& TileMap::GetLayerIndex(void)
+{
+	return m_LayerIndex;
+}
+
+const TileLayerIndex& TileMap::GetLayerIndexConst(void) const
+{
+	return m_LayerIndex;
+}
+
+DWORD TileMap::GetLayerStamp(void) const
+{
+	return m_dwLayerStamp;
+}
+
 Color& TileMap::GetBackgroundColor(void)
 {
 	return m_clrBackColor;
@@ -547,7 +880,28 @@ void TileMap::AddActor(Actor* pActor)
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
-	m_mapActors[pActor->GetName()] = pActor;
+	int nNameID = m_ActorNames.Add(pActor->GetName());
+
+	if (nNameID >= int(m_arActorsByName.size()))
+	{
+		try
+		{
+			m_arActorsByName.resize(size_t(m_ActorNames.GetCount()), NULL);
+		}
+
+		catch(std::bad_alloc)
+		{
+			throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+				__FUNCTIONW__, m_ActorNames.GetCount() * sizeof(Actor*));
+		}
+	}
+
+	pActor->m_nNameID = nNameID;
+
+	if (NULL == m_arActorsByName[nNameID])
+		m_nActors++;
+
+	m_arActorsByName[nNameID] = pActor;
 }
 
 void TileMap::RemoveActor(Actor* pActor)
@@ -557,13 +911,15 @@ void TileMap::RemoveActor(Actor* pActor)
 		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
 			__FUNCTIONW__, 0);
 
-	ActorMapIterator pos = m_mapActors.find(pActor->GetName());
+	int nNameID = pActor->m_nNameID;
+
+	if (INVALID_INDEX == nNameID || m_arActorsByName[nNameID] != pActor)
+		return;
 
-	if (pos == m_mapActors.end()) return;
+	m_arActorsByName[nNameID] = NULL;
+	m_nActors--;
 
 	delete pActor;
-
-	m_mapActors.erase(pos);
 }
 
 void TileMap::RemoveAllActors(void)
@@ -572,63 +928,104 @@ void TileMap::RemoveAllActors(void)
 
 	m_pPlayer = NULL;
 
-	for(ActorMapIterator pos = m_mapActors.begin();
-		pos != m_mapActors.end();
+	for(ActorArrayIterator pos = m_arActorsByName.begin();
+		pos != m_arActorsByName.end();
 		pos++)
 	{
-		delete pos->second;
+		delete *pos;
 	}
 
-	m_mapActors.clear();
+	m_arActorsByName.assign(m_arActorsByName.size(), NULL);
+	m_nActors = 0;
 
 	// Clear actors scheduled for update
 
 	m_arUpdateActors.clear();
+
+	// Clear actors swapped out by streaming
+
+	if (m_nStreamSwappedActors > 0)
+	{
+		for(TileLayerArrayIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			for(TileLayer::ChunkArrayIterator posChunk =
+				(*pos)->m_arChunks.begin();
+				posChunk != (*pos)->m_arChunks.end();
+				posChunk++)
+			{
+				posChunk->dwActorsOffset = 0;
+				posChunk->dwActorsSize = 0;
+				posChunk->nActors = 0;
+			}
+		}
+
+		m_nStreamSwappedActors = 0;
+		m_dwStreamSwapEnd = 0;
+		m_dwStreamSwapLive = 0;
+	}
 }
 
 int TileMap::GetActorCount(void) const
 {
-	return int(m_mapActors.size());
+	return m_nActors;
 }
 
 Actor* TileMap::GetActor(LPCWSTR pszName)
 {
-	ActorMapIterator pos = m_mapActors.find(pszName);
+	return GetActor(m_ActorNames.Find(pszName));
+}
 
-	if (pos == m_mapActors.end())
-		return NULL;
+const Actor* TileMap::GetActorConst(LPCWSTR pszName) const
+{
+	return GetActorConst(m_ActorNames.Find(pszName));
+}
 
-	return pos->second;
+int TileMap::GetActorNameID(LPCWSTR pszName)
+{
+	return m_ActorNames.Add(pszName);
 }
 
-const Actor* TileMap::GetActorConst(LPCWSTR pszName) const
+int TileMap::GetActorNameIDConst(LPCWSTR pszName) const
+{
+	return m_ActorNames.Find(pszName);
+}
+
+Actor* TileMap::GetActor(int nNameID)
 {
-	ActorMapConstIterator pos = m_mapActors.find(pszName);
+	if (nNameID < 0 || nNameID >= int(m_arActorsByName.size()))
+		return NULL;
+
+	return m_arActorsByName[nNameID];
+}
 
-	if (pos == m_mapActors.end())
+const Actor* TileMap::GetActorConst(int nNameID) const
+{
+	if (nNameID < 0 || nNameID >= int(m_arActorsByName.size()))
 		return NULL;
 
-	return pos->second;
+	return m_arActorsByName[nNameID];
 }
 
-ActorMapIterator TileMap::GetBeginActorPos(void)
+ActorArrayIterator TileMap::GetBeginActorPos(void)
 {
-	return m_mapActors.begin();
+	return m_arActorsByName.begin();
 }
 
-ActorMapIterator TileMap::GetEndActorPos(void)
+ActorArrayIterator TileMap::GetEndActorPos(void)
 {
-	return m_mapActors.end();
+	return m_arActorsByName.end();
 }
 
-ActorMapConstIterator TileMap::GetBeginActorPosConst(void) const
+ActorArrayConstIterator TileMap::GetBeginActorPosConst(void) const
 {
-	return m_mapActors.begin();
+	return m_arActorsByName.begin();
 }
 
-ActorMapConstIterator TileMap::GetEndActorPosConst(void) const
+ActorArrayConstIterator TileMap::GetEndActorPosConst(void) const
 {
-	return m_mapActors.end();
+	return m_arActorsByName.end();
 }
 
 Actor* TileMap::GetPlayerActor(void)
@@ -649,94 +1046,222 @@ void TileMap::SetPlayerActor(Actor* pPlayer)
 	m_pPlayer = pPlayer;
 }
 
-int TileMap::GetLayersFromPosition(int x,
-								   int y,
-								   TileLayerArray& rarLayers) const
+float TileMap::GetUpdateFullDistance(void) const
 {
-	for(TileLayerArrayConstIterator pos = m_arLayers.begin();
-		pos != m_arLayers.end();
-		pos++)
-	{
-		if ((*pos)->GetBounds().PtInRect(x, y) == true)
-			rarLayers.push_back(*pos);
-	}
-
-	return int(rarLayers.size());
+	return m_fUpdateFullDistance;
 }
 
-int TileMap::GetLayersFromPosition(float x,
-								   float y,
-								   TileLayerArray& rarLayers) const
+void TileMap::SetUpdateFullDistance(float fDistance)
 {
-	return GetLayersFromPosition(int(x), int(y), rarLayers);
+	m_fUpdateFullDistance = fDistance;
 }
 
-int TileMap::GetLayersFromRange(Rect& rcTileRange, 
-								TileLayerArray& rarLayers) const
+float TileMap::GetUpdateReducedDistance(void) const
 {
-	for(TileLayerArrayConstIterator pos = m_arLayers.begin();
-		pos != m_arLayers.end();
-		pos++)
-	{
-		if ((*pos)->GetBounds().Intersect(rcTileRange) == true)
-			rarLayers.push_back(*pos);
-	}
-
-	return int(rarLayers.size());
+	return m_fUpdateReducedDistance;
 }
 
-int TileMap::GetActorsFromPosition(int x,
-								   int y, 
-								   ActorArray& rarActors) const
+void TileMap::SetUpdateReducedDistance(float fDistance)
 {
-	// Get layers at that position
-
-	TileLayerArray arLayersAt;
-
-	if (GetLayersFromPosition(x, y, arLayersAt) == 0)
-		return 0;
+	m_fUpdateReducedDistance = fDistance;
+}
 
-	// For each layer, get actors at that position
+float TileMap::GetUpdateReducedInterval(void) const
+{
+	return m_fUpdateReducedInterval;
+}
 
-	ActorArray arActorsAt;
+void TileMap::SetUpdateReducedInterval(float fInterval)
+{
+	m_fUpdateReducedInterval = fInterval;
+}
 
-	for(TileLayerArrayConstIterator pos = arLayersAt.begin();
-		pos != arLayersAt.end();
-		pos++)
+int TileMap::AddWakeRegion(const Rect& rrcRegion)
+{
+	try
 	{
-		const TileLayer* pLayer = (*pos);
+		m_arWakeRegions.push_back(rrcRegion);
+	}
 
-		pLayer->GetSpace()->Query(float(x) - pLayer->GetPositionConst().x,
-			float(y) - pLayer->GetPositionConst().y, &arActorsAt);
+	catch(std::bad_alloc)
+	{
+		throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+			__FUNCTIONW__, sizeof(Rect));
 	}
 
-	// Remove duplicates
+	return int(m_arWakeRegions.size()) - 1;
+}
 
-	std::sort(arActorsAt.begin(), arActorsAt.end());
-	arActorsAt.erase(std::unique(arActorsAt.begin(), arActorsAt.end()));
+void TileMap::RemoveWakeRegion(int nRegion)
+{
+	if (nRegion < 0 || nRegion >= int(m_arWakeRegions.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
 
-	// Copy
+	m_arWakeRegions.erase(m_arWakeRegions.begin() + nRegion);
+}
 
-	std::copy(arActorsAt.begin(), arActorsAt.end(),
-		std::back_inserter(rarActors));
+void TileMap::RemoveAllWakeRegions(void)
+{
+	m_arWakeRegions.clear();
+}
 
-	return int(rarActors.size());
+int TileMap::GetWakeRegionCount(void) const
+{
+	return int(m_arWakeRegions.size());
 }
 
-int TileMap::GetActorsFromPosition(float x, 
-								   float y,
-								   ActorArray& rarActors) const
+int TileMap::WakeActors(Rect& rcTileRange, float fDuration)
 {
-	// Get layers at that position
+	return GetActorsFromRange(rcTileRange, QueryWake, &fDuration);
+}
 
-	TileLayerArray arLayersAt;
+int TileMap::GetUpdateTierCount(int nTier) const
+{
+	if (nTier < 0 || nTier >= Actor::TIER_COUNT)
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
 
-	if (GetLayersFromPosition(x, y, arLayersAt) == 0)
-		return 0;
+	return m_nUpdateTierCounts[nTier];
+}
 
-	// For each layer, get actors at that position
+int TileMap::GetStreamLoadDistance(void) const
+{
+	return m_nStreamLoadDistance;
+}
+
+void TileMap::SetStreamLoadDistance(int nDistance)
+{
+	m_nStreamLoadDistance = nDistance;
+}
+
+int TileMap::GetStreamEvictDistance(void) const
+{
+	return m_nStreamEvictDistance;
+}
+
+void TileMap::SetStreamEvictDistance(int nDistance)
+{
+	m_nStreamEvictDistance = nDistance;
+}
+
+int TileMap::GetStreamLoadBudget(void) const
+{
+	return m_nStreamLoadBudget;
+}
+
+void TileMap::SetStreamLoadBudget(int nBudget)
+{
+	m_nStreamLoadBudget = nBudget;
+}
+
+int TileMap::GetStreamResidentChunkCount(void) const
+{
+	return int(m_arStreamChunks.size());
+}
+
+int TileMap::GetStreamLoadCount(void) const
+{
+	return m_nStreamLoads;
+}
+
+int TileMap::GetStreamEvictionCount(void) const
+{
+	return m_nStreamEvictions;
+}
+
+int TileMap::GetStreamSwappedActorCount(void) const
+{
+	return m_nStreamSwappedActors;
+}
+
+int TileMap::GetUpdateThreads(void) const
+{
+	return m_nUpdateThreads;
+}
+
+void TileMap::SetUpdateThreads(int nThreads)
+{
+	if (nThreads < 0)
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	m_nUpdateThreads = nThreads;
+
+	// Re-create workers on next parallel update
+
+	m_Workers.Destroy();
+	m_bUpdateWorkers = false;
+}
+
+int TileMap::GetParallelUpdateCount(void) const
+{
+	return int(m_arParallelActors.size());
+}
+
+int TileMap::GetSpaceUpdateCount(void) const
+{
+	return m_nSpaceUpdates;
+}
+
+void TileMap::ResetSpaceUpdateCount(void)
+{
+	m_nSpaceUpdates = 0;
+}
+
+Navigation& TileMap::GetNavigation(void)
+{
+	return m_Navigation;
+}
+
+const Navigation& TileMap::GetNavigationConst(void) const
+{
+	return m_Navigation;
+}
+
+int TileMap::GetLayersFromPosition(int x,
+								   int y,
+								   TileLayerArray& rarLayers,
+								   int nMinZ,
+								   int nMaxZ) const
+{
+	m_LayerIndex.Query(x, y, rarLayers, nMinZ, nMaxZ);
+
+	return int(rarLayers.size());
+}
+
+int TileMap::GetLayersFromPosition(float x,
+								   float y,
+								   TileLayerArray& rarLayers,
+								   int nMinZ,
+								   int nMaxZ) const
+{
+	return GetLayersFromPosition(int(x), int(y), rarLayers, nMinZ, nMaxZ);
+}
+
+int TileMap::GetLayersFromRange(Rect& rcTileRange, 
+								TileLayerArray& rarLayers,
+								int nMinZ,
+								int nMaxZ) const
+{
+	m_LayerIndex.Query(rcTileRange, rarLayers, nMinZ, nMaxZ);
+
+	return int(rarLayers.size());
+}
+
+int TileMap::GetActorsFromPosition(int x,
+								   int y, 
+								   ActorArray& rarActors) const
+{
+	// Get layers at that position
+
+	TileLayerArray arLayersAt;
+
+	if (GetLayersFromPosition(x, y, arLayersAt) == 0)
+		return int(rarActors.size());
 
-	ActorArray arActorsAt;
+	// For each layer, get actors at that position. Actors are attached
+	// to one layer only, so results from different layers never overlap
 
 	for(TileLayerArrayConstIterator pos = arLayersAt.begin();
 		pos != arLayersAt.end();
@@ -744,35 +1269,61 @@ int TileMap::GetActorsFromPosition(float x,
 	{
 		const TileLayer* pLayer = (*pos);
 
-		pLayer->GetSpace()->Query(x - pLayer->GetPositionConst().x,
-			y - pLayer->GetPositionConst().y, &arActorsAt);
+		pLayer->GetSpace()->Query(float(x) - pLayer->GetPositionConst().x,
+			float(y) - pLayer->GetPositionConst().y, &rarActors);
 	}
 
-	// Remove duplicates
+	return int(rarActors.size());
+}
+
+int TileMap::GetActorsFromPosition(float x, 
+								   float y,
+								   ActorArray& rarActors) const
+{
+	// Get layers at that position
+
+	TileLayerArray arLayersAt;
+
+	if (GetLayersFromPosition(x, y, arLayersAt) == 0)
+		return int(rarActors.size());
 
-	std::sort(arActorsAt.begin(), arActorsAt.end());
-		arActorsAt.erase(std::unique(arActorsAt.begin(), arActorsAt.end()));
+	// For each layer, get actors at that position
 
-	// Copy
+	for(TileLayerArrayConstIterator pos = arLayersAt.begin();
+		pos != arLayersAt.end();
+		pos++)
+	{
+		const TileLayer* pLayer = (*pos);
 
-	std::copy(arActorsAt.begin(), arActorsAt.end(),
-		std::back_inserter(rarActors));
+		pLayer->GetSpace()->Query(x - pLayer->GetPositionConst().x,
+			y - pLayer->GetPositionConst().y, &rarActors);
+	}
 
 	return int(rarActors.size());
 }
 
 int TileMap::GetActorsFromRange(Rect& rcTileRange, ActorArray& rarActors) const
 {
-	// Get layers at that position
+	GetActorsFromRange(rcTileRange, SpacePartition::QueryAppend, &rarActors);
+
+	return int(rarActors.size());
+}
+
+int TileMap::GetActorsFromRange(Rect& rcTileRange,
+								PQUERYCALLBACK pCallback,
+								void* pContext) const
+{
+	// Get layers in that range
 
 	TileLayerArray arLayersAt;
 
 	if (GetLayersFromRange(rcTileRange, arLayersAt) == 0)
 		return 0;
 
-	// For each layer, get actors at that position
+	// For each layer, get actors in that range. Actors are attached
+	// to one layer only, so results from different layers never overlap
 
-	ActorArray arActorsAt;
+	int nCount = 0;
 
 	for(TileLayerArrayConstIterator pos = arLayersAt.begin();
 		pos != arLayersAt.end();
@@ -783,20 +1334,185 @@ int TileMap::GetActorsFromRange(Rect& rcTileRange, ActorArray& rarActors) const
 		Rect rcRange = rcTileRange;
 		rcRange.Offset(pLayer->GetPositionConst() * -1);
 
-		pLayer->GetSpace()->Query(rcRange, &arActorsAt);
+		nCount += pLayer->GetSpace()->Query(rcRange, pCallback, pContext);
 	}
 
-	// Remove duplicates
+	return nCount;
+}
+
+int TileMap::GetActorsFromRanges(const Rect* prcTileRanges,
+								 int nRangeCount,
+								 ActorArray& rarActors,
+								 int* pnFirst,
+								 int* pnCount) const
+{
+	if (NULL == prcTileRanges || NULL == pnFirst || NULL == pnCount)
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	if (nRangeCount <= 0)
+		return 0;
+
+	// Resolve layers intersecting any of the ranges once for the batch
 
-	std::sort(arActorsAt.begin(), arActorsAt.end());
-	arActorsAt.erase(std::unique(arActorsAt.begin(), arActorsAt.end()));
+	Rect rcUnion = prcTileRanges[0];
 
-	// Copy
+	for(int n = 1; n < nRangeCount; n++)
+	{
+		const Rect& rrc = prcTileRanges[n];
+
+		rcUnion.left = min(rcUnion.left, rrc.left);
+		rcUnion.top = min(rcUnion.top, rrc.top);
+		rcUnion.right = max(rcUnion.right, rrc.right);
+		rcUnion.bottom = max(rcUnion.bottom, rrc.bottom);
+	}
 
-	std::copy(arActorsAt.begin(), arActorsAt.end(),
-		std::back_inserter(rarActors));
+	TileLayerArray arLayers;
 
-	return int(rarActors.size());
+	if (GetLayersFromRange(rcUnion, arLayers) == 0)
+	{
+		std::fill(pnFirst, pnFirst + nRangeCount, int(rarActors.size()));
+		std::fill(pnCount, pnCount + nRangeCount, 0);
+
+		return 0;
+	}
+
+	// Visit ranges sorted by row then column, so that consecutive
+	// queries walk neighbouring partition cells
+
+	std::vector< std::pair<std::pair<int, int>, int> > arOrder;
+
+	arOrder.reserve(nRangeCount);
+
+	for(int n = 0; n < nRangeCount; n++)
+	{
+		arOrder.push_back(std::make_pair(std::make_pair(
+			prcTileRanges[n].top, prcTileRanges[n].left), n));
+	}
+
+	std::sort(arOrder.begin(), arOrder.end());
+
+	// Query each range from resolved layers, results of
+	// every range are stored contiguously in output array
+
+	int nTotal = 0;
+
+	for(int n = 0; n < nRangeCount; n++)
+	{
+		int nRange = arOrder[n].second;
+		const Rect& rrcRange = prcTileRanges[nRange];
+
+		pnFirst[nRange] = int(rarActors.size());
+
+		for(TileLayerArrayConstIterator pos = arLayers.begin();
+			pos != arLayers.end();
+			pos++)
+		{
+			const TileLayer* pLayer = (*pos);
+
+			if (pLayer->GetBounds().Intersect(rrcRange) == false)
+				continue;
+
+			Rect rcRange = rrcRange;
+			rcRange.Offset(pLayer->GetPositionConst() * -1);
+
+			pLayer->GetSpace()->Query(rcRange, &rarActors);
+		}
+
+		pnCount[nRange] = int(rarActors.size()) - pnFirst[nRange];
+
+		nTotal += pnCount[nRange];
+	}
+
+	return nTotal;
+}
+
+int TileMap::GetActorsFromPositions(const Vector2* pvecPositions,
+									int nPositionCount,
+									ActorArray& rarActors,
+									int* pnFirst,
+									int* pnCount) const
+{
+	if (NULL == pvecPositions || NULL == pnFirst || NULL == pnCount)
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	if (nPositionCount <= 0)
+		return 0;
+
+	// Resolve layers containing any of the positions once for the batch
+
+	Rect rcUnion(int(pvecPositions[0].x), int(pvecPositions[0].y),
+		int(pvecPositions[0].x) + 1, int(pvecPositions[0].y) + 1);
+
+	for(int n = 1; n < nPositionCount; n++)
+	{
+		int x = int(pvecPositions[n].x);
+		int y = int(pvecPositions[n].y);
+
+		rcUnion.left = min(rcUnion.left, x);
+		rcUnion.top = min(rcUnion.top, y);
+		rcUnion.right = max(rcUnion.right, x + 1);
+		rcUnion.bottom = max(rcUnion.bottom, y + 1);
+	}
+
+	TileLayerArray arLayers;
+
+	if (GetLayersFromRange(rcUnion, arLayers) == 0)
+	{
+		std::fill(pnFirst, pnFirst + nPositionCount, int(rarActors.size()));
+		std::fill(pnCount, pnCount + nPositionCount, 0);
+
+		return 0;
+	}
+
+	// Visit positions sorted by row then column, so that consecutive
+	// queries walk neighbouring partition cells
+
+	std::vector< std::pair<std::pair<int, int>, int> > arOrder;
+
+	arOrder.reserve(nPositionCount);
+
+	for(int n = 0; n < nPositionCount; n++)
+	{
+		arOrder.push_back(std::make_pair(std::make_pair(
+			int(pvecPositions[n].y), int(pvecPositions[n].x)), n));
+	}
+
+	std::sort(arOrder.begin(), arOrder.end());
+
+	// Query each position from resolved layers, results of
+	// every position are stored contiguously in output array
+
+	int nTotal = 0;
+
+	for(int n = 0; n < nPositionCount; n++)
+	{
+		int nPosition = arOrder[n].second;
+		const Vector2& rvecPos = pvecPositions[nPosition];
+
+		pnFirst[nPosition] = int(rarActors.size());
+
+		for(TileLayerArrayConstIterator pos = arLayers.begin();
+			pos != arLayers.end();
+			pos++)
+		{
+			const TileLayer* pLayer = (*pos);
+
+			if (pLayer->GetBounds().PtInRect(int(rvecPos.x),
+			   int(rvecPos.y)) == false)
+				continue;
+
+			pLayer->GetSpace()->Query(rvecPos.x - pLayer->GetPositionConst().x,
+				rvecPos.y - pLayer->GetPositionConst().y, &rarActors);
+		}
+
+		pnCount[nPosition] = int(rarActors.size()) - pnFirst[nPosition];
+
+		nTotal += pnCount[nPosition];
+	}
+
+	return nTotal;
 }
 
 Camera* TileMap::CreateCamera(void)
@@ -824,7 +1540,11 @@ void TileMap::RemoveCamera(int nCamera)
 			m_arActiveCameras.end(), pCamera);
 
 	if (pos != m_arActiveCameras.end())
-		m_arActiveCameras.erase(pos);	
+	{
+		pCamera->Activate(false);
+
+		m_arActiveCameras.erase(pos);
+	}
 
 	m_arCameras.erase(m_arCameras.begin() + nCamera);
 
@@ -833,99 +1553,882 @@ void TileMap::RemoveCamera(int nCamera)
 
 void TileMap::RemoveAllCameras(void)
 {
-	m_arActiveCameras.clear();
+	RemoveAllActiveCameras();
 
 	for(CameraArrayIterator pos = m_arCameras.begin();
 		pos != m_arCameras.end();
 		pos++)
 	{
-		delete *pos;
+		delete *pos;
+	}
+
+	m_arCameras.clear();
+}
+
+int TileMap::GetCameraCount(void) const
+{
+	return int(m_arCameras.size());
+}
+
+Camera* TileMap::GetCamera(int nCamera)
+{
+	if (nCamera < 0 || nCamera >= int(m_arCameras.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	return m_arCameras[nCamera];
+}
+
+const Camera* TileMap::GetCameraConst(int nCamera) const
+{
+	if (nCamera < 0 || nCamera >= int(m_arCameras.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	return m_arCameras[nCamera];
+}
+
+Camera* TileMap::GetActiveCamera(int nActiveCamera)
+{
+	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	return m_arActiveCameras[nActiveCamera];
+}
+
+const Camera* TileMap::GetActiveCameraConst(int nActiveCamera) const
+{
+	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	return m_arActiveCameras[nActiveCamera];
+}
+
+int TileMap::GetActiveCameraCount(void) const
+{
+	return int(m_arActiveCameras.size());
+}
+
+void TileMap::SetActiveCamera(Camera* pCamera)
+{
+	CameraArrayIterator posExisting =
+		std::find(m_arActiveCameras.begin(),
+			m_arActiveCameras.end(), pCamera);
+
+	if (posExisting != m_arActiveCameras.end())
+		return;
+
+	m_arActiveCameras.push_back(pCamera);
+
+	pCamera->Activate(true);
+}
+
+void TileMap::RemoveActiveCamera(int nActiveCamera)
+{
+	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
+		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
+			__FUNCTIONW__, 0);
+
+	m_arActiveCameras[nActiveCamera]->Activate(false);
+
+	m_arActiveCameras.erase(m_arActiveCameras.begin() + nActiveCamera);
+}
+
+void TileMap::RemoveActiveCamera(Camera* pCamera)
+{
+	CameraArrayIterator posExisting =
+		std::find(m_arActiveCameras.begin(),
+				  m_arActiveCameras.end(),
+				  pCamera);
+
+	if (posExisting != m_arActiveCameras.end())
+	{
+		pCamera->Activate(false);
+
+		m_arActiveCameras.erase(posExisting);
+	}
+}
+
+void TileMap::RemoveAllActiveCameras(void)
+{
+	for(CameraArrayIterator pos = m_arActiveCameras.begin();
+		pos != m_arActiveCameras.end();
+		pos++)
+	{
+		(*pos)->Activate(false);
+	}
+
+	m_arActiveCameras.clear();
+}
+
+void TileMap::UpdateCameras(Actor* pActor)
+{
+	// Actor moved, resized or changed layer
+
+	for(CameraArrayIterator pos = m_arActiveCameras.begin();
+		pos != m_arActiveCameras.end();
+		pos++)
+	{
+		(*pos)->UpdateVisibleActor(pActor);
+	}
+}
+
+void TileMap::UpdateCameras(TileLayer* pLayer, bool bRemoved)
+{
+	// Layer moved or is being removed
+
+	for(CameraArrayIterator pos = m_arActiveCameras.begin();
+		pos != m_arActiveCameras.end();
+		pos++)
+	{
+		if (true == bRemoved)
+			(*pos)->RemoveVisibleActors(pLayer);
+		else
+			(*pos)->UpdateVisibleActors(Rect(0, 0, 0, 0));
+	}
+}
+
+int TileMap::GetUpdateTier(const Actor* pActor, float fTime) const
+{
+	// Woken actors and actors in view always update at full rate
+
+	if (pActor->m_fLastUpdate < pActor->m_fWakeTime ||
+	   pActor->IsVisible() == true)
+		return Actor::TIER_FULL;
+
+	// Without cameras or wake regions, there is nothing to measure from
+
+	if (m_arActiveCameras.empty() == true && m_arWakeRegions.empty() == true)
+		return Actor::TIER_FULL;
+
+	Vector2 vecPos = pActor->GetPosition();
+
+	if (pActor->GetLayerConst() != NULL)
+		vecPos += pActor->GetLayerConst()->GetPositionConst();
+
+	for(RectArrayConstIterator pos = m_arWakeRegions.begin();
+		pos != m_arWakeRegions.end();
+		pos++)
+	{
+		if (pos->PtInRect(int(floor(vecPos.x)), int(floor(vecPos.y))) == true)
+			return Actor::TIER_FULL;
+	}
+
+	// Measure from the closest active camera center
+
+	float fMinDistanceSq = FLT_MAX;
+
+	for(CameraArrayConstIterator pos = m_arActiveCameras.begin();
+		pos != m_arActiveCameras.end();
+		pos++)
+	{
+		Vector2 vecCenter = (*pos)->GetPositionConst() +
+			(*pos)->GetSizeConst() * 0.5f;
+
+		float fDistanceSq = Vector2(vecCenter - vecPos).LengthSq();
+
+		if (fDistanceSq < fMinDistanceSq)
+			fMinDistanceSq = fDistanceSq;
+	}
+
+	if (fMinDistanceSq <= m_fUpdateFullDistance * m_fUpdateFullDistance)
+		return Actor::TIER_FULL;
+
+	if (fMinDistanceSq <= m_fUpdateReducedDistance * m_fUpdateReducedDistance)
+		return Actor::TIER_REDUCED;
+
+	return Actor::TIER_ASLEEP;
+}
+
+void TileMap::QueryWake(Actor* pActor, void* pContext)
+{
+	pActor->Wake(*reinterpret_cast<float*>(pContext));
+}
+
+void TileMap::UpdateStreaming(void)
+{
+	if (IsFlagSet(STREAM) == false || m_arActiveCameras.empty() == true)
+		return;
+
+	// Evict resident chunks far from views of all active cameras,
+	// never closer than chunks are loaded to avoid loading them right back
+
+	int nEvictDistance = max(m_nStreamEvictDistance, m_nStreamLoadDistance);
+
+	for(size_t n = 0; n < m_arStreamChunks.size();)
+	{
+		StreamChunk chunk = m_arStreamChunks[n];
+
+		Rect rcChunk = GetChunkRange(chunk.pLayer, chunk.nChunk);
+
+		bool bNear = false;
+
+		for(CameraArrayConstIterator pos = m_arActiveCameras.begin();
+			pos != m_arActiveCameras.end() && false == bNear;
+			pos++)
+		{
+			Rect rcNear = (*pos)->GetVisibleRange();
+			rcNear.Inflate(nEvictDistance, nEvictDistance);
+
+			bNear = rcNear.Intersect(rcChunk);
+		}
+
+		if (true == bNear)
+		{
+			n++;
+			continue;
+		}
+
+		// Order of resident chunks does not matter, fill the gap with last
+
+		m_arStreamChunks[n] = m_arStreamChunks.back();
+		m_arStreamChunks.pop_back();
+
+		EvictStreamChunk(chunk.pLayer, chunk.nChunk);
+	}
+
+	// Load chunks in camera views now, queue chunks around them
+
+	m_arStreamRequests.clear();
+
+	TileLayerArray arLayers;
+
+	for(CameraArrayConstIterator pos = m_arActiveCameras.begin();
+		pos != m_arActiveCameras.end();
+		pos++)
+	{
+		const Rect& rrcVisible = (*pos)->GetVisibleRange();
+		POINT ptCenter = rrcVisible.GetCenter();
+
+		Rect rcLoad = rrcVisible;
+		rcLoad.Inflate(m_nStreamLoadDistance, m_nStreamLoadDistance);
+
+		arLayers.clear();
+		GetLayersFromRange(rcLoad, arLayers);
+
+		for(TileLayerArrayIterator posLayer = arLayers.begin();
+			posLayer != arLayers.end();
+			posLayer++)
+		{
+			TileLayer* pLayer = *posLayer;
+
+			if (pLayer->m_arChunks.empty() == true)
+				continue;
+
+			// Convert load range to chunks in layer
+
+			int nLayerX = int(floor(pLayer->GetPositionConst().x));
+			int nLayerY = int(floor(pLayer->GetPositionConst().y));
+
+			int nChunksHeight =
+				int(pLayer->m_arChunks.size()) / pLayer->m_nChunksWidth;
+
+			int cxMin = max(0, (rcLoad.left - nLayerX) >> TileLayer::CHUNK_SHIFT);
+			int cyMin = max(0, (rcLoad.top - nLayerY) >> TileLayer::CHUNK_SHIFT);
+
+			int cxMax = min(pLayer->m_nChunksWidth - 1,
+				(rcLoad.right - 1 - nLayerX) >> TileLayer::CHUNK_SHIFT);
+
+			int cyMax = min(nChunksHeight - 1,
+				(rcLoad.bottom - 1 - nLayerY) >> TileLayer::CHUNK_SHIFT);
+
+			for(int cy = cyMin; cy <= cyMax; cy++)
+			{
+				for(int cx = cxMin; cx <= cxMax; cx++)
+				{
+					int nChunk = cy * pLayer->m_nChunksWidth + cx;
+
+					const TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+					if (true == rChunk.bResident && 0 == rChunk.nActors)
+						continue;
+
+					Rect rcChunk = GetChunkRange(pLayer, nChunk);
+
+					if (rcChunk.Intersect(rrcVisible) == true)
+					{
+						LoadStreamChunk(pLayer, nChunk);
+						continue;
+					}
+
+					POINT ptChunk = rcChunk.GetCenter();
+
+					int dx = (ptChunk.x - ptCenter.x) / TileLayer::CHUNK_SIZE;
+					int dy = (ptChunk.y - ptCenter.y) / TileLayer::CHUNK_SIZE;
+
+					StreamChunk request = { pLayer, nChunk, dx * dx + dy * dy };
+
+					m_arStreamRequests.push_back(request);
+				}
+			}
+		}
+	}
+
+	// Load queued chunks nearest first, up to budget
+
+	std::sort(m_arStreamRequests.begin(), m_arStreamRequests.end(),
+		CompareStreamChunks);
+
+	int nLoaded = 0;
+
+	for(StreamChunkArrayIterator pos = m_arStreamRequests.begin();
+		pos != m_arStreamRequests.end() && nLoaded < m_nStreamLoadBudget;
+		pos++)
+	{
+		// Same chunk may be queued by more than one camera
+
+		const TileLayer::Chunk& rChunk = pos->pLayer->m_arChunks[pos->nChunk];
+
+		if (true == rChunk.bResident && 0 == rChunk.nActors)
+			continue;
+
+		LoadStreamChunk(pos->pLayer, pos->nChunk);
+
+		nLoaded++;
+	}
+
+	// Swap out actors loaded with the map outside of resident chunks
+
+	if (true == m_bStreamSwapPending)
+	{
+		m_bStreamSwapPending = false;
+
+		SwapOutActors();
+	}
+}
+
+void TileMap::LoadStreamChunk(TileLayer* pLayer, int nChunk)
+{
+	TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+	if (NULL == rChunk.pwTiles && rChunk.dwOffset != 0)
+		pLayer->LoadTiles(nChunk);
+
+	if (rChunk.nActors > 0)
+		SwapInActors(pLayer, nChunk);
+
+	TrackStreamChunk(pLayer, nChunk);
+}
+
+void TileMap::EvictStreamChunk(TileLayer* pLayer, int nChunk)
+{
+	TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+	// Release baked geometry
+
+	pLayer->ReleaseGeometry(nChunk);
+
+	// Release tiles that can be read back from map file
+
+	if (rChunk.pwTiles != NULL && rChunk.dwOffset != 0 &&
+	   false == rChunk.bModified)
+	{
+		delete[] rChunk.pwTiles;
+		rChunk.pwTiles = NULL;
+
+		pLayer->m_nChunksAllocated--;
+	}
+
+	// Swap out actors positioned in this chunk
+
+	if (pLayer->GetSpace() != NULL)
+	{
+		Rect rcRange = GetChunkRange(pLayer, nChunk);
+
+		rcRange.Offset(-int(floor(pLayer->GetPositionConst().x)),
+			-int(floor(pLayer->GetPositionConst().y)));
+
+		ActorArray arActors;
+		pLayer->GetSpace()->Query(rcRange, &arActors);
+
+		for(ActorArrayIterator pos = arActors.begin();
+			pos != arActors.end();
+			pos++)
+		{
+			if (GetActorChunk(*pos) == nChunk)
+				SwapOutActor(*pos, pLayer, nChunk);
+		}
+	}
+
+	rChunk.bResident = false;
+
+	m_nStreamEvictions++;
+}
+
+void TileMap::TrackStreamChunk(const TileLayer* pLayer, int nChunk)
+{
+	TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+	if (true == rChunk.bResident)
+		return;
+
+	rChunk.bResident = true;
+
+	// Tiles may be loaded through a const layer, but map owns its layers
+	// and needs them writable to evict the chunk later
+
+	StreamChunk chunk = { const_cast<TileLayer*>(pLayer), nChunk, 0 };
+
+	m_arStreamChunks.push_back(chunk);
+
+	m_nStreamLoads++;
+}
+
+void TileMap::ReleaseStreamChunks(TileLayer* pLayer, bool bRestoreActors)
+{
+	// Chunks of this layer are being reallocated or released
+
+	if (m_arStreamChunks.empty() == true && 0 == m_nStreamSwappedActors)
+		return;
+
+	for(size_t n = 0; n < m_arStreamChunks.size();)
+	{
+		if (m_arStreamChunks[n].pLayer == pLayer)
+		{
+			m_arStreamChunks[n] = m_arStreamChunks.back();
+			m_arStreamChunks.pop_back();
+		}
+		else
+		{
+			n++;
+		}
+	}
+
+	for(int n = 0; n < int(pLayer->m_arChunks.size()); n++)
+	{
+		TileLayer::Chunk& rChunk = pLayer->m_arChunks[n];
+
+		rChunk.bResident = false;
+
+		if (0 == rChunk.nActors)
+			continue;
+
+		if (true == bRestoreActors)
+			SwapInActors(pLayer, n);
+		else
+			ReleaseSwapRecords(rChunk);
+	}
+
+	// Layer may be on its way out of the map, so only compact swap file
+	// once none of its records are left
+
+	ReclaimStreamSwap();
+}
+
+void TileMap::SwapOutActors(void)
+{
+	// Copy actors first, swapping out removes them from map
+
+	ActorArray arActors;
+
+	arActors.reserve(size_t(m_nActors));
+
+	for(ActorArrayIterator pos = m_arActorsByName.begin();
+		pos != m_arActorsByName.end();
+		pos++)
+	{
+		if (*pos != NULL)
+			arActors.push_back(*pos);
+	}
+
+	for(ActorArrayIterator pos = arActors.begin();
+		pos != arActors.end();
+		pos++)
+	{
+		int nChunk = GetActorChunk(*pos);
+
+		if (INVALID_INDEX == nChunk)
+			continue;
+
+		TileLayer* pLayer = (*pos)->GetLayer();
+
+		if (false == pLayer->m_arChunks[nChunk].bResident)
+			SwapOutActor(*pos, pLayer, nChunk);
+	}
+}
+
+void TileMap::SwapOutActor(Actor* pActor, TileLayer* pLayer, int nChunk)
+{
+	// Player and actors in view of any camera always stay
+
+	if (pActor == m_pPlayer || pActor->IsVisible() == true)
+		return;
+
+	if (NULL == m_pStreamSwap)
+		m_pStreamSwap = CreateStreamSwap();
+
+	// Write record linked to previous record of this chunk
+
+	TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+	DWORD dwRecordSize = 0;
+
+	m_pStreamSwap->SetPosition(LONG(m_dwStreamSwapEnd), Stream::MOVE_BEGIN);
+
+	m_pStreamSwap->WriteVar(&rChunk.dwActorsOffset);
+	m_pStreamSwap->WriteVar(&dwRecordSize);
+
+	m_pStreamSwap->ResetSizeWritten();
+
+	pActor->GetClass().Serialize(*m_pStreamSwap);
+	pActor->Serialize(*m_pStreamSwap);
+
+	// Write record size into space reserved for it
+
+	dwRecordSize = m_pStreamSwap->GetSizeWritten();
+
+	m_pStreamSwap->SetPosition(-LONG(dwRecordSize) - 4l, Stream::MOVE_CURRENT);
+	m_pStreamSwap->WriteVar(&dwRecordSize);
+
+	dwRecordSize += DWORD(sizeof(DWORD) * 2);
+
+	rChunk.dwActorsOffset = m_dwStreamSwapEnd;
+	rChunk.dwActorsSize += dwRecordSize;
+	rChunk.nActors++;
+
+	m_dwStreamSwapEnd += dwRecordSize;
+	m_dwStreamSwapLive += dwRecordSize;
+	m_nStreamSwappedActors++;
+
+	// Remove from update list and delete
+
+	pActor->SetFlags(pActor->GetFlags() & ~Actor::UPDATE);
+
+	RemoveActor(pActor);
+}
+
+void TileMap::SwapInActors(TileLayer* pLayer, int nChunk)
+{
+	TileLayer::Chunk& rChunk = pLayer->m_arChunks[nChunk];
+
+	DWORD dwOffset = rChunk.dwActorsOffset;
+
+	float fTime = m_rEngine.GetTime();
+
+	String strClass;
+
+	for(int n = 0; n < rChunk.nActors; n++)
+	{
+		// Read record header
+
+		DWORD dwPrevOffset = 0;
+		DWORD dwRecordSize = 0;
+
+		m_pStreamSwap->SetPosition(LONG(dwOffset), Stream::MOVE_BEGIN);
+
+		m_pStreamSwap->ReadVar(&dwPrevOffset);
+		m_pStreamSwap->ReadVar(&dwRecordSize);
+
+		// Create and read actor, same as when loading map
+
+		strClass.Deserialize(*m_pStreamSwap);
+
+		Actor* pActor = CreateActor(strClass, NULL);
+
+		pActor->Deserialize(*m_pStreamSwap);
+		pActor->SetLayer(pLayer, false);
+
+		AddActor(pActor);
+
+		if (pActor->IsFlagSet(Actor::UPDATE) == true)
+		{
+			m_arUpdateActors.push_back(pActor);
+
+			pActor->m_fLastUpdate = fTime;
+		}
+
+		dwOffset = dwPrevOffset;
+	}
+
+	ReleaseSwapRecords(rChunk);
+
+	ReclaimStreamSwap();
+}
+
+void TileMap::ReleaseSwapRecords(TileLayer::Chunk& rChunk)
+{
+	m_nStreamSwappedActors -= rChunk.nActors;
+	m_dwStreamSwapLive -= rChunk.dwActorsSize;
+
+	rChunk.dwActorsOffset = 0;
+	rChunk.dwActorsSize = 0;
+	rChunk.nActors = 0;
+}
+
+void TileMap::ReclaimStreamSwap(void)
+{
+	// Reuse swap file space once all actors are back, or compact it
+	// once most of it is taken by records no longer used
+
+	if (0 == m_nStreamSwappedActors)
+	{
+		m_dwStreamSwapEnd = 0;
+		m_dwStreamSwapLive = 0;
+	}
+	else if (m_dwStreamSwapEnd - m_dwStreamSwapLive > m_dwStreamSwapLive)
+	{
+		CompactStreamSwap();
+	}
+}
+
+Stream* TileMap::CreateStreamSwap(void)
+{
+	// Create swap file, deleted when closed
+
+	WCHAR szTempPath[MAX_PATH] = {0};
+	WCHAR szSwapPath[MAX_PATH] = {0};
+
+	GetTempPath(MAX_PATH, szTempPath);
+	GetTempFileName(szTempPath, L"thm", 0, szSwapPath);
+
+	Stream* pSwap = NULL;
+
+	try
+	{
+		pSwap = new Stream(&m_rEngine.GetErrors());
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+			__FUNCTIONW__, sizeof(Stream));
+	}
+
+	try
+	{
+		pSwap->Open(szSwapPath, GENERIC_READ | GENERIC_WRITE,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE);
+	}
+
+	catch(Error&)
+	{
+		delete pSwap;
+		throw;
+	}
+
+	return pSwap;
+}
+
+void TileMap::CompactStreamSwap(void)
+{
+	// Copy records still in use to a new swap file, relinking records
+	// of each chunk. Offsets are only updated once all are copied
+
+	Stream* pSwap = CreateStreamSwap();
+
+	std::vector<DWORD> arOffsets;
+	std::vector<BYTE> arRecord;
+
+	DWORD dwEnd = 0;
+
+	try
+	{
+		for(TileLayerArrayIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+			for(TileLayer::ChunkArrayIterator posChunk = rarChunks.begin();
+				posChunk != rarChunks.end();
+				posChunk++)
+			{
+				if (0 == posChunk->nActors)
+					continue;
+
+				DWORD dwOffset = posChunk->dwActorsOffset;
+				DWORD dwNewOffset = 0;
+
+				for(int n = 0; n < posChunk->nActors; n++)
+				{
+					DWORD dwPrevOffset = 0;
+					DWORD dwRecordSize = 0;
+
+					m_pStreamSwap->SetPosition(LONG(dwOffset),
+						Stream::MOVE_BEGIN);
+
+					m_pStreamSwap->ReadVar(&dwPrevOffset);
+					m_pStreamSwap->ReadVar(&dwRecordSize);
+
+					arRecord.resize(dwRecordSize);
+
+					if (dwRecordSize > 0)
+						m_pStreamSwap->Read(&arRecord[0], dwRecordSize);
+
+					// Link to record copied before, so that records are
+					// read back in reverse order of the original ones
+
+					pSwap->WriteVar(&dwNewOffset);
+					pSwap->WriteVar(&dwRecordSize);
+
+					if (dwRecordSize > 0)
+						pSwap->Write(&arRecord[0], dwRecordSize);
+
+					dwNewOffset = dwEnd;
+					dwEnd += DWORD(sizeof(DWORD) * 2) + dwRecordSize;
+
+					dwOffset = dwPrevOffset;
+				}
+
+				arOffsets.push_back(dwNewOffset);
+			}
+		}
+	}
+
+	catch(std::bad_alloc e)
+	{
+		delete pSwap;
+
+		throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+			__FUNCTIONW__, arRecord.size());
+	}
+
+	catch(Error&)
+	{
+		delete pSwap;
+		throw;
+	}
+
+	// Switch to new swap file, closing old one deletes it
+
+	std::vector<DWORD>::const_iterator posOffset = arOffsets.begin();
+
+	for(TileLayerArrayIterator pos = m_arLayers.begin();
+		pos != m_arLayers.end();
+		pos++)
+	{
+		TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+		for(TileLayer::ChunkArrayIterator posChunk = rarChunks.begin();
+			posChunk != rarChunks.end();
+			posChunk++)
+		{
+			if (posChunk->nActors > 0)
+				posChunk->dwActorsOffset = *posOffset++;
+		}
 	}
 
-	m_arCameras.clear();
-}
+	delete m_pStreamSwap;
+	m_pStreamSwap = pSwap;
 
-int TileMap::GetCameraCount(void) const
-{
-	return int(m_arCameras.size());
+	m_dwStreamSwapEnd = dwEnd;
+	m_dwStreamSwapLive = dwEnd;
 }
 
-Camera* TileMap::GetCamera(int nCamera)
+int TileMap::GetActorChunk(const Actor* pActor) const
 {
-	if (nCamera < 0 || nCamera >= int(m_arCameras.size()))
-		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
-			__FUNCTIONW__, 0);
+	const TileLayer* pLayer = pActor->GetLayerConst();
 
-	return m_arCameras[nCamera];
-}
+	if (NULL == pLayer)
+		return INVALID_INDEX;
 
-const Camera* TileMap::GetCameraConst(int nCamera) const
-{
-	if (nCamera < 0 || nCamera >= int(m_arCameras.size()))
-		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
-			__FUNCTIONW__, 0);
+	int tx = int(floor(pActor->GetPosition().x));
+	int ty = int(floor(pActor->GetPosition().y));
 
-	return m_arCameras[nCamera];
+	if (pLayer->IsValidPosition(tx, ty) == false)
+		return INVALID_INDEX;
+
+	return (ty >> TileLayer::CHUNK_SHIFT) * pLayer->m_nChunksWidth +
+		(tx >> TileLayer::CHUNK_SHIFT);
 }
 
-Camera* TileMap::GetActiveCamera(int nActiveCamera)
+Rect TileMap::GetChunkRange(const TileLayer* pLayer, int nChunk) const
 {
-	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
-		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
-			__FUNCTIONW__, 0);
+	int nLeft = int(floor(pLayer->GetPositionConst().x)) +
+		((nChunk % pLayer->m_nChunksWidth) << TileLayer::CHUNK_SHIFT);
 
-	return m_arActiveCameras[nActiveCamera];
+	int nTop = int(floor(pLayer->GetPositionConst().y)) +
+		((nChunk / pLayer->m_nChunksWidth) << TileLayer::CHUNK_SHIFT);
+
+	return Rect(nLeft, nTop,
+		nLeft + TileLayer::CHUNK_SIZE, nTop + TileLayer::CHUNK_SIZE);
 }
 
-const Camera* TileMap::GetActiveCameraConst(int nActiveCamera) const
+bool TileMap::IsStreamSource(LPCWSTR pszPath) const
 {
-	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
-		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
-			__FUNCTIONW__, 0);
+	if (NULL == m_pStreamSource || m_pStreamSource->IsOpen() == false)
+		return false;
 
-	return m_arActiveCameras[nActiveCamera];
-}
+	// Source is always opened with absolute path
 
-int TileMap::GetActiveCameraCount(void) const
-{
-	return int(m_arActiveCameras.size());
+	WCHAR szFullPath[MAX_PATH] = {0};
+
+	GetAbsolutePath(pszPath, szFullPath);
+
+	return (0 == _wcsicmp(szFullPath, m_pStreamSource->GetPath()));
 }
 
-void TileMap::SetActiveCamera(Camera* pCamera)
+void TileMap::ReplaceStreamSource(LPCWSTR pszSavedPath) const
 {
-	CameraArrayIterator posExisting =
-		std::find(m_arActiveCameras.begin(),
-			m_arActiveCameras.end(), pCamera);
+	// Map file must be closed to be replaced
 
-	if (posExisting != m_arActiveCameras.end())
-		return;
+	String strPath = m_pStreamSource->GetPath();
 
-	m_arActiveCameras.push_back(pCamera);
-}
+	m_pStreamSource->Empty();
 
-void TileMap::RemoveActiveCamera(int nActiveCamera)
-{
-	if (nActiveCamera < 0 || nActiveCamera >= int(m_arActiveCameras.size()))
-		throw m_rEngine.GetErrors().Push(Error::INVALID_PARAM,
-			__FUNCTIONW__, 0);
+	if (FALSE == MoveFileEx(pszSavedPath, strPath, MOVEFILE_REPLACE_EXISTING))
+	{
+		// Keep loading from map file as it was
 
-	m_arActiveCameras.erase(m_arActiveCameras.begin() + nActiveCamera);
+		DeleteFile(pszSavedPath);
+
+		m_pStreamSource->Open(strPath, GENERIC_READ, OPEN_EXISTING);
+
+		throw m_rEngine.GetErrors().Push(Error::FILE_WRITE,
+			__FUNCTIONW__, strPath);
+	}
+
+	m_pStreamSource->Open(strPath, GENERIC_READ, OPEN_EXISTING);
+
+	// Stored tiles are now where they were saved, and modified tiles
+	// can be read back from file like any other
+
+	for(TileLayerArrayConstIterator pos = m_arLayers.begin();
+		pos != m_arLayers.end();
+		pos++)
+	{
+		TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+		for(TileLayer::ChunkArrayIterator posChunk = rarChunks.begin();
+			posChunk != rarChunks.end();
+			posChunk++)
+		{
+			posChunk->dwOffset = posChunk->dwSavedOffset;
+			posChunk->dwSavedOffset = 0;
+			posChunk->bModified = false;
+		}
+	}
 }
 
-void TileMap::RemoveActiveCamera(Camera* pCamera)
+void TileMap::EmptyStreaming(void)
 {
-	CameraArrayIterator posExisting =
-		std::find(m_arActiveCameras.begin(),
-				  m_arActiveCameras.end(),
-				  pCamera);
+	// Closing swap file deletes it
 
-	if (posExisting != m_arActiveCameras.end())
-		m_arActiveCameras.erase(posExisting);
+	delete m_pStreamSwap;
+	m_pStreamSwap = NULL;
+
+	delete m_pStreamSource;
+	m_pStreamSource = NULL;
+
+	m_dwStreamSwapEnd = 0;
+	m_dwStreamSwapLive = 0;
+
+	m_arStreamChunks.clear();
+	m_arStreamRequests.clear();
+
+	m_nStreamLoads = 0;
+	m_nStreamEvictions = 0;
+	m_nStreamSwappedActors = 0;
+
+	m_bStreamSwapPending = false;
 }
 
-void TileMap::RemoveAllActiveCameras(void)
+bool TileMap::CompareStreamChunks(const StreamChunk& rLeft,
+								  const StreamChunk& rRight)
 {
-	m_arActiveCameras.clear();
+	return (rLeft.nDistance < rRight.nDistance);
 }
 
 int TileMap::AddMaterial(Material* pMaterial)
@@ -1195,6 +2698,16 @@ const VariableManager& TileMap::GetVariablesConst(void) const
 
 void TileMap::Render(void)
 {
+	// Partitions must be up to date when rendering, even if not updating
+
+	CommitSpaceUpdates();
+
+	// Layers and actors in view of any active camera are prepared
+	// once, then each camera renders its part of them
+
+	if (m_arActiveCameras.empty() == false)
+		PrepareRender(&m_arActiveCameras[0], int(m_arActiveCameras.size()));
+
 	// Render all active cameras
 
 	for(CameraArrayIterator pos = m_arActiveCameras.begin();
@@ -1203,6 +2716,171 @@ void TileMap::Render(void)
 	{
 		(*pos)->Render();
 	}
+
+	m_arRenderCameras.clear();
+}
+
+void TileMap::PrepareRender(Camera* const* ppCameras, int nCameras)
+{
+	m_dwRenderFrame++;
+
+	m_arRenderCameras.assign(ppCameras, ppCameras + nCameras);
+
+	// Union of actors in view, grouped by layer and sorted by
+	// address within layer like visible actors of each camera
+
+	m_arRenderActors.clear();
+
+	for(int n = 0; n < nCameras; n++)
+	{
+		// Visible actors are only maintained while camera is active,
+		// inactive cameras rendered on their own query layers instead
+
+		if (ppCameras[n]->IsActive() == true)
+		{
+			m_arRenderActors.insert(m_arRenderActors.end(),
+				ppCameras[n]->m_arVisible.begin(),
+				ppCameras[n]->m_arVisible.end());
+		}
+		else
+		{
+			ppCameras[n]->GetActorsInView(m_arRenderActors);
+		}
+	}
+
+	std::sort(m_arRenderActors.begin(), m_arRenderActors.end(),
+		CompareRenderActors);
+
+	m_arRenderActors.erase(std::unique(m_arRenderActors.begin(),
+		m_arRenderActors.end()), m_arRenderActors.end());
+
+	// Layers in Z range and in view of any camera. Chunks in view
+	// of several cameras are only prepared once. Each camera renders
+	// in the order of its own layer list
+
+	m_arRenderLayers.clear();
+
+	for(int n = 0; n < nCameras; n++)
+	{
+		const TileLayerArray& rarLayers = ppCameras[n]->GetLayers();
+
+		for(TileLayerArrayConstIterator pos = rarLayers.begin();
+			pos != rarLayers.end();
+			pos++)
+		{
+			TileLayer* pLayer = *pos;
+
+			Rect rcLayerRange;
+
+			if (pLayer->GetBounds().Intersect(
+			   ppCameras[n]->m_rcVisibleRange, rcLayerRange) == false)
+				continue;
+
+			rcLayerRange.Offset(-int(floor(pLayer->GetPositionConst().x)),
+				-int(floor(pLayer->GetPositionConst().y)));
+
+			pLayer->Prepare(rcLayerRange);
+
+			if (pLayer->m_dwRenderFrame != m_dwRenderFrame)
+			{
+				pLayer->m_dwRenderFrame = m_dwRenderFrame;
+				pLayer->m_nRenderLayer = int(m_arRenderLayers.size());
+
+				RenderLayer layer = { pLayer, 0, 0 };
+				m_arRenderLayers.push_back(layer);
+			}
+		}
+	}
+
+	for(TileLayerArrayIterator pos = m_arLayers.begin();
+		pos != m_arLayers.end();
+		pos++)
+	{
+		(*pos)->ReleaseExpiredGeometry();
+	}
+
+	// Assign each run of actors on the same layer to that layer
+
+	for(int nFirst = 0; nFirst < int(m_arRenderActors.size());)
+	{
+		const TileLayer* pLayer = m_arRenderActors[nFirst]->GetLayerConst();
+
+		int nEnd = nFirst + 1;
+
+		while(nEnd < int(m_arRenderActors.size()) &&
+			  m_arRenderActors[nEnd]->GetLayerConst() == pLayer)
+			nEnd++;
+
+		RenderLayer* pRenderLayer = GetRenderLayer(pLayer);
+
+		if (pRenderLayer != NULL)
+		{
+			pRenderLayer->nFirstActor = nFirst;
+			pRenderLayer->nActors = nEnd - nFirst;
+		}
+
+		nFirst = nEnd;
+	}
+}
+
+bool TileMap::IsRenderPrepared(const Camera* pCamera) const
+{
+	return (std::find(m_arRenderCameras.begin(), m_arRenderCameras.end(),
+		pCamera) != m_arRenderCameras.end());
+}
+
+TileMap::RenderLayer* TileMap::GetRenderLayer(const TileLayer* pLayer)
+{
+	// Layers not in view of any camera were not prepared this frame
+
+	if (NULL == pLayer || pLayer->m_dwRenderFrame != m_dwRenderFrame)
+		return NULL;
+
+	return &m_arRenderLayers[pLayer->m_nRenderLayer];
+}
+
+bool TileMap::HasOccluders(void) const
+{
+	// Look for OCCLUDER flag again only after templates changed
+
+	if (m_dwOccluderStamp == m_dwTileStamp)
+		return m_bOccluders;
+
+	m_dwOccluderStamp = m_dwTileStamp;
+	m_bOccluders = false;
+
+	for(TileStaticArrayConstIterator pos = m_arTilesStatic.begin();
+		pos != m_arTilesStatic.end() && false == m_bOccluders;
+		pos++)
+	{
+		m_bOccluders = pos->IsFlagSet(Tile::OCCLUDER);
+	}
+
+	for(TileAnimatedArrayConstIterator pos = m_arTilesAnimated.begin();
+		pos != m_arTilesAnimated.end() && false == m_bOccluders;
+		pos++)
+	{
+		m_bOccluders = pos->IsFlagSet(Tile::OCCLUDER);
+	}
+
+	return m_bOccluders;
+}
+
+void TileMap::InvalidateOcclusion(void)
+{
+	// Without occluders no layer geometry depends on other layers,
+	// so moving layers does not force their geometry to rebuild
+
+	if (HasOccluders() == true)
+		m_dwOcclusionStamp++;
+}
+
+bool TileMap::CompareRenderActors(const Actor* pLeft, const Actor* pRight)
+{
+	if (pLeft->GetLayerConst() != pRight->GetLayerConst())
+		return (pLeft->GetLayerConst() < pRight->GetLayerConst());
+
+	return (pLeft < pRight);
 }
 
 void TileMap::Update(void)
@@ -1212,35 +2890,158 @@ void TileMap::Update(void)
 	if (IsFlagSet(BACKGROUND_ANIMATED) == true)
 		m_BackAnimated.Update(m_rEngine.GetTime());
 
-	// Update tile animations
+	// Load and evict chunks around active cameras
 
-	for(TileAnimatedArrayIterator pos = m_arTilesAnimated.begin();
-		pos != m_arTilesAnimated.end();
-		pos++)
+	UpdateStreaming();
+
+	// Update tile animations, unless they are evaluated when rendered
+
+	if (IsFlagSet(ANIMATE_VISIBLE) == false)
 	{
-		pos->GetMaterialInstance().Update(m_rEngine.GetTime());
+		for(TileAnimatedArrayIterator pos = m_arTilesAnimated.begin();
+			pos != m_arTilesAnimated.end();
+			pos++)
+		{
+			pos->Update(m_rEngine.GetTime());
+		}
 	}
 
-	// Update actors
+	// Update actors according to their update tier
+
+	float fTime = m_rEngine.GetTime();
+
+	bool bParallel = IsFlagSet(PARALLEL_UPDATE);
+
+	ZeroMemory(m_nUpdateTierCounts, sizeof(m_nUpdateTierCounts));
+
+	m_arParallelActors.clear();
 
 	for(ActorArrayIterator pos = m_arUpdateActors.begin();
-		pos != m_arUpdateActors.end();
-		pos++)
+		pos != m_arUpdateActors.end();)
 	{
-		while(NULL == *pos)
+		if (NULL == *pos)
 		{
 			// If this list item has been nulled out, remove it
 
 			pos = m_arUpdateActors.erase(pos);
+			continue;
+		}
+
+		Actor* pActor = *pos++;
+
+		pActor->m_nUpdateTier = GetUpdateTier(pActor, fTime);
+
+		m_nUpdateTierCounts[pActor->m_nUpdateTier]++;
 
-			if (m_arUpdateActors.end() == pos)
-				return;
+		if (Actor::TIER_ASLEEP == pActor->m_nUpdateTier)
+			continue;
+
+		if (Actor::TIER_REDUCED == pActor->m_nUpdateTier &&
+		   (fTime - pActor->m_fLastUpdate) < m_fUpdateReducedInterval)
+			continue;
+
+		// Elapsed time accumulates over skipped frames
+
+		pActor->m_fUpdateElapsed = fTime - pActor->m_fLastUpdate;
+		pActor->m_fLastUpdate = fTime;
+
+		// Collect for parallel update, unless actor opted out
+
+		if (true == bParallel && false == pActor->IsFlagSet(Actor::SERIAL_UPDATE))
+			m_arParallelActors.push_back(pActor);
+		else
+			pActor->Update();
+	}
+
+	if (m_arParallelActors.empty() == false)
+	{
+		// Phase one: update collected actors on worker threads,
+		// recording their moves instead of updating space partitions
+
+		if (false == m_bUpdateWorkers)
+		{
+			m_Workers.Create(m_nUpdateThreads);
+			m_bUpdateWorkers = true;
+		}
+
+		m_jobUpdate.m_parActors = &m_arParallelActors;
+
+		m_bUpdateDeferred = true;
+
+		try
+		{
+			m_Workers.Run(m_jobUpdate, int(m_arParallelActors.size()));
+		}
+
+		catch(Error& rError)
+		{
+			// Keep space partitions consistent with moves made before failure
+
+			CollectParallelMoves();
+			CommitSpaceUpdates();
+
+			throw m_rEngine.GetErrors().Push(rError);
+		}
+
+		// Phase two: commit recorded moves along with deferred ones
+
+		CollectParallelMoves();
+	}
+
+	// Continue path searches within budget
+
+	m_Navigation.Update();
+
+	// Commit moves deferred during this update
+
+	CommitSpaceUpdates();
+}
+
+void TileMap::CommitSpaceUpdates(void)
+{
+	// Commit in the order actors were moved or updated, so that
+	// results do not depend on how actors were split between workers.
+	// Entries are nulled out if actor left its layer in the meantime.
+
+	for(ActorArrayIterator pos = m_arDirtyActors.begin();
+		pos != m_arDirtyActors.end();
+		pos++)
+	{
+		Actor* pActor = *pos;
+
+		if (pActor != NULL && true == pActor->m_bBoundsDeferred)
+		{
+			pActor->m_bBoundsDeferred = false;
+			pActor->CommitSpace(pActor->m_rcDeferredBounds);
+
+			m_nSpaceUpdates++;
 		}
+	}
+
+	m_arDirtyActors.clear();
+}
+
+void TileMap::CollectParallelMoves(void)
+{
+	m_bUpdateDeferred = false;
+
+	// Actors already listed before moving on a worker are
+	// listed twice, second entry is skipped on commit
 
-		(*pos)->Update();
+	for(ActorArrayIterator pos = m_arParallelActors.begin();
+		pos != m_arParallelActors.end();
+		pos++)
+	{
+		if (true == (*pos)->m_bBoundsDeferred)
+			m_arDirtyActors.push_back(*pos);
 	}
 }
 
+void TileMap::ActorUpdateJob::Execute(int nItem)
+{
+	(*m_parActors)[nItem]->Update();
+}
+
 void TileMap::Serialize(Stream& rStream, bool bInstance) const
 {
 	try
@@ -1322,7 +3123,8 @@ void TileMap::Serialize(Stream& rStream, bool bInstance) const
 				{
 					// Skip chunk if there are no actors
 
-					if (m_mapActors.empty()) continue;
+					if (0 == m_nActors && 0 == m_nStreamSwappedActors)
+						continue;
 				}
 				break;
 			case TileMap::CHUNK_USER:
@@ -1333,6 +3135,22 @@ void TileMap::Serialize(Stream& rStream, bool bInstance) const
 					   continue;
 				}
 				break;
+			case TileMap::CHUNK_LAYERINFO:
+				{
+					// Skip chunk if there are no layers
+
+					if (m_arLayers.empty() == true)
+						continue;
+				}
+				break;
+			case TileMap::CHUNK_STREAM:
+				{
+					// Skip chunk if map is not streamed
+
+					if (IsFlagSet(STREAM) == false || m_arLayers.empty() == true)
+						continue;
+				}
+				break;
 			}
 
 			// Write chunk type as byte
@@ -1378,6 +3196,12 @@ void TileMap::Serialize(Stream& rStream, bool bInstance) const
 			case TileMap::CHUNK_USER:
 				SerializeUserData(rStream, bInstance);
 				break;
+			case TileMap::CHUNK_LAYERINFO:
+				SerializeLayerInfo(rStream);
+				break;
+			case TileMap::CHUNK_STREAM:
+				SerializeStream(rStream);
+				break;
 			}
 
 			// Write chunk size into space reserved for it
@@ -1415,44 +3239,89 @@ void TileMap::Serialize(Stream& rStream, bool bInstance) const
 
 void TileMap::Serialize(LPCWSTR pszPath) const
 {
+	// Streamed map reads tiles not loaded from its own file, so saving
+	// over that file writes a temporary file that replaces it afterwards
+
+	WCHAR szTempPath[MAX_PATH] = {0};
+
+	bool bReplace = IsStreamSource(pszPath);
+
+	if (true == bReplace)
+	{
+		WCHAR szDir[MAX_PATH] = {0};
+
+		GetAbsolutePath(pszPath, szDir);
+		PathRemoveFileSpec(szDir);
+
+		if (0 == GetTempFileName(szDir, L"thm", 0, szTempPath))
+			throw m_rEngine.GetErrors().Push(Error::FILE_CREATE,
+				__FUNCTIONW__, pszPath);
+	}
+
 	Stream stream(&m_rEngine.GetErrors());
 
 	try
 	{
-		stream.Open(pszPath, GENERIC_WRITE, CREATE_ALWAYS);
+		stream.Open(true == bReplace ? szTempPath : pszPath,
+			GENERIC_WRITE, CREATE_ALWAYS);
 	}
 	
 	catch(Error& rError)
 	{
 		UNREFERENCED_PARAMETER(rError);
 
+		if (true == bReplace)
+			DeleteFile(szTempPath);
+
 		throw m_rEngine.GetErrors().Push(Error::FILE_OPEN,
 			__FUNCTIONW__, pszPath);
 	}
 
 	try
 	{
-		// Write signature and version
+		try
+		{
+			// Write signature and version
 
-		stream.WriteVar(TileMap::SIGNATURE, 4);
-		stream.WriteVar(TileMap::FORMAT_VERSION, 4);
+			stream.WriteVar(TileMap::SIGNATURE, 4);
+			stream.WriteVar(IsFlagSet(STREAM) == true ?
+				TileMap::FORMAT_VERSION : TileMap::FORMAT_VERSION_NOSTREAM, 4);
+
+			// Write class key
+
+			m_strClass.Serialize(stream);
+		}
+		
+		catch(Error& rError)
+		{
+			UNREFERENCED_PARAMETER(rError);
 
-		// Write class key
+			throw m_rEngine.GetErrors().Push(Error::FILE_WRITE,
+				__FUNCTIONW__, pszPath);
+		}
 
-		m_strClass.Serialize(stream);
+		// Write chunks
+		
+		Serialize(stream, false);
 	}
-	
-	catch(Error& rError)
+
+	catch(Error&)
 	{
-		UNREFERENCED_PARAMETER(rError);
+		if (true == bReplace)
+		{
+			stream.Empty();
+			DeleteFile(szTempPath);
+		}
 
-		throw m_rEngine.GetErrors().Push(Error::FILE_WRITE,
-			__FUNCTIONW__, pszPath);
+		throw;
 	}
 
-	// Write chunks
-	
-	Serialize(stream, false);
+	if (true == bReplace)
+	{
+		stream.Empty();
+
+		ReplaceStreamSource(szTempPath);
+	}
 }
 
 void TileMap::Deserialize(Stream& rStream, bool bInstance)
@@ -1551,6 +3420,16 @@ void TileMap::Deserialize(Stream& rStream, bool bInstance)
 					DeserializeUserData(rStream, bInstance);
 				}
 				break;
+			case TileMap::CHUNK_LAYERINFO:
+				{
+					DeserializeLayerInfo(rStream);
+				}
+				break;
+			case TileMap::CHUNK_STREAM:
+				{
+					DeserializeStream(rStream);
+				}
+				break;
 			default:
 				{
 					// If chunk type is unknown, ignore chunk
@@ -1574,6 +3453,10 @@ void TileMap::Deserialize(Stream& rStream, bool bInstance)
 				m_BackStatic.SetMaterial(GetMaterial(m_nBackMaterialID));
 		}
 
+		// Actors outside of chunks that become resident get swapped out
+
+		m_bStreamSwapPending = IsFlagSet(STREAM);
+
 		// Notify
 
 		if (true == bProgressNotify)
@@ -1652,6 +3535,8 @@ void TileMap::DeserializeInstance(Stream& rStream)
 
 		DeserializeActors(rStream);
 
+		m_bStreamSwapPending = IsFlagSet(STREAM);
+
 		// Notify client we are done with part 1 of instance data
 
 		if (true == bProgressNotify)
@@ -2284,6 +4169,8 @@ void TileMap::DeserializeTiles(Stream& rStream)
 		m_arTilesStatic.resize(nTilesStatic);
 		m_arTilesAnimated.resize(nTilesAnimated);
 
+		m_dwTileStamp++;
+
 		// Read static tiles
 
 		for(int n = 0; n < nTilesStatic; n++, nRead++)
@@ -2353,7 +4240,7 @@ void TileMap::SerializeLayers(Stream& rStream) const
 		{
 			// Write layer
 
-			(*pos)->Serialize(rStream);
+			(*pos)->Serialize(rStream, IsFlagSet(STREAM) == false);
 
 			// Notify
 
@@ -2394,18 +4281,20 @@ void TileMap::DeserializeLayers(Stream& rStream)
 				Client::PROGRESS_LOAD,
 				Client::PROGRESS_MAP_LAYERS, 0, nLayerCount);
 
-		// Read layers
+		// Read layers, replacing any existing ones
+
+		RemoveAllLayers();
 
-		m_arLayers.resize(nLayerCount);
+		m_arLayers.reserve(nLayerCount);
 
 		for(int n = 0; n < nLayerCount; n++)
 		{
 			// Read layer
 
 			TileLayer* pLayer = CreateLayer();
-			pLayer->Deserialize(rStream);
+			pLayer->Deserialize(rStream, IsFlagSet(STREAM) == false);
 
-			m_arLayers[n] = pLayer;
+			InsertLayer(pLayer);
 
 			// Notify
 
@@ -2425,13 +4314,266 @@ void TileMap::DeserializeLayers(Stream& rStream)
 	}
 }
 
+void TileMap::SerializeLayerInfo(Stream& rStream) const
+{
+	// Written in a separate chunk so that maps without it still load
+	// with default layer attributes, and older builds skip it
+
+	try
+	{
+		// Write layer count
+
+		int nLayerCount = int(m_arLayers.size());
+
+		rStream.WriteVar(&nLayerCount);
+
+		// Write partition type and Z order of each layer
+
+		for(TileLayerArrayConstIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			int nType = int((*pos)->GetSpaceType());
+			int nZ = (*pos)->GetZ();
+
+			rStream.WriteVar(&nType);
+			rStream.WriteVar(&nZ);
+		}
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		throw m_rEngine.GetErrors().Push(Error::FILE_SERIALIZE,
+			__FUNCTIONW__, rStream.GetPath());
+	}
+}
+
+void TileMap::DeserializeLayerInfo(Stream& rStream)
+{
+	try
+	{
+		// Read layer count
+
+		int nLayerCount = 0;
+
+		rStream.ReadVar(&nLayerCount);
+
+		// Read partition type and Z order of each layer,
+		// moving any actors already added
+
+		for(int n = 0; n < nLayerCount; n++)
+		{
+			int nType = 0;
+			int nZ = 0;
+
+			rStream.ReadVar(&nType);
+			rStream.ReadVar(&nZ);
+
+			if (n >= int(m_arLayers.size()))
+				continue;
+
+			if (nType >= 0 && nType < SpacePartition::TYPE_COUNT)
+				m_arLayers[n]->SetSpaceType(SpacePartition::Types(nType));
+
+			m_arLayers[n]->SetZ(nZ);
+		}
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		throw m_rEngine.GetErrors().Push(Error::FILE_DESERIALIZE,
+			__FUNCTIONW__, rStream.GetPath());
+	}
+}
+
+void TileMap::SerializeStream(Stream& rStream) const
+{
+	// Tiles are stored in fixed size blocks after the directory,
+	// so that chunks can be read back one by one while map is in use
+
+	try
+	{
+		// Write layer count
+
+		int nLayerCount = int(m_arLayers.size());
+
+		rStream.WriteVar(&nLayerCount);
+
+		// Write fill value and whether tiles are stored, for each chunk
+
+		for(TileLayerArrayConstIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			const TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+			int nChunkCount = int(rarChunks.size());
+
+			rStream.WriteVar(&nChunkCount);
+
+			for(int n = 0; n < nChunkCount; n++)
+			{
+				bool bStored = (rarChunks[n].pwTiles != NULL ||
+					rarChunks[n].dwOffset != 0);
+
+				rStream.WriteVar(&rarChunks[n].wFill);
+				rStream.WriteVar(&bStored);
+			}
+		}
+
+		// Write stored tiles, reading back those not loaded. Remember
+		// where each went in case this file replaces the map file
+
+		std::vector<WORD> arTiles(TileLayer::CHUNK_SIZE * TileLayer::CHUNK_SIZE);
+
+		for(TileLayerArrayConstIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+			for(size_t n = 0; n < rarChunks.size(); n++)
+			{
+				bool bStored = (rarChunks[n].pwTiles != NULL ||
+					rarChunks[n].dwOffset != 0);
+
+				rarChunks[n].dwSavedOffset =
+					(true == bStored) ? rStream.GetPosition() : 0;
+
+				if (rarChunks[n].pwTiles != NULL)
+				{
+					rStream.WriteVar(rarChunks[n].pwTiles, int(arTiles.size()));
+				}
+				else if (rarChunks[n].dwOffset != 0)
+				{
+					m_pStreamSource->SetPosition(LONG(rarChunks[n].dwOffset),
+						Stream::MOVE_BEGIN);
+
+					m_pStreamSource->ReadVar(&arTiles[0], int(arTiles.size()));
+
+					rStream.WriteVar(&arTiles[0], int(arTiles.size()));
+				}
+			}
+		}
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		throw m_rEngine.GetErrors().Push(Error::FILE_SERIALIZE,
+			__FUNCTIONW__, rStream.GetPath());
+	}
+}
+
+void TileMap::DeserializeStream(Stream& rStream)
+{
+	try
+	{
+		// Keep map file open to load tiles from on demand
+
+		delete m_pStreamSource;
+		m_pStreamSource = NULL;
+
+		try
+		{
+			m_pStreamSource = new Stream(&m_rEngine.GetErrors());
+		}
+
+		catch(std::bad_alloc e)
+		{
+			throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+				__FUNCTIONW__, sizeof(Stream));
+		}
+
+		m_pStreamSource->Open(rStream.GetPath(), GENERIC_READ, OPEN_EXISTING);
+
+		// Read layer count, must match layers read
+
+		int nLayerCount = 0;
+
+		rStream.ReadVar(&nLayerCount);
+
+		if (nLayerCount != int(m_arLayers.size()))
+			throw m_rEngine.GetErrors().Push(Error::FILE_FORMAT,
+				__FUNCTIONW__, rStream.GetPath());
+
+		// Read fill value and whether tiles are stored, for each chunk
+
+		std::vector<TileLayer::Chunk*> arStored;
+
+		for(TileLayerArrayIterator pos = m_arLayers.begin();
+			pos != m_arLayers.end();
+			pos++)
+		{
+			TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+			int nChunkCount = 0;
+
+			rStream.ReadVar(&nChunkCount);
+
+			if (nChunkCount != int(rarChunks.size()))
+				throw m_rEngine.GetErrors().Push(Error::FILE_FORMAT,
+					__FUNCTIONW__, rStream.GetPath());
+
+			for(int n = 0; n < nChunkCount; n++)
+			{
+				WORD wFill = TileLayer::TILE_EMPTY;
+				bool bStored = false;
+
+				rStream.ReadVar(&wFill);
+				rStream.ReadVar(&bStored);
+
+				if ((*pos)->IsValidTileValue(wFill) == false)
+					throw m_rEngine.GetErrors().Push(Error::INVALID_INDEX,
+						__FUNCTIONW__, L"wFill");
+
+				rarChunks[n].wFill = wFill;
+
+				if (true == bStored)
+					arStored.push_back(&rarChunks[n]);
+			}
+		}
+
+		// Remember where tiles of each stored chunk are, and skip them
+
+		DWORD dwBlockSize = DWORD(sizeof(WORD) *
+			TileLayer::CHUNK_SIZE * TileLayer::CHUNK_SIZE);
+
+		DWORD dwOffset = rStream.GetPosition();
+
+		for(std::vector<TileLayer::Chunk*>::iterator pos = arStored.begin();
+			pos != arStored.end();
+			pos++)
+		{
+			(*pos)->dwOffset = dwOffset;
+
+			dwOffset += dwBlockSize;
+		}
+
+		rStream.SetPosition(LONG(dwOffset), Stream::MOVE_BEGIN);
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		throw m_rEngine.GetErrors().Push(Error::FILE_DESERIALIZE,
+			__FUNCTIONW__, rStream.GetPath());
+	}
+}
+
 void TileMap::SerializeActors(Stream& rStream) const
 {
 	try
 	{
-		// Write actor count
+		// Write actor count, including actors swapped out by streaming
 
-		int nCount = int(m_mapActors.size());
+		int nCount = m_nActors + m_nStreamSwappedActors;
 		rStream.WriteVar(&nCount);
 
 		// Notify
@@ -2449,31 +4591,66 @@ void TileMap::SerializeActors(Stream& rStream) const
 
 		int n = 0;
 
-		for(ActorMapConstIterator pos = m_mapActors.begin();
-			pos != m_mapActors.end();
-			pos++, n++)
+		for(ActorArrayConstIterator pos = m_arActorsByName.begin();
+			pos != m_arActorsByName.end();
+			pos++)
 		{
-			if (pos->second != NULL)
-			{
-				// Write actor class
+			// Skip names that have no actor
 
-				pos->second->GetClass().Serialize(rStream);
+			if (NULL == *pos)
+				continue;
 
-				// Write actor
+			// Write actor class
 
-				pos->second->Serialize(rStream);
-			}
-			else
-			{
-				throw m_rEngine.GetErrors().Push(Error::FILE_NULLINSTANCE,
-					__FUNCTIONW__, rStream.GetPath());
-			}
+			(*pos)->GetClass().Serialize(rStream);
+
+			// Write actor
+
+			(*pos)->Serialize(rStream);
 
 			// Notify
 
 			if (true == bProgressNotify)
 				m_rEngine.GetClientInstance()->OnProgress(Client::PROGRESS_SAVE,
-					Client::PROGRESS_MAP_ACTORS, n + 1, nCount);
+					Client::PROGRESS_MAP_ACTORS, ++n, nCount);
+		}
+
+		// Copy swapped out actors, records are stored same as above
+
+		if (m_nStreamSwappedActors > 0)
+		{
+			std::vector<BYTE> arRecord;
+
+			for(TileLayerArrayConstIterator pos = m_arLayers.begin();
+				pos != m_arLayers.end();
+				pos++)
+			{
+				const TileLayer::ChunkArray& rarChunks = (*pos)->m_arChunks;
+
+				for(size_t nChunk = 0; nChunk < rarChunks.size(); nChunk++)
+				{
+					DWORD dwOffset = rarChunks[nChunk].dwActorsOffset;
+
+					for(int nActor = 0; nActor < rarChunks[nChunk].nActors; nActor++)
+					{
+						DWORD dwPrevOffset = 0;
+						DWORD dwRecordSize = 0;
+
+						m_pStreamSwap->SetPosition(LONG(dwOffset),
+							Stream::MOVE_BEGIN);
+
+						m_pStreamSwap->ReadVar(&dwPrevOffset);
+						m_pStreamSwap->ReadVar(&dwRecordSize);
+
+						arRecord.resize(dwRecordSize);
+
+						m_pStreamSwap->Read(&arRecord[0], dwRecordSize);
+						rStream.Write(&arRecord[0], dwRecordSize);
+
+						dwOffset = dwPrevOffset;
+					}
+				}
+			}
 		}
 
 		// Write player actor name
@@ -2606,8 +4783,17 @@ DWORD TileMap::GetMemoryFootprint(void) const
 
 	dwSize += DWORD(m_arActiveCameras.size() * sizeof(int));
 
+	dwSize += DWORD(m_arRenderLayers.capacity() * sizeof(RenderLayer) +
+		(m_arRenderActors.capacity() + m_arRenderCameras.capacity()) *
+		sizeof(void*));
+
+	dwSize += DWORD((m_arStreamChunks.size() + m_arStreamRequests.size()) *
+		sizeof(StreamChunk));
+
 	dwSize += m_Variables.GetMemoryFootprint();
 
+	dwSize += m_Navigation.GetMemoryFootprint() - sizeof(Navigation);
+
 	dwSize += DWORD(m_arMaterials.size() * sizeof(int));
 
 	dwSize += DWORD(m_arAnimations.size() * sizeof(int));
@@ -2623,19 +4809,24 @@ DWORD TileMap::GetActorsMemoryFootprint(void) const
 {
 	DWORD dwSize = 0;
 
-	for(ActorMapConstIterator posActors = m_mapActors.begin();
-		posActors != m_mapActors.end();
+	for(ActorArrayConstIterator posActors = m_arActorsByName.begin();
+		posActors != m_arActorsByName.end();
 		posActors++)
 	{
-		dwSize += posActors->second->GetMemoryFootprint();
+		if (*posActors != NULL)
+			dwSize += (*posActors)->GetMemoryFootprint();
 	}
 
+	dwSize += DWORD(m_arActorsByName.capacity() * sizeof(Actor*));
+
+	dwSize += m_ActorNames.GetMemoryFootprint() - sizeof(NameTable);
+
 	return dwSize;
 }
 
 DWORD TileMap::GetLayersMemoryFootprint(void) const
 {
-	DWORD dwSize = 0;
+	DWORD dwSize = m_LayerIndex.GetMemoryFootprint();
 
 	for(TileLayerArrayConstIterator posLayers = m_arLayers.begin();
 		posLayers != m_arLayers.end();
@@ -2653,14 +4844,35 @@ void TileMap::Empty(void)
 
 	RemoveAllCameras();
 
+	RemoveAllWakeRegions();
+
 	// Unload actors
 
 	RemoveAllActors();
 
+	m_arActorsByName.clear();
+
+	// Drop path requests
+
+	m_Navigation.Empty();
+
 	// Unload layers
 
 	RemoveAllLayers();
 
+	// Close streamed map and swap files
+
+	EmptyStreaming();
+
+	// Stop update workers
+
+	m_Workers.Destroy();
+	m_bUpdateWorkers = false;
+
+	m_arParallelActors.clear();
+
+	m_arDirtyActors.clear();
+
 	// Unload tile templates
 
 	RemoveAllTileTemplates();
@@ -2677,11 +4889,12 @@ void TileMap::OnLostDevice(bool bRecreate)
 {
 	// Forward to actors
 
-	for(ActorMapIterator pos = m_mapActors.begin();
-		pos != m_mapActors.end();
+	for(ActorArrayIterator pos = m_arActorsByName.begin();
+		pos != m_arActorsByName.end();
 		pos++)
 	{
-		pos->second->OnLostDevice(bRecreate);
+		if (*pos != NULL)
+			(*pos)->OnLostDevice(bRecreate);
 	}
 }
 
@@ -2689,11 +4902,12 @@ void TileMap::OnResetDevice(bool bRecreate)
 {
 	// Forward to actors
 
-	for(ActorMapIterator pos = m_mapActors.begin();
-		pos != m_mapActors.end();
+	for(ActorArrayIterator pos = m_arActorsByName.begin();
+		pos != m_arActorsByName.end();
 		pos++)
 	{
-		pos->second->OnResetDevice(bRecreate);
+		if (*pos != NULL)
+			(*pos)->OnResetDevice(bRecreate);
 	}
 }
 
@@ -2701,11 +4915,12 @@ void TileMap::OnSessionPause(bool bPause)
 {
 	// Forward to actors
 
-	for(ActorMapIterator pos = m_mapActors.begin();
-		pos != m_mapActors.end();
+	for(ActorArrayIterator pos = m_arActorsByName.begin();
+		pos != m_arActorsByName.end();
 		pos++)
 	{
-		pos->second->OnSessionPause(bPause);
+		if (*pos != NULL)
+			(*pos)->OnSessionPause(bPause);
 	}
 }
 
@@ -3020,7 +5235,8 @@ TileMap* TileMapManager::Load(LPCWSTR pszPath,
 		throw m_rEngine.GetErrors().Push(Error::FILE_SIGNATURE,
 			__FUNCTIONW__, pszPath);
 
-	if (memcmp(byVersion, TileMap::FORMAT_VERSION, sizeof(TileMap::FORMAT_VERSION)))
+	if (memcmp(byVersion, TileMap::FORMAT_VERSION, sizeof(TileMap::FORMAT_VERSION)) &&
+	   memcmp(byVersion, TileMap::FORMAT_VERSION_NOSTREAM, sizeof(TileMap::FORMAT_VERSION_NOSTREAM)))
 		m_rEngine.GetErrors().Push(Error::FILE_VERSION,
 			__FUNCTIONW__, pszPath);
 
@@ -22,6 +22,9 @@
 #include "ThunderActor.h"		// using Actor
 #include "ThunderCamera.h"		// using Camera
 #include "ThunderVariable.h"	// using VariableManager
+#include "ThunderJobs.h"		// using WorkerPool, Job
+#include "ThunderNavigation.h"	// using Navigation
+#include "ThunderNameTable.h"	// using NameTable
 
 /*----------------------------------------------------------*\
 | Namespace
@@ -60,6 +63,10 @@ typedef std::vector<Music*> MusicArray;
 typedef std::vector<Music*>::iterator MusicArrayIterator;
 typedef std::vector<Music*>::const_iterator MusicArrayConstIterator;
 
+typedef std::vector<Rect> RectArray;
+typedef std::vector<Rect>::iterator RectArrayIterator;
+typedef std::vector<Rect>::const_iterator RectArrayConstIterator;
+
 
 /*----------------------------------------------------------*\
 | TileMap class
@@ -103,8 +110,29 @@ public:
 		// Optimize progressively as tiles are being set
 		OPTIMIZE			= 1 << 7,
 
+		// Animate tiles only when rendered instead of on every update
+		ANIMATE_VISIBLE		= 1 << 8,
+
 		// First value for user flagss
-		USER				= 1 << 7
+		USER				= 1 << 9,
+
+		// Flags below are allocated from the top bit down,
+		// so that user flag values stay unchanged
+
+		// Load layer chunks and actors around active cameras on demand
+		STREAM				= 1 << 31,
+
+		// Update actors on worker threads, except those with
+		// Actor::SERIAL_UPDATE. Actors updated in parallel may only
+		// change themselves: no queries, creating, removing or
+		// changing flags of actors, and no errors pushed on stack
+		PARALLEL_UPDATE		= 1 << 30,
+
+		// Moving actors only marks them dirty, space partitions are
+		// updated once per moved actor at the end of Update, before
+		// rendering, or on CommitSpaceUpdates. Until then, queries find
+		// actors by their bounds as of the last commit.
+		DEFER_SPACE_UPDATE	= 1 << 29
 	};
 
 	// Chunks used in a map file
@@ -138,6 +166,12 @@ public:
 		// User chunk
 		CHUNK_USER,
 
+		// Extended layer attributes (space partition type, Z order)
+		CHUNK_LAYERINFO,
+
+		// Stream directory and tiles of layer chunks (streamed maps)
+		CHUNK_STREAM,
+
 		// Number of pre-defined chunks
 		CHUNK_COUNT
 	};
@@ -145,6 +179,10 @@ public:
 	static const BYTE SIGNATURE[4];
 	static const BYTE FORMAT_VERSION[4];
 
+	// Version of maps without streamed layers, written for those so that
+	// builds that predate streaming read them without a version warning
+	static const BYTE FORMAT_VERSION_NOSTREAM[4];
+
 	static const int RESERVE_LAYERS;
 	static const int RESERVE_MATERIALS;
 	static const int RESERVE_ANIMATIONS;
@@ -153,6 +191,60 @@ public:
 	static const int RESERVE_CAMERAS;
 	static const int RESERVE_ACTIVECAMERAS;
 
+	static const float DEFAULT_UPDATE_FULL_DISTANCE;
+	static const float DEFAULT_UPDATE_REDUCED_DISTANCE;
+	static const float DEFAULT_UPDATE_REDUCED_INTERVAL;
+
+	static const int DEFAULT_STREAM_LOAD_DISTANCE;
+	static const int DEFAULT_STREAM_EVICT_DISTANCE;
+	static const int DEFAULT_STREAM_LOAD_BUDGET;
+
+protected:
+	// Layer chunk tracked or requested by streaming
+
+	struct StreamChunk
+	{
+		// Layer containing the chunk
+		TileLayer* pLayer;
+
+		// Chunk index in layer
+		int nChunk;
+
+		// Squared distance from camera in tiles, for load requests
+		int nDistance;
+	};
+
+	typedef std::vector<StreamChunk> StreamChunkArray;
+	typedef std::vector<StreamChunk>::iterator StreamChunkArrayIterator;
+
+	// Layer in view of a camera being rendered
+
+	struct RenderLayer
+	{
+		// Layer to render
+		TileLayer* pLayer;
+
+		// Actors in view attached to layer, range in render actors
+		int nFirstActor;
+		int nActors;
+	};
+
+	typedef std::vector<RenderLayer> RenderLayerArray;
+	typedef std::vector<RenderLayer>::iterator RenderLayerArrayIterator;
+	typedef std::vector<RenderLayer>::const_iterator RenderLayerArrayConstIterator;
+
+	// Job updating actors collected for parallel update
+
+	class ActorUpdateJob: public Job
+	{
+	public:
+		// Actors to update
+		ActorArray* m_parActors;
+
+	public:
+		virtual void Execute(int nItem);
+	};
+
 protected:
 	//
 	// Attributes
@@ -171,6 +263,14 @@ protected:
 	// Animated tile templates
 	TileAnimatedArray m_arTilesAnimated;
 
+	// Changed whenever tile templates may have changed
+	DWORD m_dwTileStamp;
+
+	// Tile stamp templates were last checked for OCCLUDER flag at,
+	// and whether any template had it
+	mutable DWORD m_dwOccluderStamp;
+	mutable bool m_bOccluders;
+
 	//
 	// Layers
 	//
@@ -178,12 +278,30 @@ protected:
 	// Tile layers (each element indexes into tiles)
 	TileLayerArray m_arLayers;
 
+	// Index over layer bounds and Z for spacial lookups
+	TileLayerIndex m_LayerIndex;
+
+	// Changed whenever layers are added, removed or change Z
+	DWORD m_dwLayerStamp;
+
+	// Changed whenever layers that may cover each other are added,
+	// removed, moved or change Z
+	DWORD m_dwOcclusionStamp;
+
 	//
 	// Actors
 	//
 
-	// Actors mapped by name
-	ActorMap m_mapActors;
+	// Actors indexed by name ID for constant time lookup, NULL if none.
+	// Also used for iteration, which visits actors in name ID order
+	ActorArray m_arActorsByName;
+
+	// Number of non-NULL entries in m_arActorsByName
+	int m_nActors;
+
+	// Actor names, also interned ahead of time by scripts. Never emptied
+	// so that IDs resolved once stay valid when map is reloaded
+	NameTable m_ActorNames;
 
 	// Actors with UPDATE flag, updated on every frame
 	ActorArray m_arUpdateActors;
@@ -191,6 +309,106 @@ protected:
 	// Actor that receives forwarded keyboard and mouse input
 	Actor* m_pPlayer;
 
+	//
+	// Update Scheduling
+	//
+
+	// Actors within this distance of an active camera update every frame
+	float m_fUpdateFullDistance;
+
+	// Actors within this distance update at reduced rate, farther ones sleep
+	float m_fUpdateReducedDistance;
+
+	// Time between updates of actors at reduced rate
+	float m_fUpdateReducedInterval;
+
+	// Regions where actors always update every frame
+	RectArray m_arWakeRegions;
+
+	// Number of actors in each update tier on last update
+	int m_nUpdateTierCounts[Actor::TIER_COUNT];
+
+	//
+	// Streaming
+	//
+
+	// Map file that streamed chunk tiles are read from
+	Stream* m_pStreamSource;
+
+	// Temporary file that actors of evicted chunks are swapped to
+	Stream* m_pStreamSwap;
+
+	// End of used space in swap file
+	DWORD m_dwStreamSwapEnd;
+
+	// Bytes of swap file used by records of actors still swapped out
+	DWORD m_dwStreamSwapLive;
+
+	// Chunks currently resident
+	StreamChunkArray m_arStreamChunks;
+
+	// Chunks to load on this update, nearest first
+	StreamChunkArray m_arStreamRequests;
+
+	// Chunks within this many tiles of camera view are loaded
+	int m_nStreamLoadDistance;
+
+	// Chunks farther than this many tiles from all camera views are evicted
+	int m_nStreamEvictDistance;
+
+	// Maximum chunks loaded ahead of camera view on each update
+	int m_nStreamLoadBudget;
+
+	// Total chunks loaded and evicted
+	int m_nStreamLoads;
+	int m_nStreamEvictions;
+
+	// Actors currently in swap file
+	int m_nStreamSwappedActors;
+
+	// Actors loaded with the map still need to be swapped out
+	bool m_bStreamSwapPending;
+
+	//
+	// Parallel Update
+	//
+
+	// Worker threads for parallel actor updates, created on first use
+	WorkerPool m_Workers;
+
+	// Number of worker threads, 0 for one less than processors
+	int m_nUpdateThreads;
+
+	// Workers have been created with current thread count
+	bool m_bUpdateWorkers;
+
+	// Actors collected for update on worker threads on last update
+	ActorArray m_arParallelActors;
+
+	// Job updating collected actors
+	ActorUpdateJob m_jobUpdate;
+
+	// Set while workers update actors, space partition updates
+	// are deferred until all of them are done
+	bool m_bUpdateDeferred;
+
+	//
+	// Deferred Space Updates
+	//
+
+	// Actors moved since space partitions were last updated
+	ActorArray m_arDirtyActors;
+
+	// Space partition updates committed since last reset
+	int m_nSpaceUpdates;
+
+	//
+	// Navigation
+	//
+
+	// Path requests on tile layers
+	Navigation m_Navigation;
+
 	//
 	// Cameras
 	//
@@ -201,6 +419,17 @@ protected:
 	// Active cameras (get rendered)
 	CameraArray m_arActiveCameras;
 
+	// Layers and actors in view of cameras being rendered, prepared
+	// once per frame and shared by all of them
+	RenderLayerArray m_arRenderLayers;
+	ActorArray m_arRenderActors;
+
+	// Cameras render set was prepared for, empty when not rendering
+	CameraArray m_arRenderCameras;
+
+	// Incremented each time render set is prepared
+	DWORD m_dwRenderFrame;
+
 	//
 	// Background
 	//
@@ -290,6 +519,8 @@ public:
 
 	int GetTileTemplateStaticCount(void) const;
 
+	DWORD GetTileStamp(void) const;
+
 	TileAnimated& GetTileTemplateAnimated(int nIndex);
 	const TileAnimated& GetTileTemplateAnimatedConst(int nIndex) const;
 
@@ -315,7 +546,7 @@ public:
 
 	TileAnimated* SetTileTemplateAnimated(int nIndex, const TileAnimated& rTemplate);
 
-	void Optimize(void);
+	DWORD Optimize(void);
 
 	void RemoveAllTileTemplates(void);
 
@@ -332,6 +563,11 @@ public:
 
 	TileLayer* GetLayer(int nIndex = 0);
 	const TileLayer* GetLayerConst(int nIndex = 0) const;
+
+	TileLayerIndex& GetLayerIndex(void);
+	const TileLayerIndex& GetLayerIndexConst(void) const;
+
+	DWORD GetLayerStamp(void) const;
 	
 	//
 	// Actors
@@ -348,27 +584,110 @@ public:
 	Actor* GetActor(LPCWSTR pszName);
 	const Actor* GetActorConst(LPCWSTR pszName) const;
 
-	ActorMapIterator GetBeginActorPos(void);
-	ActorMapIterator GetEndActorPos(void);
+	// Name IDs are resolved once and then looked up in constant time
+	int GetActorNameID(LPCWSTR pszName);
+	int GetActorNameIDConst(LPCWSTR pszName) const;
+
+	Actor* GetActor(int nNameID);
+	const Actor* GetActorConst(int nNameID) const;
 
-	ActorMapConstIterator GetBeginActorPosConst(void) const;
-	ActorMapConstIterator GetEndActorPosConst(void) const;
+	// Iterated positions are NULL for names that have no actor
+	ActorArrayIterator GetBeginActorPos(void);
+	ActorArrayIterator GetEndActorPos(void);
+
+	ActorArrayConstIterator GetBeginActorPosConst(void) const;
+	ActorArrayConstIterator GetEndActorPosConst(void) const;
 
 	Actor* GetPlayerActor(void);
 	const Actor* GetPlayerActorConst(void) const;
 	void SetPlayerActor(Actor* pPlayer);
 
+	//
+	// Update Scheduling
+	//
+
+	float GetUpdateFullDistance(void) const;
+	void SetUpdateFullDistance(float fDistance);
+
+	float GetUpdateReducedDistance(void) const;
+	void SetUpdateReducedDistance(float fDistance);
+
+	float GetUpdateReducedInterval(void) const;
+	void SetUpdateReducedInterval(float fInterval);
+
+	int AddWakeRegion(const Rect& rrcRegion);
+	void RemoveWakeRegion(int nRegion);
+	void RemoveAllWakeRegions(void);
+	int GetWakeRegionCount(void) const;
+
+	int WakeActors(Rect& rcTileRange, float fDuration = 0.0f);
+
+	int GetUpdateTierCount(int nTier) const;
+
+	//
+	// Streaming
+	//
+
+	int GetStreamLoadDistance(void) const;
+	void SetStreamLoadDistance(int nDistance);
+
+	int GetStreamEvictDistance(void) const;
+	void SetStreamEvictDistance(int nDistance);
+
+	int GetStreamLoadBudget(void) const;
+	void SetStreamLoadBudget(int nBudget);
+
+	int GetStreamResidentChunkCount(void) const;
+	int GetStreamLoadCount(void) const;
+	int GetStreamEvictionCount(void) const;
+	int GetStreamSwappedActorCount(void) const;
+
+	//
+	// Parallel Update
+	//
+
+	int GetUpdateThreads(void) const;
+	void SetUpdateThreads(int nThreads);
+
+	int GetParallelUpdateCount(void) const;
+
+	//
+	// Deferred Space Updates
+	//
+
+	void CommitSpaceUpdates(void);
+
+	int GetSpaceUpdateCount(void) const;
+	void ResetSpaceUpdateCount(void);
+
+	//
+	// Navigation
+	//
+
+	Navigation& GetNavigation(void);
+	const Navigation& GetNavigationConst(void) const;
+
 	//
 	// Spacial Database
 	//
 
-	int GetLayersFromPosition(int x, int y, TileLayerArray& rarLayers) const;
-	int GetLayersFromPosition(float x, float y, TileLayerArray& rarLayers) const;
-	int GetLayersFromRange(Rect& rcTileRange, TileLayerArray& rarLayers) const;
+	int GetLayersFromPosition(int x, int y, TileLayerArray& rarLayers,
+		int nMinZ = INT_MIN, int nMaxZ = INT_MAX) const;
+	int GetLayersFromPosition(float x, float y, TileLayerArray& rarLayers,
+		int nMinZ = INT_MIN, int nMaxZ = INT_MAX) const;
+	int GetLayersFromRange(Rect& rcTileRange, TileLayerArray& rarLayers,
+		int nMinZ = INT_MIN, int nMaxZ = INT_MAX) const;
 
 	int GetActorsFromPosition(int x, int y, ActorArray& rarActors) const;
 	int GetActorsFromPosition(float x, float y, ActorArray& rarActors) const;
 	int GetActorsFromRange(Rect& rcTileRange, ActorArray& rarActors) const;
+	int GetActorsFromRange(Rect& rcTileRange, PQUERYCALLBACK pCallback,
+		void* pContext) const;
+
+	int GetActorsFromRanges(const Rect* prcTileRanges, int nRangeCount,
+		ActorArray& rarActors, int* pnFirst, int* pnCount) const;
+	int GetActorsFromPositions(const Vector2* pvecPositions, int nPositionCount,
+		ActorArray& rarActors, int* pnFirst, int* pnCount) const;
 
 	//
 	// Cameras
@@ -501,6 +820,12 @@ public:
 	virtual void OnMouseWheel(int nZDelta);
 
 protected:
+	//
+	// Layers
+	//
+
+	void IndexLayers(int nFirst);
+
 	//
 	// Serialization
 	//
@@ -532,11 +857,89 @@ protected:
 	virtual void SerializeUserData(Stream& rStream, bool bInstance) const;
 	virtual void DeserializeUserData(Stream& rStream, bool bInstance);
 
+	void SerializeLayerInfo(Stream& rStream) const;
+	void DeserializeLayerInfo(Stream& rStream);
+
+	void SerializeStream(Stream& rStream) const;
+	void DeserializeStream(Stream& rStream);
+
+	//
+	// Cameras
+	//
+
+	void UpdateCameras(Actor* pActor);
+	void UpdateCameras(TileLayer* pLayer, bool bRemoved);
+
+	//
+	// Rendering
+	//
+
+	void PrepareRender(Camera* const* ppCameras, int nCameras);
+	bool IsRenderPrepared(const Camera* pCamera) const;
+
+	RenderLayer* GetRenderLayer(const TileLayer* pLayer);
+
+	//
+	// Occlusion
+	//
+
+	bool HasOccluders(void) const;
+	void InvalidateOcclusion(void);
+
+	static bool CompareRenderActors(const Actor* pLeft, const Actor* pRight);
+
+	//
+	// Update Scheduling
+	//
+
+	int GetUpdateTier(const Actor* pActor, float fTime) const;
+
+	static void QueryWake(Actor* pActor, void* pContext);
+
+	//
+	// Parallel Update
+	//
+
+	void CollectParallelMoves(void);
+
+	//
+	// Streaming
+	//
+
+	void UpdateStreaming(void);
+
+	void LoadStreamChunk(TileLayer* pLayer, int nChunk);
+	void EvictStreamChunk(TileLayer* pLayer, int nChunk);
+	void TrackStreamChunk(const TileLayer* pLayer, int nChunk);
+	void ReleaseStreamChunks(TileLayer* pLayer, bool bRestoreActors);
+
+	void SwapOutActors(void);
+	void SwapOutActor(Actor* pActor, TileLayer* pLayer, int nChunk);
+	void SwapInActors(TileLayer* pLayer, int nChunk);
+	void ReleaseSwapRecords(TileLayer::Chunk& rChunk);
+
+	Stream* CreateStreamSwap(void);
+	void ReclaimStreamSwap(void);
+	void CompactStreamSwap(void);
+
+	int GetActorChunk(const Actor* pActor) const;
+	Rect GetChunkRange(const TileLayer* pLayer, int nChunk) const;
+
+	bool IsStreamSource(LPCWSTR pszPath) const;
+	void ReplaceStreamSource(LPCWSTR pszSavedPath) const;
+
+	void EmptyStreaming(void);
+
+	static bool CompareStreamChunks(const StreamChunk& rLeft,
+		const StreamChunk& rRight);
+
 	//
 	// Friends
 	//
 
 	friend class Actor;
+	friend class TileLayer;
+	friend class Camera;
 };
 
 /*----------------------------------------------------------*\
@@ -0,0 +1,628 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderVisibility.cpp
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine visibility polygon implementation
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "stdafx.h"				// precompiled header
+#include "ThunderVisibility.h"	// defining VisibilityMap, VisibilityPolygon
+#include "ThunderTileMap.h"		// using TileMap, TileLayer, Tile
+#include "ThunderError.h"		// using Error
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+using namespace ThunderStorm;
+
+/*----------------------------------------------------------*\
+| Constants
+\*----------------------------------------------------------*/
+
+const float VisibilityPolygon::CORNER_OFFSET = 0.0001f;
+const int VisibilityPolygon::CIRCLE_STEPS = 64;
+
+
+/*----------------------------------------------------------*\
+| VisibilityMap implementation
+\*----------------------------------------------------------*/
+
+VisibilityMap::VisibilityMap(TileLayer& rLayer):
+							 m_rLayer(rLayer),
+							 m_nWidth(0),
+							 m_nHeight(0),
+							 m_nChunksWidth(0),
+							 m_nChunksHeight(0),
+							 m_dwTileStamp(0),
+							 m_bInvalid(true),
+							 m_nRebuilds(0)
+{
+}
+
+VisibilityMap::~VisibilityMap(void)
+{
+}
+
+void VisibilityMap::Invalidate(void)
+{
+	m_bInvalid = true;
+}
+
+void VisibilityMap::Validate(void)
+{
+	DWORD dwTileStamp = m_rLayer.GetMapConst().GetTileStamp();
+
+	if (false == m_bInvalid && dwTileStamp == m_dwTileStamp)
+		return;
+
+	// Templates or size changed, edges of all chunks are rebuilt on use.
+	// Versions only grow so that sums over ranges keep changing.
+
+	m_nWidth = m_rLayer.GetWidth();
+	m_nHeight = m_rLayer.GetHeight();
+
+	m_nChunksWidth = (m_nWidth + TileLayer::CHUNK_SIZE - 1) /
+		TileLayer::CHUNK_SIZE;
+	m_nChunksHeight = (m_nHeight + TileLayer::CHUNK_SIZE - 1) /
+		TileLayer::CHUNK_SIZE;
+
+	DWORD dwVersion = 0;
+
+	for(ChunkEdgesArray::const_iterator pos = m_arChunks.begin();
+		pos != m_arChunks.end();
+		pos++)
+	{
+		dwVersion = max(dwVersion, pos->dwVersion);
+	}
+
+	try
+	{
+		m_arChunks.resize(size_t(m_nChunksWidth * m_nChunksHeight));
+	}
+
+	catch(std::bad_alloc e)
+	{
+		throw Error(Error::MEM_ALLOC, __FUNCTIONW__,
+			m_nChunksWidth * m_nChunksHeight * sizeof(ChunkEdges));
+	}
+
+	for(ChunkEdgesArray::iterator pos = m_arChunks.begin();
+		pos != m_arChunks.end();
+		pos++)
+	{
+		pos->arEdges.clear();
+		pos->dwVersion = dwVersion + 1;
+		pos->bValid = false;
+	}
+
+	m_dwTileStamp = dwTileStamp;
+	m_bInvalid = false;
+}
+
+Rect VisibilityMap::GetChunkRange(const Vector2& rvecMin,
+								  const Vector2& rvecMax) const
+{
+	Rect rc(int(floor(rvecMin.x)) / TileLayer::CHUNK_SIZE,
+		int(floor(rvecMin.y)) / TileLayer::CHUNK_SIZE,
+		int(floor(rvecMax.x)) / TileLayer::CHUNK_SIZE + 1,
+		int(floor(rvecMax.y)) / TileLayer::CHUNK_SIZE + 1);
+
+	rc.left = max(0, rc.left);
+	rc.top = max(0, rc.top);
+	rc.right = min(m_nChunksWidth, rc.right);
+	rc.bottom = min(m_nChunksHeight, rc.bottom);
+
+	return rc;
+}
+
+const VisibilityMap::EdgeArray& VisibilityMap::GetEdges(int nChunk)
+{
+	ChunkEdges& rChunk = m_arChunks[nChunk];
+
+	if (false == rChunk.bValid)
+		BuildEdges(nChunk);
+
+	return rChunk.arEdges;
+}
+
+DWORD VisibilityMap::GetVersion(const Rect& rrcChunks) const
+{
+	DWORD dwVersion = 0;
+
+	for(int cy = rrcChunks.top; cy < rrcChunks.bottom; cy++)
+	{
+		for(int cx = rrcChunks.left; cx < rrcChunks.right; cx++)
+			dwVersion += m_arChunks[cy * m_nChunksWidth + cx].dwVersion;
+	}
+
+	return dwVersion;
+}
+
+void VisibilityMap::OnTileChange(int tx, int ty)
+{
+	if (true == m_bInvalid)
+		return;
+
+	// Borders of a tile are owned by its own chunk and the chunks
+	// holding tiles to the right and below
+
+	MarkDirty(tx, ty);
+
+	if (tx + 1 < m_nWidth)
+		MarkDirty(tx + 1, ty);
+
+	if (ty + 1 < m_nHeight)
+		MarkDirty(tx, ty + 1);
+}
+
+void VisibilityMap::OnTilesLoad(const Rect& rrcTiles)
+{
+	if (true == m_bInvalid)
+		return;
+
+	// Chunks holding the tiles, and chunks sharing borders to the right and below
+
+	MarkDirty(rrcTiles.left, rrcTiles.top);
+
+	if (rrcTiles.right < m_nWidth)
+		MarkDirty(rrcTiles.right, rrcTiles.top);
+
+	if (rrcTiles.bottom < m_nHeight)
+		MarkDirty(rrcTiles.left, rrcTiles.bottom);
+}
+
+DWORD VisibilityMap::GetMemoryFootprint(void) const
+{
+	DWORD dwSize = sizeof(VisibilityMap) +
+		DWORD(m_arChunks.capacity() * sizeof(ChunkEdges));
+
+	for(ChunkEdgesArray::const_iterator pos = m_arChunks.begin();
+		pos != m_arChunks.end();
+		pos++)
+	{
+		dwSize += DWORD(pos->arEdges.capacity() * sizeof(Edge));
+	}
+
+	return dwSize;
+}
+
+void VisibilityMap::BuildEdges(int nChunk)
+{
+	ChunkEdges& rChunk = m_arChunks[nChunk];
+
+	rChunk.arEdges.clear();
+
+	int nLeft = (nChunk % m_nChunksWidth) * TileLayer::CHUNK_SIZE;
+	int nTop = (nChunk / m_nChunksWidth) * TileLayer::CHUNK_SIZE;
+	int nRight = min(nLeft + TileLayer::CHUNK_SIZE, m_nWidth);
+	int nBottom = min(nTop + TileLayer::CHUNK_SIZE, m_nHeight);
+
+	// Last chunks also own borders along the end of the layer
+
+	int nRowsEnd = (nBottom == m_nHeight) ? nBottom + 1 : nBottom;
+	int nColumnsEnd = (nRight == m_nWidth) ? nRight + 1 : nRight;
+
+	// Horizontal edges above each row, merged while the blocked
+	// side stays the same
+
+	for(int y = nTop; y < nRowsEnd; y++)
+	{
+		int nStart = INVALID_INDEX;
+		bool bStartAbove = false;
+
+		for(int x = nLeft; x <= nRight; x++)
+		{
+			bool bEdge = false;
+			bool bAbove = false;
+
+			if (x < nRight)
+			{
+				bAbove = IsBlocked(x, y - 1);
+				bEdge = (bAbove != IsBlocked(x, y));
+			}
+
+			if (INVALID_INDEX != nStart && (false == bEdge || bAbove != bStartAbove))
+			{
+				Edge edge = { { nStart, y }, { x, y } };
+				rChunk.arEdges.push_back(edge);
+
+				nStart = INVALID_INDEX;
+			}
+
+			if (true == bEdge && INVALID_INDEX == nStart)
+			{
+				nStart = x;
+				bStartAbove = bAbove;
+			}
+		}
+	}
+
+	// Vertical edges left of each column
+
+	for(int x = nLeft; x < nColumnsEnd; x++)
+	{
+		int nStart = INVALID_INDEX;
+		bool bStartLeft = false;
+
+		for(int y = nTop; y <= nBottom; y++)
+		{
+			bool bEdge = false;
+			bool bLeft = false;
+
+			if (y < nBottom)
+			{
+				bLeft = IsBlocked(x - 1, y);
+				bEdge = (bLeft != IsBlocked(x, y));
+			}
+
+			if (INVALID_INDEX != nStart && (false == bEdge || bLeft != bStartLeft))
+			{
+				Edge edge = { { x, nStart }, { x, y } };
+				rChunk.arEdges.push_back(edge);
+
+				nStart = INVALID_INDEX;
+			}
+
+			if (true == bEdge && INVALID_INDEX == nStart)
+			{
+				nStart = y;
+				bStartLeft = bLeft;
+			}
+		}
+	}
+
+	rChunk.bValid = true;
+
+	m_nRebuilds++;
+}
+
+bool VisibilityMap::IsBlocked(int tx, int ty) const
+{
+	// Outside of layer is open
+
+	if (tx < 0 || ty < 0 || tx >= m_nWidth || ty >= m_nHeight)
+		return false;
+
+	// Streamed tiles are not paged in, they block sight until loaded
+	// and edges are rebuilt
+
+	if (m_rLayer.IsTileLoaded(tx, ty) == false)
+		return true;
+
+	const Tile* pTile = m_rLayer.GetTileConst(tx, ty);
+
+	return (pTile != NULL && pTile->IsFlagSet(Tile::CLIP) == true);
+}
+
+void VisibilityMap::MarkDirty(int tx, int ty)
+{
+	ChunkEdges& rChunk = m_arChunks[(ty / TileLayer::CHUNK_SIZE) *
+		m_nChunksWidth + tx / TileLayer::CHUNK_SIZE];
+
+	rChunk.bValid = false;
+	rChunk.dwVersion++;
+}
+
+
+/*----------------------------------------------------------*\
+| VisibilityPolygon implementation
+\*----------------------------------------------------------*/
+
+VisibilityPolygon::VisibilityPolygon(void): m_fDirection(0.0f),
+											m_fHalfAngle(D3DX_PI),
+											m_fRadius(0.0f),
+											m_dwVersion(0),
+											m_bValid(false),
+											m_nRays(0)
+{
+}
+
+VisibilityPolygon::~VisibilityPolygon(void)
+{
+}
+
+bool VisibilityPolygon::Update(TileLayer& rLayer,
+							   const Vector2& rvecEye,
+							   float fRadius,
+							   float fDirection,
+							   float fHalfAngle)
+{
+	if (fRadius <= 0.0f)
+		throw Error(Error::INVALID_PARAM, __FUNCTIONW__, 1);
+
+	VisibilityMap& rMap = *rLayer.GetVisibilityMap();
+
+	rMap.Validate();
+
+	Rect rcChunks = rMap.GetChunkRange(
+		Vector2(rvecEye.x - fRadius, rvecEye.y - fRadius),
+		Vector2(rvecEye.x + fRadius, rvecEye.y + fRadius));
+
+	DWORD dwVersion = rMap.GetVersion(rcChunks);
+
+	// Nothing to do if neither view nor occluders in view changed
+
+	if (true == m_bValid &&
+	   rvecEye == m_vecEye &&
+	   fRadius == m_fRadius &&
+	   fDirection == m_fDirection &&
+	   fHalfAngle == m_fHalfAngle &&
+	   rcChunks == m_rcChunks &&
+	   dwVersion == m_dwVersion)
+		return false;
+
+	m_vecEye = rvecEye;
+	m_fRadius = fRadius;
+	m_fDirection = fDirection;
+	m_fHalfAngle = min(fHalfAngle, D3DX_PI);
+	m_rcChunks = rcChunks;
+	m_dwVersion = dwVersion;
+
+	Compute(rLayer, rMap);
+
+	m_bValid = true;
+
+	return true;
+}
+
+void VisibilityPolygon::Invalidate(void)
+{
+	m_bValid = false;
+}
+
+bool VisibilityPolygon::IsPointVisible(const Vector2& rvecPoint) const
+{
+	if (m_arPoints.size() < 2)
+		return false;
+
+	Vector2 vecOffset(rvecPoint - m_vecEye);
+
+	if (vecOffset.LengthSq() > m_fRadius * m_fRadius)
+		return false;
+
+	if (0.0f == vecOffset.x && 0.0f == vecOffset.y)
+		return true;
+
+	float fAngle = GetViewAngle(vecOffset);
+
+	if (fAngle > m_arAngles.back() && IsCone() == true)
+		return false;
+
+	// Find the triangle of the fan covering this angle
+
+	int nNext = int(std::upper_bound(m_arAngles.begin(), m_arAngles.end(),
+		fAngle) - m_arAngles.begin());
+
+	int nCount = int(m_arPoints.size());
+
+	if (nNext >= nCount)
+		nNext = (true == IsCone()) ? nCount - 1 : 0;
+
+	int nPrev = (nNext > 0) ? nNext - 1 : nCount - 1;
+
+	const Vector2& rvecPrev = m_arPoints[nPrev];
+	const Vector2& rvecNext = m_arPoints[nNext];
+
+	// Inside if on the same side of the far edge as the eye
+
+	Vector2 vecEdge(rvecNext - rvecPrev);
+	Vector2 vecToPoint(rvecPoint - rvecPrev);
+	Vector2 vecToEye(m_vecEye - rvecPrev);
+
+	float fPoint = vecEdge.x * vecToPoint.y - vecEdge.y * vecToPoint.x;
+	float fEye = vecEdge.x * vecToEye.y - vecEdge.y * vecToEye.x;
+
+	// Rays cast just past corners make some triangles too thin
+	// to tell sides, use distance to the nearer point instead
+
+	if (fabs(fEye) < FLT_EPSILON)
+	{
+		return (vecOffset.LengthSq() <=
+			min(Vector2(rvecPrev - m_vecEye).LengthSq(),
+			Vector2(rvecNext - m_vecEye).LengthSq()));
+	}
+
+	return (fPoint * fEye >= 0.0f);
+}
+
+int VisibilityPolygon::BuildTriangles(Vector2Array& rarOutVertices) const
+{
+	int nCount = int(m_arPoints.size());
+
+	if (nCount < 2)
+		return 0;
+
+	// Cones do not close around the eye
+
+	int nTriangles = (true == IsCone()) ? nCount - 1 : nCount;
+
+	rarOutVertices.reserve(rarOutVertices.size() + nTriangles * 3);
+
+	for(int n = 0; n < nTriangles; n++)
+	{
+		rarOutVertices.push_back(m_vecEye);
+		rarOutVertices.push_back(m_arPoints[n]);
+		rarOutVertices.push_back(m_arPoints[(n + 1) % nCount]);
+	}
+
+	return nTriangles;
+}
+
+DWORD VisibilityPolygon::GetMemoryFootprint(void) const
+{
+	return sizeof(VisibilityPolygon) +
+		DWORD(m_arPoints.capacity() * sizeof(Vector2)) +
+		DWORD((m_arAngles.capacity() + m_arCast.capacity()) * sizeof(float));
+}
+
+void VisibilityPolygon::Compute(TileLayer& rLayer, VisibilityMap& rMap)
+{
+	float fSpan = (true == IsCone()) ? m_fHalfAngle * 2.0f : D3DX_PI * 2.0f;
+
+	// The polygon can only turn at edge corners and where edges
+	// cross the view distance circle
+
+	m_arCast.clear();
+
+	for(int cy = m_rcChunks.top; cy < m_rcChunks.bottom; cy++)
+	{
+		for(int cx = m_rcChunks.left; cx < m_rcChunks.right; cx++)
+		{
+			const VisibilityMap::EdgeArray& rarEdges =
+				rMap.GetEdges(cy * rMap.GetChunksWidth() + cx);
+
+			for(VisibilityMap::EdgeArrayConstIterator pos = rarEdges.begin();
+				pos != rarEdges.end();
+				pos++)
+			{
+				AddEdgeAngles(*pos, fSpan);
+			}
+		}
+	}
+
+	// Follow the view distance circle where nothing is in the way
+
+	int nSteps = (true == IsCone()) ?
+		max(1, int(ceil(float(CIRCLE_STEPS) * fSpan / (D3DX_PI * 2.0f)))) :
+		CIRCLE_STEPS;
+
+	for(int n = 0; n < nSteps; n++)
+		m_arCast.push_back(fSpan * float(n) / float(nSteps));
+
+	if (true == IsCone())
+		m_arCast.push_back(fSpan);
+
+	std::sort(m_arCast.begin(), m_arCast.end());
+
+	m_arCast.erase(std::unique(m_arCast.begin(), m_arCast.end()),
+		m_arCast.end());
+
+	// Cast rays in order of angle
+
+	m_arPoints.resize(m_arCast.size());
+	m_arAngles.resize(m_arCast.size());
+
+	float fStart = (true == IsCone()) ? m_fDirection - m_fHalfAngle : 0.0f;
+
+	RayHit hit;
+
+	for(size_t n = 0; n < m_arCast.size(); n++)
+	{
+		float fAngle = fStart + m_arCast[n];
+
+		Vector2 vecTo(m_vecEye.x + cosf(fAngle) * m_fRadius,
+			m_vecEye.y + sinf(fAngle) * m_fRadius);
+
+		rLayer.CastSegment(m_vecEye, vecTo, &hit);
+
+		m_arPoints[n] = hit.vecPos;
+		m_arAngles[n] = m_arCast[n];
+	}
+
+	m_nRays = int(m_arCast.size());
+}
+
+void VisibilityPolygon::AddEdgeAngles(const VisibilityMap::Edge& rEdge,
+									  float fSpan)
+{
+	float fRadiusSq = m_fRadius * m_fRadius;
+
+	// Corners in view
+
+	Vector2 vecFrom(rEdge.ptFrom);
+	Vector2 vecTo(rEdge.ptTo);
+
+	vecFrom -= m_vecEye;
+	vecTo -= m_vecEye;
+
+	if (vecFrom.LengthSq() <= fRadiusSq)
+		AddCastAngles(vecFrom, fSpan);
+
+	if (vecTo.LengthSq() <= fRadiusSq)
+		AddCastAngles(vecTo, fSpan);
+
+	// Crossings with view distance circle, edges are either
+	// horizontal or vertical
+
+	bool bHorizontal = (rEdge.ptFrom.y == rEdge.ptTo.y);
+
+	float fAcross = (true == bHorizontal) ? vecFrom.y : vecFrom.x;
+	float fStart = (true == bHorizontal) ? vecFrom.x : vecFrom.y;
+	float fEnd = (true == bHorizontal) ? vecTo.x : vecTo.y;
+
+	float fDiscriminant = fRadiusSq - fAcross * fAcross;
+
+	if (fDiscriminant < 0.0f)
+		return;
+
+	float fAlong = sqrtf(fDiscriminant);
+
+	for(int n = 0; n < 2; n++, fAlong = -fAlong)
+	{
+		if (fAlong <= fStart || fAlong >= fEnd)
+			continue;
+
+		if (true == bHorizontal)
+			AddCastAngles(Vector2(fAlong, fAcross), fSpan);
+		else
+			AddCastAngles(Vector2(fAcross, fAlong), fSpan);
+	}
+}
+
+void VisibilityPolygon::AddCastAngles(const Vector2& rvecOffset, float fSpan)
+{
+	// Cast at the point and just past it on both sides
+
+	float fAngle = GetViewAngle(rvecOffset);
+
+	AddCastAngle(fAngle - CORNER_OFFSET, fSpan);
+	AddCastAngle(fAngle, fSpan);
+	AddCastAngle(fAngle + CORNER_OFFSET, fSpan);
+}
+
+void VisibilityPolygon::AddCastAngle(float fAngle, float fSpan)
+{
+	// Angles wrap around only when seeing all around
+
+	if (false == IsCone())
+	{
+		if (fAngle < 0.0f)
+			fAngle += fSpan;
+		else if (fAngle >= fSpan)
+			fAngle -= fSpan;
+	}
+	else if (fAngle < 0.0f || fAngle > fSpan)
+	{
+		return;
+	}
+
+	m_arCast.push_back(fAngle);
+}
+
+float VisibilityPolygon::GetViewAngle(const Vector2& rvecOffset) const
+{
+	// Angle from first view edge, between 0 and two pi
+
+	float fAngle = atan2f(rvecOffset.y, rvecOffset.x);
+
+	if (true == IsCone())
+		fAngle -= m_fDirection - m_fHalfAngle;
+
+	fAngle = fmodf(fAngle, D3DX_PI * 2.0f);
+
+	if (fAngle < 0.0f)
+		fAngle += D3DX_PI * 2.0f;
+
+	return fAngle;
+}
\ No newline at end of file
@@ -0,0 +1,279 @@
+/*------------------------------------------------------------------*\
+|
+| ThunderVisibility.h
+|
+|-------------------------------------------------------------------
+|
+| Content: ThunderStorm engine visibility polygon classes
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+#ifndef THUNDER_VISIBILITY_H
+#define THUNDER_VISIBILITY_H
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "ThunderMath.h"		// using Vector2, Rect
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+namespace ThunderStorm {
+
+/*----------------------------------------------------------*\
+| Declarations
+\*----------------------------------------------------------*/
+
+class TileLayer;			// referencing TileLayer
+
+/*----------------------------------------------------------*\
+| VisibilityMap class - occluder edges of a layer by chunk
+\*----------------------------------------------------------*/
+
+class VisibilityMap
+{
+public:
+	// Border between a tile with CLIP flag and one without,
+	// in tile corner coordinates
+
+	struct Edge
+	{
+		POINT ptFrom;
+		POINT ptTo;
+	};
+
+	typedef std::vector<Edge> EdgeArray;
+	typedef std::vector<Edge>::const_iterator EdgeArrayConstIterator;
+
+private:
+	// Edges owned by a chunk: top and left borders of its tiles,
+	// plus bottom and right borders of the layer
+
+	struct ChunkEdges
+	{
+		// Edges merged along rows and columns
+		EdgeArray arEdges;
+
+		// Changes whenever edges may have changed
+		DWORD dwVersion;
+
+		// Edges are up to date
+		bool bValid;
+	};
+
+	typedef std::vector<ChunkEdges> ChunkEdgesArray;
+
+private:
+	//
+	// Members
+	//
+
+	// Layer occluders are read from
+	TileLayer& m_rLayer;
+
+	// Layer size in tiles and chunks
+	int m_nWidth;
+	int m_nHeight;
+	int m_nChunksWidth;
+	int m_nChunksHeight;
+
+	// Edges of each chunk
+	ChunkEdgesArray m_arChunks;
+
+	// Map tile template stamp edges were built with
+	DWORD m_dwTileStamp;
+
+	// All chunks have to be rebuilt
+	bool m_bInvalid;
+
+	// Chunks rebuilt since creation
+	int m_nRebuilds;
+
+public:
+	VisibilityMap(TileLayer& rLayer);
+	~VisibilityMap(void);
+
+public:
+	//
+	// Edges
+	//
+
+	void Invalidate(void);
+
+	// Layer changes are applied before anything else is returned
+	void Validate(void);
+
+	// Chunks overlapping a range in tiles
+	Rect GetChunkRange(const Vector2& rvecMin, const Vector2& rvecMax) const;
+
+	const EdgeArray& GetEdges(int nChunk);
+
+	// Changes whenever edges of any chunk in range may have changed
+	DWORD GetVersion(const Rect& rrcChunks) const;
+
+	inline int GetChunksWidth(void) const
+	{
+		return m_nChunksWidth;
+	}
+
+	inline int GetRebuildCount(void) const
+	{
+		return m_nRebuilds;
+	}
+
+	//
+	// Events
+	//
+
+	void OnTileChange(int tx, int ty);
+
+	// Streamed tiles not loaded yet are read as open until loaded
+	void OnTilesLoad(const Rect& rrcTiles);
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+private:
+	//
+	// Private Functions
+	//
+
+	void BuildEdges(int nChunk);
+
+	bool IsBlocked(int tx, int ty) const;
+
+	void MarkDirty(int tx, int ty);
+};
+
+/*----------------------------------------------------------*\
+| VisibilityPolygon class - region seen from an eye point
+\*----------------------------------------------------------*/
+
+class VisibilityPolygon
+{
+public:
+	//
+	// Constants
+	//
+
+	// Angle in radians rays are cast to either side of each edge corner
+	static const float CORNER_OFFSET;
+
+	// Rays cast along the view distance circle
+	static const int CIRCLE_STEPS;
+
+private:
+	//
+	// Members
+	//
+
+	// Eye position in layer tiles
+	Vector2 m_vecEye;
+
+	// View direction and half of view angle in radians,
+	// half angle of pi or more sees all around
+	float m_fDirection;
+	float m_fHalfAngle;
+
+	// View distance in tiles
+	float m_fRadius;
+
+	// Polygon points in order of angle from first view edge,
+	// eye not included
+	Vector2Array m_arPoints;
+	std::vector<float> m_arAngles;
+
+	// Chunks used and their edge version when computed
+	Rect m_rcChunks;
+	DWORD m_dwVersion;
+
+	// Polygon was computed
+	bool m_bValid;
+
+	// Rays cast on last computation
+	int m_nRays;
+
+	// Angles to cast rays at
+	std::vector<float> m_arCast;
+
+public:
+	VisibilityPolygon(void);
+	~VisibilityPolygon(void);
+
+public:
+	//
+	// Update
+	//
+
+	// Recomputes polygon if view or occluders in view changed,
+	// returns true if it was recomputed
+	bool Update(TileLayer& rLayer, const Vector2& rvecEye, float fRadius,
+		float fDirection = 0.0f, float fHalfAngle = D3DX_PI);
+
+	void Invalidate(void);
+
+	inline int GetRayCount(void) const
+	{
+		return m_nRays;
+	}
+
+	//
+	// Queries
+	//
+
+	bool IsPointVisible(const Vector2& rvecPoint) const;
+
+	inline bool IsCone(void) const
+	{
+		return (m_fHalfAngle < D3DX_PI);
+	}
+
+	inline const Vector2& GetEye(void) const
+	{
+		return m_vecEye;
+	}
+
+	inline const Vector2Array& GetPoints(void) const
+	{
+		return m_arPoints;
+	}
+
+	//
+	// Geometry
+	//
+
+	// Appends a triangle list fanning out from eye, returns triangle count
+	int BuildTriangles(Vector2Array& rarOutVertices) const;
+
+	//
+	// Diagnostics
+	//
+
+	DWORD GetMemoryFootprint(void) const;
+
+private:
+	//
+	// Private Functions
+	//
+
+	void Compute(TileLayer& rLayer, VisibilityMap& rMap);
+
+	void AddEdgeAngles(const VisibilityMap::Edge& rEdge, float fSpan);
+	void AddCastAngles(const Vector2& rvecOffset, float fSpan);
+	void AddCastAngle(float fAngle, float fSpan);
+
+	float GetViewAngle(const Vector2& rvecOffset) const;
+};
+
+} // namespace ThunderStorm
+
+#endif // THUNDER_VISIBILITY_H
\ No newline at end of file
@@ -89,6 +89,8 @@
 
 #include <basetsd.h>						// Used for DWORD_PTR
 #include <cstdio>							// Used for sprintf and other formatting
+#include <climits>							// Used for INT_MIN, INT_MAX
+#include <cfloat>							// Used for FLT_MAX
 #include <crtdbg.h>							// Used for memory leak detection
 
 //
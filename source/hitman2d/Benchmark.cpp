@@ -0,0 +1,228 @@
+/*------------------------------------------------------------------*\
+|
+| Benchmark.cpp
+|
+|-------------------------------------------------------------------
+|
+| Content: HiTMAN: 2D benchmark command helper implementation
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+/*----------------------------------------------------------*\
+| Includes
+\*----------------------------------------------------------*/
+
+#include "stdafx.h"		// precompiled header
+#include "Benchmark.h"	// defining Benchmark
+#include "Globals.h"	// using GetPerformanceTime
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+using namespace Hitman2D;
+
+
+/*----------------------------------------------------------*\
+| Benchmark implementation
+\*----------------------------------------------------------*/
+
+Benchmark::Benchmark(Engine& rEngine, LPCWSTR pszTitle):
+					 m_rEngine(rEngine),
+					 m_pszTitle(pszTitle),
+					 m_pMap(NULL),
+					 m_pLayer(NULL),
+					 m_pWall(NULL),
+					 m_dStart(0.0)
+{
+}
+
+Benchmark::~Benchmark(void)
+{
+	// Clean up anything left, also if benchmark failed
+
+	DeleteActors();
+	DeleteLayer();
+
+	delete m_pMap;
+}
+
+bool Benchmark::ReadSettings(VariableArray& rParams,
+							 int* pnSettings,
+							 int nCount)
+{
+	for(int n = 0; n < int(rParams.size()) && n < nCount; n++)
+	{
+		if (rParams[n].GetVarType() != Variable::TYPE_INT ||
+			rParams[n].GetIntValue() <= 0)
+		{
+			m_rEngine.PrintError(L"invalid param (%d): expected positive int.",
+				n + 1);
+
+			return false;
+		}
+
+		pnSettings[n] = rParams[n].GetIntValue();
+	}
+
+	return true;
+}
+
+void Benchmark::Begin(LPCWSTR pszSettings, ...)
+{
+	va_list pArgs;
+	va_start(pArgs, pszSettings);
+
+	String strSettings;
+	strSettings.Format(pszSettings, pArgs);
+
+	va_end(pArgs);
+
+	m_rEngine.PrintInfo(L"\nBEGIN %s BENCHMARK\n\n   %s\n",
+		m_pszTitle, LPCWSTR(strSettings));
+}
+
+void Benchmark::End(void)
+{
+	m_rEngine.PrintInfo(L"\nEND %s BENCHMARK", m_pszTitle);
+}
+
+TileMap& Benchmark::GetMap(void)
+{
+	if (NULL == m_pMap)
+	{
+		try
+		{
+			m_pMap = new TileMap(m_rEngine);
+		}
+
+		catch(std::bad_alloc)
+		{
+			throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+				__FUNCTIONW__, sizeof(TileMap));
+		}
+	}
+
+	return *m_pMap;
+}
+
+TileLayer& Benchmark::CreateLayer(int nSize, SpacePartition::Types nType)
+{
+	DeleteLayer();
+
+	try
+	{
+		m_pLayer = new TileLayer(GetMap());
+	}
+
+	catch(std::bad_alloc)
+	{
+		throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+			__FUNCTIONW__, sizeof(TileLayer));
+	}
+
+	m_pLayer->SetSpaceType(nType);
+	m_pLayer->SetSize(nSize, nSize);
+
+	srand(1);
+
+	return *m_pLayer;
+}
+
+TileLayer& Benchmark::GetLayer(void)
+{
+	_ASSERT(m_pLayer != NULL);
+
+	return *m_pLayer;
+}
+
+void Benchmark::DeleteLayer(void)
+{
+	delete m_pLayer;
+	m_pLayer = NULL;
+}
+
+Tile* Benchmark::GetWall(void)
+{
+	if (NULL == m_pWall)
+	{
+		TileStatic tileWall;
+		tileWall.SetFlags(Tile::CLIP);
+
+		m_pWall = GetMap().SetTileTemplateStatic(INVALID_INDEX, tileWall);
+	}
+
+	return m_pWall;
+}
+
+void Benchmark::ScatterWalls(int nCount)
+{
+	int nSize = GetLayer().GetWidth();
+
+	for(int n = 0; n < nCount; n++)
+		m_pLayer->SetTile(rand() % nSize, rand() % nSize, GetWall());
+}
+
+ActorArray& Benchmark::CreateActors(int nCount, bool bAddToLayer)
+{
+	int nSize = GetLayer().GetWidth();
+
+	m_arActors.reserve(m_arActors.size() + size_t(nCount));
+
+	for(int n = 0; n < nCount; n++)
+	{
+		Actor* pActor = NULL;
+
+		try
+		{
+			pActor = new Actor(GetMap(), L"Actor");
+		}
+
+		catch(std::bad_alloc)
+		{
+			throw m_rEngine.GetErrors().Push(Error::MEM_ALLOC,
+				__FUNCTIONW__, sizeof(Actor));
+		}
+
+		m_arActors.push_back(pActor);
+
+		pActor->SetPosition(
+			float(rand()) / float(RAND_MAX) * float(nSize - 1),
+			float(rand()) / float(RAND_MAX) * float(nSize - 1));
+
+		if (true == bAddToLayer)
+			pActor->SetLayer(m_pLayer, false);
+	}
+
+	return m_arActors;
+}
+
+ActorArray& Benchmark::GetActors(void)
+{
+	return m_arActors;
+}
+
+void Benchmark::DeleteActors(void)
+{
+	for(ActorArrayIterator pos = m_arActors.begin();
+		pos != m_arActors.end();
+		pos++)
+	{
+		delete *pos;
+	}
+
+	m_arActors.clear();
+}
+
+void Benchmark::Start(void)
+{
+	m_dStart = GetPerformanceTime();
+}
+
+double Benchmark::Stop(void)
+{
+	return GetPerformanceTime() - m_dStart;
+}
\ No newline at end of file
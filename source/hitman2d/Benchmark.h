@@ -0,0 +1,120 @@
+/*------------------------------------------------------------------*\
+|
+| Benchmark.h
+|
+|-------------------------------------------------------------------
+|
+| Content: HiTMAN: 2D benchmark command helper
+| Created: 10/17/2026
+|
+|-------------------------------------------------------------------
+| This software is licensed under GNU GPLv3 (see ..\license.htm)
+\*------------------------------------------------------------------*/
+
+#ifndef HITMAN2D_BENCHMARK_H
+#define HITMAN2D_BENCHMARK_H
+
+/*----------------------------------------------------------*\
+| Using Namespace
+\*----------------------------------------------------------*/
+
+using namespace ThunderStorm;
+
+/*----------------------------------------------------------*\
+| Namespace
+\*----------------------------------------------------------*/
+
+namespace Hitman2D {
+
+
+/*----------------------------------------------------------*\
+| Benchmark class - settings, scratch map and timing
+| shared by benchmark commands
+\*----------------------------------------------------------*/
+
+class Benchmark
+{
+private:
+	//
+	// Members
+	//
+
+	// Engine to print results to
+	Engine& m_rEngine;
+
+	// Printed when benchmark begins and ends
+	LPCWSTR m_pszTitle;
+
+	// Scratch map that is never rendered or updated, created on first use
+	TileMap* m_pMap;
+
+	// Layer on scratch map
+	TileLayer* m_pLayer;
+
+	// Tile template with collision, created on first use
+	Tile* m_pWall;
+
+	// Actors created on scratch map
+	ActorArray m_arActors;
+
+	// Performance time of last Start
+	double m_dStart;
+
+public:
+	Benchmark(Engine& rEngine, LPCWSTR pszTitle);
+	~Benchmark(void);
+
+public:
+	//
+	// Settings
+	//
+
+	// Reads up to nCount positive int params over defaults,
+	// prints an error and returns false if any is invalid
+	bool ReadSettings(VariableArray& rParams, int* pnSettings, int nCount);
+
+	//
+	// Output
+	//
+
+	void Begin(LPCWSTR pszSettings, ...);
+	void End(void);
+
+	//
+	// Scratch Map
+	//
+
+	TileMap& GetMap(void);
+
+	// Replaces layer, restarting random sequence so that every layer
+	// is filled the same way
+	TileLayer& CreateLayer(int nSize,
+		SpacePartition::Types nType = SpacePartition::TYPE_UNIFORMGRID);
+
+	TileLayer& GetLayer(void);
+	void DeleteLayer(void);
+
+	Tile* GetWall(void);
+
+	// Sets walls at nCount random positions on layer
+	void ScatterWalls(int nCount);
+
+	// Creates actors at random positions within layer
+	ActorArray& CreateActors(int nCount, bool bAddToLayer);
+
+	ActorArray& GetActors(void);
+	void DeleteActors(void);
+
+	//
+	// Timing
+	//
+
+	void Start(void);
+
+	// Returns seconds since Start
+	double Stop(void);
+};
+
+} // namespace Hitman2D
+
+#endif // HITMAN2D_BENCHMARK_H
\ No newline at end of file
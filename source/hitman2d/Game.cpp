@@ -23,6 +23,7 @@
 #include "Error.h"					// using Errors
 #include "Dialogs.h"				// using ConfigDialogProc
 #include "Globals.h"				// using global constants and functions
+#include "Benchmark.h"				// using Benchmark
 #include "ScreenLabel.h"			// using ScreenLabel
 #include "ScreenListBox.h"			// using ScreenListBox, ScreenScrollBar, ScreenFrame, ScreenButtonEx
 #include "ScreenRadioButton.h"		// using ScreenButton, ScreenCheckBox, ScreenRadioButton
@@ -512,6 +513,10 @@ void Game::RegisterCommands(CommandManager& rCommands)
 	rCommands.Register(L"break", cmd_break);	
 	rCommands.Register(L"crash", cmd_crash);
 	rCommands.Register(L"benchmark", cmd_benchmark);
+	rCommands.Register(L"benchspace", cmd_benchspace);
+	rCommands.Register(L"benchpath", cmd_benchpath);
+	rCommands.Register(L"benchray", cmd_benchray);
+	rCommands.Register(L"benchvision", cmd_benchvision);
 	rCommands.Register(L"lasterror", cmd_lasterror);
 	rCommands.Register(L"errorexit", cmd_errorexit);
 	rCommands.Register(L"test", cmd_test);
@@ -520,6 +525,7 @@ void Game::RegisterCommands(CommandManager& rCommands)
 	rCommands.Register(L"map", cmd_map);
 	rCommands.Register(L"unloadmap", cmd_unloadmap);
 	rCommands.Register(L"savemap", cmd_savemap);
+	rCommands.Register(L"optimizemap", cmd_optimizemap);
 	rCommands.Register(L"loadgame", cmd_loadgame);
 	rCommands.Register(L"savegame", cmd_savegame);
 	rCommands.Register(L"quickload", cmd_quickload);
@@ -2481,11 +2487,11 @@ int Game::cmd_list(Engine& rEngine, VariableArray& rParams)
 
 		n = 0;
 
-		for(ActorMapConstIterator pos = pMap->GetBeginActorPosConst();
+		for(ActorArrayConstIterator pos = pMap->GetBeginActorPosConst();
 			pos != pMap->GetEndActorPosConst();
-			pos++, n++)
+			pos++)
 		{
-			Actor* pActor = pos->second;
+			Actor* pActor = *pos;
 
 			if (NULL == pActor) continue;
 
@@ -2494,7 +2500,7 @@ int Game::cmd_list(Engine& rEngine, VariableArray& rParams)
 				L"", L" | ");
 
 			rEngine.PrintInfo(L"%3d \"%s\" ( \"%s\" ) [ %g, %g, %g ] "
-				L"[ %g, %g ]\n   [ %s ]", n, pActor->GetName(),
+				L"[ %g, %g ]\n   [ %s ]", n++, pActor->GetName(),
 				pActor->GetClass(), pActor->GetPosition().x,
 				pActor->GetPosition().y, pActor->GetZOrder(),
 				pActor->GetSprite()->GetSizeInTiles().x,
@@ -5319,6 +5325,715 @@ int Game::cmd_benchmark(Engine& rEngine, VariableArray& rParams)
 	return TRUE;
 }
 
+int Game::cmd_benchspace(Engine& rEngine, VariableArray& rParams)
+{
+	// Read actor count, layer size and frame count
+
+	Benchmark bench(rEngine, L"SPACE PARTITION");
+
+	int nSettings[] = { 4096, 1024, 32 };
+
+	if (bench.ReadSettings(rParams, nSettings, 3) == false)
+		return FALSE;
+
+	int nActors = nSettings[0];
+	int nSize = nSettings[1];
+	int nFrames = nSettings[2];
+
+	bench.Begin(L"actors = %d, layer = %d x %d, frames = %d",
+		nActors, nSize, nSize, nFrames);
+
+	try
+	{
+		for(int nType = 0; nType < SpacePartition::TYPE_COUNT; nType++)
+		{
+			// Same random sequence for every partition type
+
+			TileLayer& rLayer =
+				bench.CreateLayer(nSize, SpacePartition::Types(nType));
+
+			ActorArray& rarActors = bench.CreateActors(nActors, false);
+
+			// Add
+
+			bench.Start();
+
+			for(ActorArrayIterator pos = rarActors.begin();
+				pos != rarActors.end();
+				pos++)
+			{
+				(*pos)->SetLayer(&rLayer, false);
+			}
+
+			double dAdd = bench.Stop();
+
+			// Move every actor by up to a tile each frame
+
+			bench.Start();
+
+			for(int nFrame = 0; nFrame < nFrames; nFrame++)
+			{
+				for(ActorArrayIterator pos = rarActors.begin();
+					pos != rarActors.end();
+					pos++)
+				{
+					Vector2 vecPos = (*pos)->GetPosition();
+
+					vecPos.x += float(rand()) / float(RAND_MAX) * 2.0f - 1.0f;
+					vecPos.y += float(rand()) / float(RAND_MAX) * 2.0f - 1.0f;
+
+					vecPos.x = max(0.0f, min(vecPos.x, float(nSize - 1)));
+					vecPos.y = max(0.0f, min(vecPos.y, float(nSize - 1)));
+
+					(*pos)->SetPosition(vecPos);
+				}
+			}
+
+			double dMove = bench.Stop();
+
+			// Query camera-sized ranges, sixteen per frame
+
+			ActorArray arFound;
+			arFound.reserve(nActors);
+
+			int nFound = 0;
+
+			bench.Start();
+
+			for(int nFrame = 0; nFrame < nFrames; nFrame++)
+			{
+				for(int nQuery = 0; nQuery < 16; nQuery++)
+				{
+					int tx = rand() % nSize;
+					int ty = rand() % nSize;
+
+					Rect rcRange(tx, ty, tx + 40, ty + 30);
+
+					arFound.clear();
+
+					nFound += rLayer.GetSpace()->Query(rcRange, &arFound);
+				}
+			}
+
+			double dQuery = bench.Stop();
+
+			// Query eight nearest actors around points, sixteen per frame
+
+			bench.Start();
+
+			for(int nFrame = 0; nFrame < nFrames; nFrame++)
+			{
+				for(int nQuery = 0; nQuery < 16; nQuery++)
+				{
+					Vector2 vecPos(float(rand() % nSize), float(rand() % nSize));
+
+					arFound.clear();
+
+					rLayer.GetSpace()->QueryNearest(vecPos, 8, &arFound);
+				}
+			}
+
+			double dNearest = bench.Stop();
+
+			// Query actors within sixteen tiles of points, sixteen per frame
+
+			int nFoundRadius = 0;
+
+			bench.Start();
+
+			for(int nFrame = 0; nFrame < nFrames; nFrame++)
+			{
+				for(int nQuery = 0; nQuery < 16; nQuery++)
+				{
+					Vector2 vecPos(float(rand() % nSize), float(rand() % nSize));
+
+					arFound.clear();
+
+					nFoundRadius += rLayer.GetSpace()->QueryRadius(vecPos,
+						16.0f, &arFound);
+				}
+			}
+
+			double dRadius = bench.Stop();
+
+			LPCWSTR pszUnits = NULL;
+
+			float fMemory = FormatMemory(
+				rLayer.GetSpace()->GetMemoryFootprint(), &pszUnits);
+
+			// Remove
+
+			bench.Start();
+
+			bench.DeleteActors();
+
+			double dRemove = bench.Stop();
+
+			rEngine.PrintInfo(L"   %-12s add %.3f ms, move %.3f ms, "
+				L"query %.3f ms (%d found), nearest %.3f ms, "
+				L"radius %.3f ms (%d found), remove %.3f ms, memory %.3f %s",
+				SZ_SPACEPARTITIONS[nType],
+				dAdd * 1000.0, dMove * 1000.0, dQuery * 1000.0, nFound,
+				dNearest * 1000.0, dRadius * 1000.0, nFoundRadius,
+				dRemove * 1000.0, fMemory, pszUnits);
+		}
+
+		bench.End();
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		PrintLastError(rEngine);
+	}
+
+	return TRUE;
+}
+
+int Game::cmd_benchpath(Engine& rEngine, VariableArray& rParams)
+{
+	// Read layer size, query count and expansion budget
+
+	Benchmark bench(rEngine, L"PATH FINDING");
+
+	int nSettings[] = { 512, 256, Navigation::DEFAULT_EXPANSION_BUDGET };
+
+	if (bench.ReadSettings(rParams, nSettings, 3) == false)
+		return FALSE;
+
+	// Maze cells are on odd tiles, walls in between
+
+	int nSize = nSettings[0] | 1;
+	int nQueries = nSettings[1];
+	int nBudget = nSettings[2];
+
+	if (nSize < 3)
+		nSize = 3;
+
+	bench.Begin(L"layer = %d x %d, queries = %d, budget = %d",
+		nSize, nSize, nQueries, nBudget);
+
+	try
+	{
+		TileLayer& rLayer = bench.CreateLayer(nSize);
+
+		Tile* pWall = bench.GetWall();
+
+		// Carve a maze from solid walls with a depth-first walk
+
+		for(int ty = 0; ty < nSize; ty++)
+		{
+			for(int tx = 0; tx < nSize; tx++)
+				rLayer.SetTile(tx, ty, pWall);
+		}
+
+		const int nStepX[] = { 2, -2, 0, 0 };
+		const int nStepY[] = { 0, 0, 2, -2 };
+
+		PointArray arStack;
+
+		POINT ptCell = { 1, 1 };
+
+		rLayer.SetTile(ptCell.x, ptCell.y, NULL);
+		arStack.push_back(ptCell);
+
+		while(arStack.empty() == false)
+		{
+			ptCell = arStack.back();
+
+			int nDirs[4];
+			int nDirCount = 0;
+
+			for(int nDir = 0; nDir < 4; nDir++)
+			{
+				int nx = ptCell.x + nStepX[nDir];
+				int ny = ptCell.y + nStepY[nDir];
+
+				if (nx > 0 && ny > 0 && nx < nSize - 1 && ny < nSize - 1 &&
+				   rLayer.GetTileConst(nx, ny) != NULL)
+					nDirs[nDirCount++] = nDir;
+			}
+
+			if (0 == nDirCount)
+			{
+				arStack.pop_back();
+				continue;
+			}
+
+			int nDir = nDirs[rand() % nDirCount];
+
+			rLayer.SetTile(ptCell.x + nStepX[nDir] / 2,
+				ptCell.y + nStepY[nDir] / 2, NULL);
+
+			ptCell.x += nStepX[nDir];
+			ptCell.y += nStepY[nDir];
+
+			rLayer.SetTile(ptCell.x, ptCell.y, NULL);
+			arStack.push_back(ptCell);
+		}
+
+		// Knock out some walls so that there is more than one way
+
+		for(int n = 0; n < nSize * nSize / 64; n++)
+		{
+			int tx = 1 + rand() % (nSize - 2);
+			int ty = 1 + rand() % (nSize - 2);
+
+			if ((tx & 1) != (ty & 1))
+				rLayer.SetTile(tx, ty, NULL);
+		}
+
+		// Pick queries between random cells
+
+		int nCells = (nSize - 1) / 2;
+
+		PointArray arStarts(nQueries);
+		PointArray arGoals(nQueries);
+
+		for(int n = 0; n < nQueries; n++)
+		{
+			arStarts[n].x = 1 + (rand() % nCells) * 2;
+			arStarts[n].y = 1 + (rand() % nCells) * 2;
+			arGoals[n].x = 1 + (rand() % nCells) * 2;
+			arGoals[n].y = 1 + (rand() % nCells) * 2;
+		}
+
+		// Build
+
+		Navigation& rNavigation = bench.GetMap().GetNavigation();
+		NavigationGraph* pGraph = rLayer.GetNavigationGraph();
+
+		bench.Start();
+
+		pGraph->Repair();
+
+		double dBuild = bench.Stop();
+
+		// Flow field leading every tile to the center cell
+
+		POINT ptCenter = { nSize / 2 | 1, nSize / 2 | 1 };
+
+		PointArray arCenter(1, ptCenter);
+
+		bench.Start();
+
+		FlowField* pField = pGraph->CreateFlowField(arCenter);
+
+		double dField = bench.Stop();
+
+		// Search to completion
+
+		PointArray arPath;
+
+		int nFound = 0;
+		int nLength = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nQueries; n++)
+		{
+			if (rNavigation.FindPath(&rLayer, arStarts[n], arGoals[n],
+			   arPath) == true)
+			{
+				nFound++;
+				nLength += int(arPath.size()) - 1;
+			}
+		}
+
+		double dFind = bench.Stop();
+
+		// Search over frames within budget
+
+		std::vector<int> arRequests(nQueries);
+
+		rNavigation.SetExpansionBudget(nBudget);
+
+		for(int n = 0; n < nQueries; n++)
+		{
+			arRequests[n] =
+				rNavigation.RequestPath(&rLayer, arStarts[n], arGoals[n]);
+		}
+
+		int nFrames = 0;
+		double dFrameMax = 0.0;
+
+		bench.Start();
+
+		while(rNavigation.GetPendingCount() > 0)
+		{
+			double dFrameStart = GetPerformanceTime();
+
+			rNavigation.Update();
+
+			dFrameMax = max(dFrameMax, GetPerformanceTime() - dFrameStart);
+
+			nFrames++;
+		}
+
+		double dAsync = bench.Stop();
+
+		for(int n = 0; n < nQueries; n++)
+			rNavigation.ReleasePath(arRequests[n]);
+
+		// Toggle walls between cells, then repair affected clusters
+
+		int nRepairs = pGraph->GetRepairCount();
+
+		for(int n = 0; n < nQueries; n++)
+		{
+			int tx = 1 + rand() % (nSize - 2);
+			int ty = 1 + rand() % (nSize - 2);
+
+			if ((tx & 1) != (ty & 1))
+			{
+				rLayer.SetTile(tx, ty,
+					(NULL == rLayer.GetTileConst(tx, ty)) ? pWall : NULL);
+			}
+		}
+
+		bench.Start();
+
+		pGraph->Repair();
+
+		double dRepair = bench.Stop();
+
+		nRepairs = pGraph->GetRepairCount() - nRepairs;
+
+		bench.Start();
+
+		pField->Update();
+
+		double dFieldRepair = bench.Stop();
+
+		int nFieldRepaired = pField->GetUpdateCount();
+
+		pGraph->ReleaseFlowField(pField);
+
+		// Compare with breadth first search over all tiles
+
+		std::vector<int> arSteps(nSize * nSize);
+		std::vector<int> arQueue;
+
+		arQueue.reserve(nSize * nSize);
+
+		int nBaseFound = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nQueries; n++)
+		{
+			std::fill(arSteps.begin(), arSteps.end(), INT_MAX);
+
+			arQueue.clear();
+
+			int nGoal = arGoals[n].y * nSize + arGoals[n].x;
+			int nOrigin = arStarts[n].y * nSize + arStarts[n].x;
+
+			arSteps[nOrigin] = 0;
+			arQueue.push_back(nOrigin);
+
+			for(size_t nNext = 0; nNext < arQueue.size(); nNext++)
+			{
+				int nTile = arQueue[nNext];
+
+				if (nTile == nGoal)
+				{
+					nBaseFound++;
+					break;
+				}
+
+				const int nNeighbors[] =
+					{ nTile - 1, nTile + 1, nTile - nSize, nTile + nSize };
+
+				for(int nDir = 0; nDir < 4; nDir++)
+				{
+					int nNeighbor = nNeighbors[nDir];
+
+					if (nNeighbor < 0 || nNeighbor >= nSize * nSize ||
+					   arSteps[nNeighbor] != INT_MAX ||
+					   rLayer.GetTileConst(nNeighbor % nSize,
+					   nNeighbor / nSize) != NULL)
+						continue;
+
+					arSteps[nNeighbor] = arSteps[nTile] + 1;
+					arQueue.push_back(nNeighbor);
+				}
+			}
+		}
+
+		double dBase = bench.Stop();
+
+		LPCWSTR pszUnits = NULL;
+
+		float fMemory = FormatMemory(pGraph->GetMemoryFootprint(), &pszUnits);
+
+		rEngine.PrintInfo(L"   graph        build %.3f ms, %d entrances, "
+			L"memory %.3f %s",
+			dBuild * 1000.0, pGraph->GetNodeCount(), fMemory, pszUnits);
+
+		rEngine.PrintInfo(L"   find         %.3f ms (%d found, "
+			L"average length %d)",
+			dFind * 1000.0, nFound, nFound > 0 ? nLength / nFound : 0);
+
+		rEngine.PrintInfo(L"   requests     %.3f ms over %d updates "
+			L"(longest update %.3f ms)",
+			dAsync * 1000.0, nFrames, dFrameMax * 1000.0);
+
+		rEngine.PrintInfo(L"   repair       %.3f ms (%d clusters)",
+			dRepair * 1000.0, nRepairs);
+
+		rEngine.PrintInfo(L"   grid search  %.3f ms (%d found)",
+			dBase * 1000.0, nBaseFound);
+
+		rEngine.PrintInfo(L"   flow field   build %.3f ms, "
+			L"repair %.3f ms (%d tiles)",
+			dField * 1000.0, dFieldRepair * 1000.0, nFieldRepaired);
+
+		bench.End();
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		PrintLastError(rEngine);
+	}
+
+	return TRUE;
+}
+
+int Game::cmd_benchray(Engine& rEngine, VariableArray& rParams)
+{
+	// Read ray count, layer size and actor count
+
+	Benchmark bench(rEngine, L"RAY CAST");
+
+	int nSettings[] = { 16384, 512, 1024 };
+
+	if (bench.ReadSettings(rParams, nSettings, 3) == false)
+		return FALSE;
+
+	int nRays = nSettings[0];
+	int nSize = nSettings[1];
+	int nActors = nSettings[2];
+
+	bench.Begin(L"rays = %d, layer = %d x %d, actors = %d",
+		nRays, nSize, nSize, nActors);
+
+	try
+	{
+		// Scatter walls over a tenth of the layer
+
+		TileLayer& rLayer = bench.CreateLayer(nSize);
+
+		bench.ScatterWalls(nSize * nSize / 10);
+		bench.CreateActors(nActors, true);
+
+		// Guards looking up to 48 tiles away
+
+		std::vector<Ray> arRays(nRays);
+		std::vector<RayHit> arHits(nRays);
+
+		for(int n = 0; n < nRays; n++)
+		{
+			Vector2 vecFrom(
+				float(rand()) / float(RAND_MAX) * float(nSize),
+				float(rand()) / float(RAND_MAX) * float(nSize));
+
+			Vector2 vecOffset(
+				float(rand()) / float(RAND_MAX) * 96.0f - 48.0f,
+				float(rand()) / float(RAND_MAX) * 96.0f - 48.0f);
+
+			arRays[n].vecFrom = vecFrom;
+			arRays[n].vecTo = vecFrom + vecOffset;
+		}
+
+		// One at a time
+
+		int nHits = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nRays; n++)
+		{
+			if (rLayer.CastSegment(arRays[n].vecFrom, arRays[n].vecTo,
+			   &arHits[n]) == true)
+				nHits++;
+		}
+
+		double dSingle = bench.Stop();
+
+		// Batched
+
+		bench.Start();
+
+		int nBatchHits = rLayer.CastSegments(&arRays[0], nRays, &arHits[0]);
+
+		double dBatch = bench.Stop();
+
+		// Batched, stopping at actors too
+
+		bench.Start();
+
+		int nActorHits = rLayer.CastSegments(&arRays[0], nRays, &arHits[0],
+			TileLayer::RAY_TILES | TileLayer::RAY_ACTORS);
+
+		double dActors = bench.Stop();
+
+		rEngine.PrintInfo(L"   single       %.3f ms, %.0f rays/s (%d hit)",
+			dSingle * 1000.0, double(nRays) / max(dSingle, 1e-9), nHits);
+
+		rEngine.PrintInfo(L"   batch        %.3f ms, %.0f rays/s (%d hit)",
+			dBatch * 1000.0, double(nRays) / max(dBatch, 1e-9), nBatchHits);
+
+		rEngine.PrintInfo(L"   with actors  %.3f ms, %.0f rays/s (%d hit)",
+			dActors * 1000.0, double(nRays) / max(dActors, 1e-9), nActorHits);
+
+		bench.End();
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		PrintLastError(rEngine);
+	}
+
+	return TRUE;
+}
+
+int Game::cmd_benchvision(Engine& rEngine, VariableArray& rParams)
+{
+	// Read guard count, layer size and view distance
+
+	Benchmark bench(rEngine, L"VISIBILITY");
+
+	int nSettings[] = { 256, 512, 16 };
+
+	if (bench.ReadSettings(rParams, nSettings, 3) == false)
+		return FALSE;
+
+	int nGuards = nSettings[0];
+	int nSize = nSettings[1];
+	float fRadius = float(nSettings[2]);
+
+	bench.Begin(L"guards = %d, layer = %d x %d, view distance = %d",
+		nGuards, nSize, nSize, nSettings[2]);
+
+	try
+	{
+		// Scatter walls over a tenth of the layer
+
+		TileLayer& rLayer = bench.CreateLayer(nSize);
+
+		bench.ScatterWalls(nSize * nSize / 10);
+
+		Tile* pWall = bench.GetWall();
+
+		// Guards with cones of 90 degrees, every other one sees all around
+
+		std::vector<VisibilityPolygon> arPolygons(nGuards);
+		Vector2Array arEyes(nGuards);
+		std::vector<float> arDirections(nGuards);
+
+		for(int n = 0; n < nGuards; n++)
+		{
+			arEyes[n] = Vector2(
+				float(rand()) / float(RAND_MAX) * float(nSize),
+				float(rand()) / float(RAND_MAX) * float(nSize));
+
+			arDirections[n] =
+				float(rand()) / float(RAND_MAX) * D3DX_PI * 2.0f;
+		}
+
+		// First computation, including edge extraction
+
+		int nRays = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nGuards; n++)
+		{
+			arPolygons[n].Update(rLayer, arEyes[n], fRadius, arDirections[n],
+				(n & 1) ? D3DX_PI : D3DX_PI / 4.0f);
+
+			nRays += arPolygons[n].GetRayCount();
+		}
+
+		double dFirst = bench.Stop();
+
+		int nRebuilds = rLayer.GetVisibilityMap()->GetRebuildCount();
+
+		// Nothing changed, polygons are reused
+
+		int nUpdated = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nGuards; n++)
+		{
+			if (arPolygons[n].Update(rLayer, arEyes[n], fRadius,
+			   arDirections[n], (n & 1) ? D3DX_PI : D3DX_PI / 4.0f) == true)
+				nUpdated++;
+		}
+
+		double dCached = bench.Stop();
+
+		// A door opens somewhere near each guard
+
+		for(int n = 0; n < nGuards; n++)
+		{
+			int tx = min(nSize - 1, max(0, int(arEyes[n].x) + 2));
+			int ty = min(nSize - 1, max(0, int(arEyes[n].y) + 2));
+
+			rLayer.SetTile(tx, ty,
+				rLayer.GetTile(tx, ty) == pWall ? NULL : pWall);
+		}
+
+		int nChanged = 0;
+
+		bench.Start();
+
+		for(int n = 0; n < nGuards; n++)
+		{
+			if (arPolygons[n].Update(rLayer, arEyes[n], fRadius,
+			   arDirections[n], (n & 1) ? D3DX_PI : D3DX_PI / 4.0f) == true)
+				nChanged++;
+		}
+
+		double dChanged = bench.Stop();
+
+		nRebuilds = rLayer.GetVisibilityMap()->GetRebuildCount() - nRebuilds;
+
+		rEngine.PrintInfo(L"   first      %.3f ms, %.3f ms/guard, "
+			L"%.0f rays/guard",
+			dFirst * 1000.0, dFirst * 1000.0 / double(nGuards),
+			double(nRays) / double(nGuards));
+
+		rEngine.PrintInfo(L"   unchanged  %.3f ms (%d recomputed)",
+			dCached * 1000.0, nUpdated);
+
+		rEngine.PrintInfo(L"   changed    %.3f ms "
+			L"(%d recomputed, %d chunks rebuilt)",
+			dChanged * 1000.0, nChanged, nRebuilds);
+
+		rEngine.PrintInfo(L"   memory     %u bytes in edges",
+			rLayer.GetVisibilityMap()->GetMemoryFootprint());
+
+		bench.End();
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		PrintLastError(rEngine);
+	}
+
+	return TRUE;
+}
+
 int Game::cmd_dir(Engine& rEngine, VariableArray& rParams)
 {
 	if (rParams.empty() == true)
@@ -5561,6 +6276,45 @@ int Game::cmd_savemap(Engine& rEngine, VariableArray& rParams)
 	return TRUE;
 }
 
+int Game::cmd_optimizemap(Engine& rEngine, VariableArray& rParams)
+{
+	UNREFERENCED_PARAMETER(rParams);
+
+	TileMap* pMap = rEngine.GetCurrentMap();
+
+	if (NULL == pMap)
+	{
+		rEngine.PrintError(L"no current map.");
+		return FALSE;
+	}
+
+	int nStatic = pMap->GetTileTemplateStaticCount();
+	int nAnimated = pMap->GetTileTemplateAnimatedCount();
+
+	try
+	{
+		DWORD dwSaved = pMap->Optimize();
+
+		rEngine.PrintInfo(L"tile templates: %d static, %d animated before, "
+			L"%d static, %d animated after; %u bytes saved.",
+			nStatic, nAnimated,
+			pMap->GetTileTemplateStaticCount(),
+			pMap->GetTileTemplateAnimatedCount(),
+			dwSaved);
+	}
+
+	catch(Error& rError)
+	{
+		UNREFERENCED_PARAMETER(rError);
+
+		PrintLastError(rEngine);
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 int Game::cmd_loadgame(Engine& rEngine, VariableArray& rParams)
 {
 	if (rParams.empty() == true)
@@ -504,6 +504,18 @@ public:
 	static int cmd_benchmark(Engine& rEngine,
 		VariableArray& rParams);
 
+	static int cmd_benchspace(Engine& rEngine,
+		VariableArray& rParams);
+
+	static int cmd_benchpath(Engine& rEngine,
+		VariableArray& rParams);
+
+	static int cmd_benchray(Engine& rEngine,
+		VariableArray& rParams);
+
+	static int cmd_benchvision(Engine& rEngine,
+		VariableArray& rParams);
+
 	static int cmd_lasterror(Engine& rEngine,
 		VariableArray& rParams);
 
@@ -527,6 +539,9 @@ public:
 	static int cmd_savemap(Engine& rEngine,
 		VariableArray& rParams);
 
+	static int cmd_optimizemap(Engine& rEngine,
+		VariableArray& rParams);
+
 	static int cmd_loadgame(Engine& rEngine,
 		VariableArray& rParams);
 
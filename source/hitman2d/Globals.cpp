@@ -51,4 +51,26 @@ float Hitman2D::FormatMemory(DWORD dwSizeInBytes, LPCWSTR* ppszUnits)
 	*ppszUnits = (LPCWSTR)SZ_UNITS[nUnit];
 
 	return fSize;
+}
+
+
+/*
+*
+* Function: GetPerformanceTime
+* 
+* Purpose:  Returns performance counter value in seconds,
+*			used for timing benchmarks.
+*
+*/
+
+double Hitman2D::GetPerformanceTime(void)
+{
+	__int64 qwFreq = 0;
+	__int64 qwTime = 0;
+
+	if (QueryPerformanceFrequency((LARGE_INTEGER*)&qwFreq) == FALSE ||
+		QueryPerformanceCounter((LARGE_INTEGER*)&qwTime) == FALSE)
+		return 0.0;
+
+	return double(qwTime) / double(qwFreq);
 }
\ No newline at end of file
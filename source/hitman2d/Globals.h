@@ -156,7 +156,15 @@ const LPCWSTR SZ_MAPFLAGS[] =			{
 											
 											L"update",
 
-											L"optimize"
+											L"optimize",
+
+											L"animate_visible",
+
+											L"stream",
+
+											L"parallel_update",
+
+											L"defer_space_update"
 										};
 
 const DWORD DW_MAPFLAGS[] =				{
@@ -172,7 +180,15 @@ const DWORD DW_MAPFLAGS[] =				{
 											
 											TileMap::UPDATE,
 
-											TileMap::OPTIMIZE
+											TileMap::OPTIMIZE,
+
+											TileMap::ANIMATE_VISIBLE,
+
+											TileMap::STREAM,
+
+											TileMap::PARALLEL_UPDATE,
+
+											TileMap::DEFER_SPACE_UPDATE
 										};
 
 // Actor flags
@@ -181,14 +197,24 @@ const LPCWSTR SZ_ACTORFLAGS[] =			{
 											L"default",
 											L"render",
 											L"update",
-											L"clip"
+											L"clip",
+											L"serial_update"
 										};
 
 const DWORD DW_ACTORFLAGS[] =			{
 											Actor::DEFAULT,
 											Actor::RENDER,
 											Actor::UPDATE,
-											Actor::CLIP
+											Actor::CLIP,
+											Actor::SERIAL_UPDATE
+										};
+
+// Space partition types
+
+const LPCWSTR SZ_SPACEPARTITIONS[] =	{
+											L"uniform grid",
+											L"flat grid",
+											L"quadtree"
 										};
 
 // Supported Device formats
@@ -782,6 +808,7 @@ const int N_PRINTTYPES[] =				{
 \*----------------------------------------------------------*/
 
 float FormatMemory(DWORD dwSizeInBytes, LPCWSTR* ppszUnits);
+double GetPerformanceTime(void);
 D3DXIMAGE_FILEFORMAT ImageFormatFromExtension(LPCWSTR pszExt);
 
 } // namespace Hitman2D
@@ -58,6 +58,8 @@ void ScreenStats::OnRender(Graphics& rGraphics, LPCRECT prc)
 
 	// Render statistics
 
+	const TileMap* pMap = m_rEngine.GetCurrentMapConst();
+
 	String strStats;
 
 	strStats.Format(
@@ -68,7 +70,14 @@ void ScreenStats::OnRender(Graphics& rGraphics, LPCRECT prc)
 		L"batches...........%d\n\n"
 		L"max prims/batch...%d\n\n"
 		L"state changes.....%d\n"
-		L"filtered changes..%d\n",
+		L"filtered changes..%d\n\n"
+		L"actors full.......%d\n"
+		L"actors reduced....%d\n"
+		L"actors asleep.....%d\n\n"
+		L"chunks resident...%d\n"
+		L"chunks loaded.....%d\n"
+		L"chunks evicted....%d\n"
+		L"actors swapped....%d\n",
 
 		rGraphics.GetRenderableCount(),
 		rGraphics.GetTriangleCount(),
@@ -77,7 +86,14 @@ void ScreenStats::OnRender(Graphics& rGraphics, LPCRECT prc)
 		rGraphics.GetBatchCount(),
 		rGraphics.GetMaxPrimitivesPerBatch(),
 		rGraphics.GetStates()->GetStateChangeCount(),
-		rGraphics.GetStates()->GetFilteredStateChangeCount()
+		rGraphics.GetStates()->GetFilteredStateChangeCount(),
+		pMap != NULL ? pMap->GetUpdateTierCount(Actor::TIER_FULL) : 0,
+		pMap != NULL ? pMap->GetUpdateTierCount(Actor::TIER_REDUCED) : 0,
+		pMap != NULL ? pMap->GetUpdateTierCount(Actor::TIER_ASLEEP) : 0,
+		pMap != NULL ? pMap->GetStreamResidentChunkCount() : 0,
+		pMap != NULL ? pMap->GetStreamLoadCount() : 0,
+		pMap != NULL ? pMap->GetStreamEvictionCount() : 0,
+		pMap != NULL ? pMap->GetStreamSwappedActorCount() : 0
 	);
 
 	Rect rcText = GetBufferRect();